@@ -0,0 +1,125 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Static control-flow analysis of a ROM.
+ *
+ * Starting from a set of entry points (reset and interrupt
+ * vectors), instructions are decoded recursively, following
+ * JMP/CALL/RST targets and conditional branches. Bytes that
+ * are never reached are treated as data. Reachable code is
+ * then split into basic blocks, which end at control-flow
+ * instructions and at instructions that talk to the machine
+ * (IN, OUT, EI, DI, HLT), so each block can be translated
+ * or cached as a unit.
+ *
+ * Indirect jumps (PCHL) can't be followed; code only reached
+ * through them shows up as data.
+ */
+
+
+// reset, RST 1 and RST 2 (the interrupts Invaders uses)
+#define ANALYSIS_DEFAULT_ENTRIES { 0x0000, 0x0008, 0x0010 }
+#define ANALYSIS_DEFAULT_ENTRY_COUNT 3
+
+
+// what a ROM byte turned out to be
+#define BYTE_DATA 0
+#define BYTE_OPCODE 1
+#define BYTE_OPERAND 2
+
+// why an address has a label (bitwise OR)
+#define LABEL_ENTRY (1 << 0)
+#define LABEL_JUMP (1 << 1)
+#define LABEL_CALL (1 << 2)
+
+
+typedef struct basic_block_t {
+    // address of the first instruction
+    uint16_t start;
+
+    // address after the last instruction
+    uint32_t end;
+
+    // number of instructions
+    uint16_t count;
+
+    // InstrFlow of the last instruction
+    uint8_t exit;
+
+    // 1 if execution can continue at `end`
+    // (calls are assumed to return)
+    uint8_t has_next;
+
+    // branch target, if `exit` has one
+    uint16_t target;
+} BasicBlock;
+
+
+typedef struct rom_analysis_t {
+    // number of ROM bytes analysed, starting at 0
+    uint32_t size;
+
+    // BYTE_* per address
+    uint8_t *bytes;
+
+    // LABEL_* per address
+    uint8_t *labels;
+
+    // blocks in address order
+    BasicBlock *blocks;
+    size_t block_count;
+
+    // index into `blocks` of the block starting at
+    // each address, or -1
+    int32_t *block_at;
+
+    // addresses where decoding ran into the middle
+    // of an already decoded instruction
+    unsigned long overlaps;
+} RomAnalysis;
+
+
+/**
+ * Analyses the first `size` bytes of `memory` (which must
+ * cover the full 16-bit address space) from the given entry
+ * points. Returns 0 on success.
+ */
+int analysis_run(RomAnalysis *an, const uint8_t *memory, uint32_t size,
+                 const uint16_t *entries, int entry_count);
+
+
+/**
+ * Frees the analysis
+ */
+void analysis_free(RomAnalysis *an);
+
+
+/**
+ * Returns the block starting at `pc`, or NULL
+ */
+const BasicBlock* analysis_block_at(const RomAnalysis *an, uint16_t pc);
+
+
+/**
+ * Writes a labelled assembly listing of the ROM, with
+ * unreached bytes shown as data
+ */
+void analysis_write_listing(const RomAnalysis *an, const uint8_t *memory, FILE *out);
+
+
+/**
+ * Writes the block map, one block per line:
+ *
+ *   start end count exit target next
+ *
+ * Addresses are hex, `exit` is the name of the last
+ * instruction's InstrFlow, and `target`/`next` are "-"
+ * when the block has none.
+ */
+void analysis_write_blocks(const RomAnalysis *an, FILE *out);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+/*
+ * Ahead-of-time compiled ROM code.
+ *
+ * The recompiler (see recompiler.h) turns every basic block
+ * found by the ROM analysis into a C function, which is
+ * built into the emulator with `make AOT_ROM=folder`. When
+ * the CPU reaches the start of a compiled block it runs the
+ * whole block in one step; anything else (RAM code, PCHL
+ * targets the analysis couldn't see, IN, OUT and HLT) goes
+ * through the interpreter as usual.
+ *
+ * Compiled blocks leave registers, flags, memory and
+ * `cycles` exactly as interpreting them would. Like fused
+ * sequences, a block is one step, so an interrupt that falls
+ * due in the middle of it is taken at the end of the block.
+ */
+
+
+/**
+ * Runs one block, including its final branch
+ */
+typedef void (*AotBlockFn)(State8080 *state);
+
+
+typedef struct aot_block_t {
+    uint16_t adr;
+    AotBlockFn run;
+} AotBlock;
+
+
+/**
+ * Output of the recompiler for one ROM
+ */
+typedef struct aot_rom_t {
+    // aot_rom_hash of the ROM it was compiled from
+    uint32_t hash;
+    uint16_t size;
+
+    const AotBlock *blocks;
+    size_t count;
+} AotRom;
+
+
+typedef struct aot_table_t {
+    // compiled block per ROM address, or NULL
+    AotBlockFn *blocks;
+    uint16_t size;
+} AotTable;
+
+
+/**
+ * The compiled ROM, defined by the generated source
+ * (only in AOT builds)
+ */
+extern const AotRom aot_rom;
+
+
+/**
+ * Returns the FNV-1a hash of the first `size` bytes
+ * of memory
+ */
+uint32_t aot_rom_hash(const uint8_t *memory, uint16_t size);
+
+
+/**
+ * Installs the compiled blocks if `rom` was compiled from
+ * the ROM loaded in the state. Returns the number of
+ * installed blocks, or -1 if the ROM doesn't match.
+ */
+int aot_install(AotTable *table, State8080 *state, const AotRom *rom);
+
+
+/**
+ * Removes the compiled blocks and frees the table
+ */
+void aot_uninstall(AotTable *table, State8080 *state);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "machine.h"
+
+/*
+ * Preallocated machines for cloning one state many times,
+ * e.g. to branch a search from a single position.
+ *
+ * All slots are machine instances in one page-aligned
+ * mapping made up front, each with the ROM copied in once,
+ * so a clone is one copy of the board's RAM (8 KB on
+ * Space Invaders) plus the registers and never allocates.
+ * Pages of a slot outside ROM and RAM are never written by
+ * the game, so they stay untouched and don't count towards
+ * resident memory.
+ */
+
+
+typedef struct machine_arena_t {
+    MachineInstance *slots;
+    size_t count;
+} MachineArena;
+
+
+/**
+ * Allocates `count` slots holding the ROM of `base` and
+ * a copy of its state. Returns 0 on success.
+ */
+int machine_arena_create(MachineArena *arena, size_t count, const Machine *base);
+
+
+void machine_arena_destroy(MachineArena *arena);
+
+
+/**
+ * Clones `src` into slots `first` to `first + n - 1`
+ */
+void machine_arena_clone(MachineArena *arena, const Machine *src, size_t first, size_t n);
+
+
+/**
+ * Machine in slot `index`
+ */
+static inline Machine* machine_arena_slot(MachineArena *arena, size_t index) {
+    return &arena->slots[index].machine;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdint.h>
+
+/*
+ * Machine definitions for 8080 arcade boards.
+ *
+ * A board is described in a small line-based text format and
+ * parsed once at startup; machine_create then turns it into
+ * the CPU's port handler tables and the interrupt schedule,
+ * so nothing is looked up per instruction. Space Invaders and
+ * a few boards built on the same hardware are compiled in
+ * (see board.c); `-m file` loads any other definition.
+ *
+ *     # comment
+ *     name invaders
+ *     rom invaders.h 0x0000 0x0800     file, address, size
+ *     ram 0x2000 0x4000                start, end (exclusive)
+ *     mirror 0x6000 0x8000 0x0000      copy of ROM: start, end, source
+ *     video 0x2400 224 256             start, columns, rows
+ *     cpu 2000000                      clock in Hz
+ *     fps 60
+ *     interrupts 1 2                   RST numbers, spread evenly over a
+ *                                      frame; the last one is VBlank
+ *     in 1 latch 0x08                  port, handler, initial value
+ *     in 3 shift_result
+ *     out 4 shift_data
+ *     out 6 none                       writes are dropped
+ *
+ * ROMs starting at address 0 and touching each other are
+ * write-protected. The address space is flat, so mirrors are
+ * copied when the ROMs are loaded and can only mirror ROM: a
+ * RAM mirror would need address decoding on every access.
+ * Video memory holds a column of `rows` pixels per `rows / 8`
+ * bytes, LSB at the bottom; the front ends only draw 224x256.
+ *
+ * IN handlers:
+ *     latch          reads a byte the machine holds for the
+ *                    port (inputs, DIP switches, constants)
+ *     shift_result   result of the shift register
+ * OUT handlers:
+ *     shift_offset   sets the shift register's offset
+ *     shift_data     shifts a byte into the shift register
+ *     none           not emulated (sound, watchdog)
+ */
+
+
+#define BOARD_MAX_ROMS 8
+#define BOARD_MAX_RAM 4
+#define BOARD_MAX_MIRRORS 4
+#define BOARD_MAX_INTERRUPTS 4
+
+// ports a board can attach handlers to
+#define BOARD_PORT_COUNT 8
+
+#define BOARD_NAME_SIZE 32
+#define BOARD_FILE_SIZE 64
+
+
+typedef struct board_rom_t {
+    char file[BOARD_FILE_SIZE];
+    uint16_t address;
+    uint16_t size;
+} BoardRom;
+
+
+// [start, end), end up to 0x10000
+typedef struct board_range_t {
+    uint32_t start;
+    uint32_t end;
+} BoardRange;
+
+
+typedef struct board_mirror_t {
+    BoardRange range;
+    uint16_t source;
+} BoardMirror;
+
+
+typedef enum board_port_kind_t {
+    PORT_NONE,
+    PORT_LATCH,
+    PORT_SHIFT_RESULT,
+    PORT_SHIFT_OFFSET,
+    PORT_SHIFT_DATA
+} BoardPortKind;
+
+
+typedef struct board_port_t {
+    BoardPortKind kind;
+
+    // initial value of a latch
+    uint8_t value;
+} BoardPort;
+
+
+typedef struct board_t {
+    char name[BOARD_NAME_SIZE];
+
+    BoardRom roms[BOARD_MAX_ROMS];
+    int rom_count;
+
+    // bytes of write-protected ROM from address 0
+    uint16_t rom_size;
+
+    BoardRange ram[BOARD_MAX_RAM];
+    int ram_count;
+
+    BoardMirror mirrors[BOARD_MAX_MIRRORS];
+    int mirror_count;
+
+    uint16_t video_start;
+    int video_cols;
+    int video_rows;
+
+    uint32_t cpu_hz;
+    int fps;
+
+    // RST number of each interrupt in a frame
+    uint8_t interrupts[BOARD_MAX_INTERRUPTS];
+    int interrupt_count;
+
+    BoardPort in[BOARD_PORT_COUNT];
+    BoardPort out[BOARD_PORT_COUNT];
+} Board;
+
+
+/**
+ * Parses a definition. `source` names it in error messages.
+ * Returns 0 on success, or prints the first error and
+ * returns 1.
+ */
+int board_parse(Board *board, const char *text, const char *source);
+
+
+/**
+ * Parses the built-in board called `name`, or else the
+ * definition file at that path. Returns 0 on success.
+ */
+int board_open(Board *board, const char *name);
+
+
+/**
+ * Loads the board's ROM files from `folder` into the 64 KB
+ * `memory` and fills in its mirrors. Returns 0 on success,
+ * or prints an error and returns 1.
+ */
+int board_load_roms(const Board *board, const char *folder, uint8_t *memory);
+
+#endif
@@ -4,6 +4,16 @@
 #include <inttypes.h>
 #include <stdint.h>
 
+// the CPU expects `memory` to cover the
+// full 16-bit address space
+#define CPU_MEM_SIZE (1 << 16)
+
+struct aot_table_t;
+struct debugger_t;
+struct fusion_table_t;
+struct hle_table_t;
+struct tracer_t;
+
 typedef struct condition_codes_t {
     // zero: set if result is 0
     uint8_t     z:1;  // z occupies 1 bit in the struct
@@ -30,27 +40,64 @@ typedef struct condition_codes_t {
 } ConditionCodes;
 
 
+// IN/OUT port numbers
+#define CPU_PORT_COUNT 256
+
+typedef uint8_t (*PortInFn)(void *arg, uint8_t port);
+typedef void (*PortOutFn)(void *arg, uint8_t port, uint8_t value);
+
+typedef struct port_in_t {
+    PortInFn fn;
+    void *arg;
+} PortIn;
+
+typedef struct port_out_t {
+    PortOutFn fn;
+    void *arg;
+} PortOut;
+
+
 /**
  * External I/O interface for 8080.
- * 
- * Whenever an IN or OUT instruction is executed,
- * the CPU populates this struct. Generally speaking, 
- * if it's an OUT instruction, the machine should set
- * port # `port` 's value to `value`. If it's an IN,
- * the machine should assign the value of port # `port`
- * to the CPU's accumulator. But the actual behavior
- * varies based on the port number.
+ *
+ * One handler per port for IN and one for OUT (on the 8080
+ * these are separate: reading port 3 and writing port 3 can
+ * reach different hardware). The CPU calls them while the
+ * IN or OUT executes: an IN loads the handler's result into
+ * the accumulator, an OUT passes it the accumulator. A port
+ * without a handler reads 0 and ignores writes, so a zeroed
+ * IO8080 is a machine with nothing attached.
+ *
+ * Handlers may request interrupts, but shouldn't otherwise
+ * change the CPU state.
  */
 typedef struct io8080_t {
-    // port number
-    uint8_t port;
-
-    // port value
-    uint8_t value;
+    PortIn in[CPU_PORT_COUNT];
+    PortOut out[CPU_PORT_COUNT];
 } IO8080;
 
 
+/**
+ * Why the CPU stopped (State8080.fault). Nothing wakes it
+ * from either: the machine has to be reset, e.g. cloned
+ * from a savestate.
+ */
+typedef enum cpu_fault_t {
+    CPU_FAULT_NONE,
+
+    // HLT (no interrupt ends it here)
+    CPU_FAULT_HALT,
+
+    // store to the write-protected ROM, which is
+    // dropped
+    CPU_FAULT_ROM_WRITE
+} CpuFault;
+
+
 typedef struct state8080_t {
+    // hot state, touched by every instruction, first
+    // so that it shares one cache line
+
     // registers (7 of them)
     uint8_t             a;
     uint8_t             b;
@@ -60,24 +107,59 @@ typedef struct state8080_t {
     uint8_t             h;
     uint8_t             l;
 
+    // status flags
+    ConditionCodes      cc;
+
     // stack pointer
     uint16_t            sp;
 
     // program counter
     uint16_t            pc;
 
-    uint8_t             *memory;
-
-    // status flags
-    ConditionCodes      cc;
-
     // 1 if interrupt enabled
     uint8_t             int_enable;
     uint8_t             int_pending;
     uint8_t             int_delay;
     uint8_t             int_type;
 
-    unsigned long       cycles;
+    uint64_t            cycles;
+
+    // cold state, read once per run or only by hooks
+
+    uint8_t             *memory;
+
+    // number of bytes of write-protected ROM
+    // starting at address 0 (0 disables the
+    // ROM-write trap, e.g. for CP/M programs)
+    uint16_t            rom_size;
+
+    // the first CPU_FAULT_* since the last reset, and
+    // the ROM address written or the HLT's address.
+    // `cpu_run` returns once it is set and runs nothing
+    // while it is; `cpu_emulate_op` doesn't check it
+    uint8_t             fault;
+    uint16_t            fault_adr;
+
+    // fused ROM sequences, or NULL when fusion
+    // is off (see fusion.h)
+    struct fusion_table_t *fused;
+
+    // native replacements for ROM subroutines,
+    // or NULL (see hle.h)
+    struct hle_table_t  *hle;
+
+    // ROM blocks compiled ahead of time, or
+    // NULL (see aot.h)
+    struct aot_table_t  *aot;
+
+    // instruction trace, or NULL (see trace.h)
+    struct tracer_t     *trace;
+
+    // attached debugger, and its WATCH_* flags per
+    // 256-byte page while it has watchpoints, or
+    // NULL (see debugger.h)
+    struct debugger_t   *debugger;
+    uint8_t             *watch;
 } State8080;
 
 
@@ -87,6 +169,12 @@ typedef struct state8080_t {
 void cpu_print_state(State8080 *state);
 
 
+/**
+ * Prints what stopped the CPU and the state it stopped in
+ */
+void cpu_print_fault(State8080 *state);
+
+
 /**
  * Returns the current opcode
  */
@@ -100,16 +188,23 @@ void cpu_set_acc(State8080 *state, uint8_t val);
 
 
 /**
- * Returns true if the given IO struct
- * is empty (has default values)
+ * Detaches all port handlers
  */
-uint8_t cpu_io_empty(IO8080 io);
+void cpu_io_init(IO8080 *io);
 
 
 /**
- * Resets the IO object to default (empty) values
+ * Calls `fn` with `arg` for every IN from `port`
+ * (NULL detaches it)
  */
-void cpu_io_reset(IO8080 *io);
+void cpu_io_on_in(IO8080 *io, uint8_t port, PortInFn fn, void *arg);
+
+
+/**
+ * Calls `fn` with `arg` for every OUT to `port`
+ * (NULL detaches it)
+ */
+void cpu_io_on_out(IO8080 *io, uint8_t port, PortOutFn fn, void *arg);
 
 
 /*
@@ -121,16 +216,18 @@ int cpu_emulate_op(State8080 *state, IO8080 *io);
 
 
 /**
- * Generates an interrupt. `interrupt_num` is
- * the interrupt number (1 or 2) rather than the opcode
- * itself.
+ * Runs instructions until at least `budget` cycles have
+ * passed or the CPU faults, keeping the registers in
+ * locals (see cpu_run.c). Returns the cycles run.
  */
-void cpu_request_interrupt(State8080 *state, int interrupt_num);
+int cpu_run(State8080 *state, IO8080 *io, int budget);
 
 
 /**
- * Returns the framebuffer from memory
+ * Generates an interrupt. `interrupt_num` is
+ * the interrupt number (1 or 2) rather than the opcode
+ * itself.
  */
-void* cpu_framebuffer(State8080 *state);
+void cpu_request_interrupt(State8080 *state, int interrupt_num);
 
 #endif
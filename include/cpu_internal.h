@@ -0,0 +1,127 @@
+#ifndef CPU_INTERNAL_H
+#define CPU_INTERNAL_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+/*
+ * Instruction helpers from cpu.c, shared with code that
+ * executes guest instructions outside of `cpu_emulate_op`
+ * (fused superinstructions and the like). Using these keeps
+ * flags, memory protection and cycle counts identical to
+ * the interpreter.
+ */
+
+
+// combine with bitwise OR
+// to set flags
+#define SET_Z_FLAG  (1 << 7)
+#define SET_S_FLAG  (1 << 6)
+#define SET_P_FLAG  (1 << 5)
+#define SET_CY_FLAG (1 << 4)
+#define SET_AC_FLAG (1 << 3)
+#define SET_ALL_FLAGS (SET_Z_FLAG | SET_S_FLAG | SET_P_FLAG | SET_CY_FLAG | SET_AC_FLAG)
+
+
+/**
+ * CPU cycle lookup table, indexed by opcode
+ */
+extern const uint8_t cycles_lookup[];
+
+
+// I/O ------------------------------------
+
+static inline uint8_t cpu_port_in(IO8080 *io, uint8_t port) {
+    PortIn *h = &io->in[port];
+    return h->fn ? h->fn(h->arg, port) : 0;
+}
+
+static inline void cpu_port_out(IO8080 *io, uint8_t port, uint8_t value) {
+    PortOut *h = &io->out[port];
+    if (h->fn) {
+        h->fn(h->arg, port, value);
+    }
+}
+
+
+// Interrupts -----------------------------
+
+void cpu_service_interrupt(State8080 *state);
+
+
+// Faults ---------------------------------
+
+/**
+ * Records the fault unless one is already set
+ */
+void cpu_fault(State8080 *state, CpuFault fault, uint16_t adr);
+
+
+// Memory ---------------------------------
+
+void mem_write_byte(State8080 *state, uint16_t offset, uint8_t value);
+void mem_write_word(State8080 *state, uint16_t offset, uint16_t word);
+uint8_t mem_read_byte(State8080 *state, uint16_t offset);
+uint16_t makeword(uint8_t left, uint8_t right);
+uint8_t get_bc_mem(State8080 *state);
+uint8_t get_de_mem(State8080 *state);
+uint8_t get_hl_mem(State8080 *state);
+void set_bc_mem(State8080 *state, uint8_t val);
+void set_de_mem(State8080 *state, uint8_t val);
+void set_hl_mem(State8080 *state, uint8_t val);
+
+
+// Flags ----------------------------------
+
+void set_arith_flags(State8080 *state, uint16_t answer, uint8_t flagstoset);
+void set_logic_flags(State8080 *state, uint8_t res, uint8_t flagstoset);
+
+
+// Registers ------------------------------
+
+uint16_t bc_addr(State8080 *state);
+uint16_t de_addr(State8080 *state);
+uint16_t hl_addr(State8080 *state);
+void set_bc_addr(State8080 *state, uint16_t addr);
+void set_de_addr(State8080 *state, uint16_t addr);
+void set_hl_addr(State8080 *state, uint16_t addr);
+void swp_ptrs(uint8_t *p1, uint8_t *p2);
+
+
+// Stack and control flow -----------------
+
+void push_word(State8080 *state, uint16_t word);
+uint16_t pop_word(State8080 *state);
+void push_pair(State8080 *state, uint8_t hi, uint8_t lo);
+void pop_pair(State8080 *state, uint8_t *hi, uint8_t *lo);
+void push_psw(State8080 *state);
+void pop_psw(State8080 *state);
+void xthl(State8080 *state);
+void jmp(State8080 *state, uint16_t adr);
+void call_adr(State8080 *state, uint16_t adr);
+void ret(State8080 *state);
+void ret_cond(State8080 *state, uint8_t cond);
+void update_cond_cycles(State8080 *state);
+
+
+// Arithmetic -----------------------------
+
+void add_to_reg(State8080 *state, uint8_t *reg, uint8_t val, uint8_t carry);
+void sub_from_reg(State8080 *state, uint8_t *reg, uint8_t val, uint8_t carry);
+void add_x(State8080 *state, uint8_t x);
+void adc_x(State8080 *state, uint8_t x);
+void sub_x(State8080 *state, uint8_t x);
+void sbb_x(State8080 *state, uint8_t x);
+void ana_x(State8080 *state, uint8_t x);
+void xra_x(State8080 *state, uint8_t x);
+void ora_x(State8080 *state, uint8_t x);
+void inr_x(State8080 *state, uint8_t *ptr);
+void dcr_x(State8080 *state, uint8_t *ptr);
+void cmp_x(State8080 *state, uint8_t x);
+void daa(State8080 *state);
+uint32_t tworeg_add(uint8_t *left_ptr, uint8_t *right_ptr, uint16_t val);
+void inx_xy(uint8_t *left_ptr, uint8_t *right_ptr);
+void dcx_xy(uint8_t *left_ptr, uint8_t *right_ptr);
+void dad_xy(State8080 *state, uint8_t *x, uint8_t *y);
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "cpu.h"
+#include "machine.h"
+
+/*
+ * Interactive debugger: PC breakpoints (optionally with a
+ * condition on a register), memory watchpoints, stepping
+ * and run-to-return, driven by a line-based command
+ * interface on any pair of streams (stdin or a socket).
+ *
+ * Nothing is checked unless it's needed. `continue` only
+ * uses the checking loop while breakpoints or watchpoints
+ * exist, and watchpoints are found through per-page flags
+ * that the CPU's memory helpers only consult when the
+ * state's `watch` pointer is set, which it isn't without
+ * watchpoints.
+ *
+ * Watchpoints see loads and stores made through the memory
+ * helpers (including the stack), not instruction fetches.
+ * The checking loop (stepping, `finish`, and `continue`
+ * with breakpoints or watchpoints) sets compiled blocks and
+ * fused sequences aside so every instruction is a step;
+ * `continue` without any runs the machine in slices with
+ * them, polling for input in between.
+ */
+
+
+#define DEBUG_MAX_POINTS 64
+
+// watchpoint access kinds (bitwise OR)
+#define WATCH_READ (1 << 0)
+#define WATCH_WRITE (1 << 1)
+
+#define DEBUG_PAGE_SHIFT 8
+#define DEBUG_PAGE_COUNT (CPU_MEM_SIZE >> DEBUG_PAGE_SHIFT)
+
+
+typedef enum debug_reg_t {
+    REG_NONE,
+    REG_A, REG_B, REG_C, REG_D, REG_E, REG_H, REG_L,
+    REG_BC, REG_DE, REG_HL, REG_SP
+} DebugReg;
+
+
+typedef enum debug_cmp_t {
+    CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE
+} DebugCmp;
+
+
+typedef enum stop_reason_t {
+    STOP_NONE,
+    STOP_STEP,
+    STOP_BREAKPOINT,
+    STOP_WATCHPOINT,
+    STOP_RETURN,
+    STOP_INTERRUPTED,
+
+    // HLT or a ROM write (see `fault` in cpu.h)
+    STOP_FAULT
+} StopReason;
+
+
+typedef struct breakpoint_t {
+    int id;
+    uint16_t adr;
+
+    // condition, unless `reg` is REG_NONE
+    uint8_t reg;
+    uint8_t cmp;
+    uint16_t value;
+
+    unsigned long hits;
+} Breakpoint;
+
+
+typedef struct watchpoint_t {
+    int id;
+    uint16_t start;
+    uint32_t len;
+
+    // WATCH_* flags
+    uint8_t access;
+
+    unsigned long hits;
+} Watchpoint;
+
+
+typedef struct debugger_t {
+    Machine *machine;
+
+    Breakpoint breakpoints[DEBUG_MAX_POINTS];
+    int breakpoint_count;
+    Watchpoint watchpoints[DEBUG_MAX_POINTS];
+    int watchpoint_count;
+    int next_id;
+
+    // number of breakpoints per address
+    uint8_t *breakpoint_map;
+
+    // WATCH_* flags of all watchpoints per page
+    uint8_t watch_pages[DEBUG_PAGE_COUNT];
+
+    // why execution last stopped, and the
+    // breakpoint/watchpoint involved
+    StopReason stop;
+    int hit_id;
+    uint16_t hit_adr;
+    uint8_t hit_value;
+    uint8_t hit_access;
+
+    // fd polled for input while running (-1 for none);
+    // any input interrupts
+    int interrupt_fd;
+
+    // called whenever execution stops, e.g. to
+    // redraw the screen
+    void (*on_stop)(void *arg);
+    void *on_stop_arg;
+
+    // instructions run by the checking loop
+    unsigned long steps;
+} Debugger;
+
+
+/**
+ * Attaches a debugger to the machine's CPU
+ */
+void debugger_attach(Debugger *dbg, Machine *machine);
+
+
+/**
+ * Removes all breakpoints and watchpoints and detaches
+ */
+void debugger_detach(Debugger *dbg);
+
+
+/**
+ * Adds a breakpoint. `reg` REG_NONE makes it unconditional.
+ * Returns its id, or -1 if there are too many.
+ */
+int debugger_add_breakpoint(Debugger *dbg, uint16_t adr, DebugReg reg, DebugCmp cmp, uint16_t value);
+
+
+/**
+ * Watches `len` bytes from `start` for the given WATCH_*
+ * accesses. Returns its id, or -1 if there are too many.
+ */
+int debugger_add_watchpoint(Debugger *dbg, uint16_t start, uint32_t len, uint8_t access);
+
+
+/**
+ * Deletes a breakpoint or watchpoint. Returns 0 on success.
+ */
+int debugger_delete(Debugger *dbg, int id);
+
+
+/**
+ * Executes up to `count` instructions, stopping early at
+ * breakpoints and watchpoints
+ */
+StopReason debugger_step(Debugger *dbg, unsigned long count);
+
+
+/**
+ * Runs until a breakpoint, watchpoint, CPU fault or input
+ * on `interrupt_fd`
+ */
+StopReason debugger_continue(Debugger *dbg);
+
+
+/**
+ * Runs until the current subroutine returns
+ */
+StopReason debugger_finish(Debugger *dbg);
+
+
+/**
+ * Called by the CPU for accesses to watched pages
+ */
+void debugger_access(Debugger *dbg, uint16_t adr, uint8_t value, uint8_t access);
+
+
+/**
+ * Reads commands from `in` and writes responses to `out`
+ * until `q` or end of input. Type `h` for a list of
+ * commands; an empty line repeats the last one. `in` is
+ * made unbuffered, so it must not have been read from yet.
+ */
+void debugger_repl(Debugger *dbg, FILE *in, FILE *out);
+
+
+/**
+ * Listens on a Unix socket at `path`, waits for a client
+ * and runs the command interface over the connection.
+ * Returns 0 once the client has quit or disconnected.
+ */
+int debugger_serve(Debugger *dbg, const char *path);
+
+#endif
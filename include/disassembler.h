@@ -1,6 +1,119 @@
 #ifndef DISASSEMBLER_H
 #define DISASSEMBLER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+
+// longest formatted instruction, e.g. "LXI    SP,#$ffff"
+#define DISASM_TEXT_SIZE 24
+
+
+typedef enum mnemonic8080_t {
+    MN_NOP, MN_LXI, MN_STAX, MN_INX, MN_INR, MN_DCR, MN_MVI, MN_RLC,
+    MN_DAD, MN_LDAX, MN_DCX, MN_RRC, MN_RAL, MN_RAR, MN_SHLD, MN_DAA,
+    MN_LHLD, MN_CMA, MN_STA, MN_STC, MN_LDA, MN_CMC, MN_MOV, MN_HLT,
+    MN_ADD, MN_ADC, MN_SUB, MN_SBB, MN_ANA, MN_XRA, MN_ORA, MN_CMP,
+    MN_RNZ, MN_POP, MN_JNZ, MN_JMP, MN_CNZ, MN_PUSH, MN_ADI, MN_RST,
+    MN_RZ, MN_RET, MN_JZ, MN_CZ, MN_CALL, MN_ACI, MN_RNC, MN_JNC,
+    MN_OUT, MN_CNC, MN_SUI, MN_RC, MN_JC, MN_IN, MN_CC, MN_SBI,
+    MN_RPO, MN_JPO, MN_XTHL, MN_CPO, MN_ANI, MN_RPE, MN_PCHL, MN_JPE,
+    MN_XCHG, MN_CPE, MN_XRI, MN_RP, MN_JP, MN_DI, MN_CP, MN_ORI,
+    MN_RM, MN_SPHL, MN_JM, MN_EI, MN_CM, MN_CPI,
+    MN_COUNT
+} Mnemonic8080;
+
+
+/**
+ * What an instruction does to the program counter
+ */
+typedef enum instr_flow_t {
+    FLOW_NEXT,       // falls through to the next instruction
+    FLOW_JUMP,       // JMP
+    FLOW_JUMP_COND,  // Jcc: target or next
+    FLOW_CALL,       // CALL
+    FLOW_CALL_COND,  // Ccc: target or next
+    FLOW_RST,        // RST n: call to n * 8
+    FLOW_RET,        // RET
+    FLOW_RET_COND,   // Rcc: return or next
+    FLOW_INDIRECT,   // PCHL: target unknown
+    FLOW_HALT        // HLT
+} InstrFlow;
+
+
+/**
+ * Kind of the immediate operand
+ */
+typedef enum operand_kind_t {
+    OPERAND_NONE,
+    OPERAND_D8,      // byte 2 is data
+    OPERAND_D16,     // bytes 2-3 are data
+    OPERAND_ADR      // bytes 2-3 are an address
+} OperandKind;
+
+
+/**
+ * A decoded instruction
+ */
+typedef struct instr8080_t {
+    // address of the first byte
+    uint16_t pc;
+
+    uint8_t opcode;
+
+    // size in bytes (1-3)
+    uint8_t length;
+
+    // Mnemonic8080
+    uint8_t mnemonic;
+
+    // InstrFlow
+    uint8_t flow;
+
+    // OperandKind of `operand`
+    uint8_t operand_kind;
+
+    // register operands as written, e.g. "B,C" or "SP"
+    const char *regs;
+
+    // immediate data or address
+    uint16_t operand;
+
+    // branch target for jumps, calls and RST
+    uint16_t target;
+} Instr8080;
+
+
+/**
+ * Decodes the instruction at `pc`. `memory` must cover the
+ * full 16-bit address space (operands wrap around at 0xffff).
+ * Returns the length of the instruction.
+ */
+int disasm_decode(const uint8_t *memory, uint16_t pc, Instr8080 *instr);
+
+
+/**
+ * Formats a decoded instruction (without its address) into
+ * `buf`, e.g. "MVI    B,#$20". Returns the number of
+ * characters written, as snprintf.
+ */
+int disasm_format(const Instr8080 *instr, char *buf, size_t size);
+
+
+/**
+ * Returns the name of a mnemonic, e.g. "MOV"
+ */
+const char* disasm_mnemonic_name(uint8_t mnemonic);
+
+
+/**
+ * Decodes consecutive instructions from `start` up to
+ * (not including) `end` into `out`, which needs room for
+ * `end - start` entries. Returns the number decoded.
+ */
+size_t disasm_range(const uint8_t *memory, uint16_t start, uint32_t end, Instr8080 *out);
+
+
 /*
  * Disassembles a single op and prints it to stdout
  */
@@ -1,12 +1,66 @@
 #ifndef EMU8080_H
 #define EMU8080_H
 
+#include "machine.h"
+
 typedef enum emu_mode_t {
     RUN_MODE,
+    HEADLESS_MODE,
     STEP_MODE,
+    GDB_MODE,
     DISASM_MODE 
 } EmuMode;
 
-int emu_start(char *folder, EmuMode mode);
+typedef struct emu_options_t {
+    // built-in board or definition file (see board.h)
+    char *board;
+
+    // DIP switch settings (0 keeps the board's)
+    DipSwitches dips;
+
+    // fuse hot ROM sequences into superinstructions
+    int fusion;
+
+    // profile used to pick which sequences to fuse
+    // (NULL fuses every recognized sequence)
+    char *fusion_profile;
+
+    // run known ROM subroutines natively
+    int hle;
+
+    // run the guest code too and compare
+    int hle_verify;
+
+    // where -d writes the basic-block map
+    char *block_map;
+
+    // instruction trace file, or NULL
+    char *trace_path;
+
+    // delta-compress the trace
+    int trace_compress;
+
+    // Unix socket for the debugger's commands
+    // instead of stdin, or NULL
+    char *debug_socket;
+
+    // TCP port or Unix socket for GDB
+    char *gdb_address;
+
+    // frames to run in headless mode
+    unsigned long frames;
+
+    // video export (see framesink.h), or NULL
+    char *video_path;
+
+    // per-frame hash log (see framehash.h), or NULL
+    char *hash_path;
+} EmuOptions;
+
+/**
+ * Loads the ROM in `folder` and runs it in `mode`. Returns
+ * 1 if the CPU stopped on a write to the ROM.
+ */
+int emu_start(char *folder, EmuMode mode, EmuOptions *options);
 
 #endif // EMU8080_H
@@ -0,0 +1,170 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "machine.h"
+#include "watchdog.h"
+
+/*
+ * Reinforcement-learning environment: a batch of headless
+ * Space Invaders machines stepped together.
+ *
+ * Every instance starts from a snapshot taken once, right
+ * after a coin is inserted and a one-player game started,
+ * so a reset only copies RAM and registers. Each step holds
+ * the instance's action for `frameskip` frames, then reads
+ * the score and ships from RAM and writes the observation
+ * straight into one contiguous buffer (optionally the
+ * caller's, e.g. a numpy array), so nothing is copied or
+ * image-processed on the way out.
+ *
+ * An instance whose game ended is reset at the start of its
+ * next step; its `done` flag stays set until then. So is one
+ * its watchdog flagged as hung (see watchdog.h), and one
+ * whose CPU faulted (HLT or a ROM write, see cpu.h).
+ */
+
+
+// actions (bitwise OR)
+#define ENV_LEFT (1 << 0)
+#define ENV_RIGHT (1 << 1)
+#define ENV_FIRE (1 << 2)
+
+// Space Invaders RAM
+#define INV_RAM_START 0x2000
+#define INV_RAM_SIZE 0x400
+#define INV_GAME_MODE 0x20ef    // 1 while a game is being played
+#define INV_P1_SCORE 0x20f8     // BCD, low byte first
+#define INV_P1_SHIPS 0x21ff     // ships left besides the current one
+
+
+typedef enum env_obs_t {
+    // upright screen, one byte (0 or 1) per pixel after
+    // max-pooling by `downsample`
+    ENV_OBS_PIXELS,
+
+    // the 1 KB of work RAM
+    ENV_OBS_RAM
+} EnvObs;
+
+
+typedef struct env_config_t {
+    // number of instances
+    int count;
+
+    // frames per step
+    int frameskip;
+
+    EnvObs obs;
+
+    // 1, 2, 4 or 8 (pixel observations)
+    int downsample;
+
+    // up to this many idle frames after a reset,
+    // so instances don't run in lockstep
+    int noop_max;
+    uint64_t seed;
+
+    // count * env_obs_size() bytes to write observations
+    // to, or NULL to allocate them
+    uint8_t *obs_buffer;
+
+    // DIP switches (zeroed keeps the defaults)
+    DipSwitches dips;
+
+    // frames without progress before an instance counts
+    // as hung, or 0 for no watchdog
+    int watchdog_frames;
+} EnvConfig;
+
+
+typedef struct env_instance_t {
+    // slot in the environment's arena
+    Machine *machine;
+
+    // buttons held (ENV_* flags)
+    uint8_t held;
+
+    unsigned int score;
+    uint64_t rng;
+
+    Watchdog watchdog;
+} EnvInstance;
+
+
+typedef struct env_t {
+    EnvConfig config;
+    size_t obs_size;
+
+    // Space Invaders, shared by all machines
+    Board *board;
+
+    EnvInstance *instances;
+    MachineArena arena;
+
+    // state right after the game starts
+    EnvInstance boot;
+
+    // per instance
+    uint8_t *obs;
+    int32_t *rewards;
+    uint8_t *dones;
+    uint8_t *ships;
+
+    // instances reset by their watchdog
+    uint64_t hangs;
+
+    // instances reset after a CPU fault
+    uint64_t faults;
+
+    int owns_obs;
+} Env;
+
+
+/**
+ * Bytes of one observation
+ */
+size_t env_obs_size(const EnvConfig *config);
+
+
+/**
+ * Boots a machine from `rom` (invaders.h, .g, .f and .e,
+ * 8 KB in that order) until a game starts and creates the
+ * instances from it. Returns 0 on success, or 1 if the
+ * configuration is invalid, the game didn't start or
+ * memory ran out.
+ */
+int env_create(Env *env, const EnvConfig *config, const uint8_t *rom);
+
+
+void env_destroy(Env *env);
+
+
+/**
+ * Resets instance `index`, or all of them if it's -1,
+ * and writes their observations
+ */
+void env_reset(Env *env, int index);
+
+
+/**
+ * Steps instances 0 to n - 1 with one action each, then
+ * fills in their observations, rewards (score gained),
+ * done flags and ships. A hung instance is done (and
+ * counted in `hangs`), and so is one whose CPU faulted
+ * (counted in `faults`).
+ */
+void env_step(Env *env, const uint8_t *actions, int n);
+
+
+/**
+ * Observation of instance `index`, inside one buffer of
+ * count * obs_size bytes
+ */
+static inline uint8_t* env_observation(Env *env, int index) {
+    return env->obs + (size_t) index * env->obs_size;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef FRAMEHASH_H
+#define FRAMEHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+
+/*
+ * Per-frame hashes of video memory for regression testing.
+ *
+ * At every VBlank the 7 KB framebuffer is hashed with a fast
+ * 64-bit hash in the style of XXH3 (eight 64-bit lanes, each
+ * stripe mixed with a 32x32->64 multiply, scrambled every
+ * 1 KB and merged with 128-bit multiplies) and logged as one
+ * text line per frame:
+ *
+ *     <frame> <hash as 16 hex digits>
+ *
+ * Two runs with the same input can be compared with
+ * `framecmp`, which reports the first frame that differs.
+ * Hashes are stable across hosts of the same byte order.
+ */
+
+
+typedef struct frame_hash_log_t {
+    FILE *file;
+    unsigned long frames;
+} FrameHashLog;
+
+
+/**
+ * Hashes `size` bytes
+ */
+uint64_t frame_hash(const uint8_t *data, size_t size);
+
+
+/**
+ * Creates the log. Returns 0 on success.
+ */
+int frame_hash_open(FrameHashLog *log, const char *path);
+
+
+/**
+ * VBlank callback for Machine: logs the hash of the
+ * framebuffer of `machine` to the log passed as `arg`
+ */
+void frame_hash_vblank(Machine *machine, void *arg);
+
+
+void frame_hash_close(FrameHashLog *log);
+
+#endif
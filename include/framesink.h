@@ -0,0 +1,124 @@
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+
+/*
+ * Video export, fed with the framebuffer at every VBlank.
+ *
+ * Frames are copied into a bounded ring and encoded by a
+ * worker thread, so the CPU only stalls if the encoder falls
+ * a whole ring behind. A frame identical to the previous one
+ * only bumps that frame's repeat count, so runs of static
+ * frames cost one memcmp each and are encoded once.
+ *
+ * Formats:
+ *
+ * - raw: header ("I8080VID", width, height as uint16), then
+ *   per distinct frame a uint32 repeat count followed by
+ *   the upright 1bpp image (rows top to bottom, MSB first,
+ *   1 = lit), all in host byte order
+ * - Y4M: an 8-bit grayscale YUV4MPEG2 stream at 60 fps with
+ *   every frame, readable by ffmpeg
+ * - PNG: one 1-bit grayscale file per distinct frame, named
+ *   from a printf pattern with the number of the frame it
+ *   first appeared in, e.g. frames/%06lu.png
+ */
+
+
+// bytes per upright 1bpp row
+#define FRAME_ROW_BYTES (FRAME_COLS / 8)
+
+#define FRAME_RING_SLOTS 32
+
+#define FRAME_MAGIC "I8080VID"
+
+
+typedef enum sink_format_t {
+    SINK_RAW,
+    SINK_Y4M,
+    SINK_PNG
+} SinkFormat;
+
+
+typedef struct sink_frame_t {
+    // framebuffer as in video memory
+    uint8_t data[FRAME_BYTES];
+
+    // number of the frame it first appeared in
+    unsigned long index;
+
+    // consecutive frames it stands for
+    uint32_t repeat;
+} SinkFrame;
+
+
+typedef struct frame_sink_t {
+    SinkFormat format;
+
+    // output file, or the file name pattern for PNG
+    FILE *file;
+    const char *pattern;
+
+    // ring of frames: the machine fills `head`, the
+    // worker encodes the `queued` frames before it
+    SinkFrame *slots;
+    size_t head;
+    size_t queued;
+
+    // 1 once `head` holds a frame
+    int pending;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+
+    // statistics
+    unsigned long frames;
+    unsigned long distinct;
+    unsigned long stalls;
+    unsigned long errors;
+} FrameSink;
+
+
+/**
+ * Picks the format from the path: a `%` makes it a PNG
+ * pattern, `.y4m` a Y4M stream, anything else raw
+ */
+SinkFormat frame_sink_format(const char *path);
+
+
+/**
+ * Opens the output and starts the worker thread. Returns
+ * 0 on success, or 1 if the output can't be opened,
+ * memory runs out or the thread can't start (nothing is
+ * left open then).
+ */
+int frame_sink_open(FrameSink *sink, const char *path, SinkFormat format);
+
+
+/**
+ * Adds a frame (FRAME_BYTES as in video memory)
+ */
+void frame_sink_push(FrameSink *sink, const uint8_t *framebuf);
+
+
+/**
+ * VBlank callback for Machine: pushes the framebuffer of
+ * `machine` to the sink passed as `arg`
+ */
+void frame_sink_vblank(Machine *machine, void *arg);
+
+
+/**
+ * Encodes the remaining frames, stops the worker and
+ * closes the output
+ */
+void frame_sink_close(FrameSink *sink);
+
+#endif
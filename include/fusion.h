@@ -0,0 +1,61 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+/*
+ * Superinstruction fusion.
+ *
+ * Hot multi-instruction sequences in ROM (the fill loop of
+ * the screen clear, block copies and similar counted loops)
+ * are found by byte pattern once the ROM is loaded. When the
+ * PC reaches one of them, `cpu_emulate_op` runs a single
+ * handler with the same total cycles, flags and memory
+ * effects instead of dispatching each instruction.
+ *
+ * Interrupts are only taken between fused sequences, so a
+ * pending interrupt is delayed by at most one sequence (one
+ * loop iteration, under 40 cycles).
+ */
+
+
+// most patterns fusion_install knows
+#define FUSION_MAX_PATTERNS 8
+
+
+typedef struct fusion_table_t {
+    // superinstruction id per ROM address (0 = none)
+    uint8_t *sites;
+
+    // number of fused sites
+    int count;
+
+    // cycles of each superinstruction, by id - 1: the
+    // sum of `cycles_lookup` over its instructions
+    uint8_t cycles[FUSION_MAX_PATTERNS];
+} FusionTable;
+
+
+/**
+ * Scans the state's ROM for fusible sequences and enables
+ * them. If `profile_path` is not NULL, only sequences that
+ * are hot in that profile (written by `profiler_save`) are
+ * fused. Returns the number of fused sites, or -1 if out
+ * of memory (fusion stays off).
+ */
+int fusion_install(FusionTable *table, State8080 *state, const char *profile_path);
+
+
+/**
+ * Disables fusion and frees the table
+ */
+void fusion_uninstall(FusionTable *table, State8080 *state);
+
+
+/**
+ * Executes the fused sequence `id` at the current PC
+ */
+void fusion_execute(State8080 *state, uint8_t id);
+
+#endif
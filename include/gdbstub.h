@@ -0,0 +1,61 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "debugger.h"
+
+/*
+ * GDB remote serial protocol server on top of the debugger,
+ * so standard tooling can inspect and control the CPU.
+ *
+ * GDB has no 8080 target, so registers are exposed with the
+ * layout of its z80 architecture (an 8080 superset): AF BC
+ * DE HL SP PC, then IX IY, the alternate set and IR, which
+ * always read as 0. The target description announces z80,
+ * so `target remote` picks it automatically.
+ *
+ * Breakpoints (Z0/Z1) and watchpoints (Z2-Z4) map onto the
+ * debugger's, and `continue` runs through debugger_continue,
+ * so the machine runs at full speed between stops whenever
+ * none are set. Ctrl-C in GDB interrupts a running machine.
+ */
+
+
+// largest packet we accept or send
+#define GDB_PACKET_SIZE 4096
+
+#define GDB_BUF_SIZE 4096
+
+
+typedef struct gdb_stub_t {
+    Debugger *debugger;
+
+    // connection to GDB
+    int fd;
+
+    // 1 until GDB switches acknowledgements off
+    int ack;
+
+    // signal of the last stop
+    int signal;
+
+    // receive buffer
+    uint8_t buf[GDB_BUF_SIZE];
+    size_t buf_len;
+    size_t buf_pos;
+
+    char packet[GDB_PACKET_SIZE + 1];
+    char reply[GDB_PACKET_SIZE + 1];
+} GdbStub;
+
+
+/**
+ * Waits for GDB on `address` and serves it until it detaches,
+ * kills the target or disconnects. `address` is a TCP port on
+ * localhost if it's a number, or else a Unix socket path.
+ * Returns 0 on success.
+ */
+int gdb_serve(Debugger *dbg, const char *address);
+
+#endif
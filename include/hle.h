@@ -0,0 +1,70 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+/*
+ * High-level emulation of known ROM subroutines.
+ *
+ * When a CALL (or RST) targets the entry point of a routine
+ * in the table, the routine is replaced by a native C
+ * implementation that leaves memory, registers, flags and
+ * `cycles` exactly as running the guest code through RET
+ * would, including the return address left below SP.
+ *
+ * A routine is only hooked if the ROM bytes at its entry
+ * point match the expected code, so a different ROM set
+ * just runs without hooks.
+ *
+ * The whole routine runs in one step, so no interrupt is
+ * taken in the middle of it. The machine then raises one
+ * catch-up interrupt per deadline the routine ran past,
+ * one instruction apart (see machine_run_slice). Catch-ups
+ * that come while interrupts are disabled, as they are in
+ * the handler of the first one, are dropped but still count
+ * towards frames. This is meant for turbo batch runs;
+ * verification mode runs both paths and reports any
+ * difference.
+ */
+
+
+typedef struct hle_table_t {
+    // routine id per ROM address (0 = not hooked)
+    uint8_t *routines;
+    uint16_t size;
+
+    // if set, run the guest code as well and
+    // compare the results
+    int verify;
+
+    // memory copy used for verification
+    uint8_t *scratch;
+
+    // statistics
+    unsigned long calls;
+    unsigned long mismatches;
+} HleTable;
+
+
+/**
+ * Hooks every known routine whose code matches the state's
+ * ROM. Returns the number of hooked routines.
+ */
+int hle_install(HleTable *table, State8080 *state, int verify);
+
+
+/**
+ * Removes the hooks and frees the table
+ */
+void hle_uninstall(HleTable *table, State8080 *state);
+
+
+/**
+ * Called by the CPU with the return address already in PC.
+ * Runs the routine at `adr` natively and returns 1, or
+ * returns 0 if `adr` is not hooked.
+ */
+int hle_call(State8080 *state, uint16_t adr);
+
+#endif
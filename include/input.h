@@ -0,0 +1,91 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+
+/*
+ * Timestamped input.
+ *
+ * The front end drains every pending host event once per
+ * frame and queues the key changes with the host time they
+ * happened at. input_run then replays them while the machine
+ * catches up with the host clock: each one is applied to the
+ * ports at the cycle its timestamp maps to, so a press lands
+ * where it would have on the real machine rather than at the
+ * start of the next frame, and several presses in one frame
+ * all get through.
+ *
+ * Input-to-photon latency is measured per key press, from its
+ * host timestamp to the present of the first frame emulated
+ * after it was applied.
+ */
+
+
+#define INPUT_QUEUE_SIZE 64
+
+
+typedef struct input_event_t {
+    // host time, monotonic clock
+    int64_t time_ns;
+
+    // machine key (P1_FIRE, INSERT_COIN, ...)
+    char key;
+    uint8_t down;
+} InputEvent;
+
+
+typedef struct input_queue_t {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    int count;
+
+    // events lost to a full queue
+    uint64_t dropped;
+
+    // presses applied but not presented yet: count,
+    // sum and oldest of their timestamps
+    uint64_t unseen;
+    int64_t unseen_total_ns;
+    int64_t unseen_oldest_ns;
+
+    // latency of presented presses
+    uint64_t presses;
+    int64_t latency_total_ns;
+    int64_t latency_max_ns;
+} InputQueue;
+
+
+void input_init(InputQueue *queue);
+
+
+/**
+ * Queues a key change at host time `time_ns`. Events must be
+ * pushed in the order they happened; earlier timestamps are
+ * moved up to the previous event's. Returns 0 on success, or
+ * 1 if the queue is full.
+ */
+int input_push(InputQueue *queue, int64_t time_ns, char key, int down);
+
+
+/**
+ * Runs `machine` up to the host's current time (machine_run),
+ * applying the queued events at their cycles, and empties
+ * the queue
+ */
+void input_run(InputQueue *queue, Machine *machine);
+
+
+/**
+ * Records that the frame emulated by the last input_run
+ * reached the screen at `time_ns`
+ */
+void input_presented(InputQueue *queue, int64_t time_ns);
+
+
+/**
+ * Prints latency statistics
+ */
+void input_report(const InputQueue *queue, FILE *out);
+
+#endif
@@ -2,12 +2,11 @@
 #define MACHINE_H
 
 #include <inttypes.h>
+#include "board.h"
 #include "cpu.h"
+#include "shifter.h"
 
 
-// ports 0-6
-#define __PORT_COUNT 7
-
 #define P2_START 1
 #define P1_START 2
 #define P1_FIRE 4
@@ -19,16 +18,63 @@
 #define P2_JOY_LEFT (P1_JOY_LEFT * 2)
 #define P2_JOY_RIGHT (P1_JOY_RIGHT * 2)
 
+// input state of ports 1 (low byte) and 2 (high byte),
+// as wired on Space Invaders; see machine_set_input
+#define INPUT_COIN 0x0001
+#define INPUT_P2_START 0x0002
+#define INPUT_P1_START 0x0004
+#define INPUT_P1_FIRE 0x0010
+#define INPUT_P1_LEFT 0x0020
+#define INPUT_P1_RIGHT 0x0040
+#define INPUT_TILT 0x0400
+#define INPUT_P2_FIRE 0x1000
+#define INPUT_P2_LEFT 0x2000
+#define INPUT_P2_RIGHT 0x4000
+
+// the bits above; the other bits of ports 1 and 2 are
+// DIP switches or wired high or low
+#define INPUT_MASK 0x7477
+
 #define FRAME_ROWS 256
 #define FRAME_COLS 224
 
+// 1bpp framebuffer size
+#define FRAME_BYTES (FRAME_ROWS * FRAME_COLS / 8)
+
+// CPU clock and frame rate of boards that don't set them
+#define MACHINE_CPU_HZ 2000000
+#define MACHINE_FPS 60
+
+#define NSEC_PER_SEC 1000000000LL
+
+// callbacks run at VBlank
+#define MACHINE_VBLANK_HOOKS 4
+
+/**
+ * Space Invaders DIP switches, on port 2. Fields left at 0
+ * keep the board's setting (its `in 2` latch value; the
+ * invaders default is 3 ships, an extra ship at 1500 points
+ * and the coin information shown).
+ */
+typedef struct dip_switches_t {
+    // ships per game, 3-6
+    int lives;
+
+    // score for the extra ship, 1000 or 1500
+    int bonus_life;
 
-// type alias for time stamp
-typedef double timestamp;
+    // 1 shows the coin information on the demo screen,
+    // -1 hides it
+    int coin_info;
+} DipSwitches;
+
+
+struct machine_t;
+typedef void (*VBlankFn)(struct machine_t *machine, void *arg);
 
 typedef struct machine_t {
-    // special hardware for shifts
-    uint16_t shift_register;
+    // special hardware for shifts (see shifter.h)
+    Shifter shifter;
 
     // CPU
     State8080 *cpu_state; 
@@ -36,24 +82,100 @@ typedef struct machine_t {
     // I/O
     IO8080 *io;
 
-    // machine's ports
-    uint8_t ports [__PORT_COUNT];
+    // hardware description (see board.h)
+    const Board *board;
 
-    // time stamp of last time
-    timestamp last_ts;
+    // machine's ports
+    uint8_t ports [BOARD_PORT_COUNT];
 
-    // type of interrupt (1 or 2)
-    int int_type;
+    // host time of the last sync in nanoseconds (0 before
+    // the first one), the cycle count it has caught up to,
+    // and the fraction of a cycle it still owes, in units of
+    // 1/NSEC_PER_SEC cycles
+    int64_t last_sync_ns;
+    uint64_t sync_cycles;
+    uint64_t sync_frac;
 
     // total cycles
-    unsigned long cycles;
+    uint64_t cycles;
+
+    // interrupts raised so far; the next one is due at
+    // machine_interrupt_due(machine)
+    uint64_t interrupts;
+
+    // those raised with interrupts enabled, which the CPU
+    // takes (the game is making progress)
+    uint64_t interrupts_delivered;
+
+    // frames completed (VBlank interrupts, the last
+    // of each frame)
+    unsigned long frames;
+
+    // called at every VBlank, in order
+    VBlankFn on_vblank[MACHINE_VBLANK_HOOKS];
+    void *vblank_arg[MACHINE_VBLANK_HOOKS];
+    int vblank_count;
 } Machine;
 
 
+// instances start on a cache line, so machines on
+// different threads never share one
+#define MACHINE_ALIGN 64
+
+
 /**
- * Initializes default values for machine ports
+ * Everything one machine owns, in a single allocation: the
+ * CPU state first, so its hot fields fill the first cache
+ * line, then the rest of the machine, then the address
+ * space on its own cache line
  */
-void machine_init_ports(Machine *machine);
+typedef struct machine_instance_t {
+    State8080 cpu;
+    Machine machine;
+    IO8080 io;
+    _Alignas(MACHINE_ALIGN) uint8_t memory[CPU_MEM_SIZE];
+} MachineInstance;
+
+
+/**
+ * Allocates a machine for `board`, which must outlive it,
+ * with zeroed memory. Load the ROM into its
+ * cpu_state->memory (board_load_roms). Returns NULL if
+ * out of memory.
+ */
+Machine* machine_create(const Board *board);
+
+
+void machine_destroy(Machine *machine);
+
+
+/**
+ * Resets the state of `inst` (but not its memory) and
+ * wires its parts together
+ */
+void machine_instance_init(MachineInstance *inst, const Board *board);
+
+
+/**
+ * Sets the port latches to the board's initial values, then
+ * applies `dips` (if not NULL). Returns 0 on success, or
+ * prints an error and returns 1 if a setting is out of range.
+ */
+int machine_init_ports(Machine *machine, const DipSwitches *dips);
+
+
+/**
+ * Cycle count at which the next interrupt is due. With k
+ * interrupts a frame, interrupt n comes at cycle
+ * ceil(n * cpu_hz / (fps * k)), so an interval like
+ * 16666.67 cycles never drifts.
+ */
+static inline uint64_t machine_interrupt_due(const Machine *machine) {
+    const Board *board = machine->board;
+    uint64_t n = machine->interrupts + 1;
+    uint64_t hz = (uint64_t) board->fps * board->interrupt_count;
+    return (n * board->cpu_hz + hz - 1) / hz;
+}
 
 
 /**
@@ -63,6 +185,34 @@ void machine_init_ports(Machine *machine);
  */
 int machine_step(Machine* machine);
 
+
+/**
+ * Runs the CPU until the next interrupt is due or
+ * `max_cycles` have passed, raises the interrupt if it's
+ * due, and returns the number of cycles. While interrupts
+ * are overdue, each slice is one instruction.
+ */
+int machine_run_slice(Machine *machine, int max_cycles);
+
+/**
+ * Sets every input of ports 1 and 2 at once from `input`
+ * (INPUT_* bits); the DIP switches keep their values
+ */
+void machine_set_input(Machine *machine, uint16_t input);
+
+
+/**
+ * Inputs of ports 1 and 2 (INPUT_* bits)
+ */
+uint16_t machine_input(const Machine *machine);
+
+
+/**
+ * INPUT_* bit of a key (P1_FIRE, INSERT_COIN, ...), or 0
+ */
+uint16_t machine_key_input(char key);
+
+
 /**
  * Insert coin into machine
  */
@@ -82,10 +232,59 @@ void machine_keyup(Machine *machine, char key);
 
 
 /**
- * Runs the machine and delays execution for the specified
- * number of micro seconds
+ * Runs the machine until it catches up with the host's
+ * monotonic clock (at the board's clock), or the CPU
+ * faults (see `fault` in cpu.h); pace calls with a Pacer
+ */
+void machine_run(Machine *machine);
+
+
+/**
+ * Runs without time sync until `cycle` cycles in total
+ * (the last instruction may go past it). Returns
+ * CPU_FAULT_NONE, or the fault that stopped it early.
+ */
+int machine_run_to(Machine *machine, uint64_t cycle);
+
+
+/**
+ * Cycle that host time `time_ns` (monotonic clock) maps to
+ * in the next machine_run: times before the last sync map to
+ * its target, and times are capped like the sync is
+ */
+uint64_t machine_cycle_at(const Machine *machine, int64_t time_ns);
+
+
+/**
+ * Calls `fn` with `arg` at every VBlank. Returns 0 on
+ * success, or 1 if all hooks are taken.
+ */
+int machine_add_vblank(Machine *machine, VBlankFn fn, void *arg);
+
+
+/**
+ * Removes a hook added with machine_add_vblank
+ */
+void machine_remove_vblank(Machine *machine, VBlankFn fn, void *arg);
+
+
+/**
+ * Runs without time sync until `frames` more frames
+ * have completed. Returns CPU_FAULT_NONE, or the fault
+ * that stopped it early.
+ */
+int machine_run_frames(Machine *machine, unsigned long frames);
+
+
+/**
+ * Copies the state of `src` (RAM, registers, ports, timing)
+ * into `dst`, which must already be wired to its own CPU
+ * state, I/O and memory holding the same board and ROM.
+ * Memory outside the board's RAM isn't copied, shared tables (fusion, HLE, AOT) are,
+ * and `dst` keeps its own trace, debugger, port handlers and
+ * VBlank hooks.
  */
-void machine_run(Machine *machine, long sleep_microseconds);
+void machine_clone(Machine *dst, const Machine *src);
 
 
 /**
@@ -0,0 +1,76 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Frame pacer on the monotonic clock.
+ *
+ * Deadlines are absolute: frame n is due at start + n * period,
+ * so the time spent emulating and rendering a frame comes out
+ * of the wait instead of adding to it, and the rate doesn't
+ * drift with host load. The pacer sleeps until shortly before
+ * the deadline (clock_nanosleep with TIMER_ABSTIME) and spins
+ * for the rest, since a sleep can overshoot by a scheduler tick.
+ *
+ * A frame that misses its deadline is counted as late and the
+ * next one is still due on schedule; after falling more than
+ * PACER_MAX_BEHIND frames behind (the host was suspended, a
+ * debugger stopped it, ...) the schedule restarts from now
+ * instead of rushing through the missed frames.
+ */
+
+
+// time spun before each deadline
+#define PACER_SPIN_NS 500000
+
+#define PACER_MAX_BEHIND 4
+
+
+typedef struct pacer_t {
+    int64_t period_ns;
+
+    // the next frame is due at this host time
+    int64_t deadline_ns;
+
+    // frame times: from one wake-up to the next
+    int64_t last_wake_ns;
+    uint64_t frames;
+    int64_t min_ns;
+    int64_t max_ns;
+    int64_t total_ns;
+
+    // frames that woke after their deadline, and
+    // times the schedule restarted
+    uint64_t late;
+    uint64_t resyncs;
+} Pacer;
+
+
+/**
+ * Monotonic host time in nanoseconds
+ */
+int64_t pacer_now_ns(void);
+
+
+/**
+ * Starts a schedule of `hz` frames per second,
+ * the first one due a period from now
+ */
+void pacer_init(Pacer *pacer, int hz);
+
+
+/**
+ * Waits for the current frame's deadline and
+ * moves on to the next one
+ */
+void pacer_wait(Pacer *pacer);
+
+
+/**
+ * Prints frame time statistics
+ */
+void pacer_report(const Pacer *pacer, FILE *out);
+
+#endif
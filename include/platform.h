@@ -1,6 +1,7 @@
 #ifndef PLATFORM_H
 #define PLATFORM_H
 
+#include "debugger.h"
 #include "machine.h"
 
 
@@ -11,8 +12,10 @@ void platform_run(Machine *machine);
 
 
 /**
- * Steps through one instruction at a time
+ * Runs the debugger's command interface on stdin, or on a
+ * Unix socket at `socket_path` unless it's NULL, and shows
+ * the screen whenever execution stops
  */
-void platform_step(Machine *machine);
+void platform_step(Machine *machine, Debugger *debugger, const char *socket_path);
 
 #endif
@@ -0,0 +1,70 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+/*
+ * Execution profiler for the CPU core.
+ *
+ * Compiled out unless PROFILE is defined (`make profile`),
+ * in which case `cpu_emulate_op` counts executions and
+ * cycles per opcode and per address, and CALL/RET (and
+ * interrupts) are tracked on a shadow stack so cycles can
+ * be attributed to subroutines.
+ */
+
+#ifdef PROFILE
+
+#define PROFILE_OP(pc, opcode, cycles) profiler_record_op(pc, opcode, cycles)
+#define PROFILE_CALL(target) profiler_enter(target)
+#define PROFILE_RET() profiler_leave()
+
+#else
+
+#define PROFILE_OP(pc, opcode, cycles)
+#define PROFILE_CALL(target)
+#define PROFILE_RET()
+
+#endif
+
+
+/**
+ * Records one executed instruction
+ */
+void profiler_record_op(uint16_t pc, uint8_t opcode, int cycles);
+
+
+/**
+ * Records a taken CALL, RST or interrupt to `target`
+ */
+void profiler_enter(uint16_t target);
+
+
+/**
+ * Records a taken RET
+ */
+void profiler_leave(void);
+
+
+/**
+ * Clears all counters
+ */
+void profiler_reset(void);
+
+
+/**
+ * Prints the `top` hottest opcodes, addresses and
+ * subroutines to stdout, annotating addresses with
+ * their disassembly from `memory`
+ */
+void profiler_report(uint8_t *memory, int top);
+
+
+/**
+ * Writes the per-address counts and cycles to `path`
+ * as "pc count cycles" lines (read by `fusion_install`).
+ * Returns 0 on success.
+ */
+int profiler_save(const char *path);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Static recompiler: writes C source for every basic block
+ * the ROM analysis finds, to be linked into the emulator
+ * (see aot.h). The generated code calls the same helpers as
+ * the interpreter (cpu_internal.h), with operands, branch
+ * targets and cycle counts folded in as constants.
+ *
+ * IN, OUT and HLT are left to the interpreter: a block that
+ * ends in one stops just before it.
+ */
+
+
+/**
+ * Compiles the first `size` bytes of `memory` (which must
+ * cover the full 16-bit address space) and writes the
+ * source to `out`. Returns the number of compiled blocks,
+ * or -1 on error.
+ */
+int recompile_rom(const uint8_t *memory, uint16_t size, FILE *out);
+
+#endif
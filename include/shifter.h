@@ -0,0 +1,84 @@
+#ifndef SHIFTER_H
+#define SHIFTER_H
+
+#include <stdint.h>
+
+/*
+ * 16 bit shift register of the Midway 8080 boards, which the
+ * games use to draw sprites at any pixel offset:
+ *
+ *     f              0    bit
+ *     xxxxxxxxyyyyyyyy
+ *
+ * Writing the data port shifts x into y, and the new value
+ * into x, eg.
+ *     $0000,
+ *     write $aa -> $aa00,
+ *     write $ff -> $ffaa,
+ *     write $12 -> $12ff, ..
+ *
+ * Writing the offset port (bits 0,1,2) sets the offset for
+ * the 8 bit result, eg.
+ *     offset 0:
+ *     rrrrrrrr            result=xxxxxxxx
+ *     xxxxxxxxyyyyyyyy
+ *
+ *     offset 2:
+ *       rrrrrrrr          result=xxxxxxyy
+ *     xxxxxxxxyyyyyyyy
+ *
+ *     offset 7:
+ *            rrrrrrrr     result=xyyyyyyy
+ *     xxxxxxxxyyyyyyyy
+ *
+ * Reading the result port returns said result.
+ *
+ * The offset is a register of its own: on the real board the
+ * offset port is write-only and reading the same port number
+ * returns inputs. The port handlers take the Shifter itself
+ * as their argument, so each IN/OUT is a single inlined
+ * operation with no lookup through the machine.
+ */
+
+
+typedef struct shifter_t {
+    // xxxxxxxxyyyyyyyy
+    uint16_t value;
+
+    // 0-7
+    uint8_t offset;
+} Shifter;
+
+
+/**
+ * Shifts `data` into the high byte
+ */
+static inline void shifter_write_data(Shifter *shifter, uint8_t data) {
+    shifter->value = (uint16_t) (data << 8) | (shifter->value >> 8);
+}
+
+
+/**
+ * Sets the offset from the low 3 bits of `data`
+ */
+static inline void shifter_write_offset(Shifter *shifter, uint8_t data) {
+    shifter->offset = data & 0x7;
+}
+
+
+/**
+ * The 8 bits `offset` bits below the top
+ */
+static inline uint8_t shifter_result(const Shifter *shifter) {
+    return (uint8_t) (shifter->value >> (8 - shifter->offset));
+}
+
+
+/*
+ * Port handlers (see cpu.h), with the Shifter as `arg`
+ */
+uint8_t shifter_in_result(void *arg, uint8_t port);
+void shifter_out_offset(void *arg, uint8_t port, uint8_t value);
+void shifter_out_data(void *arg, uint8_t port, uint8_t value);
+
+#endif
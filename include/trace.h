@@ -0,0 +1,180 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+
+/*
+ * Instruction-level execution trace.
+ *
+ * Every executed instruction appends a fixed-size record
+ * (state before the instruction, plus the cycles it took)
+ * to a ring of chunks owned by the CPU's thread. Full chunks
+ * are handed to a writer thread, so the CPU only stalls if
+ * the disk falls a whole ring behind.
+ *
+ * Compressed traces store each record as a bitmask of the
+ * bytes that differ from the previous record, followed by
+ * those bytes XORed with it. Consecutive instructions share
+ * most of their state, so this is typically 2-3x smaller.
+ *
+ * Records are written in host byte order and layout; the
+ * header stores the record size so a mismatched reader
+ * fails cleanly.
+ *
+ * Compiled blocks and fused sequences execute as one step and
+ * show up as a single record for their first instruction.
+ */
+
+
+#define TRACE_MAGIC "I8080TRC"
+#define TRACE_VERSION 1
+
+// header flags
+#define TRACE_COMPRESSED (1 << 0)
+
+// records per chunk and chunks per ring
+#define TRACE_CHUNK_RECORDS 4096
+#define TRACE_RING_CHUNKS 16
+
+
+typedef struct trace_record_t {
+    uint16_t pc;
+    uint16_t sp;
+
+    // cycles taken by the instruction
+    uint32_t cycles;
+
+    // instruction bytes at PC
+    uint8_t opcode;
+    uint8_t operand[2];
+
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint8_t d;
+    uint8_t e;
+    uint8_t h;
+    uint8_t l;
+
+    ConditionCodes cc;
+
+    uint8_t int_enable;
+} TraceRecord;
+
+
+typedef struct trace_chunk_t {
+    TraceRecord records[TRACE_CHUNK_RECORDS];
+    size_t count;
+} TraceChunk;
+
+
+typedef struct tracer_t {
+    FILE *file;
+    int compress;
+
+    // ring of chunks: the CPU fills `head`, the writer
+    // drains the `queued` chunks before it
+    TraceChunk *chunks;
+    size_t head;
+    size_t queued;
+
+    // next free record in `head`, and the end of it
+    TraceRecord *next;
+    TraceRecord *end;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+
+    // statistics
+    unsigned long records;
+    unsigned long bytes;
+    unsigned long stalls;
+    uint64_t stall_ns;
+
+    // list of open tracers, flushed at exit
+    struct tracer_t *next_open;
+} Tracer;
+
+
+typedef struct trace_reader_t {
+    FILE *file;
+    int compressed;
+
+    TraceRecord *records;
+    size_t count;
+    size_t pos;
+
+    uint8_t *buf;
+} TraceReader;
+
+
+/**
+ * Creates the trace file and starts the writer thread.
+ * Returns 0 on success.
+ */
+int trace_open(Tracer *tracer, const char *path, int compress);
+
+
+/**
+ * Writes the remaining records, stops the writer thread
+ * and closes the file. Also called at exit for tracers
+ * that are still open, so a trace survives HLT and ROM
+ * write traps.
+ */
+void trace_close(Tracer *tracer);
+
+
+/**
+ * Queues the current chunk and moves on to the next one
+ */
+void trace_submit(Tracer *tracer);
+
+
+/**
+ * Records the state before the instruction at PC and
+ * returns the record, so the caller can fill in `cycles`
+ * once the instruction has run
+ */
+static inline TraceRecord* trace_begin(Tracer *tracer, State8080 *state) {
+    if (tracer->next == tracer->end) {
+        trace_submit(tracer);
+    }
+    TraceRecord *rec = tracer->next++;
+    rec->pc = state->pc;
+    rec->sp = state->sp;
+    rec->cycles = 0;
+    rec->opcode = state->memory[state->pc];
+    rec->operand[0] = state->memory[(uint16_t) (state->pc + 1)];
+    rec->operand[1] = state->memory[(uint16_t) (state->pc + 2)];
+
+    // A to L are consecutive in both structs
+    memcpy(&rec->a, &state->a, 7);
+    memcpy(&rec->cc, &state->cc, sizeof(rec->cc));
+    rec->int_enable = state->int_enable;
+    return rec;
+}
+
+
+/**
+ * Opens a trace for reading. Returns 0 on success.
+ */
+int trace_reader_open(TraceReader *reader, const char *path);
+
+
+/**
+ * Reads the next record. Returns 1 on success and 0 at
+ * the end of the trace.
+ */
+int trace_reader_next(TraceReader *reader, TraceRecord *rec);
+
+
+void trace_reader_close(TraceReader *reader);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+#include "machine.h"
+
+/*
+ * Hang detection for unattended machines.
+ *
+ * A watchdog is a VBlank hook, so it costs nothing in the
+ * instruction loop: once per frame it looks at how many
+ * interrupts the machine delivered and where the PC is. Space
+ * Invaders runs its game from the interrupt handlers, so a
+ * frame with an interrupt taken is progress. Frames without
+ * one widen the loop signature, the range of PCs seen at the
+ * frame boundaries since the last progress. After `frames`
+ * frames without progress inside a range of at most
+ * `loop_bytes` (a tight loop with interrupts disabled, which
+ * would run forever), the machine is flagged as hung and
+ * `on_hang` is called once.
+ *
+ * The watchdog only flags: the hook runs in the middle of
+ * the frame loop, so the supervisor resets the machine (e.g.
+ * machine_clone from a savestate) once the run returns, then
+ * calls watchdog_reset.
+ */
+
+
+// frames without progress before a machine counts as hung
+#define WATCHDOG_FRAMES 120
+
+// widest PC range that counts as a tight loop
+#define WATCHDOG_LOOP_BYTES 64
+
+
+struct watchdog_t;
+typedef void (*WatchdogFn)(Machine *machine, struct watchdog_t *watchdog, void *arg);
+
+typedef struct watchdog_t {
+    int frames;
+
+    // 0 flags a machine without progress wherever it runs
+    int loop_bytes;
+
+    // called when the machine is flagged, or NULL
+    WatchdogFn on_hang;
+    void *arg;
+
+    // interrupts delivered at the last progress, and
+    // frames since
+    uint64_t delivered;
+    int stalled;
+
+    // loop signature: lowest and highest PC seen at a
+    // frame boundary since the last progress
+    uint16_t loop_start;
+    uint16_t loop_end;
+
+    // set when flagged, until watchdog_reset
+    int hung;
+
+    // times flagged
+    uint64_t hangs;
+} Watchdog;
+
+
+void watchdog_init(Watchdog *watchdog, int frames, int loop_bytes, WatchdogFn on_hang, void *arg);
+
+
+/**
+ * Starts watching `machine`. Returns 0 on success, or 1 if
+ * all its VBlank hooks are taken.
+ */
+int watchdog_attach(Watchdog *watchdog, Machine *machine);
+
+
+void watchdog_detach(Watchdog *watchdog, Machine *machine);
+
+
+/**
+ * Clears the hung flag and starts counting from the
+ * current state of `machine`, e.g. after it was reset
+ */
+void watchdog_reset(Watchdog *watchdog, const Machine *machine);
+
+#endif
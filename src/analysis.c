@@ -0,0 +1,361 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "disassembler.h"
+
+
+// data bytes per DB line in the listing
+#define DATA_PER_LINE 8
+
+// column where listing comments start
+#define COMMENT_COLUMN 40
+
+
+static const char *FLOW_NAMES[] = {
+    "next", "jump", "jump_cond", "call", "call_cond",
+    "rst", "ret", "ret_cond", "indirect", "halt"
+};
+
+
+/**
+ * Growable stack of addresses still to decode
+ */
+typedef struct worklist_t {
+    uint16_t *items;
+    size_t len;
+    size_t cap;
+} Worklist;
+
+
+void worklist_push(Worklist *list, uint16_t adr) {
+    if (list->len == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 64;
+        list->items = realloc(list->items, list->cap * sizeof(*list->items));
+    }
+    list->items[list->len++] = adr;
+}
+
+
+/**
+ * Returns 1 if the instruction interacts with the machine,
+ * so a block should end after it
+ */
+int is_machine_boundary(const Instr8080 *instr) {
+    switch (instr->mnemonic) {
+        case MN_IN:
+        case MN_OUT:
+        case MN_EI:
+        case MN_DI:
+        case MN_HLT:
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Returns 1 if execution can continue after the instruction
+ */
+int falls_through(uint8_t flow) {
+    switch (flow) {
+        case FLOW_JUMP:
+        case FLOW_RET:
+        case FLOW_INDIRECT:
+        case FLOW_HALT:
+            return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * Adds a branch target to the worklist if it's in the ROM
+ */
+void add_target(RomAnalysis *an, Worklist *list, uint16_t target, uint8_t label) {
+    if (target >= an->size) {
+        return;
+    }
+    an->labels[target] |= label;
+    worklist_push(list, target);
+}
+
+
+/**
+ * Decodes straight-line code from `pc` until the path ends
+ * or reaches code that was already decoded
+ */
+void trace_path(RomAnalysis *an, const uint8_t *memory, Worklist *list, uint32_t pc) {
+    Instr8080 instr;
+    while (pc < an->size) {
+        if (an->bytes[pc] == BYTE_OPCODE) {
+            return;
+        }
+        if (an->bytes[pc] == BYTE_OPERAND) {
+            an->overlaps++;
+            return;
+        }
+        disasm_decode(memory, pc, &instr);
+        if (pc + instr.length > an->size) {
+            return;
+        }
+        an->bytes[pc] = BYTE_OPCODE;
+        for (int i = 1; i < instr.length; i++) {
+            an->bytes[pc + i] = BYTE_OPERAND;
+        }
+
+        switch (instr.flow) {
+            case FLOW_JUMP:
+            case FLOW_JUMP_COND:
+                add_target(an, list, instr.target, LABEL_JUMP);
+                break;
+            case FLOW_CALL:
+            case FLOW_CALL_COND:
+            case FLOW_RST:
+                add_target(an, list, instr.target, LABEL_CALL);
+                break;
+        }
+        if (!falls_through(instr.flow)) {
+            return;
+        }
+        pc += instr.length;
+    }
+}
+
+
+/**
+ * Appends a block to the analysis
+ */
+void add_block(RomAnalysis *an, size_t *cap, BasicBlock *block) {
+    if (an->block_count == *cap) {
+        *cap = *cap ? *cap * 2 : 256;
+        an->blocks = realloc(an->blocks, *cap * sizeof(*an->blocks));
+    }
+    an->block_at[block->start] = an->block_count;
+    an->blocks[an->block_count++] = *block;
+}
+
+
+/**
+ * Splits the decoded code into basic blocks
+ */
+void build_blocks(RomAnalysis *an, const uint8_t *memory) {
+    size_t cap = 0;
+    int open = 0;
+    BasicBlock block;
+    Instr8080 instr;
+
+    for (uint32_t adr = 0; adr < an->size; adr++) {
+        if (an->bytes[adr] != BYTE_OPCODE) {
+            continue;
+        }
+
+        // a label or a gap starts a new block
+        if (open && (an->labels[adr] || adr != block.end)) {
+            block.has_next = adr == block.end;
+            add_block(an, &cap, &block);
+            open = 0;
+        }
+        if (!open) {
+            block = (BasicBlock) {
+                .start = adr,
+                .end = adr,
+                .count = 0,
+                .exit = FLOW_NEXT,
+                .has_next = 1,
+                .target = 0
+            };
+            open = 1;
+        }
+
+        disasm_decode(memory, adr, &instr);
+        block.end = adr + instr.length;
+        block.count++;
+        if (instr.flow != FLOW_NEXT || is_machine_boundary(&instr)) {
+            block.exit = instr.flow;
+            block.target = instr.target;
+            block.has_next = falls_through(instr.flow);
+            add_block(an, &cap, &block);
+            open = 0;
+        }
+    }
+    if (open) {
+        block.has_next = 0;
+        add_block(an, &cap, &block);
+    }
+}
+
+
+int analysis_run(RomAnalysis *an, const uint8_t *memory, uint32_t size,
+                 const uint16_t *entries, int entry_count) {
+    *an = (RomAnalysis) {
+        .size = size,
+        .bytes = calloc(size ? size : 1, sizeof(*an->bytes)),
+        .labels = calloc(size ? size : 1, sizeof(*an->labels)),
+        .blocks = NULL,
+        .block_count = 0,
+        .block_at = malloc((size ? size : 1) * sizeof(*an->block_at)),
+        .overlaps = 0
+    };
+    if (an->bytes == NULL || an->labels == NULL || an->block_at == NULL) {
+        analysis_free(an);
+        return 1;
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        an->block_at[i] = -1;
+    }
+
+    Worklist list = { .items = NULL, .len = 0, .cap = 0 };
+    for (int i = 0; i < entry_count; i++) {
+        add_target(an, &list, entries[i], LABEL_ENTRY);
+    }
+    while (list.len > 0) {
+        trace_path(an, memory, &list, list.items[--list.len]);
+    }
+    free(list.items);
+
+    build_blocks(an, memory);
+    return 0;
+}
+
+
+void analysis_free(RomAnalysis *an) {
+    free(an->bytes);
+    free(an->labels);
+    free(an->blocks);
+    free(an->block_at);
+    an->bytes = NULL;
+    an->labels = NULL;
+    an->blocks = NULL;
+    an->block_at = NULL;
+    an->block_count = 0;
+}
+
+
+const BasicBlock* analysis_block_at(const RomAnalysis *an, uint16_t pc) {
+    if (pc >= an->size || an->block_at[pc] < 0) {
+        return NULL;
+    }
+    return &an->blocks[an->block_at[pc]];
+}
+
+
+/**
+ * Writes the label name for `adr` into `buf`
+ */
+void label_name(const RomAnalysis *an, uint16_t adr, char *buf, size_t size) {
+    uint8_t labels = adr < an->size ? an->labels[adr] : 0;
+    const char *prefix = "L";
+    if (labels & LABEL_ENTRY) {
+        prefix = "entry";
+    } else if (labels & LABEL_CALL) {
+        prefix = "sub";
+    }
+    snprintf(buf, size, "%s_%04x", prefix, adr);
+}
+
+
+/**
+ * Writes one line of data bytes starting at `adr` and
+ * returns how many were written
+ */
+uint32_t write_data_line(const RomAnalysis *an, const uint8_t *memory, uint32_t adr, FILE *out) {
+    uint32_t n = 0;
+    char ascii[DATA_PER_LINE + 1];
+    int col = fprintf(out, "    %04x  DB     ", adr);
+    while (n < DATA_PER_LINE && adr + n < an->size &&
+           an->bytes[adr + n] == BYTE_DATA &&
+           (n == 0 || !an->labels[adr + n])) {
+        uint8_t byte = memory[adr + n];
+        col += fprintf(out, "%s%02x", n ? "," : "", byte);
+        ascii[n] = (byte >= 0x20 && byte < 0x7f) ? byte : '.';
+        n++;
+    }
+    ascii[n] = '\0';
+    fprintf(out, "%*s; %s\n", col < COMMENT_COLUMN ? COMMENT_COLUMN - col : 1, "", ascii);
+    return n;
+}
+
+
+void analysis_write_listing(const RomAnalysis *an, const uint8_t *memory, FILE *out) {
+    uint32_t code_bytes = 0;
+    for (uint32_t adr = 0; adr < an->size; adr++) {
+        code_bytes += an->bytes[adr] != BYTE_DATA;
+    }
+    fprintf(out, "; %u bytes: %u code, %u data, %zu blocks\n",
+        an->size, code_bytes, an->size - code_bytes, an->block_count);
+
+    Instr8080 instr;
+    char text[DISASM_TEXT_SIZE];
+    char label[16];
+    uint32_t adr = 0;
+    while (adr < an->size) {
+        if (an->labels[adr] || (an->block_at[adr] >= 0 && adr > 0 &&
+                                an->bytes[adr - 1] == BYTE_DATA)) {
+            label_name(an, adr, label, sizeof(label));
+            fprintf(out, "\n%s:\n", label);
+        }
+
+        if (an->bytes[adr] != BYTE_OPCODE) {
+            adr += write_data_line(an, memory, adr, out);
+            continue;
+        }
+
+        disasm_decode(memory, adr, &instr);
+        disasm_format(&instr, text, sizeof(text));
+        int col = fprintf(out, "    %04x  ", adr);
+        for (int i = 0; i < 3; i++) {
+            col += i < instr.length ?
+                fprintf(out, "%02x ", memory[adr + i]) : fprintf(out, "   ");
+        }
+        col += fprintf(out, " %s", text);
+
+        switch (instr.flow) {
+            case FLOW_JUMP:
+            case FLOW_JUMP_COND:
+            case FLOW_CALL:
+            case FLOW_CALL_COND:
+            case FLOW_RST:
+                label_name(an, instr.target, label, sizeof(label));
+                fprintf(out, "%*s; %s", col < COMMENT_COLUMN ? COMMENT_COLUMN - col : 1, "",
+                    instr.target < an->size ? label : "outside ROM");
+                break;
+        }
+        fprintf(out, "\n");
+
+        // separate blocks that can't fall through
+        if (!falls_through(instr.flow)) {
+            fprintf(out, "\n");
+        }
+        adr += instr.length;
+    }
+}
+
+
+void analysis_write_blocks(const RomAnalysis *an, FILE *out) {
+    fprintf(out, "# start end count exit target next\n");
+    for (size_t i = 0; i < an->block_count; i++) {
+        const BasicBlock *block = &an->blocks[i];
+        fprintf(out, "%04x %04x %u %s ",
+            block->start, block->end, block->count, FLOW_NAMES[block->exit]);
+        switch (block->exit) {
+            case FLOW_JUMP:
+            case FLOW_JUMP_COND:
+            case FLOW_CALL:
+            case FLOW_CALL_COND:
+            case FLOW_RST:
+                fprintf(out, "%04x ", block->target);
+                break;
+            default:
+                fprintf(out, "- ");
+                break;
+        }
+        if (block->has_next) {
+            fprintf(out, "%04x\n", block->end);
+        } else {
+            fprintf(out, "-\n");
+        }
+    }
+}
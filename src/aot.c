@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "aot.h"
+#include "cpu.h"
+
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+
+uint32_t aot_rom_hash(const uint8_t *memory, uint16_t size) {
+    uint32_t hash = FNV_OFFSET;
+    for (uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ memory[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+
+int aot_install(AotTable *table, State8080 *state, const AotRom *rom) {
+    table->blocks = NULL;
+    table->size = 0;
+
+    // compiled code is only valid for the exact ROM
+    // and only while it can't be written to
+    uint32_t hash = aot_rom_hash(state->memory, rom->size);
+    if (hash != rom->hash || rom->size > state->rom_size) {
+        printf("WARNING: ROM doesn't match the compiled code "
+               "(hash 0x%08x, expected 0x%08x), interpreting\n", hash, rom->hash);
+        return -1;
+    }
+
+    table->blocks = calloc(rom->size ? rom->size : 1, sizeof(*table->blocks));
+    table->size = rom->size;
+    for (size_t i = 0; i < rom->count; i++) {
+        table->blocks[rom->blocks[i].adr] = rom->blocks[i].run;
+    }
+
+    state->aot = table;
+    printf("AOT: %zu compiled blocks\n", rom->count);
+    return rom->count;
+}
+
+
+void aot_uninstall(AotTable *table, State8080 *state) {
+    state->aot = NULL;
+    free(table->blocks);
+    table->blocks = NULL;
+    table->size = 0;
+}
@@ -0,0 +1,58 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "cpu.h"
+#include "machine.h"
+
+
+int machine_arena_create(MachineArena *arena, size_t count, const Machine *base) {
+    // zero pages straight from the OS, faulted in only
+    // once they're written
+    void *slots = mmap(NULL, count * sizeof(MachineInstance), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slots == MAP_FAILED) {
+        arena->slots = NULL;
+        arena->count = 0;
+        return 1;
+    }
+    arena->slots = slots;
+    arena->count = count;
+
+    const Board *board = base->board;
+    const uint8_t *memory = base->cpu_state->memory;
+    for (size_t i = 0; i < count; i++) {
+        MachineInstance *slot = &arena->slots[i];
+
+        // only the ROM and its mirrors, so pages
+        // nothing maps stay untouched
+        for (int r = 0; r < board->rom_count; r++) {
+            const BoardRom *rom = &board->roms[r];
+            memcpy(slot->memory + rom->address, memory + rom->address, rom->size);
+        }
+        for (int m = 0; m < board->mirror_count; m++) {
+            const BoardRange *range = &board->mirrors[m].range;
+            memcpy(slot->memory + range->start, memory + range->start, range->end - range->start);
+        }
+        machine_instance_init(slot, board);
+        machine_clone(&slot->machine, base);
+    }
+    return 0;
+}
+
+
+void machine_arena_destroy(MachineArena *arena) {
+    if (arena->slots != NULL) {
+        munmap(arena->slots, arena->count * sizeof(MachineInstance));
+    }
+    arena->slots = NULL;
+    arena->count = 0;
+}
+
+
+void machine_arena_clone(MachineArena *arena, const Machine *src, size_t first, size_t n) {
+    for (size_t i = first; i < first + n; i++) {
+        machine_clone(&arena->slots[i].machine, src);
+    }
+}
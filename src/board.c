@@ -0,0 +1,477 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "machine.h"
+
+
+#define MAX_LINE 256
+#define MAX_ARGS 8
+
+#define ADDRESS_SPACE 0x10000
+
+
+// Midway 8080 hardware: RST 1 at mid-screen, RST 2 at
+// VBlank, a shift register for sprites and 7 KB of video
+// memory in a rotated 224x256 screen
+#define MIDWAY_8080 \
+    "ram 0x2000 0x4000\n" \
+    "video 0x2400 224 256\n" \
+    "cpu 2000000\n" \
+    "fps 60\n" \
+    "interrupts 1 2\n" \
+    "in 1 latch 0x08\n" \
+    "in 2 latch 0x00\n" \
+    "in 3 shift_result\n" \
+    "out 2 shift_offset\n" \
+    "out 3 none\n" \
+    "out 4 shift_data\n" \
+    "out 5 none\n" \
+    "out 6 none\n"
+
+
+typedef struct builtin_board_t {
+    const char *name;
+    const char *text;
+} BuiltinBoard;
+
+
+static const BuiltinBoard BUILTIN[] = {
+    {
+        "invaders",
+        "name invaders\n"
+        "rom invaders.h 0x0000 0x0800\n"
+        "rom invaders.g 0x0800 0x0800\n"
+        "rom invaders.f 0x1000 0x0800\n"
+        "rom invaders.e 0x1800 0x0800\n"
+        "in 0 latch 0x01\n"
+        MIDWAY_8080
+    },
+    {
+        // Space Invaders Part II
+        "invadpt2",
+        "name invadpt2\n"
+        "rom pv01 0x0000 0x0800\n"
+        "rom pv02 0x0800 0x0800\n"
+        "rom pv03 0x1000 0x0800\n"
+        "rom pv04 0x1800 0x0800\n"
+        "rom pv05 0x4000 0x0800\n"
+        "in 0 latch 0x0e\n"
+        MIDWAY_8080
+    },
+    {
+        // Lunar Rescue
+        "lrescue",
+        "name lrescue\n"
+        "rom lrescue.1 0x0000 0x0800\n"
+        "rom lrescue.2 0x0800 0x0800\n"
+        "rom lrescue.3 0x1000 0x0800\n"
+        "rom lrescue.4 0x1800 0x0800\n"
+        "rom lrescue.5 0x4000 0x0800\n"
+        "rom lrescue.6 0x4800 0x0800\n"
+        "in 0 latch 0x0e\n"
+        MIDWAY_8080
+    },
+    {
+        // Balloon Bomber
+        "ballbomb",
+        "name ballbomb\n"
+        "rom tn01 0x0000 0x0800\n"
+        "rom tn02 0x0800 0x0800\n"
+        "rom tn03 0x1000 0x0800\n"
+        "rom tn04 0x1800 0x0800\n"
+        "rom tn05-1 0x4000 0x0800\n"
+        "in 0 latch 0x0e\n"
+        MIDWAY_8080
+    }
+};
+
+#define BUILTIN_COUNT (sizeof(BUILTIN) / sizeof(BUILTIN[0]))
+
+
+typedef struct port_kind_name_t {
+    const char *name;
+    BoardPortKind kind;
+    int out;
+} PortKindName;
+
+
+static const PortKindName PORT_KINDS[] = {
+    { "latch", PORT_LATCH, 0 },
+    { "shift_result", PORT_SHIFT_RESULT, 0 },
+    { "shift_offset", PORT_SHIFT_OFFSET, 1 },
+    { "shift_data", PORT_SHIFT_DATA, 1 },
+    { "none", PORT_NONE, 1 }
+};
+
+#define PORT_KIND_COUNT (sizeof(PORT_KINDS) / sizeof(PORT_KINDS[0]))
+
+
+/**
+ * Parses a number (decimal, or hex with 0x) up to `max`.
+ * Returns 0 on success.
+ */
+int parse_value(const char *s, unsigned long max, unsigned long *out) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+    if (*s == '\0' || *end != '\0' || v > max) {
+        return 1;
+    }
+    *out = v;
+    return 0;
+}
+
+
+int ranges_overlap(BoardRange a, BoardRange b) {
+    return a.start < b.end && b.start < a.end;
+}
+
+
+int range_inside(BoardRange inner, BoardRange outer) {
+    return inner.start >= outer.start && inner.end <= outer.end;
+}
+
+
+/**
+ * Returns 1 if `range` lies within a single ROM
+ */
+int in_rom(const Board *board, BoardRange range) {
+    for (int i = 0; i < board->rom_count; i++) {
+        BoardRange rom = { board->roms[i].address, board->roms[i].address + board->roms[i].size };
+        if (range_inside(range, rom)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Returns 1 if `range` overlaps a ROM, RAM or mirror
+ */
+int range_taken(const Board *board, BoardRange range) {
+    for (int i = 0; i < board->rom_count; i++) {
+        BoardRange rom = { board->roms[i].address, board->roms[i].address + board->roms[i].size };
+        if (ranges_overlap(range, rom)) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < board->ram_count; i++) {
+        if (ranges_overlap(range, board->ram[i])) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < board->mirror_count; i++) {
+        if (ranges_overlap(range, board->mirrors[i].range)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Parses "start end" at `argv` into a non-empty range
+ */
+int parse_range(char **argv, BoardRange *range) {
+    unsigned long start, end;
+    if (parse_value(argv[0], ADDRESS_SPACE - 1, &start) ||
+        parse_value(argv[1], ADDRESS_SPACE, &end) || end <= start) {
+        return 1;
+    }
+    *range = (BoardRange) { start, end };
+    return 0;
+}
+
+
+/**
+ * Applies one line, split into `argc` words. Returns NULL
+ * on success or the error message.
+ */
+const char* parse_line(Board *board, int argc, char **argv) {
+    const char *cmd = argv[0];
+    unsigned long v, w;
+
+    if (strcmp(cmd, "name") == 0) {
+        if (argc != 2 || strlen(argv[1]) >= BOARD_NAME_SIZE) {
+            return "expected: name <name>";
+        }
+        strcpy(board->name, argv[1]);
+    } else if (strcmp(cmd, "rom") == 0) {
+        if (argc != 4 || strlen(argv[1]) >= BOARD_FILE_SIZE ||
+            parse_value(argv[2], ADDRESS_SPACE - 1, &v) || parse_value(argv[3], ADDRESS_SPACE - v, &w) || w == 0) {
+            return "expected: rom <file> <address> <size>";
+        }
+        if (board->rom_count == BOARD_MAX_ROMS) {
+            return "too many ROMs";
+        }
+        BoardRange range = { v, v + w };
+        if (range_taken(board, range)) {
+            return "ROM overlaps another range";
+        }
+        BoardRom *rom = &board->roms[board->rom_count++];
+        strcpy(rom->file, argv[1]);
+        rom->address = v;
+        rom->size = w;
+    } else if (strcmp(cmd, "ram") == 0) {
+        BoardRange range;
+        if (argc != 3 || parse_range(&argv[1], &range)) {
+            return "expected: ram <start> <end>";
+        }
+        if (board->ram_count == BOARD_MAX_RAM) {
+            return "too many RAM ranges";
+        }
+        if (range_taken(board, range)) {
+            return "RAM overlaps another range";
+        }
+        board->ram[board->ram_count++] = range;
+    } else if (strcmp(cmd, "mirror") == 0) {
+        BoardRange range;
+        if (argc != 4 || parse_range(&argv[1], &range) || parse_value(argv[3], ADDRESS_SPACE - 1, &v)) {
+            return "expected: mirror <start> <end> <source>";
+        }
+        if (board->mirror_count == BOARD_MAX_MIRRORS) {
+            return "too many mirrors";
+        }
+        BoardRange source = { v, v + (range.end - range.start) };
+        if (!in_rom(board, source)) {
+            return "only ROM can be mirrored (declare the ROM first)";
+        }
+        if (range_taken(board, range)) {
+            return "mirror overlaps another range";
+        }
+        board->mirrors[board->mirror_count++] = (BoardMirror) { range, v };
+    } else if (strcmp(cmd, "video") == 0) {
+        unsigned long cols, rows;
+        if (argc != 4 || parse_value(argv[1], ADDRESS_SPACE - 1, &v) ||
+            parse_value(argv[2], ADDRESS_SPACE, &cols) || parse_value(argv[3], ADDRESS_SPACE, &rows)) {
+            return "expected: video <start> <columns> <rows>";
+        }
+        if (cols != FRAME_COLS || rows != FRAME_ROWS) {
+            return "only 224x256 screens are supported";
+        }
+        board->video_start = v;
+        board->video_cols = FRAME_COLS;
+        board->video_rows = FRAME_ROWS;
+    } else if (strcmp(cmd, "cpu") == 0) {
+        if (argc != 2 || parse_value(argv[1], 100000000, &v) || v == 0) {
+            return "expected: cpu <hz>";
+        }
+        board->cpu_hz = v;
+    } else if (strcmp(cmd, "fps") == 0) {
+        if (argc != 2 || parse_value(argv[1], 1000, &v) || v == 0) {
+            return "expected: fps <frames per second>";
+        }
+        board->fps = v;
+    } else if (strcmp(cmd, "interrupts") == 0) {
+        if (argc < 2 || argc > BOARD_MAX_INTERRUPTS + 1) {
+            return "expected: interrupts <rst>...";
+        }
+        for (int i = 1; i < argc; i++) {
+            if (parse_value(argv[i], 7, &v)) {
+                return "RST numbers go from 0 to 7";
+            }
+            board->interrupts[i - 1] = v;
+        }
+        board->interrupt_count = argc - 1;
+    } else if (strcmp(cmd, "in") == 0 || strcmp(cmd, "out") == 0) {
+        int out = cmd[0] == 'o';
+        if (argc < 3 || parse_value(argv[1], BOARD_PORT_COUNT - 1, &v)) {
+            return "expected: in|out <port> <handler> [value]";
+        }
+        const PortKindName *kind = NULL;
+        for (size_t i = 0; i < PORT_KIND_COUNT; i++) {
+            if (PORT_KINDS[i].out == out && strcmp(argv[2], PORT_KINDS[i].name) == 0) {
+                kind = &PORT_KINDS[i];
+            }
+        }
+        if (kind == NULL) {
+            return "unknown handler for this direction";
+        }
+        w = 0;
+        if (kind->kind == PORT_LATCH ? argc != 4 || parse_value(argv[3], 0xff, &w) : argc != 3) {
+            return "latch takes one byte, other handlers nothing";
+        }
+        BoardPort *ports = out ? board->out : board->in;
+        ports[v] = (BoardPort) { kind->kind, w };
+    } else {
+        return "unknown keyword";
+    }
+    return NULL;
+}
+
+
+/**
+ * Checks what single lines can't. Returns NULL or
+ * the error message.
+ */
+const char* check_board(Board *board) {
+    if (board->rom_count == 0) {
+        return "no ROM";
+    }
+    if (board->interrupt_count == 0) {
+        return "no interrupts";
+    }
+    if (board->video_cols == 0) {
+        return "no video memory";
+    }
+    BoardRange video = {
+        board->video_start,
+        board->video_start + board->video_cols * board->video_rows / 8
+    };
+    int video_in_ram = 0;
+    for (int i = 0; i < board->ram_count; i++) {
+        video_in_ram |= range_inside(video, board->ram[i]);
+    }
+    if (!video_in_ram) {
+        return "video memory isn't inside a RAM range";
+    }
+
+    // ROMs from address 0 up to the first gap are protected
+    uint32_t end = 0;
+    for (int grew = 1; grew;) {
+        grew = 0;
+        for (int i = 0; i < board->rom_count; i++) {
+            if (board->roms[i].address == end) {
+                end += board->roms[i].size;
+                grew = 1;
+            }
+        }
+    }
+    if (end > UINT16_MAX) {
+        return "ROM can't fill the address space";
+    }
+    board->rom_size = end;
+    return NULL;
+}
+
+
+int board_parse(Board *board, const char *text, const char *source) {
+    *board = (Board) {
+        .cpu_hz = MACHINE_CPU_HZ,
+        .fps = MACHINE_FPS
+    };
+    strcpy(board->name, "board");
+
+    const char *p = text;
+    for (int line_no = 1; *p != '\0'; line_no++) {
+        size_t len = strcspn(p, "\n");
+        char line[MAX_LINE];
+        if (len >= MAX_LINE) {
+            fprintf(stderr, "Error: %s:%d: line too long\n", source, line_no);
+            return 1;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p += len + (p[len] == '\n');
+
+        line[strcspn(line, "#")] = '\0';
+        char *argv[MAX_ARGS];
+        int argc = 0;
+        for (char *tok = strtok(line, " \t\r"); tok != NULL; tok = strtok(NULL, " \t\r")) {
+            if (argc == MAX_ARGS) {
+                fprintf(stderr, "Error: %s:%d: too many words\n", source, line_no);
+                return 1;
+            }
+            argv[argc++] = tok;
+        }
+        if (argc == 0) {
+            continue;
+        }
+
+        const char *error = parse_line(board, argc, argv);
+        if (error != NULL) {
+            fprintf(stderr, "Error: %s:%d: %s\n", source, line_no, error);
+            return 1;
+        }
+    }
+
+    const char *error = check_board(board);
+    if (error != NULL) {
+        fprintf(stderr, "Error: %s: %s\n", source, error);
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Reads a whole file into a string. Returns NULL on failure.
+ */
+char* read_text(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0L, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+    char *text = size < 0 ? NULL : malloc(size + 1);
+    if (text != NULL) {
+        size_t n = fread(text, 1, size, f);
+        text[n] = '\0';
+    }
+    fclose(f);
+    return text;
+}
+
+
+int board_open(Board *board, const char *name) {
+    for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+        if (strcmp(name, BUILTIN[i].name) == 0) {
+            return board_parse(board, BUILTIN[i].text, name);
+        }
+    }
+
+    char *text = read_text(name);
+    if (text == NULL) {
+        fprintf(stderr, "Error: %s is neither a readable file nor a built-in board:", name);
+        for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+            fprintf(stderr, " %s", BUILTIN[i].name);
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    int res = board_parse(board, text, name);
+    free(text);
+    return res;
+}
+
+
+int board_load_roms(const Board *board, const char *folder, uint8_t *memory) {
+    for (int i = 0; i < board->rom_count; i++) {
+        const BoardRom *rom = &board->roms[i];
+        char *path = malloc(strlen(folder) + BOARD_FILE_SIZE + 2);
+        sprintf(path, "%s/%s", folder, rom->file);
+
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) {
+            fprintf(stderr, "Error: couldn't open %s\n", path);
+            free(path);
+            return 1;
+        }
+        fseek(f, 0L, SEEK_END);
+        long fsize = ftell(f);
+        fseek(f, 0L, SEEK_SET);
+        if (fsize != rom->size) {
+            fprintf(stderr, "WARNING: %s is %ld bytes, expected %d\n", path, fsize, rom->size);
+        }
+        size_t n = fread(memory + rom->address, 1, rom->size, f);
+        fclose(f);
+        if (n == 0) {
+            fprintf(stderr, "Error: couldn't read %s\n", path);
+            free(path);
+            return 1;
+        }
+        free(path);
+    }
+
+    for (int i = 0; i < board->mirror_count; i++) {
+        const BoardMirror *m = &board->mirrors[i];
+        memcpy(memory + m->range.start, memory + m->source, m->range.end - m->range.start);
+    }
+    return 0;
+}
+
@@ -1,14 +1,22 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "cpu.h"
+#include "cpu_internal.h"
+#include "aot.h"
+#include "debugger.h"
 #include "disassembler.h"
+#include "fusion.h"
+#include "hle.h"
+#include "profiler.h"
+#include "trace.h"
 
 /**
  * CPU cycle lookup table
  */
-uint8_t cycles_lookup[] = {
+const uint8_t cycles_lookup[] = {
     4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4, //0x00..0x0f
     4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4, //0x10..0x1f
     4, 10, 16, 5, 5, 5, 7, 4, 4, 10, 16, 5, 5, 5, 7, 4, //etc
@@ -35,21 +43,18 @@ uint8_t cycles_lookup[] = {
 #define ROM_END 0x1fff
 #define RAM_START (ROM_END + 1)
 #define RAM_END 0x23ff
-#define FRAMEBUFFER_START 0x2400
-
-
-void* cpu_framebuffer(State8080 *state) {
-    return (void*) &state->memory[FRAMEBUFFER_START];
-}
 
 
 #define INSTRS_TO_PRINT 10
 
 void print_instructions(State8080 *state) {
+    Instr8080 instr;
+    char text[DISASM_TEXT_SIZE];
     uint16_t pc = state->pc;
     for (int i = 0; i < INSTRS_TO_PRINT; i++) {
-        int steps_to_advance = disassemble8080op(state->memory, pc);
-        pc += steps_to_advance;
+        pc += disasm_decode(state->memory, pc, &instr);
+        disasm_format(&instr, text, sizeof(text));
+        printf("%04x %s\n", instr.pc, text);
     }
 }
 
@@ -86,18 +91,33 @@ void cpu_print_state(State8080 *state) {
 }
 
 
-uint8_t cpu_io_empty(IO8080 io) {
-    uint8_t any_filled = io.port || io.value;
-    return !any_filled;
-}
-
-
 void print_failed_state(State8080 *state) {
     printf("State at failure:\n");
     cpu_print_state(state);
 }
 
 
+void cpu_print_fault(State8080 *state) {
+    switch (state->fault) {
+        case CPU_FAULT_HALT:
+            printf("Halted at 0x%04x\n", state->fault_adr);
+            return;
+        case CPU_FAULT_ROM_WRITE:
+            printf("Fatal error: tried to write to ROM at address 0x%x\n", state->fault_adr);
+            print_failed_state(state);
+            return;
+    }
+}
+
+
+void cpu_fault(State8080 *state, CpuFault fault, uint16_t adr) {
+    if (state->fault == CPU_FAULT_NONE) {
+        state->fault = fault;
+        state->fault_adr = adr;
+    }
+}
+
+
 void unimplemented_instr(State8080 *state) {
     uint8_t opcode = state->memory[state->pc];
     printf("Error: Unimplemented instruction 0x%x\n", opcode);
@@ -114,14 +134,17 @@ void unused_opcode(State8080 *state, uint8_t opcode) {
 
 
 /**
- * Writes to memory only if the offset is valid.
- * Otherwise, exits the program with failure.
+ * Writes to memory only if the offset is outside
+ * of the protected ROM region.
+ * Otherwise, drops the write and faults the CPU.
  */
 void mem_write_byte(State8080 *state, uint16_t offset, uint8_t value) {
-    if (offset >= ROM_START && offset <= ROM_END) {
-        printf("Fatal error: tried to write to ROM at address 0x%x\n", offset);
-        print_failed_state(state);
-        exit(EXIT_FAILURE);
+    if (offset < state->rom_size) {
+        cpu_fault(state, CPU_FAULT_ROM_WRITE, offset);
+        return;
+    }
+    if (state->watch != NULL && (state->watch[offset >> DEBUG_PAGE_SHIFT] & WATCH_WRITE)) {
+        debugger_access(state->debugger, offset, value, WATCH_WRITE);
     }
     state->memory[offset] = value;
 }
@@ -154,6 +177,9 @@ uint16_t makeword(uint8_t left, uint8_t right) {
  * Reads the byte at the specified location
  */
 uint8_t mem_read_byte(State8080 *state, uint16_t offset) {
+    if (state->watch != NULL && (state->watch[offset >> DEBUG_PAGE_SHIFT] & WATCH_READ)) {
+        debugger_access(state->debugger, offset, state->memory[offset], WATCH_READ);
+    }
     return state->memory[offset];
 }
 
@@ -163,7 +189,8 @@ uint8_t mem_read_byte(State8080 *state, uint16_t offset) {
  * and increments the program counter
  */
 uint8_t next_byte(State8080 *state) {
-    return mem_read_byte(state, state->pc++);
+    // instruction fetch, not a data read
+    return state->memory[state->pc++];
 }
 
 
@@ -224,10 +251,10 @@ uint8_t carry(uint16_t answer) {
 
 
 /**
- * Returns 1 when instruction resulted in
- * auxiliary carry (half-carry)
+ * Returns 1 when adding `left` and `right` (plus any
+ * carry in) into `answer` carried out of bit 3
  */
-uint8_t auxcarry(uint16_t answer) {
+uint8_t auxcarry(uint8_t left, uint8_t right, uint16_t answer) {
     // From the manual:
     // If the instruction caused a
     // carry out of bit 3 and into
@@ -244,30 +271,21 @@ uint8_t auxcarry(uint16_t answer) {
     // preceding a DAA (Decimal
     // Adjust Accumulator)
     // instruction.
-    uint8_t last8, cleaned;
-    last8 = answer & 0xff;
-    // zero out first three bits
-    //                  76543210
-    cleaned = last8 & 0b00011111; 
-    return cleaned > 0xf;  
+    //
+    // Bit 4 of the sum is the two bit 4s plus the
+    // carry into it, so the carry is what's left
+    // after removing the operands' bits.
+    return ((left ^ right ^ answer) >> 4) & 1;
 }
 
 
-// combine with bitwise OR
-// to set flags 
-#define SET_Z_FLAG  (1 << 7)
-#define SET_S_FLAG  (1 << 6)
-#define SET_P_FLAG  (1 << 5)
-#define SET_CY_FLAG (1 << 4)
-#define SET_AC_FLAG (1 << 3)
-#define SET_ALL_FLAGS (SET_Z_FLAG | SET_S_FLAG | SET_P_FLAG | SET_CY_FLAG | SET_AC_FLAG)
-
-
 /**
  * Set the specified flags according to the answer received by
  * arithmetic
  * flagstoset - from left to right, the z, s, p, cy, 
  * and ac flags (should set flag if set to 1)
+ * AC depends on the operands, so callers set it
+ * (see auxcarry) and SET_AC_FLAG is ignored here.
  */
 void set_arith_flags(State8080 *state, uint16_t answer, uint8_t flagstoset) {
     // remove trailing bits
@@ -284,14 +302,12 @@ void set_arith_flags(State8080 *state, uint16_t answer, uint8_t flagstoset) {
     if (cleaned & SET_CY_FLAG) {
         state->cc.cy = carry(answer);
     }
-    if (cleaned & SET_AC_FLAG) {
-        state->cc.ac = auxcarry(answer); 
-    }
 }
 
 
 /**
- * Sets flags from a logic operation response
+ * Sets flags from a logic operation response. AC is
+ * cleared (ANA sets it afterwards).
  */
 void set_logic_flags(State8080 *state, uint8_t res, uint8_t flagstoset) {
     // remove trailing bits
@@ -307,7 +323,7 @@ void set_logic_flags(State8080 *state, uint8_t res, uint8_t flagstoset) {
         state->cc.p = parity(answer);
     }
     if (cleaned & SET_AC_FLAG) {
-        state->cc.ac = auxcarry(answer); 
+        state->cc.ac = 0;
     }
 
     // carry is always zero
@@ -367,12 +383,18 @@ void push_pair(State8080 *state, uint8_t hi, uint8_t lo) {
  * Call specified target address
  */
 void call_adr(State8080 *state, uint16_t adr) {
+    // known ROM routines may run natively
+    if (state->hle != NULL && hle_call(state, adr)) {
+        return;
+    }
+
     // push return address onto the stack
     push_word(state, state->pc);
 
     // set program counter to
     // target address
     jmp(state, adr);
+    PROFILE_CALL(adr);
 }
 
 
@@ -428,6 +450,7 @@ uint16_t pop_word(State8080 *state) {
  */
 void ret(State8080 *state) {
     state->pc = pop_word(state);
+    PROFILE_RET();
 }
 
 
@@ -442,10 +465,16 @@ void ret_cond(State8080 *state, uint8_t cond) {
 void add_to_reg(State8080 *state, uint8_t *reg, uint8_t val, uint8_t carry) {
     uint16_t answer = (uint16_t) *reg + val + carry;
     set_arith_flags(state, answer, SET_ALL_FLAGS);
+    state->cc.ac = auxcarry(*reg, val, answer);
     *reg = answer & 0xff;
 }
 
 
+/**
+ * Subtracts by adding the complement, as the 8080 does:
+ * CY is the inverted carry, AC the carry out of bit 3
+ * of that addition
+ */
 void sub_from_reg(State8080 *state, uint8_t *reg, uint8_t val, uint8_t carry) {
     add_to_reg(state, reg, ~val, !carry);
     state->cc.cy = !state->cc.cy;
@@ -499,6 +528,9 @@ void ana_x(State8080 *state, uint8_t x) {
     uint8_t answer;
     answer = state->a & x;
     set_logic_flags(state, answer, SET_ALL_FLAGS);
+
+    // AC is the OR of bit 3 of the operands
+    state->cc.ac = ((state->a | x) >> 3) & 1;
     state->a = answer;
 }
 
@@ -545,9 +577,11 @@ void swp_ptrs(uint8_t *p1, uint8_t *p2) {
  * Z flag is set to 1 if (A) = (r). CY set to 1 if (A) < (r).
  */
 void cmp_x(State8080 *state, uint8_t x) {
-    uint16_t answer;
-    answer = (uint16_t) state->a - (uint16_t) x;
+    // A + ~x + 1, like SUB
+    uint8_t nx = ~x;
+    uint16_t answer = (uint16_t) state->a + nx + 1;
     set_arith_flags(state, answer, SET_ALL_FLAGS ^ SET_CY_FLAG);
+    state->cc.ac = auxcarry(state->a, nx, answer);
     state->cc.cy = state->a < x;
 }
 
@@ -583,8 +617,9 @@ uint32_t tworeg_add(uint8_t *left_ptr, uint8_t *right_ptr, uint16_t val) {
  */
 void inr_x(State8080 *state, uint8_t *ptr) {
     uint16_t answer = (uint16_t) *ptr + 1;
-    uint8_t flags = SET_Z_FLAG | SET_S_FLAG | SET_P_FLAG | SET_AC_FLAG;
+    uint8_t flags = SET_Z_FLAG | SET_S_FLAG | SET_P_FLAG;
     set_arith_flags(state, answer, flags);
+    state->cc.ac = (answer & 0xf) == 0;
     *ptr = answer & 0xff;
 }
 
@@ -595,8 +630,12 @@ void inr_x(State8080 *state, uint8_t *ptr) {
  */
 void dcr_x(State8080 *state, uint8_t *ptr) {
     uint16_t answer = (uint16_t) *ptr - 1;
-    uint8_t flags = SET_Z_FLAG | SET_S_FLAG | SET_P_FLAG | SET_AC_FLAG;
+    uint8_t flags = SET_Z_FLAG | SET_S_FLAG | SET_P_FLAG;
     set_arith_flags(state, answer, flags);
+
+    // adding 0xff carries out of bit 3 unless
+    // the low nibble was 0
+    state->cc.ac = (answer & 0xf) != 0xf;
     *ptr = answer & 0xff;
 }
 
@@ -728,6 +767,122 @@ void set_hl_mem(State8080 *state, uint8_t val) {
 }
 
 
+/**
+ * DAA: decimal adjust accumulator
+ *
+ * The eight-bit number in the accumulator
+ * is adjusted to form two four-bit
+ * Binary-Coded-Decimal digits by the
+ * following process:
+ * 1. If the value of the least significant
+ * 4 bits of the accumulator is greater
+ * than 9 or if the AC flag is set, 6 is
+ * added to the accumulator.
+ * 2. If the value of the most significant
+ * 4 bits of the accumulator is now greater
+ * than 9, or if the CY flag is set, 6 is
+ * added to the most significant 4 bits
+ * of the accumulator.
+ */
+void daa(State8080 *state) {
+    uint8_t correction = 0;
+    uint8_t cy = state->cc.cy;
+    // 1.
+    if ((state->a & 0xf) > 9 || state->cc.ac) {
+        correction |= 0x06;
+    }
+    // 2. (a high nibble of 9 counts as 10 if
+    // step 1 carries into it)
+    if ((state->a >> 4) > 9 || cy || ((state->a >> 4) == 9 && (state->a & 0xf) > 9)) {
+        correction |= 0x60;
+        cy = 1;
+    }
+    // both steps as one addition; CY is only ever set
+    add_to_reg(state, &state->a, correction, 0);
+    state->cc.cy = cy;
+}
+
+
+/**
+ * XTHL: L <-> (SP); H <-> (SP+1)
+ */
+void xthl(State8080 *state) {
+    uint16_t sp = state->sp;
+    uint8_t sp_l = mem_read_byte(state, sp);
+    uint8_t sp_h = mem_read_byte(state, sp + 1);
+    mem_write_byte(state, sp, state->l);
+    mem_write_byte(state, sp + 1, state->h);
+    state->l = sp_l;
+    state->h = sp_h;
+}
+
+
+/**
+ * POP PSW: pops the flags and A
+ */
+void pop_psw(State8080 *state) {
+    uint8_t sp_val, a_val;
+    pop_pair(state, &a_val, &sp_val);
+
+    // (CY) <- ((SP))O
+    state->cc.cy = sp_val & 1;
+
+    // (P) <- ((SP))2
+    state->cc.p = (sp_val & (1 << 2)) > 0;
+
+    // (AC) <- ((SP))4
+    state->cc.ac = (sp_val & (1 << 4)) > 0;
+
+    // (Z) <- ((SP))6
+    state->cc.z = (sp_val & (1 << 6)) > 0;
+
+    // (S) <- ((SP))7
+    state->cc.s = (sp_val & (1 << 7)) > 0;
+
+    // (A) <- ((SP) +1)
+    state->a = a_val;
+}
+
+
+/**
+ * PUSH PSW: pushes A and the flags
+ */
+void push_psw(State8080 *state) {
+    uint16_t sp_adr = state->sp;
+    
+    // ((SP) - 1) <- A
+    mem_write_byte(state, sp_adr - 1, state->a);
+
+    uint8_t sp_flags = 0;
+
+    // ((SP) - 2)0 <- CY
+    sp_flags |= state->cc.cy; 
+
+    // (........)1 <- 1
+    sp_flags |= (1 << 1);
+
+    // (........)2 <- P
+    sp_flags |= (state->cc.p << 2);
+
+    // (........)3 <- 0
+
+    // (........)4 <- AC
+    sp_flags |= (state->cc.ac << 4);
+
+    // (........)5 <- 0
+
+    // (........)6 <- Z
+    sp_flags |= (state->cc.z << 6);
+
+    // (........)7 <- S
+    sp_flags |= (state->cc.s << 7);
+    mem_write_byte(state, sp_adr - 2, sp_flags);
+
+    // (SP) <- (SP) - 2
+    state->sp -= 2;
+}
+
+
 uint8_t cpu_curr_op(State8080 *state) {
     return mem_read_byte(state, state->pc);
 }
@@ -738,12 +893,18 @@ void cpu_set_acc(State8080 *state, uint8_t val) {
 }
 
 
-/**
- * Clears all I/O values
- */
-void cpu_io_reset(IO8080 *io) {
-    io->port = 0;
-    io->value = 0;
+void cpu_io_init(IO8080 *io) {
+    memset(io, 0, sizeof(*io));
+}
+
+
+void cpu_io_on_in(IO8080 *io, uint8_t port, PortInFn fn, void *arg) {
+    io->in[port] = (PortIn) { .fn = fn, .arg = arg };
+}
+
+
+void cpu_io_on_out(IO8080 *io, uint8_t port, PortOutFn fn, void *arg) {
+    io->out[port] = (PortOut) { .fn = fn, .arg = arg };
 }
 
 
@@ -757,18 +918,45 @@ void cpu_service_interrupt(State8080 *state) {
     if (!state->int_enable || !state->int_pending || state->int_delay != 0) {
         return;
     }
+    // taking an interrupt disables further ones
+    // until the handler's EI
     state->int_pending = 0;
+    state->int_enable = 0;
     push_word(state, state->pc);
     jmp(state, state->int_type);
+    PROFILE_CALL(state->int_type);
 }
 
 
-int cpu_emulate_op(State8080 *state, IO8080 *io) {
-    cpu_service_interrupt(state);
+/**
+ * Executes the instruction at PC (after any interrupt
+ * has been taken)
+ */
+int emulate_op(State8080 *state, IO8080 *io) {
+    uint64_t cycles_old = state->cycles;
 
-    unsigned long cycles_old = state->cycles;
+    uint16_t op_pc = state->pc;
+    uint8_t *opcode = &state->memory[op_pc];
 
-    uint8_t *opcode = &state->memory[state->pc];
+    // a compiled block runs up to its last instruction
+    if (state->aot != NULL && op_pc < state->aot->size && state->aot->blocks[op_pc] != NULL) {
+        if (state->int_delay > 0) {
+            state->int_delay--;
+        }
+        state->aot->blocks[op_pc](state);
+        PROFILE_OP(op_pc, *opcode, state->cycles - cycles_old);
+        return state->cycles - cycles_old;
+    }
+
+    // fused sequences only exist in ROM
+    if (state->fused != NULL && op_pc < state->rom_size && state->fused->sites[op_pc]) {
+        if (state->int_delay > 0) {
+            state->int_delay--;
+        }
+        fusion_execute(state, state->fused->sites[op_pc]);
+        PROFILE_OP(op_pc, *opcode, state->cycles - cycles_old);
+        return state->cycles - cycles_old;
+    }
 
     state->cycles += cycles_lookup[*opcode];
 
@@ -947,41 +1135,7 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             state->h = next_byte(state);
             break;
         case 0x27:  // DAA - decimal adjust accumulator
-        // The eight-bit number in the accumulator
-        // is adjusted to form two four-bi 
-        // Binary-Coded-Decimal digits by the
-        // following process:
-        // 1. If the value of the least significant
-        // 4 bits of the accumulator is greater
-        // than 9 or if the AC flag is set, 6 is
-        // added to the accumulator.
-        // 2. If the value of the most significant
-        // 4 bits of the accumulator is now greater
-        // than 9, or if the CY flag is set, 6 is
-        // added to the most significant 4 bits
-        // of the accumulator.
-        {
-            uint8_t least4, most4;
-            uint16_t answer;
-            // 1.
-            least4 = state->a & 0xf;
-            if (least4 > 9 || state->cc.ac) {
-                answer = state->a + 6;
-                // set flags of intermediate result
-                set_arith_flags(state, answer, SET_ALL_FLAGS);
-                state->a = answer & 0xff;
-            }
-            // 2.
-            most4 = state->a >> 4;
-            if (most4 > 9 || state->cc.cy) {
-                most4 += 6;
-            }
-            // put most and least sig. 4 digits back
-            // together
-            answer = (most4 << 4) | least4;
-            set_arith_flags(state, answer, SET_ALL_FLAGS);
-            state->a = answer & 0xff;
-        }
+            daa(state);
             break;
         case 0x28: 
             unused_opcode(state, *opcode); 
@@ -1034,16 +1188,16 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             break;
         case 0x34:  // INR M
         {
-            uint16_t offset = hl_addr(state);
-            uint8_t *m_ptr = &state->memory[offset];
-            inr_x(state, m_ptr);
+            uint8_t m = get_hl_mem(state);
+            inr_x(state, &m);
+            set_hl_mem(state, m);
         }
             break;
         case 0x35:  // DCR M
         {
-            uint16_t offset = hl_addr(state);
-            uint8_t *m_ptr = &state->memory[offset];
-            dcr_x(state, m_ptr);
+            uint8_t m = get_hl_mem(state);
+            dcr_x(state, &m);
+            set_hl_mem(state, m);
         }
             break;
         case 0x36:  // (HL) <- byte 2
@@ -1255,8 +1409,7 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             break;
         case 0x76: 
             // HLT (Halt) instruction
-            printf("Halting execution...\n");
-            exit(0);
+            cpu_fault(state, CPU_FAULT_HALT, op_pc);
             break;
         case 0x77:
             set_hl_mem(state, state->a);
@@ -1327,8 +1480,9 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
         case 0x8d:  // ADC L
             adc_x(state, state->l);
             break;
-        case 0x8e:
+        case 0x8e:  // ADC M
             adc_x(state, get_hl_mem(state));
+            break;
         case 0x8f: 
             adc_x(state, state->a);
             break;
@@ -1539,8 +1693,7 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             jmp_cond(state, !state->cc.cy);
             break;
         case 0xd3:  // OUT D8
-            io->port = next_byte(state);
-            io->value = state->a;
+            cpu_port_out(io, next_byte(state), state->a);
             break;
         case 0xd4:
             call_cond(state, !state->cc.cy);
@@ -1565,7 +1718,7 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             jmp_cond(state, state->cc.cy);
             break;
         case 0xdb:  // IN D8
-            io->port = next_byte(state);
+            state->a = cpu_port_in(io, next_byte(state));
             break;
         case 0xdc:  // CC adr
             call_cond(state, state->cc.cy);
@@ -1590,15 +1743,7 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             jmp_cond(state, !state->cc.p);
             break;
         case 0xe3:  // XTHL
-        {
-            // L <-> (SP); H <-> (SP+1)
-            uint16_t sp = state->sp;
-            uint8_t *sp_h, *sp_l;
-            sp_h = &state->memory[sp + 1];
-            sp_l = &state->memory[sp]; 
-            swp_ptrs(&state->l, sp_l);
-            swp_ptrs(&state->h, sp_h);
-        }
+            xthl(state);
             break;
         case 0xe4:  // CPO adr
             call_cond(state, !state->cc.p);
@@ -1607,11 +1752,7 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             push_pair(state, state->h, state->l);
             break;
         case 0xe6:  // ANI D8
-        {
-            uint8_t answer = state->a & next_byte(state);
-            set_logic_flags(state, answer, SET_ALL_FLAGS);
-            state->a = answer & 0xff;
-        }
+            ana_x(state, next_byte(state));
             break;
         case 0xe7:  // RST 4
             call_adr(state, 0x20);
@@ -1653,29 +1794,9 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
         case 0xf0:  // RP
             // if positive, RET
             ret_cond(state, state->cc.s == 0);
+            break;
         case 0xf1:  // POP PSW
-        {
-            uint8_t sp_val, a_val;
-            pop_pair(state, &a_val, &sp_val);
-
-            // (CY) <- ((SP))O
-            state->cc.cy = sp_val & 1;
-
-            // (P) <- ((SP))2
-            state->cc.p = (sp_val & (1 << 2)) > 0;
-
-            // (AC) <- ((SP))4
-            state->cc.ac = (sp_val & (1 << 4)) > 0;
-
-            // (Z) <- ((SP))6
-            state->cc.z = (sp_val & (1 << 6)) > 0;
-
-            // (S) <- ((SP))7
-            state->cc.s = (sp_val & (1 << 7)) > 0;
-
-            // (A) <- ((SP) +1)
-            state->a = a_val;
-        }
+            pop_psw(state);
             break;
         case 0xf2:  // JP adr
             // if positive, JMP
@@ -1690,40 +1811,7 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             call_cond(state, !state->cc.s);
             break;
         case 0xf5:  // PUSH PSW
-        {
-            uint16_t sp_adr = state->sp;
-            
-            // ((SP) - 1) <- A
-            mem_write_byte(state, sp_adr - 1, state->a);
-
-            uint8_t sp_flags = 0;
-
-            // ((SP) - 2)0 <- CY
-            sp_flags |= state->cc.cy; 
-
-            // (........)1 <- 1
-            sp_flags |= (1 << 1);
-
-            // (........)2 <- P
-            sp_flags |= (state->cc.p << 2);
-
-            // (........)3 <- 0
- 
-            // (........)4 <- AC
-            sp_flags |= (state->cc.ac << 4);
-
-            // (........)5 <- 0
-
-            // (........)6 <- Z
-            sp_flags |= (state->cc.z << 6);
-
-            // (........)7 <- S
-            sp_flags |= (state->cc.s << 7);
-            mem_write_byte(state, sp_adr - 2, sp_flags);
-
-            // (SP) <- (SP) - 2
-            state->sp -= 2;
-        } 
+            push_psw(state);
             break;
         case 0xf6:  // ORI D8
         {
@@ -1768,7 +1856,20 @@ int cpu_emulate_op(State8080 *state, IO8080 *io) {
             break;
     }
 
-    unsigned long cycles_new = state->cycles;
+    uint64_t cycles_new = state->cycles;
+    PROFILE_OP(op_pc, *opcode, cycles_new - cycles_old);
 
     return cycles_new - cycles_old;
 }
+
+
+int cpu_emulate_op(State8080 *state, IO8080 *io) {
+    cpu_service_interrupt(state);
+    if (state->trace == NULL) {
+        return emulate_op(state, io);
+    }
+    TraceRecord *rec = trace_begin(state->trace, state);
+    int cycles = emulate_op(state, io);
+    rec->cycles = cycles;
+    return cycles;
+}
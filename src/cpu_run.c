@@ -0,0 +1,1191 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+#include "cpu_internal.h"
+
+/*
+ * Register-resident interpreter.
+ *
+ * `cpu_emulate_op` reads and writes every register through
+ * the State8080 pointer, so the compiler has to assume any
+ * store to guest memory may change them. Here the registers,
+ * flags, PC, SP, cycle counter and interrupt bits live in
+ * locals for a whole run and are written back only when it
+ * stops, at the end of the cycle budget (the machine's next
+ * interrupt), and around calls out of the loop: port
+ * handlers for IN/OUT and ROM writes. A fault (HLT or a
+ * ROM write) ends the run after its instruction.
+ *
+ * The result is instruction for instruction the same as
+ * `cpu_emulate_op`. Hooks that need to see
+ * every instruction (fusion, HLE, AOT, tracing, watchpoints,
+ * the profiler) make it fall back to `cpu_emulate_op`.
+ */
+
+
+// 1 if the byte has an even number of set bits
+#define P2(n) n, n ^ 1, n ^ 1, n
+#define P4(n) P2(n), P2(n ^ 1), P2(n ^ 1), P2(n)
+#define P6(n) P4(n), P4(n ^ 1), P4(n ^ 1), P4(n)
+
+static const uint8_t PARITY[256] = { P6(1), P6(0), P6(0), P6(1) };
+
+
+// Memory ---------------------------------
+
+#define RD(adr) mem[(uint16_t) (adr)]
+
+// ROM writes go through mem_write_byte, which drops
+// them and records the fault
+#define WR(adr, v) do { \
+    uint16_t o_ = (adr); \
+    uint8_t v_ = (v); \
+    if (o_ < rom_size) { \
+        mem_write_byte(state, o_, v_); \
+        faulted = 1; \
+    } else { \
+        mem[o_] = v_; \
+    } \
+} while (0)
+
+#define FETCH8 mem[pc++]
+#define FETCH16 (pc += 2, (uint16_t) (mem[(uint16_t) (pc - 2)] | (mem[(uint16_t) (pc - 1)] << 8)))
+
+
+// Registers ------------------------------
+
+#define BC ((uint16_t) ((b << 8) | c))
+#define DE ((uint16_t) ((d << 8) | e))
+#define HL ((uint16_t) ((h << 8) | l))
+
+#define SET_BC(v) do { uint16_t p_ = (v); b = p_ >> 8; c = p_; } while (0)
+#define SET_DE(v) do { uint16_t p_ = (v); d = p_ >> 8; e = p_; } while (0)
+#define SET_HL(v) do { uint16_t p_ = (v); h = p_ >> 8; l = p_; } while (0)
+
+#define LOAD() \
+    uint8_t a = state->a, b = state->b, c = state->c, d = state->d; \
+    uint8_t e = state->e, h = state->h, l = state->l; \
+    uint8_t fz = state->cc.z, fs = state->cc.s, fp = state->cc.p; \
+    uint8_t fcy = state->cc.cy, fac = state->cc.ac; \
+    uint16_t sp = state->sp, pc = state->pc; \
+    uint64_t cycles = state->cycles; \
+    uint8_t int_enable = state->int_enable; \
+    uint8_t int_pending = state->int_pending; \
+    uint8_t int_delay = state->int_delay
+
+#define SAVE() do { \
+    state->a = a; state->b = b; state->c = c; state->d = d; \
+    state->e = e; state->h = h; state->l = l; \
+    state->cc.z = fz; state->cc.s = fs; state->cc.p = fp; \
+    state->cc.cy = fcy; state->cc.ac = fac; \
+    state->sp = sp; state->pc = pc; \
+    state->cycles = cycles; \
+    state->int_enable = int_enable; \
+    state->int_pending = int_pending; \
+    state->int_delay = int_delay; \
+} while (0)
+
+
+// port handlers see the saved state and may request
+// an interrupt, so the interrupt bits are read back
+#define PORT_CALL(call) do { \
+    SAVE(); \
+    call; \
+    int_enable = state->int_enable; \
+    int_pending = state->int_pending; \
+    int_delay = state->int_delay; \
+} while (0)
+
+
+// Flags and arithmetic -------------------
+// (same flag rules as cpu.c: AC is the carry
+// out of bit 3)
+
+#define SZP(v) do { uint8_t szp_ = (v); fz = szp_ == 0; fs = szp_ >> 7; fp = PARITY[szp_]; } while (0)
+
+// XRA, ORA and their immediates clear AC
+#define LOGIC(v) do { SZP(v); fac = 0; fcy = 0; } while (0)
+
+// AC is the OR of bit 3 of the operands
+#define ANA(x) do { \
+    uint8_t x_ = (x); \
+    fac = ((a | x_) >> 3) & 1; \
+    a &= x_; \
+    SZP(a); \
+    fcy = 0; \
+} while (0)
+
+#define ADD(x, carry) do { \
+    uint8_t x_ = (x); \
+    uint16_t sum_ = a + x_ + (carry); \
+    SZP(sum_); \
+    fcy = sum_ > 0xff; \
+    fac = ((a ^ x_ ^ sum_) >> 4) & 1; \
+    a = sum_; \
+} while (0)
+
+#define SUB(x, carry) do { \
+    uint8_t nx_ = ~(x); \
+    uint8_t nc_ = !(carry); \
+    ADD(nx_, nc_); \
+    fcy = !fcy; \
+} while (0)
+
+// A + ~x + 1, like SUB
+#define CMP(x) do { \
+    uint8_t x_ = (x); \
+    uint8_t nx_ = ~x_; \
+    uint16_t r_ = a + nx_ + 1; \
+    SZP(r_); \
+    fac = ((a ^ nx_ ^ r_) >> 4) & 1; \
+    fcy = a < x_; \
+} while (0)
+
+#define INR(r) do { uint8_t n_ = (r) + 1; (r) = n_; SZP(n_); fac = (n_ & 0xf) == 0; } while (0)
+#define DCR(r) do { uint8_t n_ = (r) - 1; (r) = n_; SZP(n_); fac = (n_ & 0xf) != 0xf; } while (0)
+
+#define DAD(v) do { \
+    uint32_t r_ = HL + (v); \
+    SET_HL(r_); \
+    fcy = (r_ >> 16) & 1; \
+} while (0)
+
+// both corrections as one addition, as daa does;
+// CY is only ever set
+#define DAA() do { \
+    uint8_t cor_ = 0; \
+    uint8_t cy_ = fcy; \
+    if ((a & 0xf) > 9 || fac) { \
+        cor_ |= 0x06; \
+    } \
+    if ((a >> 4) > 9 || cy_ || ((a >> 4) == 9 && (a & 0xf) > 9)) { \
+        cor_ |= 0x60; \
+        cy_ = 1; \
+    } \
+    ADD(cor_, 0); \
+    fcy = cy_; \
+} while (0)
+
+
+// Stack ----------------------------------
+
+#define PUSH(w) do { \
+    uint16_t w_ = (w); \
+    sp -= 2; \
+    WR(sp + 1, w_ >> 8); \
+    WR(sp, w_ & 0xff); \
+} while (0)
+
+#define CALL(adr) do { uint16_t t_ = (adr); PUSH(pc); pc = t_; } while (0)
+
+#define RET() do { \
+    uint8_t lo_ = RD(sp); \
+    uint8_t hi_ = RD(sp + 1); \
+    sp += 2; \
+    pc = (hi_ << 8) | lo_; \
+} while (0)
+
+
+/**
+ * Runs through `cpu_emulate_op` so hooks see every
+ * instruction
+ */
+int run_hooked(State8080 *state, IO8080 *io, int budget) {
+    int cycles = 0;
+    while (cycles < budget && state->fault == CPU_FAULT_NONE) {
+        cycles += cpu_emulate_op(state, io);
+    }
+    return cycles;
+}
+
+
+int run_fast(State8080 *state, IO8080 *io, int budget) {
+    uint8_t *mem = state->memory;
+    uint16_t rom_size = state->rom_size;
+    LOAD();
+    uint64_t start = cycles;
+    int faulted = state->fault != CPU_FAULT_NONE;
+
+    while (cycles - start < (uint64_t) budget && !faulted) {
+        if (int_pending && int_enable && int_delay == 0) {
+            int_pending = 0;
+            int_enable = 0;
+            PUSH(pc);
+            pc = state->int_type;
+        }
+
+        uint8_t op = mem[pc];
+        cycles += cycles_lookup[op];
+
+        // interrupts are not serviced until
+        // the next instruction
+        if (int_delay > 0) {
+            int_delay--;
+        }
+        pc++;
+
+        switch (op) {
+            case 0x00:  // NOP
+                break;
+            case 0x01:  // LXI B,D16
+                c = FETCH8;
+                b = FETCH8;
+                break;
+            case 0x02:  // STAX B
+                WR(BC, a);
+                break;
+            case 0x03:  // INX B
+                SET_BC(BC + 1);
+                break;
+            case 0x04:  // INR B
+                INR(b);
+                break;
+            case 0x05:  // DCR B
+                DCR(b);
+                break;
+            case 0x06:  // MVI B,D8
+                b = FETCH8;
+                break;
+            case 0x07:  // RLC
+                fcy = a >> 7;
+                a = (a << 1) | fcy;
+                break;
+            case 0x08:  // unused
+                break;
+            case 0x09:  // DAD B
+                DAD(BC);
+                break;
+            case 0x0a:  // LDAX B
+                a = RD(BC);
+                break;
+            case 0x0b:  // DCX B
+                SET_BC(BC - 1);
+                break;
+            case 0x0c:  // INR C
+                INR(c);
+                break;
+            case 0x0d:  // DCR C
+                DCR(c);
+                break;
+            case 0x0e:  // MVI C,D8
+                c = FETCH8;
+                break;
+            case 0x0f:  // RRC
+                fcy = a & 1;
+                a = (a >> 1) | (fcy << 7);
+                break;
+            case 0x10:  // unused
+                break;
+            case 0x11:  // LXI D,D16
+                e = FETCH8;
+                d = FETCH8;
+                break;
+            case 0x12:  // STAX D
+                WR(DE, a);
+                break;
+            case 0x13:  // INX D
+                SET_DE(DE + 1);
+                break;
+            case 0x14:  // INR D
+                INR(d);
+                break;
+            case 0x15:  // DCR D
+                DCR(d);
+                break;
+            case 0x16:  // MVI D,D8
+                d = FETCH8;
+                break;
+            case 0x17:  // RAL
+            {
+                uint8_t prev_cy = fcy;
+                fcy = a >> 7;
+                a = (a << 1) | prev_cy;
+            }
+                break;
+            case 0x18:  // unused
+                break;
+            case 0x19:  // DAD D
+                DAD(DE);
+                break;
+            case 0x1a:  // LDAX D
+                a = RD(DE);
+                break;
+            case 0x1b:  // DCX D
+                SET_DE(DE - 1);
+                break;
+            case 0x1c:  // INR E
+                INR(e);
+                break;
+            case 0x1d:  // DCR E
+                DCR(e);
+                break;
+            case 0x1e:  // MVI E,D8
+                e = FETCH8;
+                break;
+            case 0x1f:  // RAR
+            {
+                uint8_t prev_cy = fcy;
+                fcy = a & 1;
+                a = (a >> 1) | (prev_cy << 7);
+            }
+                break;
+            case 0x20:  // unused
+                break;
+            case 0x21:  // LXI H,D16
+                l = FETCH8;
+                h = FETCH8;
+                break;
+            case 0x22:  // SHLD adr
+            {
+                uint16_t adr = FETCH16;
+                WR(adr, l);
+                WR(adr + 1, h);
+            }
+                break;
+            case 0x23:  // INX H
+                SET_HL(HL + 1);
+                break;
+            case 0x24:  // INR H
+                INR(h);
+                break;
+            case 0x25:  // DCR H
+                DCR(h);
+                break;
+            case 0x26:  // MVI H,D8
+                h = FETCH8;
+                break;
+            case 0x27:  // DAA
+                DAA();
+                break;
+            case 0x28:  // unused
+                break;
+            case 0x29:  // DAD H
+                DAD(HL);
+                break;
+            case 0x2a:  // LHLD adr
+            {
+                uint16_t adr = FETCH16;
+                l = RD(adr);
+                h = RD(adr + 1);
+            }
+                break;
+            case 0x2b:  // DCX H
+                SET_HL(HL - 1);
+                break;
+            case 0x2c:  // INR L
+                INR(l);
+                break;
+            case 0x2d:  // DCR L
+                DCR(l);
+                break;
+            case 0x2e:  // MVI L,D8
+                l = FETCH8;
+                break;
+            case 0x2f:  // CMA
+                a = ~a;
+                break;
+            case 0x30:  // unused
+                break;
+            case 0x31:  // LXI SP,D16
+                sp = FETCH16;
+                break;
+            case 0x32:  // STA adr
+                WR(FETCH16, a);
+                break;
+            case 0x33:  // INX SP
+                sp++;
+                break;
+            case 0x34:  // INR M
+            {
+                uint8_t m = RD(HL);
+                INR(m);
+                WR(HL, m);
+            }
+                break;
+            case 0x35:  // DCR M
+            {
+                uint8_t m = RD(HL);
+                DCR(m);
+                WR(HL, m);
+            }
+                break;
+            case 0x36:  // MVI M,D8
+                WR(HL, FETCH8);
+                break;
+            case 0x37:  // STC
+                fcy = 1;
+                break;
+            case 0x38:  // unused
+                break;
+            case 0x39:  // DAD SP
+                DAD(sp);
+                break;
+            case 0x3a:  // LDA adr
+                a = RD(FETCH16);
+                break;
+            case 0x3b:  // DCX SP
+                sp--;
+                break;
+            case 0x3c:  // INR A
+                INR(a);
+                break;
+            case 0x3d:  // DCR A
+                DCR(a);
+                break;
+            case 0x3e:  // MVI A,D8
+                a = FETCH8;
+                break;
+            case 0x3f:  // CMC
+                fcy = !fcy;
+                break;
+            case 0x40:  // MOV B,B
+                break;
+            case 0x41:  // MOV B,C
+                b = c;
+                break;
+            case 0x42:  // MOV B,D
+                b = d;
+                break;
+            case 0x43:  // MOV B,E
+                b = e;
+                break;
+            case 0x44:  // MOV B,H
+                b = h;
+                break;
+            case 0x45:  // MOV B,L
+                b = l;
+                break;
+            case 0x46:  // MOV B,M
+                b = RD(HL);
+                break;
+            case 0x47:  // MOV B,A
+                b = a;
+                break;
+            case 0x48:  // MOV C,B
+                c = b;
+                break;
+            case 0x49:  // MOV C,C
+                break;
+            case 0x4a:  // MOV C,D
+                c = d;
+                break;
+            case 0x4b:  // MOV C,E
+                c = e;
+                break;
+            case 0x4c:  // MOV C,H
+                c = h;
+                break;
+            case 0x4d:  // MOV C,L
+                c = l;
+                break;
+            case 0x4e:  // MOV C,M
+                c = RD(HL);
+                break;
+            case 0x4f:  // MOV C,A
+                c = a;
+                break;
+            case 0x50:  // MOV D,B
+                d = b;
+                break;
+            case 0x51:  // MOV D,C
+                d = c;
+                break;
+            case 0x52:  // MOV D,D
+                break;
+            case 0x53:  // MOV D,E
+                d = e;
+                break;
+            case 0x54:  // MOV D,H
+                d = h;
+                break;
+            case 0x55:  // MOV D,L
+                d = l;
+                break;
+            case 0x56:  // MOV D,M
+                d = RD(HL);
+                break;
+            case 0x57:  // MOV D,A
+                d = a;
+                break;
+            case 0x58:  // MOV E,B
+                e = b;
+                break;
+            case 0x59:  // MOV E,C
+                e = c;
+                break;
+            case 0x5a:  // MOV E,D
+                e = d;
+                break;
+            case 0x5b:  // MOV E,E
+                break;
+            case 0x5c:  // MOV E,H
+                e = h;
+                break;
+            case 0x5d:  // MOV E,L
+                e = l;
+                break;
+            case 0x5e:  // MOV E,M
+                e = RD(HL);
+                break;
+            case 0x5f:  // MOV E,A
+                e = a;
+                break;
+            case 0x60:  // MOV H,B
+                h = b;
+                break;
+            case 0x61:  // MOV H,C
+                h = c;
+                break;
+            case 0x62:  // MOV H,D
+                h = d;
+                break;
+            case 0x63:  // MOV H,E
+                h = e;
+                break;
+            case 0x64:  // MOV H,H
+                break;
+            case 0x65:  // MOV H,L
+                h = l;
+                break;
+            case 0x66:  // MOV H,M
+                h = RD(HL);
+                break;
+            case 0x67:  // MOV H,A
+                h = a;
+                break;
+            case 0x68:  // MOV L,B
+                l = b;
+                break;
+            case 0x69:  // MOV L,C
+                l = c;
+                break;
+            case 0x6a:  // MOV L,D
+                l = d;
+                break;
+            case 0x6b:  // MOV L,E
+                l = e;
+                break;
+            case 0x6c:  // MOV L,H
+                l = h;
+                break;
+            case 0x6d:  // MOV L,L
+                break;
+            case 0x6e:  // MOV L,M
+                l = RD(HL);
+                break;
+            case 0x6f:  // MOV L,A
+                l = a;
+                break;
+            case 0x70:  // MOV M,B
+                WR(HL, b);
+                break;
+            case 0x71:  // MOV M,C
+                WR(HL, c);
+                break;
+            case 0x72:  // MOV M,D
+                WR(HL, d);
+                break;
+            case 0x73:  // MOV M,E
+                WR(HL, e);
+                break;
+            case 0x74:  // MOV M,H
+                WR(HL, h);
+                break;
+            case 0x75:  // MOV M,L
+                WR(HL, l);
+                break;
+            case 0x76:  // HLT
+                cpu_fault(state, CPU_FAULT_HALT, pc - 1);
+                faulted = 1;
+                break;
+            case 0x77:  // MOV M,A
+                WR(HL, a);
+                break;
+            case 0x78:  // MOV A,B
+                a = b;
+                break;
+            case 0x79:  // MOV A,C
+                a = c;
+                break;
+            case 0x7a:  // MOV A,D
+                a = d;
+                break;
+            case 0x7b:  // MOV A,E
+                a = e;
+                break;
+            case 0x7c:  // MOV A,H
+                a = h;
+                break;
+            case 0x7d:  // MOV A,L
+                a = l;
+                break;
+            case 0x7e:  // MOV A,M
+                a = RD(HL);
+                break;
+            case 0x7f:  // MOV A,A
+                break;
+            case 0x80:  // ADD B
+                ADD(b, 0);
+                break;
+            case 0x81:  // ADD C
+                ADD(c, 0);
+                break;
+            case 0x82:  // ADD D
+                ADD(d, 0);
+                break;
+            case 0x83:  // ADD E
+                ADD(e, 0);
+                break;
+            case 0x84:  // ADD H
+                ADD(h, 0);
+                break;
+            case 0x85:  // ADD L
+                ADD(l, 0);
+                break;
+            case 0x86:  // ADD M
+                ADD(RD(HL), 0);
+                break;
+            case 0x87:  // ADD A
+                ADD(a, 0);
+                break;
+            case 0x88:  // ADC B
+                ADD(b, fcy);
+                break;
+            case 0x89:  // ADC C
+                ADD(c, fcy);
+                break;
+            case 0x8a:  // ADC D
+                ADD(d, fcy);
+                break;
+            case 0x8b:  // ADC E
+                ADD(e, fcy);
+                break;
+            case 0x8c:  // ADC H
+                ADD(h, fcy);
+                break;
+            case 0x8d:  // ADC L
+                ADD(l, fcy);
+                break;
+            case 0x8e:  // ADC M
+                ADD(RD(HL), fcy);
+                break;
+            case 0x8f:  // ADC A
+                ADD(a, fcy);
+                break;
+            case 0x90:  // SUB B
+                SUB(b, 0);
+                break;
+            case 0x91:  // SUB C
+                SUB(c, 0);
+                break;
+            case 0x92:  // SUB D
+                SUB(d, 0);
+                break;
+            case 0x93:  // SUB E
+                SUB(e, 0);
+                break;
+            case 0x94:  // SUB H
+                SUB(h, 0);
+                break;
+            case 0x95:  // SUB L
+                SUB(l, 0);
+                break;
+            case 0x96:  // SUB M
+                SUB(RD(HL), 0);
+                break;
+            case 0x97:  // SUB A
+                SUB(a, 0);
+                break;
+            case 0x98:  // SBB B
+                SUB(b, fcy);
+                break;
+            case 0x99:  // SBB C
+                SUB(c, fcy);
+                break;
+            case 0x9a:  // SBB D
+                SUB(d, fcy);
+                break;
+            case 0x9b:  // SBB E
+                SUB(e, fcy);
+                break;
+            case 0x9c:  // SBB H
+                SUB(h, fcy);
+                break;
+            case 0x9d:  // SBB L
+                SUB(l, fcy);
+                break;
+            case 0x9e:  // SBB M
+                SUB(RD(HL), fcy);
+                break;
+            case 0x9f:  // SBB A
+                SUB(a, fcy);
+                break;
+            case 0xa0:  // ANA B
+                ANA(b);
+                break;
+            case 0xa1:  // ANA C
+                ANA(c);
+                break;
+            case 0xa2:  // ANA D
+                ANA(d);
+                break;
+            case 0xa3:  // ANA E
+                ANA(e);
+                break;
+            case 0xa4:  // ANA H
+                ANA(h);
+                break;
+            case 0xa5:  // ANA L
+                ANA(l);
+                break;
+            case 0xa6:  // ANA M
+                ANA(RD(HL));
+                break;
+            case 0xa7:  // ANA A
+                ANA(a);
+                break;
+            case 0xa8:  // XRA B
+                a ^= b;
+                LOGIC(a);
+                break;
+            case 0xa9:  // XRA C
+                a ^= c;
+                LOGIC(a);
+                break;
+            case 0xaa:  // XRA D
+                a ^= d;
+                LOGIC(a);
+                break;
+            case 0xab:  // XRA E
+                a ^= e;
+                LOGIC(a);
+                break;
+            case 0xac:  // XRA H
+                a ^= h;
+                LOGIC(a);
+                break;
+            case 0xad:  // XRA L
+                a ^= l;
+                LOGIC(a);
+                break;
+            case 0xae:  // XRA M
+                a ^= RD(HL);
+                LOGIC(a);
+                break;
+            case 0xaf:  // XRA A
+                a ^= a;
+                LOGIC(a);
+                break;
+            case 0xb0:  // ORA B
+                a |= b;
+                LOGIC(a);
+                break;
+            case 0xb1:  // ORA C
+                a |= c;
+                LOGIC(a);
+                break;
+            case 0xb2:  // ORA D
+                a |= d;
+                LOGIC(a);
+                break;
+            case 0xb3:  // ORA E
+                a |= e;
+                LOGIC(a);
+                break;
+            case 0xb4:  // ORA H
+                a |= h;
+                LOGIC(a);
+                break;
+            case 0xb5:  // ORA L
+                a |= l;
+                LOGIC(a);
+                break;
+            case 0xb6:  // ORA M
+                a |= RD(HL);
+                LOGIC(a);
+                break;
+            case 0xb7:  // ORA A
+                a |= a;
+                LOGIC(a);
+                break;
+            case 0xb8:  // CMP B
+                CMP(b);
+                break;
+            case 0xb9:  // CMP C
+                CMP(c);
+                break;
+            case 0xba:  // CMP D
+                CMP(d);
+                break;
+            case 0xbb:  // CMP E
+                CMP(e);
+                break;
+            case 0xbc:  // CMP H
+                CMP(h);
+                break;
+            case 0xbd:  // CMP L
+                CMP(l);
+                break;
+            case 0xbe:  // CMP M
+                CMP(RD(HL));
+                break;
+            case 0xbf:  // CMP A
+                CMP(a);
+                break;
+            case 0xc0:  // RNZ
+                if (!fz) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xc1:  // POP B
+                c = RD(sp);
+                b = RD(sp + 1);
+                sp += 2;
+                break;
+            case 0xc2:  // JNZ adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fz) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xc3:  // JMP adr
+                pc = FETCH16;
+                break;
+            case 0xc4:  // CNZ adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fz) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xc5:  // PUSH B
+                PUSH((b << 8) | c);
+                break;
+            case 0xc6:  // ADI D8
+                ADD(FETCH8, 0);
+                break;
+            case 0xc7:  // RST 0
+                CALL(0x00);
+                break;
+            case 0xc8:  // RZ
+                if (fz) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xc9:  // RET
+                RET();
+                break;
+            case 0xca:  // JZ adr
+            {
+                uint16_t adr = FETCH16;
+                if (fz) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xcb:  // unused
+                break;
+            case 0xcc:  // CZ adr
+            {
+                uint16_t adr = FETCH16;
+                if (fz) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xcd:  // CALL adr
+                CALL(FETCH16);
+                break;
+            case 0xce:  // ACI D8
+                ADD(FETCH8, fcy);
+                break;
+            case 0xcf:  // RST 1
+                CALL(0x08);
+                break;
+            case 0xd0:  // RNC
+                if (!fcy) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xd1:  // POP D
+                e = RD(sp);
+                d = RD(sp + 1);
+                sp += 2;
+                break;
+            case 0xd2:  // JNC adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fcy) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xd3:  // OUT D8
+            {
+                uint8_t port = FETCH8;
+                PORT_CALL(cpu_port_out(io, port, a));
+            }
+                break;
+            case 0xd4:  // CNC adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fcy) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xd5:  // PUSH D
+                PUSH((d << 8) | e);
+                break;
+            case 0xd6:  // SUI D8
+                SUB(FETCH8, 0);
+                break;
+            case 0xd7:  // RST 2
+                CALL(0x10);
+                break;
+            case 0xd8:  // RC
+                if (fcy) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xd9:  // unused
+                break;
+            case 0xda:  // JC adr
+            {
+                uint16_t adr = FETCH16;
+                if (fcy) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xdb:  // IN D8
+            {
+                uint8_t port = FETCH8;
+                PORT_CALL(a = cpu_port_in(io, port));
+            }
+                break;
+            case 0xdc:  // CC adr
+            {
+                uint16_t adr = FETCH16;
+                if (fcy) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xdd:  // unused
+                break;
+            case 0xde:  // SBI D8
+                SUB(FETCH8, fcy);
+                break;
+            case 0xdf:  // RST 3
+                CALL(0x18);
+                break;
+            case 0xe0:  // RPO
+                if (!fp) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xe1:  // POP H
+                l = RD(sp);
+                h = RD(sp + 1);
+                sp += 2;
+                break;
+            case 0xe2:  // JPO adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fp) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xe3:  // XTHL
+            {
+                uint8_t lo = RD(sp);
+                uint8_t hi = RD(sp + 1);
+                WR(sp, l);
+                WR(sp + 1, h);
+                l = lo;
+                h = hi;
+            }
+                break;
+            case 0xe4:  // CPO adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fp) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xe5:  // PUSH H
+                PUSH((h << 8) | l);
+                break;
+            case 0xe6:  // ANI D8
+                ANA(FETCH8);
+                break;
+            case 0xe7:  // RST 4
+                CALL(0x20);
+                break;
+            case 0xe8:  // RPE
+                if (fp) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xe9:  // PCHL
+                pc = HL;
+                break;
+            case 0xea:  // JPE adr
+            {
+                uint16_t adr = FETCH16;
+                if (fp) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xeb:  // XCHG
+            {
+                uint8_t t = h;
+                h = d;
+                d = t;
+                t = l;
+                l = e;
+                e = t;
+            }
+                break;
+            case 0xec:  // CPE adr
+            {
+                uint16_t adr = FETCH16;
+                if (fp) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xed:  // unused
+                break;
+            case 0xee:  // XRI D8
+                a ^= FETCH8;
+                LOGIC(a);
+                break;
+            case 0xef:  // RST 5
+                CALL(0x28);
+                break;
+            case 0xf0:  // RP
+                if (!fs) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xf1:  // POP PSW
+            {
+                uint8_t f = RD(sp);
+                a = RD(sp + 1);
+                sp += 2;
+                fcy = f & 1;
+                fp = (f >> 2) & 1;
+                fac = (f >> 4) & 1;
+                fz = (f >> 6) & 1;
+                fs = f >> 7;
+            }
+                break;
+            case 0xf2:  // JP adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fs) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xf3:  // DI
+                int_enable = 0;
+                break;
+            case 0xf4:  // CP adr
+            {
+                uint16_t adr = FETCH16;
+                if (!fs) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xf5:  // PUSH PSW
+                WR(sp - 1, a);
+                WR(sp - 2, fcy | (1 << 1) | (fp << 2) | (fac << 4) | (fz << 6) | (fs << 7));
+                sp -= 2;
+                break;
+            case 0xf6:  // ORI D8
+                a |= FETCH8;
+                LOGIC(a);
+                break;
+            case 0xf7:  // RST 6
+                CALL(0x30);
+                break;
+            case 0xf8:  // RM
+                if (fs) {
+                    RET();
+                    cycles += 6;
+                }
+                break;
+            case 0xf9:  // SPHL
+                sp = HL;
+                break;
+            case 0xfa:  // JM adr
+            {
+                uint16_t adr = FETCH16;
+                if (fs) {
+                    pc = adr;
+                }
+            }
+                break;
+            case 0xfb:  // EI
+                int_enable = 1;
+                int_delay = 1;
+                break;
+            case 0xfc:  // CM adr
+            {
+                uint16_t adr = FETCH16;
+                if (fs) {
+                    CALL(adr);
+                    cycles += 6;
+                }
+            }
+                break;
+            case 0xfd:  // unused
+                break;
+            case 0xfe:  // CPI D8
+                CMP(FETCH8);
+                break;
+            case 0xff:  // RST 7
+                CALL(0x38);
+                break;
+        }
+    }
+
+    SAVE();
+    return cycles - start;
+}
+
+
+int cpu_run(State8080 *state, IO8080 *io, int budget) {
+#ifndef PROFILE
+    if (state->aot == NULL && state->fused == NULL && state->hle == NULL &&
+        state->trace == NULL && state->watch == NULL) {
+        return run_fast(state, io, budget);
+    }
+#endif
+    return run_hooked(state, io, budget);
+}
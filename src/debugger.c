@@ -0,0 +1,695 @@
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "debugger.h"
+#include "disassembler.h"
+#include "machine.h"
+
+
+// instructions between checks for input while running
+#define DEBUG_POLL_STEPS 4096
+
+// cycles between checks for input while running with
+// nothing to check
+#define DEBUG_POLL_CYCLES 16384
+
+#define LINE_SIZE 128
+#define MAX_ARGS 8
+
+// bytes per line of a memory dump
+#define DUMP_COLS 16
+
+// instructions shown by `u` without a count
+#define LIST_DEFAULT 8
+
+
+static const char *HELP =
+    "b ADR [if REG OP VALUE]  break at ADR, optionally only if the condition holds\n"
+    "                         (REG: a b c d e h l bc de hl sp, OP: == != < <= > >=)\n"
+    "w ADR [LEN] [r|w|rw]     watch LEN bytes from ADR (default: 1 byte, writes)\n"
+    "d ID                     delete a breakpoint or watchpoint\n"
+    "l                        list breakpoints and watchpoints\n"
+    "s [N]                    step N instructions\n"
+    "c                        continue until a breakpoint, watchpoint or input\n"
+    "f                        run until the current subroutine returns\n"
+    "r                        show registers\n"
+    "x ADR [LEN]              dump memory\n"
+    "u [ADR] [N]              disassemble\n"
+    "q                        quit\n"
+    "Numbers are hex; an empty line repeats the last command.\n";
+
+
+static const char *REG_NAMES[] = {
+    [REG_A] = "a", [REG_B] = "b", [REG_C] = "c", [REG_D] = "d",
+    [REG_E] = "e", [REG_H] = "h", [REG_L] = "l",
+    [REG_BC] = "bc", [REG_DE] = "de", [REG_HL] = "hl", [REG_SP] = "sp"
+};
+
+static const char *CMP_NAMES[] = {
+    [CMP_EQ] = "==", [CMP_NE] = "!=", [CMP_LT] = "<",
+    [CMP_LE] = "<=", [CMP_GT] = ">", [CMP_GE] = ">="
+};
+
+
+void debugger_attach(Debugger *dbg, Machine *machine) {
+    *dbg = (Debugger) {
+        .machine = machine,
+        .breakpoint_count = 0,
+        .watchpoint_count = 0,
+        .next_id = 1,
+        .breakpoint_map = calloc(CPU_MEM_SIZE, sizeof(uint8_t)),
+        .watch_pages = {0},
+        .stop = STOP_NONE,
+        .interrupt_fd = -1,
+        .on_stop = NULL,
+        .on_stop_arg = NULL,
+        .steps = 0
+    };
+    machine->cpu_state->debugger = dbg;
+    machine->cpu_state->watch = NULL;
+}
+
+
+void debugger_detach(Debugger *dbg) {
+    State8080 *state = dbg->machine->cpu_state;
+    state->debugger = NULL;
+    state->watch = NULL;
+
+    free(dbg->breakpoint_map);
+    dbg->breakpoint_map = NULL;
+    dbg->breakpoint_count = 0;
+    dbg->watchpoint_count = 0;
+}
+
+
+/**
+ * Recomputes the per-page watch flags and points the
+ * CPU at them, or at nothing without watchpoints
+ */
+void update_watch_pages(Debugger *dbg) {
+    memset(dbg->watch_pages, 0, sizeof(dbg->watch_pages));
+    for (int i = 0; i < dbg->watchpoint_count; i++) {
+        Watchpoint *wp = &dbg->watchpoints[i];
+        uint32_t last = wp->start + wp->len - 1;
+        for (uint32_t page = wp->start >> DEBUG_PAGE_SHIFT; page <= last >> DEBUG_PAGE_SHIFT; page++) {
+            dbg->watch_pages[page] |= wp->access;
+        }
+    }
+    dbg->machine->cpu_state->watch = dbg->watchpoint_count ? dbg->watch_pages : NULL;
+}
+
+
+int debugger_add_breakpoint(Debugger *dbg, uint16_t adr, DebugReg reg, DebugCmp cmp, uint16_t value) {
+    if (dbg->breakpoint_count == DEBUG_MAX_POINTS) {
+        return -1;
+    }
+    dbg->breakpoints[dbg->breakpoint_count++] = (Breakpoint) {
+        .id = dbg->next_id,
+        .adr = adr,
+        .reg = reg,
+        .cmp = cmp,
+        .value = value,
+        .hits = 0
+    };
+    dbg->breakpoint_map[adr]++;
+    return dbg->next_id++;
+}
+
+
+int debugger_add_watchpoint(Debugger *dbg, uint16_t start, uint32_t len, uint8_t access) {
+    if (dbg->watchpoint_count == DEBUG_MAX_POINTS || len == 0 || access == 0) {
+        return -1;
+    }
+    // stay inside the address space
+    if (start + len > CPU_MEM_SIZE) {
+        len = CPU_MEM_SIZE - start;
+    }
+    dbg->watchpoints[dbg->watchpoint_count++] = (Watchpoint) {
+        .id = dbg->next_id,
+        .start = start,
+        .len = len,
+        .access = access,
+        .hits = 0
+    };
+    update_watch_pages(dbg);
+    return dbg->next_id++;
+}
+
+
+int debugger_delete(Debugger *dbg, int id) {
+    for (int i = 0; i < dbg->breakpoint_count; i++) {
+        if (dbg->breakpoints[i].id == id) {
+            dbg->breakpoint_map[dbg->breakpoints[i].adr]--;
+            dbg->breakpoint_count--;
+            memmove(&dbg->breakpoints[i], &dbg->breakpoints[i + 1],
+                (dbg->breakpoint_count - i) * sizeof(Breakpoint));
+            return 0;
+        }
+    }
+    for (int i = 0; i < dbg->watchpoint_count; i++) {
+        if (dbg->watchpoints[i].id == id) {
+            dbg->watchpoint_count--;
+            memmove(&dbg->watchpoints[i], &dbg->watchpoints[i + 1],
+                (dbg->watchpoint_count - i) * sizeof(Watchpoint));
+            update_watch_pages(dbg);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+void debugger_access(Debugger *dbg, uint16_t adr, uint8_t value, uint8_t access) {
+    // report the first access of an instruction
+    if (dbg->stop != STOP_NONE) {
+        return;
+    }
+    for (int i = 0; i < dbg->watchpoint_count; i++) {
+        Watchpoint *wp = &dbg->watchpoints[i];
+        if ((wp->access & access) && adr >= wp->start && adr - wp->start < wp->len) {
+            wp->hits++;
+            dbg->stop = STOP_WATCHPOINT;
+            dbg->hit_id = wp->id;
+            dbg->hit_adr = adr;
+            dbg->hit_value = value;
+            dbg->hit_access = access;
+            return;
+        }
+    }
+}
+
+
+uint16_t reg_value(State8080 *state, DebugReg reg) {
+    switch (reg) {
+        case REG_A: return state->a;
+        case REG_B: return state->b;
+        case REG_C: return state->c;
+        case REG_D: return state->d;
+        case REG_E: return state->e;
+        case REG_H: return state->h;
+        case REG_L: return state->l;
+        case REG_BC: return (state->b << 8) | state->c;
+        case REG_DE: return (state->d << 8) | state->e;
+        case REG_HL: return (state->h << 8) | state->l;
+        case REG_SP: return state->sp;
+        default: return 0;
+    }
+}
+
+
+int condition_holds(State8080 *state, Breakpoint *bp) {
+    if (bp->reg == REG_NONE) {
+        return 1;
+    }
+    uint16_t v = reg_value(state, bp->reg);
+    switch (bp->cmp) {
+        case CMP_EQ: return v == bp->value;
+        case CMP_NE: return v != bp->value;
+        case CMP_LT: return v < bp->value;
+        case CMP_LE: return v <= bp->value;
+        case CMP_GT: return v > bp->value;
+        case CMP_GE: return v >= bp->value;
+        default: return 0;
+    }
+}
+
+
+/**
+ * Returns 1 if one of the breakpoints at `adr` triggers
+ */
+int breakpoint_hit(Debugger *dbg, uint16_t adr) {
+    State8080 *state = dbg->machine->cpu_state;
+    for (int i = 0; i < dbg->breakpoint_count; i++) {
+        Breakpoint *bp = &dbg->breakpoints[i];
+        if (bp->adr == adr && condition_holds(state, bp)) {
+            bp->hits++;
+            dbg->hit_id = bp->id;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int is_return(uint8_t opcode) {
+    // RET, its undocumented alias and the conditional returns
+    return opcode == 0xc9 || opcode == 0xd9 || (opcode & 0xc7) == 0xc0;
+}
+
+
+int input_pending(Debugger *dbg) {
+    if (dbg->interrupt_fd < 0) {
+        return 0;
+    }
+    struct pollfd pfd = { .fd = dbg->interrupt_fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+
+StopReason stopped(Debugger *dbg) {
+    if (dbg->on_stop != NULL) {
+        dbg->on_stop(dbg->on_stop_arg);
+    }
+    return dbg->stop;
+}
+
+
+/**
+ * Executes up to `count` instructions (0 for no limit),
+ * stopping at breakpoints, watchpoints, faults, input and,
+ * if `frame` is set, a return above `frame_sp`
+ */
+StopReason run_checked(Debugger *dbg, unsigned long count, int frame, uint16_t frame_sp) {
+    State8080 *state = dbg->machine->cpu_state;
+
+    // every instruction has to be a step of its own
+    struct aot_table_t *aot = state->aot;
+    struct fusion_table_t *fused = state->fused;
+    state->aot = NULL;
+    state->fused = NULL;
+
+    unsigned long n = 0;
+    dbg->stop = STOP_NONE;
+    while (dbg->stop == STOP_NONE) {
+        uint8_t opcode = cpu_curr_op(state);
+        machine_step(dbg->machine);
+        dbg->steps++;
+        n++;
+
+        if (dbg->stop != STOP_NONE) {
+            // watchpoint
+            break;
+        }
+        if (state->fault != CPU_FAULT_NONE) {
+            dbg->stop = STOP_FAULT;
+        } else if (frame && is_return(opcode) && state->sp > frame_sp) {
+            dbg->stop = STOP_RETURN;
+        } else if (dbg->breakpoint_map[state->pc] && breakpoint_hit(dbg, state->pc)) {
+            dbg->stop = STOP_BREAKPOINT;
+        } else if (n == count) {
+            dbg->stop = STOP_STEP;
+        } else if (n % DEBUG_POLL_STEPS == 0 && input_pending(dbg)) {
+            dbg->stop = STOP_INTERRUPTED;
+        }
+    }
+    state->aot = aot;
+    state->fused = fused;
+    return stopped(dbg);
+}
+
+
+StopReason debugger_step(Debugger *dbg, unsigned long count) {
+    return run_checked(dbg, count ? count : 1, 0, 0);
+}
+
+
+StopReason debugger_continue(Debugger *dbg) {
+    if (dbg->breakpoint_count || dbg->watchpoint_count) {
+        return run_checked(dbg, 0, 0, 0);
+    }
+
+    // nothing to check between instructions: run in
+    // slices, with compiled blocks and fused sequences
+    Machine *machine = dbg->machine;
+    dbg->stop = STOP_NONE;
+    while (dbg->stop == STOP_NONE) {
+        if (machine_run_to(machine, machine->cycles + DEBUG_POLL_CYCLES)) {
+            dbg->stop = STOP_FAULT;
+        } else if (input_pending(dbg)) {
+            dbg->stop = STOP_INTERRUPTED;
+        }
+    }
+    return stopped(dbg);
+}
+
+
+StopReason debugger_finish(Debugger *dbg) {
+    return run_checked(dbg, 0, 1, dbg->machine->cpu_state->sp);
+}
+
+
+// Command interface -----------------------
+
+
+/**
+ * Parses a hex number (with or without 0x). Returns 0
+ * on success.
+ */
+int parse_number(const char *s, unsigned long max, unsigned long *out) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 16);
+    if (*s == '\0' || *end != '\0' || v > max) {
+        return 1;
+    }
+    *out = v;
+    return 0;
+}
+
+
+DebugReg parse_reg(const char *s) {
+    for (int r = REG_A; r <= REG_SP; r++) {
+        if (strcmp(s, REG_NAMES[r]) == 0) {
+            return r;
+        }
+    }
+    return REG_NONE;
+}
+
+
+int parse_cmp(const char *s) {
+    for (int c = CMP_EQ; c <= CMP_GE; c++) {
+        if (strcmp(s, CMP_NAMES[c]) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+
+int parse_access(const char *s) {
+    if (strcmp(s, "r") == 0) {
+        return WATCH_READ;
+    }
+    if (strcmp(s, "w") == 0) {
+        return WATCH_WRITE;
+    }
+    if (strcmp(s, "rw") == 0) {
+        return WATCH_READ | WATCH_WRITE;
+    }
+    return 0;
+}
+
+
+/**
+ * Prints the instruction at `pc` and returns its length
+ */
+int print_instr(uint8_t *memory, uint16_t pc, FILE *out) {
+    Instr8080 instr;
+    char text[DISASM_TEXT_SIZE];
+    disasm_decode(memory, pc, &instr);
+    disasm_format(&instr, text, sizeof(text));
+
+    fprintf(out, "%04x  ", pc);
+    for (int i = 0; i < 3; i++) {
+        if (i < instr.length) {
+            fprintf(out, "%02x ", memory[(uint16_t) (pc + i)]);
+        } else {
+            fprintf(out, "   ");
+        }
+    }
+    fprintf(out, " %s\n", text);
+    return instr.length;
+}
+
+
+void print_regs(State8080 *state, FILE *out) {
+    fprintf(out, "pc=%04x sp=%04x a=%02x bc=%02x%02x de=%02x%02x hl=%02x%02x "
+        "szapc=%d%d%d%d%d ie=%d cycles=%" PRIu64 "\n",
+        state->pc, state->sp, state->a, state->b, state->c,
+        state->d, state->e, state->h, state->l,
+        state->cc.s, state->cc.z, state->cc.ac, state->cc.p, state->cc.cy,
+        state->int_enable, state->cycles);
+}
+
+
+void print_stop(Debugger *dbg, FILE *out) {
+    State8080 *state = dbg->machine->cpu_state;
+    switch (dbg->stop) {
+        case STOP_BREAKPOINT:
+            fprintf(out, "Breakpoint %d at %04x\n", dbg->hit_id, state->pc);
+            break;
+        case STOP_WATCHPOINT:
+            fprintf(out, "Watchpoint %d: %s %04x = %02x\n", dbg->hit_id,
+                dbg->hit_access == WATCH_READ ? "read" : "write",
+                dbg->hit_adr, dbg->hit_value);
+            break;
+        case STOP_RETURN:
+            fprintf(out, "Returned to %04x\n", state->pc);
+            break;
+        case STOP_INTERRUPTED:
+            fprintf(out, "Interrupted\n");
+            break;
+        case STOP_FAULT:
+            if (state->fault == CPU_FAULT_HALT) {
+                fprintf(out, "Halted at %04x\n", state->fault_adr);
+            } else {
+                fprintf(out, "Write to ROM at %04x\n", state->fault_adr);
+            }
+            break;
+        default:
+            break;
+    }
+    print_regs(state, out);
+    print_instr(state->memory, state->pc, out);
+}
+
+
+void print_points(Debugger *dbg, FILE *out) {
+    for (int i = 0; i < dbg->breakpoint_count; i++) {
+        Breakpoint *bp = &dbg->breakpoints[i];
+        fprintf(out, "%d: break %04x", bp->id, bp->adr);
+        if (bp->reg != REG_NONE) {
+            fprintf(out, " if %s %s %x", REG_NAMES[bp->reg], CMP_NAMES[bp->cmp], bp->value);
+        }
+        fprintf(out, " (%lu hits)\n", bp->hits);
+    }
+    for (int i = 0; i < dbg->watchpoint_count; i++) {
+        Watchpoint *wp = &dbg->watchpoints[i];
+        fprintf(out, "%d: watch %04x-%04x %s%s (%lu hits)\n", wp->id,
+            wp->start, (unsigned int) (wp->start + wp->len - 1),
+            wp->access & WATCH_READ ? "r" : "", wp->access & WATCH_WRITE ? "w" : "",
+            wp->hits);
+    }
+    if (dbg->breakpoint_count + dbg->watchpoint_count == 0) {
+        fprintf(out, "No breakpoints or watchpoints\n");
+    }
+}
+
+
+void dump_memory(uint8_t *memory, uint16_t start, unsigned long len, FILE *out) {
+    for (unsigned long i = 0; i < len; i++) {
+        uint16_t adr = start + i;
+        if (i % DUMP_COLS == 0) {
+            fprintf(out, "%s%04x:", i ? "\n" : "", adr);
+        }
+        fprintf(out, " %02x", memory[adr]);
+    }
+    fprintf(out, "\n");
+}
+
+
+void cmd_break(Debugger *dbg, int argc, char **argv, FILE *out) {
+    unsigned long adr, value = 0;
+    DebugReg reg = REG_NONE;
+    int cmp = CMP_EQ;
+    if (argc < 2 || parse_number(argv[1], 0xffff, &adr)) {
+        fprintf(out, "Usage: b ADR [if REG OP VALUE]\n");
+        return;
+    }
+    if (argc > 2) {
+        if (argc != 6 || strcmp(argv[2], "if") != 0 ||
+            (reg = parse_reg(argv[3])) == REG_NONE ||
+            (cmp = parse_cmp(argv[4])) < 0 ||
+            parse_number(argv[5], 0xffff, &value)) {
+            fprintf(out, "Usage: b ADR [if REG OP VALUE]\n");
+            return;
+        }
+    }
+    int id = debugger_add_breakpoint(dbg, adr, reg, cmp, value);
+    if (id < 0) {
+        fprintf(out, "Too many breakpoints\n");
+    } else {
+        fprintf(out, "Breakpoint %d at %04lx\n", id, adr);
+    }
+}
+
+
+void cmd_watch(Debugger *dbg, int argc, char **argv, FILE *out) {
+    unsigned long adr, len = 1;
+    int access = WATCH_WRITE;
+    int arg = 2;
+    if (argc < 2 || argc > 4 || parse_number(argv[1], 0xffff, &adr)) {
+        fprintf(out, "Usage: w ADR [LEN] [r|w|rw]\n");
+        return;
+    }
+    if (arg < argc && parse_access(argv[arg]) == 0) {
+        if (parse_number(argv[arg], CPU_MEM_SIZE, &len) || len == 0) {
+            fprintf(out, "Usage: w ADR [LEN] [r|w|rw]\n");
+            return;
+        }
+        arg++;
+    }
+    if (arg < argc) {
+        access = parse_access(argv[arg]);
+        if (access == 0 || arg + 1 < argc) {
+            fprintf(out, "Usage: w ADR [LEN] [r|w|rw]\n");
+            return;
+        }
+    }
+    int id = debugger_add_watchpoint(dbg, adr, len, access);
+    if (id < 0) {
+        fprintf(out, "Too many watchpoints\n");
+    } else {
+        fprintf(out, "Watchpoint %d at %04lx\n", id, adr);
+    }
+}
+
+
+/**
+ * Runs one command. Returns 1 when it's time to quit.
+ */
+int run_command(Debugger *dbg, int argc, char **argv, FILE *in, FILE *out) {
+    State8080 *state = dbg->machine->cpu_state;
+    char *cmd = argv[0];
+    unsigned long a, n;
+    StopReason stop = STOP_NONE;
+
+    if (strcmp(cmd, "b") == 0 || strcmp(cmd, "break") == 0) {
+        cmd_break(dbg, argc, argv, out);
+    } else if (strcmp(cmd, "w") == 0 || strcmp(cmd, "watch") == 0) {
+        cmd_watch(dbg, argc, argv, out);
+    } else if (strcmp(cmd, "d") == 0 || strcmp(cmd, "delete") == 0) {
+        if (argc != 2 || debugger_delete(dbg, atoi(argv[1]))) {
+            fprintf(out, "No such breakpoint or watchpoint\n");
+        }
+    } else if (strcmp(cmd, "l") == 0 || strcmp(cmd, "list") == 0) {
+        print_points(dbg, out);
+    } else if (strcmp(cmd, "s") == 0 || strcmp(cmd, "step") == 0) {
+        n = 1;
+        if (argc > 1 && parse_number(argv[1], ~0UL, &n)) {
+            fprintf(out, "Usage: s [N]\n");
+            return 0;
+        }
+        stop = debugger_step(dbg, n);
+    } else if (strcmp(cmd, "c") == 0 || strcmp(cmd, "continue") == 0) {
+        stop = debugger_continue(dbg);
+    } else if (strcmp(cmd, "f") == 0 || strcmp(cmd, "finish") == 0) {
+        stop = debugger_finish(dbg);
+    } else if (strcmp(cmd, "r") == 0 || strcmp(cmd, "regs") == 0) {
+        print_regs(state, out);
+        print_instr(state->memory, state->pc, out);
+    } else if (strcmp(cmd, "x") == 0) {
+        n = DUMP_COLS;
+        if (argc < 2 || parse_number(argv[1], 0xffff, &a) ||
+            (argc > 2 && parse_number(argv[2], CPU_MEM_SIZE, &n))) {
+            fprintf(out, "Usage: x ADR [LEN]\n");
+            return 0;
+        }
+        dump_memory(state->memory, a, n, out);
+    } else if (strcmp(cmd, "u") == 0) {
+        a = state->pc;
+        n = LIST_DEFAULT;
+        if ((argc > 1 && parse_number(argv[1], 0xffff, &a)) ||
+            (argc > 2 && parse_number(argv[2], CPU_MEM_SIZE, &n))) {
+            fprintf(out, "Usage: u [ADR] [N]\n");
+            return 0;
+        }
+        for (unsigned long i = 0; i < n; i++) {
+            a = (uint16_t) (a + print_instr(state->memory, a, out));
+        }
+    } else if (strcmp(cmd, "h") == 0 || strcmp(cmd, "help") == 0) {
+        fputs(HELP, out);
+    } else if (strcmp(cmd, "q") == 0 || strcmp(cmd, "quit") == 0) {
+        return 1;
+    } else {
+        fprintf(out, "Unknown command %s (h for help)\n", cmd);
+    }
+
+    if (stop != STOP_NONE) {
+        print_stop(dbg, out);
+        if (stop == STOP_INTERRUPTED) {
+            // drop the line that interrupted us
+            char line[LINE_SIZE];
+            if (fgets(line, sizeof(line), in) == NULL) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+void debugger_repl(Debugger *dbg, FILE *in, FILE *out) {
+    char line[LINE_SIZE];
+    char last[LINE_SIZE] = "s";
+
+    // unbuffered, so a line typed while running stays in the
+    // kernel where input_pending polls for it, rather than in
+    // the stream's buffer after the previous command
+    setvbuf(in, NULL, _IONBF, 0);
+
+    print_stop(dbg, out);
+    while (1) {
+        fprintf(out, "(dbg) ");
+        fflush(out);
+        if (fgets(line, sizeof(line), in) == NULL) {
+            break;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            strcpy(line, last);
+        } else {
+            strcpy(last, line);
+        }
+
+        char *argv[MAX_ARGS];
+        int argc = 0;
+        for (char *tok = strtok(line, " \t"); tok != NULL && argc < MAX_ARGS; tok = strtok(NULL, " \t")) {
+            argv[argc++] = tok;
+        }
+        if (argc == 0) {
+            continue;
+        }
+        if (run_command(dbg, argc, argv, in, out)) {
+            break;
+        }
+        fflush(out);
+    }
+}
+
+
+int debugger_serve(Debugger *dbg, const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path %s is too long\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(path);
+    if (bind(server, (struct sockaddr *) &addr, sizeof(addr)) || listen(server, 1)) {
+        perror(path);
+        close(server);
+        return 1;
+    }
+    fprintf(stderr, "Debugger listening on %s\n", path);
+
+    int client = accept(server, NULL, NULL);
+    close(server);
+    unlink(path);
+    if (client < 0) {
+        perror("accept");
+        return 1;
+    }
+
+    FILE *in = fdopen(client, "r");
+    FILE *out = fdopen(dup(client), "w");
+    dbg->interrupt_fd = client;
+    debugger_repl(dbg, in, out);
+    dbg->interrupt_fd = -1;
+    fclose(out);
+    fclose(in);
+    return 0;
+}
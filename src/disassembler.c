@@ -1,276 +1,392 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "disassembler.h"
 
 
-/*
- * Prints out the mnemonic
- * Returns the size of the operation in bytes
+static const char *MNEMONIC_NAMES[MN_COUNT] = {
+    "NOP", "LXI", "STAX", "INX", "INR", "DCR", "MVI", "RLC",
+    "DAD", "LDAX", "DCX", "RRC", "RAL", "RAR", "SHLD", "DAA",
+    "LHLD", "CMA", "STA", "STC", "LDA", "CMC", "MOV", "HLT",
+    "ADD", "ADC", "SUB", "SBB", "ANA", "XRA", "ORA", "CMP",
+    "RNZ", "POP", "JNZ", "JMP", "CNZ", "PUSH", "ADI", "RST",
+    "RZ", "RET", "JZ", "CZ", "CALL", "ACI", "RNC", "JNC",
+    "OUT", "CNC", "SUI", "RC", "JC", "IN", "CC", "SBI",
+    "RPO", "JPO", "XTHL", "CPO", "ANI", "RPE", "PCHL", "JPE",
+    "XCHG", "CPE", "XRI", "RP", "JP", "DI", "CP", "ORI",
+    "RM", "SPHL", "JM", "EI", "CM", "CPI",
+};
+
+
+typedef struct opcode_info_t {
+    uint8_t mnemonic;
+    const char *regs;
+    uint8_t operand_kind;
+    uint8_t flow;
+} OpcodeInfo;
+
+
+/**
+ * Decoding table, indexed by opcode
  * http://www.emulator101.com/reference/8080-by-opcode.html
+ *
+ * Undocumented opcodes decode as NOP, which is
+ * how the CPU core executes them.
  */
-int disassemble8080op(unsigned char *codebuffer, int pc) {
-    unsigned char *code = &codebuffer[pc]; // pointer to the pc-th element in the codebuffer array
-    int opbytes = 1;  // size of operation to be returned
-    printf("%04x ", pc); // formatted as hexadecimal integer
+static const OpcodeInfo OPCODES[256] = {
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x00
+    { MN_LXI,  "B,",   OPERAND_D16,  FLOW_NEXT       },  // 0x01
+    { MN_STAX, "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x02
+    { MN_INX,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x03
+    { MN_INR,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x04
+    { MN_DCR,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x05
+    { MN_MVI,  "B,",   OPERAND_D8,   FLOW_NEXT       },  // 0x06
+    { MN_RLC,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x07
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x08
+    { MN_DAD,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x09
+    { MN_LDAX, "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x0a
+    { MN_DCX,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x0b
+    { MN_INR,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0x0c
+    { MN_DCR,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0x0d
+    { MN_MVI,  "C,",   OPERAND_D8,   FLOW_NEXT       },  // 0x0e
+    { MN_RRC,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x0f
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x10
+    { MN_LXI,  "D,",   OPERAND_D16,  FLOW_NEXT       },  // 0x11
+    { MN_STAX, "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x12
+    { MN_INX,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x13
+    { MN_INR,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x14
+    { MN_DCR,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x15
+    { MN_MVI,  "D,",   OPERAND_D8,   FLOW_NEXT       },  // 0x16
+    { MN_RAL,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x17
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x18
+    { MN_DAD,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x19
+    { MN_LDAX, "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x1a
+    { MN_DCX,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x1b
+    { MN_INR,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0x1c
+    { MN_DCR,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0x1d
+    { MN_MVI,  "E,",   OPERAND_D8,   FLOW_NEXT       },  // 0x1e
+    { MN_RAR,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x1f
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x20
+    { MN_LXI,  "H,",   OPERAND_D16,  FLOW_NEXT       },  // 0x21
+    { MN_SHLD, "",     OPERAND_ADR,  FLOW_NEXT       },  // 0x22
+    { MN_INX,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x23
+    { MN_INR,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x24
+    { MN_DCR,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x25
+    { MN_MVI,  "H,",   OPERAND_D8,   FLOW_NEXT       },  // 0x26
+    { MN_DAA,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x27
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x28
+    { MN_DAD,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x29
+    { MN_LHLD, "",     OPERAND_ADR,  FLOW_NEXT       },  // 0x2a
+    { MN_DCX,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x2b
+    { MN_INR,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0x2c
+    { MN_DCR,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0x2d
+    { MN_MVI,  "L,",   OPERAND_D8,   FLOW_NEXT       },  // 0x2e
+    { MN_CMA,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x2f
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x30
+    { MN_LXI,  "SP,",  OPERAND_D16,  FLOW_NEXT       },  // 0x31
+    { MN_STA,  "",     OPERAND_ADR,  FLOW_NEXT       },  // 0x32
+    { MN_INX,  "SP",   OPERAND_NONE, FLOW_NEXT       },  // 0x33
+    { MN_INR,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0x34
+    { MN_DCR,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0x35
+    { MN_MVI,  "M,",   OPERAND_D8,   FLOW_NEXT       },  // 0x36
+    { MN_STC,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x37
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x38
+    { MN_DAD,  "SP",   OPERAND_NONE, FLOW_NEXT       },  // 0x39
+    { MN_LDA,  "",     OPERAND_ADR,  FLOW_NEXT       },  // 0x3a
+    { MN_DCX,  "SP",   OPERAND_NONE, FLOW_NEXT       },  // 0x3b
+    { MN_INR,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0x3c
+    { MN_DCR,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0x3d
+    { MN_MVI,  "A,",   OPERAND_D8,   FLOW_NEXT       },  // 0x3e
+    { MN_CMC,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0x3f
+    { MN_MOV,  "B,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x40
+    { MN_MOV,  "B,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x41
+    { MN_MOV,  "B,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x42
+    { MN_MOV,  "B,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x43
+    { MN_MOV,  "B,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x44
+    { MN_MOV,  "B,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x45
+    { MN_MOV,  "B,M",  OPERAND_NONE, FLOW_NEXT       },  // 0x46
+    { MN_MOV,  "B,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x47
+    { MN_MOV,  "C,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x48
+    { MN_MOV,  "C,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x49
+    { MN_MOV,  "C,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x4a
+    { MN_MOV,  "C,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x4b
+    { MN_MOV,  "C,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x4c
+    { MN_MOV,  "C,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x4d
+    { MN_MOV,  "C,M",  OPERAND_NONE, FLOW_NEXT       },  // 0x4e
+    { MN_MOV,  "C,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x4f
+    { MN_MOV,  "D,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x50
+    { MN_MOV,  "D,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x51
+    { MN_MOV,  "D,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x52
+    { MN_MOV,  "D,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x53
+    { MN_MOV,  "D,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x54
+    { MN_MOV,  "D,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x55
+    { MN_MOV,  "D,M",  OPERAND_NONE, FLOW_NEXT       },  // 0x56
+    { MN_MOV,  "D,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x57
+    { MN_MOV,  "E,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x58
+    { MN_MOV,  "E,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x59
+    { MN_MOV,  "E,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x5a
+    { MN_MOV,  "E,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x5b
+    { MN_MOV,  "E,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x5c
+    { MN_MOV,  "E,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x5d
+    { MN_MOV,  "E,M",  OPERAND_NONE, FLOW_NEXT       },  // 0x5e
+    { MN_MOV,  "E,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x5f
+    { MN_MOV,  "H,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x60
+    { MN_MOV,  "H,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x61
+    { MN_MOV,  "H,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x62
+    { MN_MOV,  "H,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x63
+    { MN_MOV,  "H,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x64
+    { MN_MOV,  "H,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x65
+    { MN_MOV,  "H,M",  OPERAND_NONE, FLOW_NEXT       },  // 0x66
+    { MN_MOV,  "H,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x67
+    { MN_MOV,  "L,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x68
+    { MN_MOV,  "L,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x69
+    { MN_MOV,  "L,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x6a
+    { MN_MOV,  "L,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x6b
+    { MN_MOV,  "L,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x6c
+    { MN_MOV,  "L,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x6d
+    { MN_MOV,  "L,M",  OPERAND_NONE, FLOW_NEXT       },  // 0x6e
+    { MN_MOV,  "L,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x6f
+    { MN_MOV,  "M,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x70
+    { MN_MOV,  "M,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x71
+    { MN_MOV,  "M,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x72
+    { MN_MOV,  "M,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x73
+    { MN_MOV,  "M,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x74
+    { MN_MOV,  "M,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x75
+    { MN_HLT,  "",     OPERAND_NONE, FLOW_HALT       },  // 0x76
+    { MN_MOV,  "M,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x77
+    { MN_MOV,  "A,B",  OPERAND_NONE, FLOW_NEXT       },  // 0x78
+    { MN_MOV,  "A,C",  OPERAND_NONE, FLOW_NEXT       },  // 0x79
+    { MN_MOV,  "A,D",  OPERAND_NONE, FLOW_NEXT       },  // 0x7a
+    { MN_MOV,  "A,E",  OPERAND_NONE, FLOW_NEXT       },  // 0x7b
+    { MN_MOV,  "A,H",  OPERAND_NONE, FLOW_NEXT       },  // 0x7c
+    { MN_MOV,  "A,L",  OPERAND_NONE, FLOW_NEXT       },  // 0x7d
+    { MN_MOV,  "A,M",  OPERAND_NONE, FLOW_NEXT       },  // 0x7e
+    { MN_MOV,  "A,A",  OPERAND_NONE, FLOW_NEXT       },  // 0x7f
+    { MN_ADD,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x80
+    { MN_ADD,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0x81
+    { MN_ADD,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x82
+    { MN_ADD,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0x83
+    { MN_ADD,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x84
+    { MN_ADD,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0x85
+    { MN_ADD,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0x86
+    { MN_ADD,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0x87
+    { MN_ADC,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x88
+    { MN_ADC,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0x89
+    { MN_ADC,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x8a
+    { MN_ADC,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0x8b
+    { MN_ADC,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x8c
+    { MN_ADC,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0x8d
+    { MN_ADC,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0x8e
+    { MN_ADC,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0x8f
+    { MN_SUB,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x90
+    { MN_SUB,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0x91
+    { MN_SUB,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x92
+    { MN_SUB,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0x93
+    { MN_SUB,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x94
+    { MN_SUB,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0x95
+    { MN_SUB,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0x96
+    { MN_SUB,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0x97
+    { MN_SBB,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0x98
+    { MN_SBB,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0x99
+    { MN_SBB,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0x9a
+    { MN_SBB,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0x9b
+    { MN_SBB,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0x9c
+    { MN_SBB,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0x9d
+    { MN_SBB,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0x9e
+    { MN_SBB,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0x9f
+    { MN_ANA,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0xa0
+    { MN_ANA,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0xa1
+    { MN_ANA,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0xa2
+    { MN_ANA,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0xa3
+    { MN_ANA,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0xa4
+    { MN_ANA,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0xa5
+    { MN_ANA,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0xa6
+    { MN_ANA,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0xa7
+    { MN_XRA,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0xa8
+    { MN_XRA,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0xa9
+    { MN_XRA,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0xaa
+    { MN_XRA,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0xab
+    { MN_XRA,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0xac
+    { MN_XRA,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0xad
+    { MN_XRA,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0xae
+    { MN_XRA,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0xaf
+    { MN_ORA,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0xb0
+    { MN_ORA,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0xb1
+    { MN_ORA,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0xb2
+    { MN_ORA,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0xb3
+    { MN_ORA,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0xb4
+    { MN_ORA,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0xb5
+    { MN_ORA,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0xb6
+    { MN_ORA,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0xb7
+    { MN_CMP,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0xb8
+    { MN_CMP,  "C",    OPERAND_NONE, FLOW_NEXT       },  // 0xb9
+    { MN_CMP,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0xba
+    { MN_CMP,  "E",    OPERAND_NONE, FLOW_NEXT       },  // 0xbb
+    { MN_CMP,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0xbc
+    { MN_CMP,  "L",    OPERAND_NONE, FLOW_NEXT       },  // 0xbd
+    { MN_CMP,  "M",    OPERAND_NONE, FLOW_NEXT       },  // 0xbe
+    { MN_CMP,  "A",    OPERAND_NONE, FLOW_NEXT       },  // 0xbf
+    { MN_RNZ,  "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xc0
+    { MN_POP,  "B",    OPERAND_NONE, FLOW_NEXT       },  // 0xc1
+    { MN_JNZ,  "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xc2
+    { MN_JMP,  "",     OPERAND_ADR,  FLOW_JUMP       },  // 0xc3
+    { MN_CNZ,  "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xc4
+    { MN_PUSH, "B",    OPERAND_NONE, FLOW_NEXT       },  // 0xc5
+    { MN_ADI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xc6
+    { MN_RST,  "0",    OPERAND_NONE, FLOW_RST        },  // 0xc7
+    { MN_RZ,   "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xc8
+    { MN_RET,  "",     OPERAND_NONE, FLOW_RET        },  // 0xc9
+    { MN_JZ,   "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xca
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0xcb
+    { MN_CZ,   "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xcc
+    { MN_CALL, "",     OPERAND_ADR,  FLOW_CALL       },  // 0xcd
+    { MN_ACI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xce
+    { MN_RST,  "1",    OPERAND_NONE, FLOW_RST        },  // 0xcf
+    { MN_RNC,  "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xd0
+    { MN_POP,  "D",    OPERAND_NONE, FLOW_NEXT       },  // 0xd1
+    { MN_JNC,  "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xd2
+    { MN_OUT,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xd3
+    { MN_CNC,  "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xd4
+    { MN_PUSH, "D",    OPERAND_NONE, FLOW_NEXT       },  // 0xd5
+    { MN_SUI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xd6
+    { MN_RST,  "2",    OPERAND_NONE, FLOW_RST        },  // 0xd7
+    { MN_RC,   "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xd8
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0xd9
+    { MN_JC,   "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xda
+    { MN_IN,   "",     OPERAND_D8,   FLOW_NEXT       },  // 0xdb
+    { MN_CC,   "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xdc
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0xdd
+    { MN_SBI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xde
+    { MN_RST,  "3",    OPERAND_NONE, FLOW_RST        },  // 0xdf
+    { MN_RPO,  "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xe0
+    { MN_POP,  "H",    OPERAND_NONE, FLOW_NEXT       },  // 0xe1
+    { MN_JPO,  "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xe2
+    { MN_XTHL, "",     OPERAND_NONE, FLOW_NEXT       },  // 0xe3
+    { MN_CPO,  "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xe4
+    { MN_PUSH, "H",    OPERAND_NONE, FLOW_NEXT       },  // 0xe5
+    { MN_ANI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xe6
+    { MN_RST,  "4",    OPERAND_NONE, FLOW_RST        },  // 0xe7
+    { MN_RPE,  "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xe8
+    { MN_PCHL, "",     OPERAND_NONE, FLOW_INDIRECT   },  // 0xe9
+    { MN_JPE,  "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xea
+    { MN_XCHG, "",     OPERAND_NONE, FLOW_NEXT       },  // 0xeb
+    { MN_CPE,  "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xec
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0xed
+    { MN_XRI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xee
+    { MN_RST,  "5",    OPERAND_NONE, FLOW_RST        },  // 0xef
+    { MN_RP,   "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xf0
+    { MN_POP,  "PSW",  OPERAND_NONE, FLOW_NEXT       },  // 0xf1
+    { MN_JP,   "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xf2
+    { MN_DI,   "",     OPERAND_NONE, FLOW_NEXT       },  // 0xf3
+    { MN_CP,   "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xf4
+    { MN_PUSH, "PSW",  OPERAND_NONE, FLOW_NEXT       },  // 0xf5
+    { MN_ORI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xf6
+    { MN_RST,  "6",    OPERAND_NONE, FLOW_RST        },  // 0xf7
+    { MN_RM,   "",     OPERAND_NONE, FLOW_RET_COND   },  // 0xf8
+    { MN_SPHL, "",     OPERAND_NONE, FLOW_NEXT       },  // 0xf9
+    { MN_JM,   "",     OPERAND_ADR,  FLOW_JUMP_COND  },  // 0xfa
+    { MN_EI,   "",     OPERAND_NONE, FLOW_NEXT       },  // 0xfb
+    { MN_CM,   "",     OPERAND_ADR,  FLOW_CALL_COND  },  // 0xfc
+    { MN_NOP,  "",     OPERAND_NONE, FLOW_NEXT       },  // 0xfd
+    { MN_CPI,  "",     OPERAND_D8,   FLOW_NEXT       },  // 0xfe
+    { MN_RST,  "7",    OPERAND_NONE, FLOW_RST        },  // 0xff
+
+};
+
+
+// instruction length by operand kind
+static const uint8_t OPERAND_LENGTH[] = { 1, 2, 3, 3 };
+
+
+int disasm_decode(const uint8_t *memory, uint16_t pc, Instr8080 *instr) {
+    uint8_t opcode = memory[pc];
+    const OpcodeInfo *info = &OPCODES[opcode];
+
+    instr->pc = pc;
+    instr->opcode = opcode;
+    instr->mnemonic = info->mnemonic;
+    instr->flow = info->flow;
+    instr->operand_kind = info->operand_kind;
+    instr->regs = info->regs;
+    instr->length = OPERAND_LENGTH[info->operand_kind];
+
+    switch (info->operand_kind) {
+        case OPERAND_D8:
+            instr->operand = memory[(uint16_t) (pc + 1)];
+            break;
+        case OPERAND_D16:
+        case OPERAND_ADR:
+            instr->operand = memory[(uint16_t) (pc + 1)] |
+                (memory[(uint16_t) (pc + 2)] << 8);
+            break;
+        default:
+            instr->operand = 0;
+            break;
+    }
+
+    switch (info->flow) {
+        case FLOW_JUMP:
+        case FLOW_JUMP_COND:
+        case FLOW_CALL:
+        case FLOW_CALL_COND:
+            instr->target = instr->operand;
+            break;
+        case FLOW_RST:
+            // RST n calls n * 8, and n is bits 3-5
+            instr->target = opcode & 0x38;
+            break;
+        default:
+            instr->target = 0;
+            break;
+    }
+
+    return instr->length;
+}
 
-    switch(*code) {
-        case 0x00: printf("NOP"); break;    
-        case 0x01: printf("LXI    B,#$%02x%02x", code[2], code[1]); opbytes = 3; break;    
-        case 0x02: printf("STAX   B"); break;    
-        case 0x03: printf("INX    B"); break;    
-        case 0x04: printf("INR    B"); break;    
-        case 0x05: printf("DCR    B"); break;    
-        case 0x06: printf("MVI    B,#$%02x", code[1]); opbytes = 2; break;    
-        case 0x07: printf("RLC"); break;    
-        case 0x08: printf("NOP"); break;    
-        case 0x09: printf("DAD    B"); break;
-        case 0x0a: printf("LDAX   B"); break;
-        case 0x0b: printf("DCX    B"); break;
-        case 0x0c: printf("INR    C"); break;
-        case 0x0d: printf("DCR    C"); break;
-        case 0x0e: printf("MVI    C,#$%02x", code[1]); opbytes = 2; break;
-        case 0x0f: printf("RRC"); break;
-        case 0x10: printf("NOP"); break;    
-        case 0x11: printf("LXI    D, #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x12: printf("STAX   D"); break;
-        case 0x13: printf("INX    D"); break;
-        case 0x14: printf("INR    D"); break;
-        case 0x15: printf("DCR    D"); break;
-        case 0x16: printf("MVI    D,#$%02x", code[1]); opbytes = 2; break;
-        case 0x17: printf("RAL"); break;
-        case 0x18: printf("NOP"); break;
-        case 0x19: printf("DAD    D"); break;
-        case 0x1a: printf("LDAX   D"); break;
-        case 0x1b: printf("DCX    D"); break;
-        case 0x1c: printf("INR    E"); break;
-        case 0x1d: printf("DCR    E"); break;
-        case 0x1f: printf("RAR"); break;
-        case 0x20: printf("RIM"); break;
-        case 0x21: printf("LXI    H,#$%02x%02x", code[2], code[1]); opbytes = 3; break;  
-        case 0x22: printf("SHLD   $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x23: printf("INX    H"); break;
-        case 0x24: printf("INR    H"); break;
-        case 0x25: printf("DCR    H"); break;
-        case 0x26: printf("MVI    H,#$%02x", code[1]); break;
-        case 0x27: printf("DAA"); break;
-        case 0x28: printf("NOP"); break;
-        case 0x29: printf("DAD    H"); break;
-        case 0x2a: printf("LHLD   $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x2b: printf("DCX    H"); break;
-        case 0x2c: printf("INR    L"); break;
-        case 0x2d: printf("DCR    L"); break;
-        case 0x2e: printf("MVI    L,#$%02x", code[1]); opbytes = 2; break;
-        case 0x2f: printf("CMA"); break;
-        case 0x30: printf("SIM"); break;
-        case 0x31: printf("LXI    SP, #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x32: printf("STA    $%02x%02x", code[2], code[1]); opbytes = 3; break;    
-        case 0x33: printf("INX    SP"); break;
-        case 0x34: printf("INR    M"); break;
-        case 0x35: printf("DCR    M"); break;
-        case 0x36: printf("MVI    M,#$%02x", code[1]); opbytes = 2; break;
-        case 0x37: printf("STC"); break;
-        case 0x38: printf("NOP"); break;
-        case 0x39: printf("DAD    SP"); break;
-        case 0x3a: printf("LDA    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x3b: printf("DCX    SP"); break;
-        case 0x3c: printf("INR    A"); break;
-        case 0x3d: printf("DCR    A"); break;
-        case 0x3e: printf("MVI    A,#0x%02x", code[1]); opbytes = 2; break;
-        case 0x3f: printf("CMC"); break;
-        case 0x40: printf("MOV    B,B"); break;
-        case 0x41: printf("MOV    B,C"); break;
-        case 0x42: printf("MOV    B,D"); break;
-        case 0x43: printf("MOV    B,E"); break;
-        case 0x44: printf("MOV    B,H"); break;
-        case 0x45: printf("MOV    B,L"); break;
-        case 0x46: printf("MOV    B,M"); break;
-        case 0x47: printf("MOV    B,A"); break;
-        case 0x48: printf("MOV    C,B"); break;
-        case 0x49: printf("MOV    C,C"); break;
-        case 0x4a: printf("MOV    C,D"); break;
-        case 0x4b: printf("MOV    C,E"); break;
-        case 0x4c: printf("MOV    C,H"); break;
-        case 0x4d: printf("MOV    C,L"); break;
-        case 0x4e: printf("MOV    C,M"); break;
-        case 0x4f: printf("MOV    C,A"); break;
-        case 0x50: printf("MOV    D,B"); break;
-        case 0x51: printf("MOV    D,C"); break;
-        case 0x52: printf("MOV    D,D"); break;
-        case 0x53: printf("MOV    D,E"); break;
-        case 0x54: printf("MOV    D,H"); break;
-        case 0x55: printf("MOV    D,L"); break;
-        case 0x56: printf("MOV    D,M"); break;
-        case 0x57: printf("MOV    D,A"); break;
-        case 0x58: printf("MOV    E,B"); break;
-        case 0x59: printf("MOV    E,C"); break;
-        case 0x5a: printf("MOV    E,D"); break;
-        case 0x5b: printf("MOV    E,E"); break;
-        case 0x5c: printf("MOV    E,H"); break;
-        case 0x5d: printf("MOV    E,L"); break;
-        case 0x5e: printf("MOV    E,M"); break;
-        case 0x5f: printf("MOV    E,A"); break;
-        case 0x60: printf("MOV    H,B"); break;
-        case 0x61: printf("MOV    H,C"); break;
-        case 0x62: printf("MOV    H,D"); break;
-        case 0x63: printf("MOV    H,E"); break;
-        case 0x64: printf("MOV    H,H"); break;
-        case 0x65: printf("MOV    H,L"); break;
-        case 0x66: printf("MOV    H,M"); break;
-        case 0x67: printf("MOV    H,A"); break;
-        case 0x68: printf("MOV    L,B"); break;
-        case 0x69: printf("MOV    L,C"); break;
-        case 0x6a: printf("MOV    L,D"); break;
-        case 0x6b: printf("MOV    L,E"); break;
-        case 0x6c: printf("MOV    L,H"); break;
-        case 0x6d: printf("MOV    L,L"); break;
-        case 0x6e: printf("MOV    L,M"); break;
-        case 0x6f: printf("MOV    L,A"); break;
-        case 0x70: printf("MOV    M,B"); break;
-        case 0x71: printf("MOV    M,C"); break;
-        case 0x72: printf("MOV    M,D"); break;
-        case 0x73: printf("MOV    M,E"); break;
-        case 0x74: printf("MOV    M,H"); break;
-        case 0x75: printf("MOV    M,L"); break;
-        case 0x76: printf("HLT"); break;
-        case 0x77: printf("MOV    M,A"); break;
-        case 0x78: printf("MOV    A,B"); break;
-        case 0x79: printf("MOV    A,C"); break;
-        case 0x7a: printf("MOV    A,D"); break;
-        case 0x7b: printf("MOV    A,E"); break;
-        case 0x7c: printf("MOV    A,H"); break;
-        case 0x7d: printf("MOV    A,L"); break;
-        case 0x7e: printf("MOV    A,M"); break;
-        case 0x7f: printf("MOV    A,A"); break;
-        case 0x80: printf("ADD    B"); break;  // A <- A + B
-        case 0x81: printf("ADD    C"); break;
-        case 0x82: printf("ADD    D"); break;
-        case 0x83: printf("ADD    E"); break;
-        case 0x84: printf("ADD    H"); break;
-        case 0x85: printf("ADD    L"); break;
-        case 0x86: printf("ADD    M"); break;
-        case 0x87: printf("ADD    A"); break;
-        case 0x88: printf("ADC    B"); break;
-        case 0x89: printf("ADC    C"); break;
-        case 0x8a: printf("ADC    D"); break;
-        case 0x8b: printf("ADC    E"); break;
-        case 0x8c: printf("ADC    H"); break;
-        case 0x8d: printf("ADC    L"); break;
-        case 0x8e: printf("ADC    M"); break;
-        case 0x8f: printf("ADC    A"); break;
-        case 0x90: printf("SUB    B"); break;
-        case 0x91: printf("SUB    C"); break;
-        case 0x92: printf("SUB    D"); break;
-        case 0x93: printf("SUB    E"); break;
-        case 0x94: printf("SUB    H"); break;
-        case 0x95: printf("SUB    L"); break;
-        case 0x96: printf("SUB    M"); break;
-        case 0x97: printf("SUB    A"); break;
-        case 0x98: printf("SBB    B"); break;
-        case 0x99: printf("SBB    C"); break;
-        case 0x9a: printf("SBB    D"); break;
-        case 0x9b: printf("SBB    E"); break;
-        case 0x9c: printf("SBB    H"); break;
-        case 0x9d: printf("SBB    L"); break;
-        case 0x9e: printf("SBB    M"); break;
-        case 0x9f: printf("SBB    A"); break;
-        case 0xa0: printf("ANA    B"); break;  // A <- A & B
-        case 0xa1: printf("ANA    C"); break;
-        case 0xa2: printf("ANA    D"); break;
-        case 0xa3: printf("ANA    E"); break;
-        case 0xa4: printf("ANA    H"); break;
-        case 0xa5: printf("ANA    L"); break;
-        case 0xa6: printf("ANA    M"); break;
-        case 0xa7: printf("ANA    A"); break;
-        case 0xa8: printf("XRA    B"); break;
-        case 0xa9: printf("XRA    C"); break;
-        case 0xaa: printf("XRA    D"); break;
-        case 0xab: printf("XRA    E"); break;
-        case 0xac: printf("XRA    H"); break;
-        case 0xad: printf("XRA    L"); break;
-        case 0xae: printf("XRA    M"); break;
-        case 0xaf: printf("XRA    A"); break;
-        case 0xb0: printf("ORA    B"); break;  
-        case 0xb1: printf("ORA    C"); break;
-        case 0xb2: printf("ORA    D"); break;
-        case 0xb3: printf("ORA    E"); break;
-        case 0xb4: printf("ORA    H"); break;
-        case 0xb5: printf("ORA    L"); break;
-        case 0xb6: printf("ORA    M"); break;
-        case 0xb7: printf("ORA    A"); break;
-        case 0xb8: printf("CMP    B"); break;
-        case 0xb9: printf("CMP    C"); break;
-        case 0xba: printf("CMP    D"); break;
-        case 0xbb: printf("CMP    E"); break;
-        case 0xbc: printf("CMP    H"); break;
-        case 0xbd: printf("CMP    L"); break;
-        case 0xbe: printf("CMP    M"); break;
-        case 0xbf: printf("CMP    A"); break;
-        case 0xc0: printf("RNZ"); break;
-        case 0xc1: printf("POP    B"); break;
-        case 0xc2: printf("JNZ    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xc3: printf("JMP    $%02x%02x", code[2], code[1]); opbytes = 3; break;    
-        case 0xc4: printf("CNZ    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xc5: printf("PUSH   B"); break;
-        case 0xc6: printf("ADI    #$%02x", code[1]); opbytes = 2; break; 
-        case 0xc7: printf("REST   0"); break;
-        case 0xc8: printf("RZ "); break;
-        case 0xc9: printf("RET"); break;
-        case 0xca: printf("JZ     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xcb: printf("NOP"); break;
-        case 0xcc: printf("CZ     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xcd: printf("CALL   $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xcf: printf("RST    1"); break;
-        case 0xd0: printf("RNC"); break;
-        case 0xd1: printf("POP    D"); break;
-        case 0xd2: printf("JNC    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xd3: printf("OUT    #$%02x", code[1]); opbytes = 2; break;
-        case 0xd4: printf("CNC    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xd5: printf("PUSH   D"); break;
-        case 0xd6: printf("SUI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xd7: printf("RST    2"); break;
-        case 0xd8: printf("RC "); break;
-        case 0xd9: printf("NOP"); break;
-        case 0xda: printf("JC     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xdb: printf("IN     #$%02x", code[1]); opbytes = 2; break;
-        case 0xdc: printf("CC     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xdd: printf("NOP"); break;
-        case 0xde: printf("SBI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xdf: printf("RST    3"); break;
-        case 0xe0: printf("RPO"); break;
-        case 0xe1: printf("POP    H"); break;
-        case 0xe2: printf("JPO    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xe3: printf("XTHL   "); break;
-        case 0xe4: printf("CPO    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xe5: printf("PUSH   H"); break;
-        case 0xe6: printf("ANI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xe7: printf("RST    4"); break;
-        case 0xe8: printf("RPE"); break;
-        case 0xe9: printf("PCHL   "); break;
-        case 0xea: printf("JPE    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xeb: printf("XCHG   "); break;
-        case 0xec: printf("CPE    $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xed: printf("NOP"); break;
-        case 0xef: printf("RST    5"); break;
-        case 0xf0: printf("RP "); break;
-        case 0xf1: printf("POP    PSW"); break;
-        case 0xf2: printf("JP     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xf3: printf("DI "); break;
-        case 0xf4: printf("CP     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xf5: printf("PUSH   PSW"); break;
-        case 0xf6: printf("ORI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xf7: printf("RST    6"); break;
-        case 0xf8: printf("RM "); break;
-        case 0xf9: printf("SPHL   "); break;
-        case 0xfa: printf("JM     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xfb: printf("EI "); break;
-        case 0xfc: printf("CM     $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xfd: printf("NOP"); break;
-        case 0xfe: printf("CPI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xff: printf("RST    7"); break;
+
+int disasm_format(const Instr8080 *instr, char *buf, size_t size) {
+    const char *name = MNEMONIC_NAMES[instr->mnemonic];
+    switch (instr->operand_kind) {
+        case OPERAND_D8:
+            return snprintf(buf, size, "%-6s %s#$%02x", name, instr->regs, instr->operand);
+        case OPERAND_D16:
+            return snprintf(buf, size, "%-6s %s#$%04x", name, instr->regs, instr->operand);
+        case OPERAND_ADR:
+            return snprintf(buf, size, "%-6s $%04x", name, instr->operand);
+        default:
+            if (instr->regs[0] == '\0') {
+                return snprintf(buf, size, "%s", name);
+            }
+            return snprintf(buf, size, "%-6s %s", name, instr->regs);
     }
+}
 
-    printf("\n");
-    return opbytes;
+
+const char* disasm_mnemonic_name(uint8_t mnemonic) {
+    return mnemonic < MN_COUNT ? MNEMONIC_NAMES[mnemonic] : "???";
 }
 
+
+size_t disasm_range(const uint8_t *memory, uint16_t start, uint32_t end, Instr8080 *out) {
+    size_t count = 0;
+    uint32_t pc = start;
+    while (pc < end) {
+        pc += disasm_decode(memory, pc, &out[count++]);
+    }
+    return count;
+}
+
+
+/*
+ * Prints out the mnemonic
+ * Returns the size of the operation in bytes
+ */
+int disassemble8080op(unsigned char *codebuffer, int pc) {
+    Instr8080 instr;
+    char text[DISASM_TEXT_SIZE];
+    disasm_decode(codebuffer, pc, &instr);
+    disasm_format(&instr, text, sizeof(text));
+    printf("%04x %s\n", pc, text);
+    return instr.length;
+}
@@ -3,140 +3,178 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "analysis.h"
+#include "aot.h"
+#include "board.h"
 #include "cpu.h"
+#include "debugger.h"
 #include "machine.h"
 #include "emu.h"
+#include "framehash.h"
+#include "framesink.h"
+#include "fusion.h"
+#include "gdbstub.h"
+#include "hle.h"
 #include "platform.h"
+#include "profiler.h"
+#include "trace.h"
 
 
-// 16-bit address has a maximum of
-// 2^15 addressable 8-bit chunks
-#define MAX_MEM (1 << 15)
+// rows per section of the profile report
+#define PROFILE_TOP 32
 
+// per-address profile written on exit, usable with -F
+#define PROFILE_DATA "profile.dat"
 
-#define H_START 0x0000
-#define G_START 0x0800
-#define F_START 0x1000
-#define E_START 0x1800
 
-#define CHUNK_SIZE (G_START - H_START)
+/**
+ * Prints a labelled listing of the ROM to stdout and
+ * writes its basic-block map to `block_map`
+ */
+void disassemble_rom(uint8_t *memory, uint16_t rom_size, char *block_map) {
+    uint16_t entries[] = ANALYSIS_DEFAULT_ENTRIES;
+    RomAnalysis an;
+    if (analysis_run(&an, memory, rom_size, entries, ANALYSIS_DEFAULT_ENTRY_COUNT)) {
+        fprintf(stderr, "Error: ROM analysis failed\n");
+        return;
+    }
+    analysis_write_listing(&an, memory, stdout);
 
+    FILE *f = fopen(block_map, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Error: couldn't open %s\n", block_map);
+    } else {
+        analysis_write_blocks(&an, f);
+        fclose(f);
+        fprintf(stderr, "Wrote %zu blocks to %s\n", an.block_count, block_map);
+    }
+    if (an.overlaps) {
+        fprintf(stderr, "WARNING: %lu jumps into the middle of an instruction\n", an.overlaps);
+    }
+    analysis_free(&an);
+}
 
-void load_invaders_chunk(char *invaders_folder, char chunk, uint8_t *memory) {
-    // make full path
-    size_t folder_len = strlen(invaders_folder);
-    char *folder_path = calloc(folder_len + 16, sizeof(*folder_path));
-    sprintf(folder_path, "%s/invaders.%c", invaders_folder, chunk);
 
-    // load the file
-    FILE *f = fopen(folder_path, "rb");
-    if (f == NULL) {
-        printf("Error: couldn't open %s\n", folder_path);
-        free(folder_path);
+int emu_start(char *folder, EmuMode mode, EmuOptions *options) {
+    Board board;
+    if (board_open(&board, options->board)) {
         exit(1);
     }
-
-    // get the file size and read it into a memory buffer
-    fseek(f, 0L, SEEK_END);
-    int fsize = ftell(f);
-    if (fsize != CHUNK_SIZE) {
-        printf("WARNING: unexpected chunk size %d, expected %d\n", fsize, CHUNK_SIZE);
+    Machine *machine = machine_create(&board);
+    if (machine == NULL) {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    if (machine_init_ports(machine, &options->dips)) {
+        exit(1);
     }
-    fseek(f, 0L, SEEK_SET);
+    State8080 *state = machine->cpu_state;
 
-    int offset = 0;
-    switch (chunk) {
-        case 'h':
-            offset = H_START;
-            break;
-        case 'g':
-            offset = G_START;
-            break;
-        case 'f':
-            offset = F_START;
-            break;
-        case 'e':
-            offset = E_START;
-            break;
+    if (board_load_roms(&board, folder, state->memory)) {
+        exit(1);
     }
-    fread(memory + offset, fsize, 1, f);
 
-    free(folder_path);
-    fclose(f);
-}
+#ifdef AOT
+    AotTable aot;
+    aot_install(&aot, state, &aot_rom);
+#endif
 
+    FusionTable fusion;
+    if (options->fusion && fusion_install(&fusion, state, options->fusion_profile) < 0) {
+        exit(1);
+    }
 
-void load_invaders(char *invaders_folder, uint8_t *memory) {
-    load_invaders_chunk(invaders_folder, 'h', memory);
-    load_invaders_chunk(invaders_folder, 'g', memory);
-    load_invaders_chunk(invaders_folder, 'f', memory);
-    load_invaders_chunk(invaders_folder, 'e', memory);
-}
+    HleTable hle;
+    if (options->hle) {
+        hle_install(&hle, state, options->hle_verify);
+    }
 
+    Tracer tracer;
+    if (options->trace_path != NULL) {
+        if (trace_open(&tracer, options->trace_path, options->trace_compress)) {
+            printf("Error: couldn't open %s\n", options->trace_path);
+            exit(1);
+        }
+        state->trace = &tracer;
+    }
 
-int emu_start(char *folder, EmuMode mode) {
-    // declare ConditionCodes struct
-    ConditionCodes cc;
-    cc = (ConditionCodes) {
-        .z = 0,
-        .s = 0,
-        .p = 0,
-        .cy = 0,
-        .ac = 0
-    };
-
-    uint8_t memory [MAX_MEM];
-
-    // declare State8080 struct
-    State8080 state;
-    state = (State8080) {
-        .a = 0,
-        .b = 0,
-        .c = 0,
-        .d = 0,
-        .e = 0,
-        .h = 0,
-        .l = 0,
-        .sp = 0,
-        .pc = 0,
-        .int_enable = 0,
-        .int_delay = 0,
-        .int_pending = 0,
-        .int_type = 0,
-        .cycles = 0,
-        .memory = &memory,
-        .cc = cc
-    };
-
-    IO8080 io;
-    io = (IO8080) {
-        .port = 0,
-        .value = 0
-    };
-
-    Machine machine;
-    machine = (Machine) {
-        .cpu_state = &state,
-        .shift_register = 0,
-        .io = &io,
-        .ports = {0, 0, 0, 0, 0, 0, 0},
-        .int_type = 1,
-    };
-    machine_init_ports(&machine);
-
-    load_invaders(folder, state.memory);
+    FrameSink sink;
+    if (options->video_path != NULL) {
+        if (frame_sink_open(&sink, options->video_path, frame_sink_format(options->video_path))) {
+            printf("Error: couldn't open %s\n", options->video_path);
+            exit(1);
+        }
+        machine_add_vblank(machine, frame_sink_vblank, &sink);
+    }
+
+    FrameHashLog hash_log;
+    if (options->hash_path != NULL) {
+        if (frame_hash_open(&hash_log, options->hash_path)) {
+            printf("Error: couldn't open %s\n", options->hash_path);
+            exit(1);
+        }
+        machine_add_vblank(machine, frame_hash_vblank, &hash_log);
+    }
 
+    Debugger debugger;
     switch (mode) {
         case RUN_MODE:
-            platform_run(&machine);
+            platform_run(machine);
+            break;
+        case HEADLESS_MODE:
+            machine_run_frames(machine, options->frames);
             break;
         case STEP_MODE:
-            platform_step(&machine);
+            debugger_attach(&debugger, machine);
+            platform_step(machine, &debugger, options->debug_socket);
+            debugger_detach(&debugger);
+            break;
+        case GDB_MODE:
+            debugger_attach(&debugger, machine);
+            gdb_serve(&debugger, options->gdb_address);
+            debugger_detach(&debugger);
             break;
         case DISASM_MODE:
-            fprintf(stderr, "Disassembler not implemented yet\n");
+            disassemble_rom(state->memory, board.rom_size, options->block_map);
             break;
     }
 
-    return 0;
+    if (options->hash_path != NULL) {
+        machine_remove_vblank(machine, frame_hash_vblank, &hash_log);
+        frame_hash_close(&hash_log);
+    }
+    if (options->video_path != NULL) {
+        machine_remove_vblank(machine, frame_sink_vblank, &sink);
+        frame_sink_close(&sink);
+    }
+
+    if (options->trace_path != NULL) {
+        state->trace = NULL;
+        trace_close(&tracer);
+    }
+
+    // HLT ends the run as quitting does; a ROM write is
+    // an error
+    int fault = state->fault;
+    if (fault != CPU_FAULT_NONE) {
+        cpu_print_fault(state);
+    }
+
+#ifdef PROFILE
+    profiler_report(state->memory, PROFILE_TOP);
+    profiler_save(PROFILE_DATA);
+#endif
+
+    if (options->hle) {
+        hle_uninstall(&hle, state);
+    }
+    if (options->fusion) {
+        fusion_uninstall(&fusion, state);
+    }
+#ifdef AOT
+    aot_uninstall(&aot, state);
+#endif
+
+    machine_destroy(machine);
+    return fault == CPU_FAULT_ROM_WRITE;
 }
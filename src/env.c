@@ -0,0 +1,289 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "cpu.h"
+#include "env.h"
+#include "machine.h"
+#include "watchdog.h"
+
+
+// frames to boot, and to wait for a game to start
+#define BOOT_FRAMES 120
+#define BOOT_MAX_FRAMES 1200
+
+// frames a coin or start button is held
+#define PRESS_FRAMES 4
+
+// frames between the coin and the start button
+#define COIN_FRAMES 60
+
+
+/**
+ * Copies the snapshot's RAM and registers into `inst`
+ */
+void instance_restore(EnvInstance *inst, const EnvInstance *snapshot) {
+    machine_clone(inst->machine, snapshot->machine);
+    inst->held = snapshot->held;
+    inst->score = snapshot->score;
+}
+
+
+unsigned int bcd(uint8_t v) {
+    return (v >> 4) * 10 + (v & 0xf);
+}
+
+
+static inline uint8_t* instance_memory(EnvInstance *inst) {
+    return inst->machine->cpu_state->memory;
+}
+
+
+unsigned int instance_score(EnvInstance *inst) {
+    uint8_t *memory = instance_memory(inst);
+    return bcd(memory[INV_P1_SCORE + 1]) * 100 + bcd(memory[INV_P1_SCORE]);
+}
+
+
+void press(Machine *machine, char key, unsigned long frames) {
+    machine_keydown(machine, key);
+    machine_run_frames(machine, frames);
+    machine_keyup(machine, key);
+}
+
+
+/**
+ * Inserts a coin and starts a one-player game. Returns 0
+ * once the game is running.
+ */
+int instance_boot(EnvInstance *inst) {
+    Machine *machine = inst->machine;
+    machine_run_frames(machine, BOOT_FRAMES);
+    press(machine, INSERT_COIN, PRESS_FRAMES);
+    machine_run_frames(machine, COIN_FRAMES);
+    press(machine, P1_START, PRESS_FRAMES);
+
+    // a fault stops the machine, and with it the frames
+    State8080 *state = machine->cpu_state;
+    while (instance_memory(inst)[INV_GAME_MODE] == 0 && machine->frames <= BOOT_MAX_FRAMES &&
+            state->fault == CPU_FAULT_NONE) {
+        machine_run_frames(machine, 1);
+    }
+    if (instance_memory(inst)[INV_GAME_MODE] == 0 || state->fault != CPU_FAULT_NONE) {
+        return 1;
+    }
+    inst->score = instance_score(inst);
+    return 0;
+}
+
+
+/**
+ * Holds the buttons in `actions` and releases the others
+ */
+void instance_input(EnvInstance *inst, uint8_t actions) {
+    uint16_t input = 0;
+    if (actions & ENV_LEFT) {
+        input |= INPUT_P1_LEFT;
+    }
+    if (actions & ENV_RIGHT) {
+        input |= INPUT_P1_RIGHT;
+    }
+    if (actions & ENV_FIRE) {
+        input |= INPUT_P1_FIRE;
+    }
+    machine_set_input(inst->machine, input);
+    inst->held = actions;
+}
+
+
+/**
+ * Max-pools the upright screen by `factor` into one byte
+ * per pixel
+ */
+void observe_pixels(const uint8_t *framebuf, int factor, uint8_t *out) {
+    int width = FRAME_COLS / factor;
+    memset(out, 0, (size_t) width * (FRAME_ROWS / factor));
+    for (int x = 0; x < FRAME_COLS; x++) {
+        // a column runs bottom to top, LSB first
+        const uint8_t *column = &framebuf[x * FRAME_ROWS / 8];
+        for (int b = 0; b < FRAME_ROWS / 8; b++) {
+            uint8_t bits = column[b];
+            while (bits) {
+                int i = b * 8 + __builtin_ctz(bits);
+                int y = FRAME_ROWS - 1 - i;
+                out[(y / factor) * width + x / factor] = 1;
+                bits &= bits - 1;
+            }
+        }
+    }
+}
+
+
+void observe(Env *env, int index) {
+    EnvInstance *inst = &env->instances[index];
+    uint8_t *memory = instance_memory(inst);
+    uint8_t *out = env_observation(env, index);
+    if (env->config.obs == ENV_OBS_RAM) {
+        memcpy(out, &memory[INV_RAM_START], INV_RAM_SIZE);
+    } else {
+        observe_pixels(machine_framebuffer(inst->machine), env->config.downsample, out);
+    }
+    env->ships[index] = memory[INV_P1_SHIPS];
+}
+
+
+uint64_t next_random(uint64_t *state) {
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+
+void reset_instance(Env *env, int index) {
+    EnvInstance *inst = &env->instances[index];
+    instance_restore(inst, &env->boot);
+    watchdog_reset(&inst->watchdog, inst->machine);
+    if (env->config.noop_max > 0) {
+        machine_run_frames(inst->machine, next_random(&inst->rng) % (env->config.noop_max + 1));
+    }
+    inst->score = instance_score(inst);
+    env->rewards[index] = 0;
+    env->dones[index] = 0;
+    observe(env, index);
+}
+
+
+size_t env_obs_size(const EnvConfig *config) {
+    if (config->obs == ENV_OBS_RAM) {
+        return INV_RAM_SIZE;
+    }
+    return (size_t) (FRAME_COLS / config->downsample) * (FRAME_ROWS / config->downsample);
+}
+
+
+int env_create(Env *env, const EnvConfig *config, const uint8_t *rom) {
+    int d = config->downsample;
+    if (config->count <= 0 || config->frameskip <= 0 || config->noop_max < 0 ||
+        config->watchdog_frames < 0 ||
+        (config->obs == ENV_OBS_PIXELS && d != 1 && d != 2 && d != 4 && d != 8)) {
+        return 1;
+    }
+
+    Board *board = malloc(sizeof(Board));
+    if (board == NULL || board_open(board, "invaders")) {
+        free(board);
+        return 1;
+    }
+    Machine *boot = machine_create(board);
+    if (boot == NULL) {
+        free(board);
+        return 1;
+    }
+    if (machine_init_ports(boot, &config->dips)) {
+        machine_destroy(boot);
+        free(board);
+        return 1;
+    }
+    memcpy(boot->cpu_state->memory, rom, board->rom_size);
+    EnvInstance boot_inst = {
+        .machine = boot
+    };
+    if (instance_boot(&boot_inst)) {
+        machine_destroy(boot);
+        free(board);
+        return 1;
+    }
+
+    *env = (Env) {
+        .config = *config,
+        .obs_size = env_obs_size(config),
+        .board = board,
+        .instances = calloc(config->count, sizeof(EnvInstance)),
+        .boot = boot_inst,
+        .rewards = calloc(config->count, sizeof(int32_t)),
+        .dones = calloc(config->count, sizeof(uint8_t)),
+        .ships = calloc(config->count, sizeof(uint8_t)),
+        .owns_obs = config->obs_buffer == NULL
+    };
+    env->obs = env->owns_obs ? calloc(config->count, env->obs_size) : config->obs_buffer;
+    if (env->instances == NULL || env->rewards == NULL || env->dones == NULL ||
+        env->ships == NULL || env->obs == NULL ||
+        machine_arena_create(&env->arena, config->count, boot)) {
+        env_destroy(env);
+        return 1;
+    }
+
+    for (int i = 0; i < config->count; i++) {
+        EnvInstance *inst = &env->instances[i];
+        inst->machine = machine_arena_slot(&env->arena, i);
+        // never 0, or xorshift gets stuck
+        inst->rng = (config->seed + i) * 0x9e3779b97f4a7c15ULL | 1;
+        if (config->watchdog_frames > 0) {
+            watchdog_init(&inst->watchdog, config->watchdog_frames, WATCHDOG_LOOP_BYTES, NULL, NULL);
+            watchdog_attach(&inst->watchdog, inst->machine);
+        }
+    }
+    env_reset(env, -1);
+    return 0;
+}
+
+
+void env_destroy(Env *env) {
+    free(env->instances);
+    machine_arena_destroy(&env->arena);
+    machine_destroy(env->boot.machine);
+    free(env->board);
+    free(env->rewards);
+    free(env->dones);
+    free(env->ships);
+    if (env->owns_obs) {
+        free(env->obs);
+    }
+    env->instances = NULL;
+    env->boot.machine = NULL;
+    env->board = NULL;
+    env->obs = NULL;
+}
+
+
+void env_reset(Env *env, int index) {
+    if (index >= 0) {
+        reset_instance(env, index);
+        return;
+    }
+    for (int i = 0; i < env->config.count; i++) {
+        reset_instance(env, i);
+    }
+}
+
+
+void env_step(Env *env, const uint8_t *actions, int n) {
+    for (int i = 0; i < n; i++) {
+        EnvInstance *inst = &env->instances[i];
+        if (env->dones[i]) {
+            reset_instance(env, i);
+        }
+
+        instance_input(inst, actions[i]);
+        int fault = machine_run_frames(inst->machine, env->config.frameskip);
+
+        unsigned int score = instance_score(inst);
+        env->rewards[i] = (int32_t) score - (int32_t) inst->score;
+        inst->score = score;
+        env->dones[i] = instance_memory(inst)[INV_GAME_MODE] == 0;
+        if (inst->watchdog.hung) {
+            env->hangs++;
+            env->dones[i] = 1;
+        }
+        if (fault) {
+            env->faults++;
+            env->dones[i] = 1;
+        }
+        observe(env, i);
+    }
+}
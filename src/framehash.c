@@ -0,0 +1,125 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "framehash.h"
+#include "machine.h"
+
+
+#define LANES 8
+#define STRIPE_BYTES (LANES * 8)
+
+// stripes between scrambles (1 KB)
+#define STRIPES_PER_BLOCK 16
+
+#define PRIME32_1 0x9e3779b1U
+#define PRIME64_1 0x9e3779b185ebca87ULL
+#define PRIME64_2 0xc2b2ae3d27d4eb4fULL
+
+
+// per-lane keys for accumulation, scrambling and merging
+static const uint64_t SECRET[LANES] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL,
+    0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL,
+    0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL
+};
+
+static const uint64_t MERGE_SECRET[LANES] = {
+    0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL,
+    0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+    0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL,
+    0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL
+};
+
+
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+static inline uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t) a * b;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+
+static inline void accumulate_stripe(uint64_t *acc, const uint8_t *stripe) {
+    for (int i = 0; i < LANES; i++) {
+        uint64_t v = read64(stripe + 8 * i);
+        uint64_t k = v ^ SECRET[i];
+        acc[i ^ 1] += v;
+        acc[i] += (k & 0xffffffff) * (k >> 32);
+    }
+}
+
+
+static inline void scramble(uint64_t *acc) {
+    for (int i = 0; i < LANES; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= SECRET[i];
+        acc[i] *= PRIME32_1;
+    }
+}
+
+
+static inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919e3779f9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+
+uint64_t frame_hash(const uint8_t *data, size_t size) {
+    uint64_t acc[LANES] = {
+        PRIME32_1, PRIME64_1, PRIME64_2, 0x165667b19e3779f9ULL,
+        0x85ebca77c2b2ae63ULL, 0x27d4eb2f165667c5ULL, 0x61c8864e7a143579ULL, PRIME32_1
+    };
+
+    size_t stripes = size / STRIPE_BYTES;
+    for (size_t s = 0; s < stripes; s++) {
+        accumulate_stripe(acc, data + s * STRIPE_BYTES);
+        if (s % STRIPES_PER_BLOCK == STRIPES_PER_BLOCK - 1) {
+            scramble(acc);
+        }
+    }
+
+    // zero-padded last stripe
+    size_t rest = size % STRIPE_BYTES;
+    if (rest) {
+        uint8_t last[STRIPE_BYTES] = {0};
+        memcpy(last, data + stripes * STRIPE_BYTES, rest);
+        accumulate_stripe(acc, last);
+    }
+
+    uint64_t h = size * PRIME64_1;
+    for (int i = 0; i < LANES; i += 2) {
+        h += mul128_fold64(acc[i] ^ MERGE_SECRET[i], acc[i + 1] ^ MERGE_SECRET[i + 1]);
+    }
+    return avalanche(h);
+}
+
+
+int frame_hash_open(FrameHashLog *log, const char *path) {
+    log->file = fopen(path, "w");
+    log->frames = 0;
+    return log->file == NULL;
+}
+
+
+void frame_hash_vblank(Machine *machine, void *arg) {
+    FrameHashLog *log = arg;
+    uint64_t h = frame_hash(machine_framebuffer(machine), FRAME_BYTES);
+    fprintf(log->file, "%lu %016" PRIx64 "\n", log->frames++, h);
+}
+
+
+void frame_hash_close(FrameHashLog *log) {
+    fclose(log->file);
+    log->file = NULL;
+    fprintf(stderr, "Frame hashes: %lu frames\n", log->frames);
+}
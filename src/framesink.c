@@ -0,0 +1,364 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framesink.h"
+#include "machine.h"
+
+
+#define Y4M_HEADER "YUV4MPEG2 W224 H256 F60:1 Ip A1:1 Cmono\n"
+#define Y4M_FRAME "FRAME\n"
+
+// luma of unlit and lit pixels
+#define Y_BLACK 0
+#define Y_WHITE 255
+
+#define MAGIC_SIZE 8
+
+// PNG scanlines: a filter byte, then the row
+#define PNG_ROW_BYTES (FRAME_ROW_BYTES + 1)
+#define PNG_DATA_BYTES (FRAME_ROWS * PNG_ROW_BYTES)
+
+// zlib header, one stored deflate block, Adler-32
+#define ZLIB_BYTES (2 + 5 + PNG_DATA_BYTES + 4)
+
+#define PATH_SIZE 4096
+
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+
+typedef struct sink_header_t {
+    char magic[MAGIC_SIZE];
+    uint16_t width;
+    uint16_t height;
+} SinkHeader;
+
+
+void init_crc_table(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+}
+
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+
+uint32_t adler32(const uint8_t *data, size_t size) {
+    uint32_t s1 = 1, s2 = 0;
+    for (size_t i = 0; i < size; i++) {
+        s1 = (s1 + data[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    return (s2 << 16) | s1;
+}
+
+
+void put_be32(uint8_t *out, uint32_t v) {
+    out[0] = v >> 24;
+    out[1] = v >> 16;
+    out[2] = v >> 8;
+    out[3] = v;
+}
+
+
+/**
+ * Turns video memory (columns bottom to top, LSB first)
+ * into upright 1bpp rows, MSB first
+ */
+void frame_upright(const uint8_t *framebuf, uint8_t *out) {
+    memset(out, 0, FRAME_BYTES);
+    for (int x = 0; x < FRAME_COLS; x++) {
+        const uint8_t *column = &framebuf[x * FRAME_ROWS / 8];
+        for (int i = 0; i < FRAME_ROWS; i++) {
+            if (column[i / 8] & (1 << (i % 8))) {
+                int y = FRAME_ROWS - 1 - i;
+                out[y * FRAME_ROW_BYTES + x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+    }
+}
+
+
+void write_png_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t size) {
+    uint8_t len[4];
+    uint8_t crc[4];
+    put_be32(len, size);
+    uint32_t c = crc32_update(0xffffffff, (const uint8_t *) type, 4);
+    c = crc32_update(c, data, size);
+    put_be32(crc, c ^ 0xffffffff);
+
+    fwrite(len, 4, 1, f);
+    fwrite(type, 4, 1, f);
+    fwrite(data, size, 1, f);
+    fwrite(crc, 4, 1, f);
+}
+
+
+/**
+ * Writes an upright 1bpp image as a 1-bit grayscale PNG.
+ * The data is tiny, so it's stored without compression.
+ * Returns 0 on success.
+ */
+int write_png(const char *path, const uint8_t *image) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return 1;
+    }
+
+    uint8_t ihdr[13];
+    put_be32(ihdr, FRAME_COLS);
+    put_be32(ihdr + 4, FRAME_ROWS);
+    ihdr[8] = 1;    // bit depth
+    ihdr[9] = 0;    // grayscale
+    ihdr[10] = 0;   // deflate
+    ihdr[11] = 0;   // adaptive filtering
+    ihdr[12] = 0;   // no interlace
+
+    uint8_t z[ZLIB_BYTES];
+    uint8_t *p = z;
+    *p++ = 0x78;
+    *p++ = 0x01;
+    // final stored block
+    *p++ = 1;
+    *p++ = PNG_DATA_BYTES & 0xff;
+    *p++ = PNG_DATA_BYTES >> 8;
+    *p++ = ~PNG_DATA_BYTES & 0xff;
+    *p++ = (~PNG_DATA_BYTES >> 8) & 0xff;
+
+    uint8_t *data = p;
+    for (int y = 0; y < FRAME_ROWS; y++) {
+        // filter type 0 (none)
+        *p++ = 0;
+        memcpy(p, &image[y * FRAME_ROW_BYTES], FRAME_ROW_BYTES);
+        p += FRAME_ROW_BYTES;
+    }
+    put_be32(p, adler32(data, PNG_DATA_BYTES));
+
+    fwrite(signature, sizeof(signature), 1, f);
+    write_png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    write_png_chunk(f, "IDAT", z, sizeof(z));
+    write_png_chunk(f, "IEND", NULL, 0);
+    return fclose(f) != 0;
+}
+
+
+/**
+ * Encodes one frame and its repeats
+ */
+void encode_frame(FrameSink *sink, SinkFrame *frame, uint8_t *image, uint8_t *luma) {
+    frame_upright(frame->data, image);
+
+    switch (sink->format) {
+        case SINK_RAW:
+            fwrite(&frame->repeat, sizeof(frame->repeat), 1, sink->file);
+            fwrite(image, FRAME_BYTES, 1, sink->file);
+            break;
+        case SINK_Y4M:
+            for (int i = 0; i < FRAME_ROWS * FRAME_COLS; i++) {
+                luma[i] = image[i / 8] & (0x80 >> (i % 8)) ? Y_WHITE : Y_BLACK;
+            }
+            // a video stream needs every frame
+            for (uint32_t r = 0; r < frame->repeat; r++) {
+                fputs(Y4M_FRAME, sink->file);
+                fwrite(luma, FRAME_ROWS * FRAME_COLS, 1, sink->file);
+            }
+            break;
+        case SINK_PNG:
+        {
+            char path[PATH_SIZE];
+            snprintf(path, sizeof(path), sink->pattern, frame->index);
+            if (write_png(path, image)) {
+                sink->errors++;
+            }
+        }
+            break;
+    }
+}
+
+
+/**
+ * Worker thread: encodes queued frames until the sink
+ * is closed
+ */
+void* sink_main(void *arg) {
+    FrameSink *sink = arg;
+    uint8_t *image = malloc(FRAME_BYTES);
+    uint8_t *luma = sink->format == SINK_Y4M ? malloc(FRAME_ROWS * FRAME_COLS) : NULL;
+
+    pthread_mutex_lock(&sink->lock);
+    while (1) {
+        while (sink->queued == 0 && !sink->done) {
+            pthread_cond_wait(&sink->cond, &sink->lock);
+        }
+        if (sink->queued == 0) {
+            break;
+        }
+        size_t tail = (sink->head + FRAME_RING_SLOTS - sink->queued) % FRAME_RING_SLOTS;
+        pthread_mutex_unlock(&sink->lock);
+
+        encode_frame(sink, &sink->slots[tail], image, luma);
+
+        pthread_mutex_lock(&sink->lock);
+        sink->queued--;
+        pthread_cond_broadcast(&sink->cond);
+    }
+    pthread_mutex_unlock(&sink->lock);
+
+    free(image);
+    free(luma);
+    return NULL;
+}
+
+
+SinkFormat frame_sink_format(const char *path) {
+    size_t len = strlen(path);
+    if (strchr(path, '%') != NULL) {
+        return SINK_PNG;
+    }
+    if (len >= 4 && strcmp(path + len - 4, ".y4m") == 0) {
+        return SINK_Y4M;
+    }
+    return SINK_RAW;
+}
+
+
+int frame_sink_open(FrameSink *sink, const char *path, SinkFormat format) {
+    pthread_once(&crc_once, init_crc_table);
+
+    sink->slots = malloc(FRAME_RING_SLOTS * sizeof(*sink->slots));
+    if (sink->slots == NULL) {
+        return 1;
+    }
+    sink->format = format;
+    sink->file = NULL;
+    sink->pattern = path;
+    if (format != SINK_PNG) {
+        sink->file = fopen(path, "wb");
+        if (sink->file == NULL) {
+            free(sink->slots);
+            sink->slots = NULL;
+            return 1;
+        }
+    }
+    if (format == SINK_RAW) {
+        SinkHeader header = {
+            .magic = FRAME_MAGIC,
+            .width = FRAME_COLS,
+            .height = FRAME_ROWS
+        };
+        fwrite(&header, sizeof(header), 1, sink->file);
+    } else if (format == SINK_Y4M) {
+        fputs(Y4M_HEADER, sink->file);
+    }
+
+    sink->head = 0;
+    sink->queued = 0;
+    sink->pending = 0;
+    sink->done = 0;
+    sink->frames = 0;
+    sink->distinct = 0;
+    sink->stalls = 0;
+    sink->errors = 0;
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->cond, NULL);
+    if (pthread_create(&sink->thread, NULL, sink_main, sink) != 0) {
+        pthread_cond_destroy(&sink->cond);
+        pthread_mutex_destroy(&sink->lock);
+        if (sink->file != NULL) {
+            fclose(sink->file);
+            sink->file = NULL;
+        }
+        free(sink->slots);
+        sink->slots = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Queues the frame at `head` and moves on to the next slot
+ */
+void queue_head(FrameSink *sink) {
+    pthread_mutex_lock(&sink->lock);
+    sink->queued++;
+    sink->head = (sink->head + 1) % FRAME_RING_SLOTS;
+    pthread_cond_broadcast(&sink->cond);
+
+    // the next slot is free once the worker
+    // has less than a full ring queued
+    if (sink->queued == FRAME_RING_SLOTS) {
+        sink->stalls++;
+        while (sink->queued == FRAME_RING_SLOTS) {
+            pthread_cond_wait(&sink->cond, &sink->lock);
+        }
+    }
+    pthread_mutex_unlock(&sink->lock);
+    sink->pending = 0;
+}
+
+
+void frame_sink_push(FrameSink *sink, const uint8_t *framebuf) {
+    SinkFrame *frame = &sink->slots[sink->head];
+    sink->frames++;
+    if (sink->pending) {
+        if (memcmp(frame->data, framebuf, FRAME_BYTES) == 0) {
+            frame->repeat++;
+            return;
+        }
+        queue_head(sink);
+        frame = &sink->slots[sink->head];
+    }
+    memcpy(frame->data, framebuf, FRAME_BYTES);
+    frame->index = sink->frames - 1;
+    frame->repeat = 1;
+    sink->pending = 1;
+    sink->distinct++;
+}
+
+
+void frame_sink_vblank(Machine *machine, void *arg) {
+    frame_sink_push(arg, machine_framebuffer(machine));
+}
+
+
+void frame_sink_close(FrameSink *sink) {
+    if (sink->pending) {
+        queue_head(sink);
+    }
+    pthread_mutex_lock(&sink->lock);
+    sink->done = 1;
+    pthread_cond_broadcast(&sink->cond);
+    pthread_mutex_unlock(&sink->lock);
+    pthread_join(sink->thread, NULL);
+
+    if (sink->file != NULL) {
+        fclose(sink->file);
+        sink->file = NULL;
+    }
+    free(sink->slots);
+    sink->slots = NULL;
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->cond);
+
+    fprintf(stderr, "Video: %lu frames, %lu distinct, %lu stalls\n",
+        sink->frames, sink->distinct, sink->stalls);
+    if (sink->errors) {
+        fprintf(stderr, "WARNING: couldn't write %lu frames\n", sink->errors);
+    }
+}
@@ -0,0 +1,245 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+#include "cpu_internal.h"
+#include "disassembler.h"
+#include "fusion.h"
+
+
+// pattern bytes that aren't compared literally
+#define ANY (-1)
+#define SELF_LO (-2)
+#define SELF_HI (-3)
+
+#define MAX_PATTERN 12
+
+// sequences using less than 1/FUSION_MIN_SHARE of the
+// profiled cycles are not worth fusing
+#define FUSION_MIN_SHARE 1000
+
+#define ADDR_COUNT (1 << 16)
+
+
+typedef struct pattern_t {
+    const char *name;
+
+    // instruction bytes, or ANY/SELF_LO/SELF_HI
+    int16_t bytes[MAX_PATTERN];
+    uint8_t length;
+
+    void (*handler)(State8080 *state, uint8_t *code);
+} Pattern;
+
+
+/**
+ * Shared tail of every fused loop: JNZ at the end
+ * of a `length` byte sequence
+ */
+void fused_jnz(State8080 *state, uint8_t *code, uint8_t length) {
+    state->pc += length;
+    if (!state->cc.z) {
+        jmp(state, makeword(code[length - 1], code[length - 2]));
+    }
+}
+
+
+/**
+ * MVI M,d8 / INX H / MOV A,H / CPI d8 / JNZ self
+ * Fills memory from HL up to a page, e.g. the screen clear
+ */
+void fused_fill_loop(State8080 *state, uint8_t *code) {
+    mem_write_byte(state, hl_addr(state), code[1]);
+    set_hl_addr(state, hl_addr(state) + 1);
+    state->a = state->h;
+    cmp_x(state, code[5]);
+    fused_jnz(state, code, 9);
+}
+
+
+/**
+ * LDAX D / MOV M,A / INX H / INX D / DCR B / JNZ self
+ * Copies B bytes from (DE) to (HL)
+ */
+void fused_copy_loop(State8080 *state, uint8_t *code) {
+    state->a = mem_read_byte(state, de_addr(state));
+    mem_write_byte(state, hl_addr(state), state->a);
+    set_hl_addr(state, hl_addr(state) + 1);
+    set_de_addr(state, de_addr(state) + 1);
+    dcr_x(state, &state->b);
+    fused_jnz(state, code, 8);
+}
+
+
+/**
+ * MOV A,M / INX H / DCR B / JNZ adr
+ * Counted walk over (HL)
+ */
+void fused_read_count(State8080 *state, uint8_t *code) {
+    state->a = mem_read_byte(state, hl_addr(state));
+    set_hl_addr(state, hl_addr(state) + 1);
+    dcr_x(state, &state->b);
+    fused_jnz(state, code, 6);
+}
+
+
+static const Pattern PATTERNS[] = {
+    {
+        "fill loop",
+        { 0x36, ANY, 0x23, 0x7c, 0xfe, ANY, 0xc2, SELF_LO, SELF_HI },
+        9,
+        fused_fill_loop
+    },
+    {
+        "copy loop",
+        { 0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2, SELF_LO, SELF_HI },
+        8,
+        fused_copy_loop
+    },
+    {
+        "read/count",
+        { 0x7e, 0x23, 0x05, 0xc2, ANY, ANY },
+        6,
+        fused_read_count
+    },
+};
+
+#define PATTERN_COUNT (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+_Static_assert(PATTERN_COUNT <= FUSION_MAX_PATTERNS, "FusionTable.cycles is too small");
+
+
+/**
+ * Returns 1 if `pattern` matches the memory at `adr`
+ */
+int pattern_matches(const Pattern *pattern, uint8_t *memory, uint16_t adr) {
+    for (int i = 0; i < pattern->length; i++) {
+        int16_t expected = pattern->bytes[i];
+        uint8_t actual = memory[(uint16_t) (adr + i)];
+        if ((expected >= 0 && actual != expected) ||
+            (expected == SELF_LO && actual != (adr & 0xff)) ||
+            (expected == SELF_HI && actual != (adr >> 8))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Cycles of the `length` bytes of instructions at `adr`
+ */
+int sequence_cycles(const uint8_t *memory, uint16_t adr, int length) {
+    int cycles = 0;
+    Instr8080 instr;
+    for (int i = 0; i < length; i += disasm_decode(memory, adr + i, &instr)) {
+        cycles += cycles_lookup[memory[(uint16_t) (adr + i)]];
+    }
+    return cycles;
+}
+
+
+/**
+ * Reads the per-address cycles of a profile written by
+ * `profiler_save`. Returns the total, or 0 on failure.
+ */
+uint64_t load_profile(const char *path, uint64_t *cycles) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("Error: couldn't open profile %s\n", path);
+        return 0;
+    }
+    char line[128];
+    uint64_t total = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned int pc;
+        unsigned long long count, pc_cycles;
+        if (line[0] == '#' || sscanf(line, "%x %llu %llu", &pc, &count, &pc_cycles) != 3) {
+            continue;
+        }
+        cycles[pc & 0xffff] += pc_cycles;
+        total += pc_cycles;
+    }
+    fclose(f);
+    return total;
+}
+
+
+int fusion_install(FusionTable *table, State8080 *state, const char *profile_path) {
+    uint16_t rom_size = state->rom_size;
+    *table = (FusionTable) {
+        .sites = calloc(rom_size ? rom_size : 1, sizeof(*table->sites))
+    };
+
+    uint64_t *profile = NULL;
+    uint64_t total = 0;
+    if (profile_path != NULL) {
+        profile = calloc(ADDR_COUNT, sizeof(*profile));
+    }
+    if (table->sites == NULL || (profile_path != NULL && profile == NULL)) {
+        fprintf(stderr, "Error: out of memory for fusion\n");
+        free(table->sites);
+        free(profile);
+        table->sites = NULL;
+        return -1;
+    }
+    if (profile != NULL) {
+        total = load_profile(profile_path, profile);
+    }
+
+    int counts[PATTERN_COUNT] = {0};
+    for (uint32_t adr = 0; adr < rom_size; adr++) {
+        for (size_t p = 0; p < PATTERN_COUNT; p++) {
+            const Pattern *pattern = &PATTERNS[p];
+            if (adr + pattern->length > rom_size ||
+                !pattern_matches(pattern, state->memory, adr)) {
+                continue;
+            }
+            if (profile != NULL) {
+                uint64_t site_cycles = 0;
+                for (int i = 0; i < pattern->length; i++) {
+                    site_cycles += profile[adr + i];
+                }
+                if (site_cycles * FUSION_MIN_SHARE < total || total == 0) {
+                    continue;
+                }
+            }
+            table->cycles[p] = sequence_cycles(state->memory, adr, pattern->length);
+            table->sites[adr] = p + 1;
+            table->count++;
+            counts[p]++;
+            break;
+        }
+    }
+
+    free(profile);
+    if (table->count > 0) {
+        const char *sep = ":";
+        printf("Fused %d sites", table->count);
+        for (size_t p = 0; p < PATTERN_COUNT; p++) {
+            if (counts[p]) {
+                printf("%s %d %s", sep, counts[p], PATTERNS[p].name);
+                sep = ",";
+            }
+        }
+        printf("\n");
+    }
+    state->fused = table;
+    return table->count;
+}
+
+
+void fusion_uninstall(FusionTable *table, State8080 *state) {
+    state->fused = NULL;
+    free(table->sites);
+    table->sites = NULL;
+    table->count = 0;
+}
+
+
+void fusion_execute(State8080 *state, uint8_t id) {
+    const Pattern *pattern = &PATTERNS[id - 1];
+    state->cycles += state->fused->cycles[id - 1];
+    pattern->handler(state, &state->memory[state->pc]);
+}
@@ -0,0 +1,579 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "debugger.h"
+#include "gdbstub.h"
+
+
+// registers in GDB's z80 layout, 16 bits each
+#define GDB_REG_COUNT 13
+#define GDB_REG_AF 0
+#define GDB_REG_BC 1
+#define GDB_REG_DE 2
+#define GDB_REG_HL 3
+#define GDB_REG_SP 4
+#define GDB_REG_PC 5
+
+#define SIGINT_NUM 2
+#define SIGTRAP_NUM 5
+#define SIGSEGV_NUM 11
+
+// ctrl-c from GDB while the target runs
+#define GDB_INTERRUPT 0x03
+
+// breakpoint and watchpoint types of Z/z packets
+#define Z_SOFTWARE 0
+#define Z_HARDWARE 1
+#define Z_WRITE 2
+#define Z_READ 3
+#define Z_ACCESS 4
+
+
+static const char TARGET_XML[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\"><architecture>z80</architecture></target>";
+
+static const char HEX[] = "0123456789abcdef";
+
+
+/**
+ * Returns the next byte from GDB, or -1 once it's gone
+ */
+int gdb_read_byte(GdbStub *stub) {
+    if (stub->buf_pos == stub->buf_len) {
+        ssize_t n = read(stub->fd, stub->buf, sizeof(stub->buf));
+        if (n <= 0) {
+            return -1;
+        }
+        stub->buf_len = n;
+        stub->buf_pos = 0;
+    }
+    return stub->buf[stub->buf_pos++];
+}
+
+
+int hex_value(int c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+/**
+ * Parses hex digits at `*p` and moves `*p` past them
+ */
+unsigned long parse_hex(const char **p) {
+    unsigned long v = 0;
+    int d;
+    while ((d = hex_value(**p)) >= 0) {
+        v = (v << 4) | d;
+        (*p)++;
+    }
+    return v;
+}
+
+
+/**
+ * Receives the next packet into `stub->packet`. Returns
+ * its length, or -1 once GDB is gone.
+ */
+int gdb_get_packet(GdbStub *stub) {
+    while (1) {
+        int c;
+        // skip acknowledgements and stray interrupts
+        do {
+            c = gdb_read_byte(stub);
+            if (c < 0) {
+                return -1;
+            }
+        } while (c != '$');
+
+        int len = 0;
+        uint8_t sum = 0;
+        while ((c = gdb_read_byte(stub)) != '#') {
+            if (c < 0) {
+                return -1;
+            }
+            if (len < GDB_PACKET_SIZE) {
+                stub->packet[len++] = c;
+            }
+            sum += c;
+        }
+        int hi = hex_value(gdb_read_byte(stub));
+        int lo = hex_value(gdb_read_byte(stub));
+        stub->packet[len] = '\0';
+
+        int ok = hi >= 0 && lo >= 0 && ((hi << 4) | lo) == sum;
+        if (stub->ack) {
+            write(stub->fd, ok ? "+" : "-", 1);
+        }
+        if (ok) {
+            return len;
+        }
+    }
+}
+
+
+void gdb_put_packet(GdbStub *stub, const char *data) {
+    char frame[GDB_PACKET_SIZE + 5];
+    size_t len = strlen(data);
+    uint8_t sum = 0;
+    frame[0] = '$';
+    for (size_t i = 0; i < len; i++) {
+        frame[i + 1] = data[i];
+        sum += (uint8_t) data[i];
+    }
+    frame[len + 1] = '#';
+    frame[len + 2] = HEX[sum >> 4];
+    frame[len + 3] = HEX[sum & 0xf];
+
+    while (1) {
+        write(stub->fd, frame, len + 4);
+        // resend until GDB acknowledges
+        if (!stub->ack || gdb_read_byte(stub) != '-') {
+            return;
+        }
+    }
+}
+
+
+/**
+ * Appends `size` bytes from `data` as hex to `out`
+ */
+char* put_hex(char *out, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        *out++ = HEX[data[i] >> 4];
+        *out++ = HEX[data[i] & 0xf];
+    }
+    *out = '\0';
+    return out;
+}
+
+
+uint8_t flags_byte(ConditionCodes cc) {
+    // same layout as PUSH PSW
+    return (cc.s << 7) | (cc.z << 6) | (cc.ac << 4) | (cc.p << 2) | (1 << 1) | cc.cy;
+}
+
+
+void set_flags(ConditionCodes *cc, uint8_t f) {
+    cc->cy = f & 1;
+    cc->p = (f >> 2) & 1;
+    cc->ac = (f >> 4) & 1;
+    cc->z = (f >> 6) & 1;
+    cc->s = (f >> 7) & 1;
+}
+
+
+uint16_t get_reg(State8080 *state, int reg) {
+    switch (reg) {
+        case GDB_REG_AF: return (state->a << 8) | flags_byte(state->cc);
+        case GDB_REG_BC: return (state->b << 8) | state->c;
+        case GDB_REG_DE: return (state->d << 8) | state->e;
+        case GDB_REG_HL: return (state->h << 8) | state->l;
+        case GDB_REG_SP: return state->sp;
+        case GDB_REG_PC: return state->pc;
+        default: return 0;
+    }
+}
+
+
+void set_reg(State8080 *state, int reg, uint16_t v) {
+    switch (reg) {
+        case GDB_REG_AF:
+            state->a = v >> 8;
+            set_flags(&state->cc, v & 0xff);
+            break;
+        case GDB_REG_BC: state->b = v >> 8; state->c = v & 0xff; break;
+        case GDB_REG_DE: state->d = v >> 8; state->e = v & 0xff; break;
+        case GDB_REG_HL: state->h = v >> 8; state->l = v & 0xff; break;
+        case GDB_REG_SP: state->sp = v; break;
+        case GDB_REG_PC: state->pc = v; break;
+    }
+}
+
+
+/**
+ * Parses a little-endian 16-bit register value
+ */
+uint16_t parse_reg_value(const char *p) {
+    int d[4];
+    for (int i = 0; i < 4; i++) {
+        d[i] = hex_value(p[i]);
+        if (d[i] < 0) {
+            return 0;
+        }
+    }
+    return (d[0] << 4) | d[1] | (d[2] << 12) | (d[3] << 8);
+}
+
+
+void put_reg(char *out, uint16_t v) {
+    uint8_t bytes[2] = { v & 0xff, v >> 8 };
+    put_hex(out, bytes, 2);
+}
+
+
+/**
+ * Writes the stop reply for the debugger's last stop
+ */
+void stop_reply(GdbStub *stub) {
+    Debugger *dbg = stub->debugger;
+    if (dbg->stop == STOP_WATCHPOINT) {
+        const char *kind = dbg->hit_access == WATCH_READ ? "rwatch" : "watch";
+        for (int i = 0; i < dbg->watchpoint_count; i++) {
+            if (dbg->watchpoints[i].id == dbg->hit_id &&
+                dbg->watchpoints[i].access == (WATCH_READ | WATCH_WRITE)) {
+                kind = "awatch";
+            }
+        }
+        snprintf(stub->reply, sizeof(stub->reply), "T%02x%s:%04x;", stub->signal, kind, dbg->hit_adr);
+    } else {
+        snprintf(stub->reply, sizeof(stub->reply), "S%02x", stub->signal);
+    }
+}
+
+
+/**
+ * Runs the machine for `c` or `s` and replies once it stops.
+ * Returns 1 if GDB went away meanwhile.
+ */
+int gdb_resume(GdbStub *stub, int step) {
+    Debugger *dbg = stub->debugger;
+    const char *p = stub->packet + 1;
+    if (*p) {
+        dbg->machine->cpu_state->pc = parse_hex(&p);
+    }
+
+    StopReason stop = step ? debugger_step(dbg, 1) : debugger_continue(dbg);
+    stub->signal = SIGTRAP_NUM;
+    if (stop == STOP_INTERRUPTED) {
+        // input while running is GDB's ctrl-c, or a hangup
+        int c = gdb_read_byte(stub);
+        if (c < 0) {
+            return 1;
+        }
+        if (c != GDB_INTERRUPT) {
+            stub->buf_pos--;
+        }
+        stub->signal = SIGINT_NUM;
+    } else if (stop == STOP_FAULT && dbg->machine->cpu_state->fault == CPU_FAULT_ROM_WRITE) {
+        stub->signal = SIGSEGV_NUM;
+    }
+    stop_reply(stub);
+    return 0;
+}
+
+
+/**
+ * Handles Z (insert) and z (remove) packets
+ */
+void gdb_breakpoint(GdbStub *stub, int insert) {
+    Debugger *dbg = stub->debugger;
+    const char *p = stub->packet + 1;
+    int type = parse_hex(&p);
+    if (*p++ != ',') {
+        strcpy(stub->reply, "E01");
+        return;
+    }
+    uint16_t adr = parse_hex(&p);
+    uint32_t len = 1;
+    if (*p == ',') {
+        p++;
+        len = parse_hex(&p);
+    }
+
+    uint8_t access = 0;
+    switch (type) {
+        case Z_SOFTWARE:
+        case Z_HARDWARE: break;
+        case Z_WRITE: access = WATCH_WRITE; break;
+        case Z_READ: access = WATCH_READ; break;
+        case Z_ACCESS: access = WATCH_READ | WATCH_WRITE; break;
+        default:
+            // unsupported type
+            stub->reply[0] = '\0';
+            return;
+    }
+
+    int id = -1;
+    if (insert) {
+        id = access ? debugger_add_watchpoint(dbg, adr, len, access) :
+            debugger_add_breakpoint(dbg, adr, REG_NONE, CMP_EQ, 0);
+    } else if (access) {
+        for (int i = 0; i < dbg->watchpoint_count; i++) {
+            Watchpoint *wp = &dbg->watchpoints[i];
+            if (wp->start == adr && wp->access == access) {
+                id = debugger_delete(dbg, wp->id) ? -1 : 0;
+                break;
+            }
+        }
+    } else {
+        for (int i = 0; i < dbg->breakpoint_count; i++) {
+            Breakpoint *bp = &dbg->breakpoints[i];
+            if (bp->adr == adr && bp->reg == REG_NONE) {
+                id = debugger_delete(dbg, bp->id) ? -1 : 0;
+                break;
+            }
+        }
+    }
+    strcpy(stub->reply, id < 0 ? "E01" : "OK");
+}
+
+
+/**
+ * Serves qXfer:features:read:target.xml:offset,length
+ */
+void gdb_read_features(GdbStub *stub, const char *args) {
+    const char *p = args;
+    unsigned long offset = parse_hex(&p);
+    unsigned long len = *p == ',' ? (p++, parse_hex(&p)) : 0;
+    size_t total = sizeof(TARGET_XML) - 1;
+    if (offset >= total) {
+        strcpy(stub->reply, "l");
+        return;
+    }
+    if (len > GDB_PACKET_SIZE - 1) {
+        len = GDB_PACKET_SIZE - 1;
+    }
+    size_t n = total - offset < len ? total - offset : len;
+    stub->reply[0] = offset + n < total ? 'm' : 'l';
+    memcpy(stub->reply + 1, TARGET_XML + offset, n);
+    stub->reply[n + 1] = '\0';
+}
+
+
+void gdb_query(GdbStub *stub) {
+    const char *q = stub->packet;
+    const char *features = "qXfer:features:read:target.xml:";
+    if (strncmp(q, "qSupported", 10) == 0) {
+        snprintf(stub->reply, sizeof(stub->reply),
+            "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+", GDB_PACKET_SIZE);
+    } else if (strncmp(q, features, strlen(features)) == 0) {
+        gdb_read_features(stub, q + strlen(features));
+    } else if (strcmp(q, "qAttached") == 0) {
+        strcpy(stub->reply, "1");
+    } else if (strcmp(q, "qC") == 0) {
+        strcpy(stub->reply, "QC1");
+    } else if (strcmp(q, "qfThreadInfo") == 0) {
+        strcpy(stub->reply, "m1");
+    } else if (strcmp(q, "qsThreadInfo") == 0) {
+        strcpy(stub->reply, "l");
+    } else if (strcmp(q, "QStartNoAckMode") == 0) {
+        strcpy(stub->reply, "OK");
+    }
+}
+
+
+/**
+ * Handles one packet. Returns 1 when the session is over.
+ */
+int gdb_handle(GdbStub *stub, int len) {
+    State8080 *state = stub->debugger->machine->cpu_state;
+    const char *p = stub->packet + 1;
+    char *r = stub->reply;
+    r[0] = '\0';
+
+    switch (stub->packet[0]) {
+        case '?':
+            stop_reply(stub);
+            break;
+        case 'g':
+            for (int i = 0; i < GDB_REG_COUNT; i++) {
+                put_reg(r + 4 * i, get_reg(state, i));
+            }
+            break;
+        case 'G':
+            for (int i = 0; i < GDB_REG_COUNT && 4 * (i + 1) <= len - 1; i++) {
+                set_reg(state, i, parse_reg_value(p + 4 * i));
+            }
+            strcpy(r, "OK");
+            break;
+        case 'p':
+        {
+            int reg = parse_hex(&p);
+            put_reg(r, reg < GDB_REG_COUNT ? get_reg(state, reg) : 0);
+        }
+            break;
+        case 'P':
+        {
+            int reg = parse_hex(&p);
+            if (*p++ != '=' || strlen(p) < 4) {
+                strcpy(r, "E01");
+                break;
+            }
+            set_reg(state, reg, parse_reg_value(p));
+            strcpy(r, "OK");
+        }
+            break;
+        case 'm':
+        {
+            uint16_t adr = parse_hex(&p);
+            unsigned long n = *p == ',' ? (p++, parse_hex(&p)) : 0;
+            if (n > GDB_PACKET_SIZE / 2) {
+                n = GDB_PACKET_SIZE / 2;
+            }
+            for (unsigned long i = 0; i < n; i++) {
+                put_hex(r + 2 * i, &state->memory[(uint16_t) (adr + i)], 1);
+            }
+        }
+            break;
+        case 'M':
+        {
+            uint16_t adr = parse_hex(&p);
+            unsigned long n = *p == ',' ? (p++, parse_hex(&p)) : 0;
+            if (*p++ != ':' || strlen(p) < 2 * n) {
+                strcpy(r, "E01");
+                break;
+            }
+            // patches ROM too, like a hardware debugger
+            for (unsigned long i = 0; i < n; i++) {
+                state->memory[(uint16_t) (adr + i)] = (hex_value(p[2 * i]) << 4) | hex_value(p[2 * i + 1]);
+            }
+            strcpy(r, "OK");
+        }
+            break;
+        case 'c':
+        case 's':
+            if (gdb_resume(stub, stub->packet[0] == 's')) {
+                return 1;
+            }
+            break;
+        case 'Z':
+        case 'z':
+            gdb_breakpoint(stub, stub->packet[0] == 'Z');
+            break;
+        case 'H':
+            strcpy(r, "OK");
+            break;
+        case 'q':
+        case 'Q':
+            gdb_query(stub);
+            break;
+        case 'D':
+            gdb_put_packet(stub, "OK");
+            return 1;
+        case 'k':
+            return 1;
+    }
+
+    gdb_put_packet(stub, r);
+    if (strcmp(stub->packet, "QStartNoAckMode") == 0) {
+        stub->ack = 0;
+    }
+    return 0;
+}
+
+
+/**
+ * Listens on `address` and returns the first connection,
+ * or -1
+ */
+int gdb_accept(const char *address) {
+    char *end;
+    long port = strtol(address, &end, 10);
+    int tcp = *address != '\0' && *end == '\0';
+    int server;
+
+    if (tcp) {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+        };
+        int on = 1;
+        server = socket(AF_INET, SOCK_STREAM, 0);
+        if (server < 0) {
+            perror("socket");
+            return -1;
+        }
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(server, (struct sockaddr *) &addr, sizeof(addr)) || listen(server, 1)) {
+            perror(address);
+            close(server);
+            return -1;
+        }
+        fprintf(stderr, "Waiting for GDB on localhost:%ld\n", port);
+    } else {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(address) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "Error: socket path %s is too long\n", address);
+            return -1;
+        }
+        strcpy(addr.sun_path, address);
+        server = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server < 0) {
+            perror("socket");
+            return -1;
+        }
+        unlink(address);
+        if (bind(server, (struct sockaddr *) &addr, sizeof(addr)) || listen(server, 1)) {
+            perror(address);
+            close(server);
+            return -1;
+        }
+        fprintf(stderr, "Waiting for GDB on %s\n", address);
+    }
+
+    int client = accept(server, NULL, NULL);
+    close(server);
+    if (!tcp) {
+        unlink(address);
+    }
+    if (client < 0) {
+        perror("accept");
+        return -1;
+    }
+    if (tcp) {
+        int on = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return client;
+}
+
+
+int gdb_serve(Debugger *dbg, const char *address) {
+    GdbStub *stub = malloc(sizeof(*stub));
+    *stub = (GdbStub) {
+        .debugger = dbg,
+        .fd = gdb_accept(address),
+        .ack = 1,
+        .signal = SIGTRAP_NUM,
+        .buf_len = 0,
+        .buf_pos = 0
+    };
+    if (stub->fd < 0) {
+        free(stub);
+        return 1;
+    }
+
+    dbg->interrupt_fd = stub->fd;
+    int len;
+    while ((len = gdb_get_packet(stub)) >= 0) {
+        if (gdb_handle(stub, len)) {
+            break;
+        }
+    }
+    dbg->interrupt_fd = -1;
+
+    close(stub->fd);
+    free(stub);
+    return 0;
+}
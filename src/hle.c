@@ -0,0 +1,252 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "cpu_internal.h"
+#include "hle.h"
+
+
+#define MAX_SIGNATURE 16
+
+// memory differences printed per mismatch
+#define MAX_MEM_DIFFS 8
+
+
+typedef struct hle_routine_t {
+    const char *name;
+    uint16_t entry;
+
+    // code expected at the entry point
+    uint8_t code[MAX_SIGNATURE];
+    uint8_t length;
+
+    // runs the body; the caller handles the
+    // return address and PC
+    void (*native)(State8080 *state, uint8_t *code);
+} HleRoutine;
+
+
+/**
+ * ClearScreen (0x1a5c)
+ *      LXI  H,start
+ * loop MVI  M,value
+ *      INX  H
+ *      MOV  A,H
+ *      CPI  end
+ *      JNZ  loop
+ *      RET
+ */
+void hle_fill_pages(State8080 *state, uint8_t *code) {
+    uint16_t hl = makeword(code[2], code[1]);
+    uint8_t value = code[4];
+    uint8_t end = code[8];
+    unsigned long iterations = 0;
+    do {
+        mem_write_byte(state, hl, value);
+        hl++;
+        iterations++;
+    } while ((hl >> 8) != end);
+
+    set_hl_addr(state, hl);
+    state->a = state->h;
+    cmp_x(state, end);
+
+    // LXI + (MVI M, INX, MOV, CPI, JNZ) * n + RET
+    state->cycles += 10 + (10 + 5 + 5 + 7 + 10) * iterations + 10;
+}
+
+
+/**
+ * BlockCopy (0x1a32): copies B bytes (256 if B is 0)
+ * from (DE) to (HL)
+ * loop LDAX D
+ *      MOV  M,A
+ *      INX  H
+ *      INX  D
+ *      DCR  B
+ *      JNZ  loop
+ *      RET
+ */
+void hle_block_copy(State8080 *state, uint8_t *code) {
+    unsigned long iterations = state->b ? state->b : 256;
+    uint16_t hl = hl_addr(state);
+    uint16_t de = de_addr(state);
+    for (unsigned long i = 0; i < iterations; i++) {
+        state->a = mem_read_byte(state, de++);
+        mem_write_byte(state, hl++, state->a);
+    }
+    set_hl_addr(state, hl);
+    set_de_addr(state, de);
+
+    // flags of the last DCR B
+    state->b = 1;
+    dcr_x(state, &state->b);
+
+    // (LDAX, MOV, INX, INX, DCR, JNZ) * n + RET
+    state->cycles += (7 + 7 + 5 + 5 + 5 + 10) * iterations + 10;
+}
+
+
+static const HleRoutine ROUTINES[] = {
+    {
+        "ClearScreen", 0x1a5c,
+        { 0x21, 0x00, 0x24, 0x36, 0x00, 0x23, 0x7c, 0xfe, 0x40,
+          0xc2, 0x5f, 0x1a, 0xc9 },
+        13, hle_fill_pages
+    },
+    {
+        "BlockCopy", 0x1a32,
+        { 0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2, 0x32, 0x1a, 0xc9 },
+        9, hle_block_copy
+    },
+};
+
+#define ROUTINE_COUNT (sizeof(ROUTINES) / sizeof(ROUTINES[0]))
+
+
+int hle_install(HleTable *table, State8080 *state, int verify) {
+    uint16_t rom_size = state->rom_size;
+    table->routines = calloc(rom_size ? rom_size : 1, sizeof(*table->routines));
+    table->size = rom_size;
+    table->verify = verify;
+    table->scratch = verify ? malloc(CPU_MEM_SIZE) : NULL;
+    table->calls = 0;
+    table->mismatches = 0;
+
+    int count = 0;
+    for (size_t i = 0; i < ROUTINE_COUNT; i++) {
+        const HleRoutine *routine = &ROUTINES[i];
+        if (routine->entry + routine->length > rom_size ||
+            memcmp(&state->memory[routine->entry], routine->code, routine->length) != 0) {
+            continue;
+        }
+        table->routines[routine->entry] = i + 1;
+        count++;
+        printf("HLE hook for %s at 0x%04x\n", routine->name, routine->entry);
+    }
+
+    state->hle = table;
+    return count;
+}
+
+
+void hle_uninstall(HleTable *table, State8080 *state) {
+    if (table->verify) {
+        printf("HLE: %lu calls verified, %lu mismatches\n", table->calls, table->mismatches);
+    }
+    state->hle = NULL;
+    free(table->routines);
+    free(table->scratch);
+    table->routines = NULL;
+    table->scratch = NULL;
+}
+
+
+/**
+ * Runs the native routine as if it had been called with
+ * the return address in PC
+ */
+void run_native(State8080 *state, const HleRoutine *routine) {
+    uint16_t ret_adr = state->pc;
+
+    // CALL leaves the return address below SP, and
+    // RET pops it again
+    mem_write_word(state, state->sp - 2, ret_adr);
+    routine->native(state, &state->memory[routine->entry]);
+    state->pc = ret_adr;
+}
+
+
+/**
+ * Returns 1 and prints the differences if the guest and
+ * native results differ
+ */
+int compare_results(const HleRoutine *routine, State8080 *guest, State8080 *native) {
+    int regs_differ = guest->a != native->a || guest->b != native->b ||
+        guest->c != native->c || guest->d != native->d ||
+        guest->e != native->e || guest->h != native->h ||
+        guest->l != native->l || guest->sp != native->sp ||
+        guest->pc != native->pc || guest->cycles != native->cycles ||
+        guest->cc.z != native->cc.z || guest->cc.s != native->cc.s ||
+        guest->cc.p != native->cc.p || guest->cc.cy != native->cc.cy ||
+        guest->cc.ac != native->cc.ac;
+    int mem_differ = memcmp(guest->memory, native->memory, CPU_MEM_SIZE) != 0;
+    if (!regs_differ && !mem_differ) {
+        return 0;
+    }
+
+    printf("HLE mismatch in %s (0x%04x):\n", routine->name, routine->entry);
+    printf("         A  B  C  D  E  H  L  SP   PC   Z S P CY AC cycles\n");
+    State8080 *rows[2] = {guest, native};
+    const char *names[2] = {"guest ", "native"};
+    for (int i = 0; i < 2; i++) {
+        State8080 *s = rows[i];
+        printf("  %s %02x %02x %02x %02x %02x %02x %02x %04x %04x %d %d %d %d  %d  %" PRIu64 "\n",
+            names[i], s->a, s->b, s->c, s->d, s->e, s->h, s->l, s->sp, s->pc,
+            s->cc.z, s->cc.s, s->cc.p, s->cc.cy, s->cc.ac, s->cycles);
+    }
+    int diffs = 0;
+    for (uint32_t adr = 0; adr < CPU_MEM_SIZE && diffs < MAX_MEM_DIFFS; adr++) {
+        if (guest->memory[adr] != native->memory[adr]) {
+            printf("  [%04x] guest %02x native %02x\n",
+                adr, guest->memory[adr], native->memory[adr]);
+            diffs++;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Runs the native routine on a copy of the state and the
+ * guest code on the real one, and compares the results.
+ * The guest result is kept.
+ */
+void verify_call(State8080 *state, const HleRoutine *routine) {
+    HleTable *table = state->hle;
+
+    State8080 native = *state;
+    memcpy(table->scratch, state->memory, CPU_MEM_SIZE);
+    native.memory = table->scratch;
+    run_native(&native, routine);
+
+    // no hooks and no interrupts while the guest
+    // code runs, as in the native path
+    uint16_t ret_adr = state->pc;
+    uint16_t sp = state->sp;
+    uint8_t int_pending = state->int_pending;
+    state->int_pending = 0;
+    state->hle = NULL;
+
+    // routines don't do I/O
+    static IO8080 no_io;
+    call_adr(state, routine->entry);
+    while (state->pc != ret_adr || state->sp != sp) {
+        cpu_emulate_op(state, &no_io);
+    }
+
+    state->hle = table;
+    state->int_pending = int_pending;
+
+    if (compare_results(routine, state, &native)) {
+        table->mismatches++;
+    }
+}
+
+
+int hle_call(State8080 *state, uint16_t adr) {
+    HleTable *table = state->hle;
+    if (adr >= table->size || !table->routines[adr]) {
+        return 0;
+    }
+    const HleRoutine *routine = &ROUTINES[table->routines[adr] - 1];
+    table->calls++;
+    if (table->verify) {
+        verify_call(state, routine);
+    } else {
+        run_native(state, routine);
+    }
+    return 1;
+}
@@ -0,0 +1,77 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "input.h"
+#include "machine.h"
+
+
+void input_init(InputQueue *queue) {
+    *queue = (InputQueue) {0};
+}
+
+
+int input_push(InputQueue *queue, int64_t time_ns, char key, int down) {
+    if (queue->count == INPUT_QUEUE_SIZE) {
+        queue->dropped++;
+        return 1;
+    }
+    if (queue->count > 0 && time_ns < queue->events[queue->count - 1].time_ns) {
+        time_ns = queue->events[queue->count - 1].time_ns;
+    }
+    queue->events[queue->count++] = (InputEvent) {
+        .time_ns = time_ns,
+        .key = key,
+        .down = down != 0
+    };
+    return 0;
+}
+
+
+void input_run(InputQueue *queue, Machine *machine) {
+    for (int i = 0; i < queue->count; i++) {
+        InputEvent *event = &queue->events[i];
+        machine_run_to(machine, machine_cycle_at(machine, event->time_ns));
+
+        if (event->down) {
+            machine_keydown(machine, event->key);
+            if (queue->unseen == 0) {
+                queue->unseen_oldest_ns = event->time_ns;
+            }
+            queue->unseen++;
+            queue->unseen_total_ns += event->time_ns;
+        } else {
+            machine_keyup(machine, event->key);
+        }
+    }
+    queue->count = 0;
+    machine_run(machine);
+}
+
+
+void input_presented(InputQueue *queue, int64_t time_ns) {
+    if (queue->unseen == 0) {
+        return;
+    }
+    queue->presses += queue->unseen;
+    queue->latency_total_ns += (int64_t) queue->unseen * time_ns - queue->unseen_total_ns;
+    if (time_ns - queue->unseen_oldest_ns > queue->latency_max_ns) {
+        queue->latency_max_ns = time_ns - queue->unseen_oldest_ns;
+    }
+    queue->unseen = 0;
+    queue->unseen_total_ns = 0;
+}
+
+
+void input_report(const InputQueue *queue, FILE *out) {
+    if (queue->presses == 0) {
+        return;
+    }
+    fprintf(out, "Input: %" PRIu64 " presses, latency %.3f/%.3f ms (mean/max)",
+        queue->presses, (double) queue->latency_total_ns / queue->presses / 1e6,
+        queue->latency_max_ns / 1e6);
+    if (queue->dropped) {
+        fprintf(out, ", %" PRIu64 " events dropped", queue->dropped);
+    }
+    fprintf(out, "\n");
+}
@@ -1,341 +1,357 @@
 #include <stdint.h>
-#include <time.h>
-#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stddef.h>
 #include "cpu.h"
 #include "machine.h"
+#include "pacer.h"
+#include "shifter.h"
 
-#define EPSILON 1e-9
-
-// 16 bit shift register:
-
-// 	f              0	bit
-// 	xxxxxxxxyyyyyyyy
-	
-// 	Writing to port 4 shifts x into y, and the new value into x, eg.
-// 	$0000,
-// 	write $aa -> $aa00,
-// 	write $ff -> $ffaa,
-// 	write $12 -> $12ff, ..
-	
-// 	Writing to port 2 (bits 0,1,2) sets the offset for the 8 bit result, eg.
-// 	offset 0:
-// 	rrrrrrrr		result=xxxxxxxx
-// 	xxxxxxxxyyyyyyyy
-	
-// 	offset 2:
-// 	  rrrrrrrr	result=xxxxxxyy
-// 	xxxxxxxxyyyyyyyy
-	
-// 	offset 7:
-// 	       rrrrrrrr	result=xyyyyyyy
-// 	xxxxxxxxyyyyyyyy
-	
-// 	Reading from port 3 returns said result.
 
 /**
- * Handles data flow from machine to CPU
+ * Port latch: inputs, DIP switches or a constant
  */
-uint8_t machine_in_cpu(Machine *machine, uint8_t port) {
-    uint8_t a = 0;
-    switch (port) {
-        case 0:
-            a = 1;
-            break;
-        case 1:
-            a = machine->ports[1];
-            break;
-        // case 2:
-        //     a = machine->ports[2];
-        //     break;
-        case 3:
-        {
-            uint16_t v = machine->shift_register;
-            uint8_t shift_offset = machine->ports[2];
-            a = (v >> (8 - shift_offset)) & 0xff;
-        }
-            break;
-    }
-    return a;
+uint8_t in_latch(void *arg, uint8_t port) {
+    Machine *machine = arg;
+    return machine->ports[port];
 }
 
 
 /**
- * Handles data flow from CPU to machine
+ * Attaches the board's hardware to the I/O ports. Ports
+ * without a handler, or with `none` (sound, the watchdog),
+ * read 0 and drop writes.
  */
-void machine_out_cpu(Machine *machine, uint8_t port, uint8_t value) {
-    switch (port) {
-        case 2:
-        {
-            // right-most three bits (0x7 = 0b111)
-            uint8_t shift_offset = value & 0x7;
-            machine->ports[2] = shift_offset;
+void machine_init_io(Machine *machine) {
+    IO8080 *io = machine->io;
+    const Board *board = machine->board;
+    cpu_io_init(io);
+    for (int port = 0; port < BOARD_PORT_COUNT; port++) {
+        switch (board->in[port].kind) {
+            case PORT_LATCH:
+                cpu_io_on_in(io, port, in_latch, machine);
+                break;
+            case PORT_SHIFT_RESULT:
+                cpu_io_on_in(io, port, shifter_in_result, &machine->shifter);
+                break;
+            default:
+                break;
         }
-            break;
-        case 3:
-            // play sound
-            break;
-        case 4:
-        {
-            uint16_t curr_val = machine->shift_register;
-
-            // shift the right 8 bits to the right
-            // by 8, and put value as left 8 bits
-            uint16_t new_val = (value << 8) | (curr_val >> 8);
-            machine->shift_register = new_val;
+        switch (board->out[port].kind) {
+            case PORT_SHIFT_OFFSET:
+                cpu_io_on_out(io, port, shifter_out_offset, &machine->shifter);
+                break;
+            case PORT_SHIFT_DATA:
+                cpu_io_on_out(io, port, shifter_out_data, &machine->shifter);
+                break;
+            default:
+                break;
         }
-            break;
-        case 5:
-            // play sound
-            break;
     }
 }
 
 
-/**
- * Get UNIX timestamp in microseconds
- * as a float
- */
-timestamp ts_utc_micro() {
-    struct timespec time;
-    timespec_get(&time, TIME_UTC);
-    return ((double)time.tv_sec * 1e6) + ((double) time.tv_nsec) / 1000.0;
-}
-
-
-#define MHZ 2
-#define FPS 60
-
-
-// cycle timing
-#define CYCLES_PER_FRAME (MHZ * 1e6 / FPS)
-
-// number of cycles between interrupts (every half frame)
-#define CYCLES_INTERVAL (CYCLES_PER_FRAME / 2)
+// longest host time a sync catches up on; beyond this
+// (the host was suspended, a debugger stopped it, ...)
+// the rest is dropped instead of run at full speed
+#define MAX_SYNC_NS NSEC_PER_SEC
 
 
 void process_interrupts(Machine *machine) {
-    if (machine->cycles < CYCLES_INTERVAL) {
+    if (machine->cycles < machine_interrupt_due(machine)) {
         return;
     }
 
+    const Board *board = machine->board;
+    int index = machine->interrupts % board->interrupt_count;
     if (machine->cpu_state->int_enable) {
-        cpu_request_interrupt(machine->cpu_state, machine->int_type);
+        cpu_request_interrupt(machine->cpu_state, board->interrupts[index]);
+        machine->interrupts_delivered++;
     }
 
-    // trick to flip between 1 and 2
-    machine->int_type = 3 - machine->int_type;
-    machine->cycles -= CYCLES_INTERVAL;
+    // the last interrupt comes at the end of the frame
+    if (index == board->interrupt_count - 1) {
+        machine->frames++;
+        for (int i = 0; i < machine->vblank_count; i++) {
+            machine->on_vblank[i](machine, machine->vblank_arg[i]);
+        }
+    }
+    machine->interrupts++;
 }
 
 
-int machine_step(Machine *machine) {
-    IO8080 *io = machine->io;
-    uint8_t opcode = cpu_curr_op(machine->cpu_state);
-    int cycles = cpu_emulate_op(machine->cpu_state, io);
-    machine->cycles += cycles;
+int machine_run_slice(Machine *machine, int max_cycles) {
+    // the first instruction that reaches the interrupt
+    // ends the slice, like a step at a time
+    uint64_t due = machine_interrupt_due(machine);
 
-    switch (opcode) {
-        case 0xdb: // IN
-            cpu_set_acc(machine->cpu_state, machine_in_cpu(machine, io->port));
-            break;
-        case 0xd3: // OUT
-            machine_out_cpu(machine, io->port, io->value);
-            break;
+    // overdue after a step that ran past several interrupts
+    // (a native routine, a compiled block): one instruction,
+    // so they are raised in turn and the machine catches up
+    int budget = 1;
+    if (due > machine->cycles) {
+        uint64_t left = due - machine->cycles;
+        budget = left < (uint64_t) max_cycles ? (int) left : max_cycles;
     }
-    cpu_io_reset(io);
+    if (budget < 1) {
+        budget = 1;
+    }
+
+    int cycles = cpu_run(machine->cpu_state, machine->io, budget);
+    machine->cycles += cycles;
     process_interrupts(machine);
 
     return cycles;
 }
 
 
+int machine_step(Machine *machine) {
+    // every instruction takes at least one cycle
+    return machine_run_slice(machine, 1);
+}
+
+
+int machine_run_to(Machine *machine, uint64_t cycle) {
+    State8080 *state = machine->cpu_state;
+    while (machine->cycles < cycle && state->fault == CPU_FAULT_NONE) {
+        uint64_t left = cycle - machine->cycles;
+        machine_run_slice(machine, left < INT_MAX ? (int) left : INT_MAX);
+    }
+    return state->fault;
+}
+
+
+/**
+ * Host time since the last sync, as the sync counts it
+ */
+int64_t sync_elapsed(const Machine *machine, int64_t time_ns) {
+    int64_t elapsed = time_ns - machine->last_sync_ns;
+    if (elapsed < 0) {
+        return 0;
+    }
+    return elapsed > MAX_SYNC_NS ? MAX_SYNC_NS : elapsed;
+}
+
+
+uint64_t machine_cycle_at(const Machine *machine, int64_t time_ns) {
+    if (machine->last_sync_ns == 0) {
+        return machine->cycles;
+    }
+    uint64_t owed = (uint64_t) sync_elapsed(machine, time_ns) * machine->board->cpu_hz + machine->sync_frac;
+    return machine->sync_cycles + owed / NSEC_PER_SEC;
+}
+
+
 /**
  * Time-aware machine execution
- * (synchronized at 2 MHz)
+ * (synchronized at the board's clock)
  */
 void machine_do_sync(Machine *machine) {
-    timestamp now = ts_utc_micro();
-    if (machine->last_ts < EPSILON) {
-        machine->last_ts = now;
+    int64_t now = pacer_now_ns();
+    if (machine->last_sync_ns == 0) {
+        machine->last_sync_ns = now;
+        machine->sync_cycles = machine->cycles;
     }
 
-    timestamp since_last = now - machine->last_ts;
+    int64_t elapsed = sync_elapsed(machine, now);
+    machine->last_sync_ns = now;
 
-    // 2 MHz clock speed, so 2 cycles per microsecond
-    int cycles_to_catch_up = MHZ * since_last;
+    // fixed point: whole cycles go to the target, the
+    // remainder is carried over to the next sync
+    uint64_t owed = (uint64_t) elapsed * machine->board->cpu_hz + machine->sync_frac;
+    machine->sync_cycles += owed / NSEC_PER_SEC;
+    machine->sync_frac = owed % NSEC_PER_SEC;
 
-    int cycles = 0;
-    while (cycles_to_catch_up > cycles) {
-        cycles += machine_step(machine);
-    }
+    // a slice may overshoot the target; the next sync
+    // starts from the target, so that isn't lost either
+    machine_run_to(machine, machine->sync_cycles);
+}
 
-    machine->last_ts = now;
+
+void machine_run(Machine *machine) {
+    machine_do_sync(machine);
 }
 
 
-int sleep_msec(long microseconds) {
-    long nsec = (microseconds % 1000000) * 1000;
-    long seconds = microseconds / 1e6;
-    struct timespec ts = (struct timespec) {
-        .tv_sec = seconds,
-        .tv_nsec = nsec
-    };
-    int res;
-    do {
-        res = nanosleep(&ts, &ts);
-    } while (res && errno == EINTR);
-    return res;
+int machine_add_vblank(Machine *machine, VBlankFn fn, void *arg) {
+    if (machine->vblank_count == MACHINE_VBLANK_HOOKS) {
+        return 1;
+    }
+    machine->on_vblank[machine->vblank_count] = fn;
+    machine->vblank_arg[machine->vblank_count] = arg;
+    machine->vblank_count++;
+    return 0;
 }
 
 
-void machine_run(Machine *machine, long sleep_microseconds) {
-    machine_do_sync(machine);
-    sleep_msec(sleep_microseconds);
+void machine_remove_vblank(Machine *machine, VBlankFn fn, void *arg) {
+    for (int i = 0; i < machine->vblank_count; i++) {
+        if (machine->on_vblank[i] == fn && machine->vblank_arg[i] == arg) {
+            machine->vblank_count--;
+            for (int j = i; j < machine->vblank_count; j++) {
+                machine->on_vblank[j] = machine->on_vblank[j + 1];
+                machine->vblank_arg[j] = machine->vblank_arg[j + 1];
+            }
+            return;
+        }
+    }
 }
 
 
-void* machine_framebuffer(Machine *machine) {
-    return cpu_framebuffer(machine->cpu_state);
+int machine_run_frames(Machine *machine, unsigned long frames) {
+    State8080 *state = machine->cpu_state;
+    unsigned long target = machine->frames + frames;
+    while (machine->frames < target && state->fault == CPU_FAULT_NONE) {
+        machine_run_slice(machine, INT_MAX);
+    }
+    return state->fault;
 }
 
 
-// Bits 1-3 always set
-#define PORT_0_DEFAULT 0b00001110
+void machine_instance_init(MachineInstance *inst, const Board *board) {
+    inst->cpu = (State8080) {
+        .memory = inst->memory,
+        .rom_size = board->rom_size
+    };
+    inst->machine = (Machine) {
+        .cpu_state = &inst->cpu,
+        .io = &inst->io,
+        .board = board
+    };
+    machine_init_io(&inst->machine);
+    machine_init_ports(&inst->machine, NULL);
+}
+
 
-// Bit 3 always set
-#define PORT_1_DEFAULT 0b00001000
+Machine* machine_create(const Board *board) {
+    MachineInstance *inst = aligned_alloc(MACHINE_ALIGN, sizeof(MachineInstance));
+    if (inst == NULL) {
+        return NULL;
+    }
+    memset(inst->memory, 0, CPU_MEM_SIZE);
+    machine_instance_init(inst, board);
+    return &inst->machine;
+}
 
 
-void machine_init_ports(Machine *machine) {
-    machine->ports[0] = PORT_0_DEFAULT;
-    machine->ports[1] = PORT_1_DEFAULT;
+void machine_destroy(Machine *machine) {
+    free((char *) machine - offsetof(MachineInstance, machine));
 }
 
 
-#define P2_START_BIT_SET (1 << P2_START)
-#define P1_START_BIT_SET (1 << P1_START)
+void machine_clone(Machine *dst, const Machine *src) {
+    State8080 *cpu = dst->cpu_state;
+    IO8080 *io = dst->io;
+    uint8_t *memory = cpu->memory;
+    const Board *board = dst->board;
+    for (int i = 0; i < board->ram_count; i++) {
+        const BoardRange *ram = &board->ram[i];
+        memcpy(memory + ram->start, src->cpu_state->memory + ram->start, ram->end - ram->start);
+    }
 
-// fire is bit 4 for both player 1 and 2
-#define FIRE_BIT_SET (1 << P1_FIRE)
+    // attachments stay with dst
+    struct tracer_t *trace = cpu->trace;
+    struct debugger_t *debugger = cpu->debugger;
+    uint8_t *watch = cpu->watch;
+    *cpu = *src->cpu_state;
+    cpu->memory = memory;
+    cpu->trace = trace;
+    cpu->debugger = debugger;
+    cpu->watch = watch;
+
+    // so do its port handlers, which point at it
+    Machine hooks = *dst;
+    *dst = *src;
+    dst->cpu_state = cpu;
+    dst->io = io;
+    memcpy(dst->on_vblank, hooks.on_vblank, sizeof(hooks.on_vblank));
+    memcpy(dst->vblank_arg, hooks.vblank_arg, sizeof(hooks.vblank_arg));
+    dst->vblank_count = hooks.vblank_count;
+}
 
-// joy left is bit 5 for both player 1 and 2
-#define LEFT_BIT_SET (1 << P1_JOY_LEFT)
 
-// joy right is bit 6 for both player 1 and 2
-#define RIGHT_BIT_SET (1 << P1_JOY_RIGHT)
+void* machine_framebuffer(Machine *machine) {
+    return &machine->cpu_state->memory[machine->board->video_start];
+}
 
-#define P2_START_BIT_UNSET ~P2_START_BIT_SET
-#define P1_START_BIT_UNSET ~P1_START_BIT_SET
-#define FIRE_BIT_UNSET ~FIRE_BIT_SET
-#define LEFT_BIT_UNSET ~LEFT_BIT_SET
-#define RIGHT_BIT_UNSET ~RIGHT_BIT_SET
 
+// Space Invaders DIP switches on port 2
+#define DIP_LIVES 0x03
+#define DIP_BONUS_1000 0x08
+#define DIP_COIN_INFO_OFF 0x80
 
-/**
- * Returns which port the key
- * will get mapped to
- */
-uint8_t which_port(char key) {
-    uint8_t port;
-    switch (key) {
-        case P2_START:
-        case P1_START:
-        case P1_FIRE:
-        case P1_JOY_LEFT: 
-        case P1_JOY_RIGHT:
-        case INSERT_COIN:
-            port = 1;
-            break;
-        case P2_FIRE:
-        case P2_JOY_LEFT: 
-        case P2_JOY_RIGHT:
-            port = 2;
-    } 
-    return port;
+
+int machine_init_ports(Machine *machine, const DipSwitches *dips) {
+    for (int port = 0; port < BOARD_PORT_COUNT; port++) {
+        machine->ports[port] = machine->board->in[port].value;
+    }
+    if (dips == NULL) {
+        return 0;
+    }
+
+    uint8_t *p2 = &machine->ports[2];
+    if (dips->lives) {
+        if (dips->lives < 3 || dips->lives > 6) {
+            fprintf(stderr, "Error: %d lives, the DIP switches allow 3 to 6\n", dips->lives);
+            return 1;
+        }
+        *p2 = (*p2 & ~DIP_LIVES) | (dips->lives - 3);
+    }
+    if (dips->bonus_life) {
+        if (dips->bonus_life != 1000 && dips->bonus_life != 1500) {
+            fprintf(stderr, "Error: extra ship at %d, the DIP switches allow 1000 or 1500\n",
+                dips->bonus_life);
+            return 1;
+        }
+        *p2 = dips->bonus_life == 1000 ? *p2 | DIP_BONUS_1000 : *p2 & ~DIP_BONUS_1000;
+    }
+    if (dips->coin_info) {
+        *p2 = dips->coin_info > 0 ? *p2 & ~DIP_COIN_INFO_OFF : *p2 | DIP_COIN_INFO_OFF;
+    }
+    return 0;
 }
 
 
-void machine_insert_coin(Machine *machine) {
-    machine->ports[1] |= 1;
+void machine_set_input(Machine *machine, uint16_t input) {
+    input &= INPUT_MASK;
+    machine->ports[1] = (machine->ports[1] & ~INPUT_MASK) | input;
+    machine->ports[2] = (machine->ports[2] & ~(INPUT_MASK >> 8)) | input >> 8;
 }
 
 
-void update_io(Machine *machine, char key) {
-    uint8_t port = which_port(key);
-    machine->io->value = machine->ports[port];
+uint16_t machine_input(const Machine *machine) {
+    return (machine->ports[1] | machine->ports[2] << 8) & INPUT_MASK;
 }
 
 
-void machine_keydown(Machine *machine, char key) {
+uint16_t machine_key_input(char key) {
     switch (key) {
-        case P2_START:
-            machine->ports[1] |= P2_START_BIT_SET;
-            break;
-        case P1_START:
-            machine->ports[1] |= P1_START_BIT_SET;
-            break;
-        case P1_FIRE:
-            machine->ports[1] |= FIRE_BIT_SET;
-            break;
-        case P1_JOY_LEFT: 
-            // set bit 5 of port 1
-            machine->ports[1] |= LEFT_BIT_SET;
-            break;
-        case P1_JOY_RIGHT:
-            // set bit 6 of port 1
-            machine->ports[1] |= RIGHT_BIT_SET;
-            break;
-        case P2_FIRE:
-            machine->ports[2] |= FIRE_BIT_SET;
-            break;
-        case P2_JOY_LEFT: 
-            // set bit 5 of port 2
-            machine->ports[2] |= LEFT_BIT_SET;
-            break;
-        case P2_JOY_RIGHT:
-            // set bit 6 of port 2
-            machine->ports[2] |= RIGHT_BIT_SET;
-            break;
-        case INSERT_COIN:
-            machine_insert_coin(machine);
-            break;
+        case INSERT_COIN: return INPUT_COIN;
+        case P2_START: return INPUT_P2_START;
+        case P1_START: return INPUT_P1_START;
+        case P1_FIRE: return INPUT_P1_FIRE;
+        case P1_JOY_LEFT: return INPUT_P1_LEFT;
+        case P1_JOY_RIGHT: return INPUT_P1_RIGHT;
+        case P2_FIRE: return INPUT_P2_FIRE;
+        case P2_JOY_LEFT: return INPUT_P2_LEFT;
+        case P2_JOY_RIGHT: return INPUT_P2_RIGHT;
+        default: return 0;
     }
+}
+
+
+void machine_insert_coin(Machine *machine) {
+    machine_set_input(machine, machine_input(machine) | INPUT_COIN);
+}
+
 
-    update_io(machine, key);
+void machine_keydown(Machine *machine, char key) {
+    machine_set_input(machine, machine_input(machine) | machine_key_input(key));
 }
 
 
 void machine_keyup(Machine *machine, char key) {
-    switch (key) {
-        case P2_START:
-            machine->ports[1] &= P2_START_BIT_UNSET;
-            break;
-        case P1_START:
-            machine->ports[1] &= P1_START_BIT_UNSET;
-            break;
-        case P1_FIRE:
-            machine->ports[1] &= FIRE_BIT_UNSET;
-            break;
-        case P1_JOY_LEFT: 
-            machine->ports[1] &= LEFT_BIT_UNSET;
-            break;
-        case P1_JOY_RIGHT:
-            machine->ports[1] &= RIGHT_BIT_UNSET;
-            break;
-        case P2_FIRE:
-            machine->ports[2] &= FIRE_BIT_UNSET;
-            break;
-        case P2_JOY_LEFT: 
-            // set bit 5 of port 1
-            machine->ports[2] &= LEFT_BIT_UNSET;
-            break;
-        case P2_JOY_RIGHT:
-            // set bit 6 of port 1
-            machine->ports[2] &= RIGHT_BIT_UNSET;
-            break;
-        case INSERT_COIN:
-            machine->ports[1] &= 0b11111110;
-            break;
-    }
-    update_io(machine, key);
+    machine_set_input(machine, machine_input(machine) & ~machine_key_input(key));
 }
@@ -1,25 +1,104 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "emu.h"
 
+/**
+ * Parses DIP switch settings like "lives=5,bonus=1000,coininfo=off"
+ * into `dips`. Returns 0 on success, or prints an error and
+ * returns 1.
+ */
+int parse_dips(char *text, DipSwitches *dips) {
+    for (char *setting = strtok(text, ","); setting != NULL; setting = strtok(NULL, ",")) {
+        char *value = strchr(setting, '=');
+        if (value == NULL) {
+            fprintf(stderr, "Error: DIP switch setting %s has no value\n", setting);
+            return 1;
+        }
+        *value++ = '\0';
+        if (strcmp(setting, "lives") == 0) {
+            dips->lives = atoi(value);
+        } else if (strcmp(setting, "bonus") == 0) {
+            dips->bonus_life = atoi(value);
+        } else if (strcmp(setting, "coininfo") == 0 && strcmp(value, "on") == 0) {
+            dips->coin_info = 1;
+        } else if (strcmp(setting, "coininfo") == 0 && strcmp(value, "off") == 0) {
+            dips->coin_info = -1;
+        } else {
+            fprintf(stderr, "Error: unknown DIP switch setting %s=%s\n", setting, value);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
 int main(int argc, char **argv) {
     int opt;
     EmuMode mode = RUN_MODE;
-    while ((opt = getopt(argc, argv, "rsd")) != -1) {
+    EmuOptions options = (EmuOptions) {
+        .board = "invaders",
+        .dips = {0},
+        .fusion = 0,
+        .fusion_profile = NULL,
+        .hle = 0,
+        .hle_verify = 0,
+        .block_map = "blocks.map",
+        .trace_path = NULL,
+        .trace_compress = 0,
+        .debug_socket = NULL,
+        .gdb_address = NULL,
+        .frames = 0,
+        .video_path = NULL,
+        .hash_path = NULL
+    };
+    while ((opt = getopt(argc, argv, "rH:su:g:db:fF:eEt:zv:c:m:D:")) != -1) {
         switch (opt) {
             case 'r': mode = RUN_MODE; break;
+            case 'H':
+                mode = HEADLESS_MODE;
+                options.frames = strtoul(optarg, NULL, 10);
+                break;
             case 's': mode = STEP_MODE; break;
+            case 'u':
+                mode = STEP_MODE;
+                options.debug_socket = optarg;
+                break;
+            case 'g':
+                mode = GDB_MODE;
+                options.gdb_address = optarg;
+                break;
             case 'd': mode = DISASM_MODE; break;
+            case 'b': options.block_map = optarg; break;
+            case 'f': options.fusion = 1; break;
+            case 'F':
+                options.fusion = 1;
+                options.fusion_profile = optarg;
+                break;
+            case 'e': options.hle = 1; break;
+            case 'E':
+                options.hle = 1;
+                options.hle_verify = 1;
+                break;
+            case 't': options.trace_path = optarg; break;
+            case 'z': options.trace_compress = 1; break;
+            case 'v': options.video_path = optarg; break;
+            case 'c': options.hash_path = optarg; break;
+            case 'm': options.board = optarg; break;
+            case 'D':
+                if (parse_dips(optarg, &options.dips)) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
             default:
-                fprintf(stderr, "Usage: %s [-rsd] [folder...]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-rsdfeEz] [-H frames] [-u socket] [-g port|socket] [-b block_map] [-F profile] [-t trace] [-v video] [-c hashes] [-m board] [-D dips] [folder...]\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
 
     char *folder = argv[optind];
-    emu_start(folder, mode);
-    return 0;
+    return emu_start(folder, mode, &options) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
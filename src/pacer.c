@@ -0,0 +1,84 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "machine.h"
+#include "pacer.h"
+
+
+int64_t pacer_now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t) time.tv_sec * NSEC_PER_SEC + time.tv_nsec;
+}
+
+
+void pacer_init(Pacer *pacer, int hz) {
+    int64_t now = pacer_now_ns();
+    *pacer = (Pacer) {
+        .period_ns = NSEC_PER_SEC / hz,
+        .deadline_ns = now + NSEC_PER_SEC / hz,
+        .last_wake_ns = now,
+        .min_ns = INT64_MAX
+    };
+}
+
+
+/**
+ * Sleeps until `deadline_ns` on the monotonic clock
+ */
+void sleep_until(int64_t deadline_ns) {
+    struct timespec ts = {
+        .tv_sec = deadline_ns / NSEC_PER_SEC,
+        .tv_nsec = deadline_ns % NSEC_PER_SEC
+    };
+    // returns the error instead of setting errno
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+
+void pacer_wait(Pacer *pacer) {
+    int64_t now = pacer_now_ns();
+    if (now < pacer->deadline_ns) {
+        if (pacer->deadline_ns - now > PACER_SPIN_NS) {
+            sleep_until(pacer->deadline_ns - PACER_SPIN_NS);
+        }
+        do {
+            now = pacer_now_ns();
+        } while (now < pacer->deadline_ns);
+    } else if (now > pacer->deadline_ns) {
+        pacer->late++;
+    }
+
+    int64_t frame = now - pacer->last_wake_ns;
+    pacer->last_wake_ns = now;
+    pacer->frames++;
+    pacer->total_ns += frame;
+    if (frame < pacer->min_ns) {
+        pacer->min_ns = frame;
+    }
+    if (frame > pacer->max_ns) {
+        pacer->max_ns = frame;
+    }
+
+    pacer->deadline_ns += pacer->period_ns;
+    if (now - pacer->deadline_ns > PACER_MAX_BEHIND * pacer->period_ns) {
+        pacer->deadline_ns = now + pacer->period_ns;
+        pacer->resyncs++;
+    }
+}
+
+
+void pacer_report(const Pacer *pacer, FILE *out) {
+    if (pacer->frames == 0) {
+        return;
+    }
+    double mean = (double) pacer->total_ns / pacer->frames;
+    fprintf(out, "Frames: %" PRIu64 ", %.3f Hz, frame time %.3f/%.3f/%.3f ms (min/mean/max), "
+        "%" PRIu64 " late, %" PRIu64 " resyncs\n",
+        pacer->frames, NSEC_PER_SEC / mean,
+        pacer->min_ns / 1e6, mean / 1e6, pacer->max_ns / 1e6,
+        pacer->late, pacer->resyncs);
+}
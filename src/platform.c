@@ -3,8 +3,11 @@
 #include <stdio.h>
 #include <SDL2/SDL.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "input.h"
 #include "machine.h"
+#include "pacer.h"
 #include "platform.h"
 
 #define WINDOW_WIDTH 600
@@ -18,7 +21,6 @@
 #define WHITE_B 255
 
 #define ALPHA 255
-#define MICRO_SECS (1e6 / 60) 
 
 
 #define ROWS FRAME_ROWS
@@ -53,21 +55,6 @@ void render_bitmap_upright(SDL_Renderer *renderer, uint8_t *framebuf) {
 }
 
 
-#define MAX_STEPS 1e7
-
-size_t get_num_instrs(char *input) {
-    if (strlen(input) == 1) {
-        return 1;
-    }
-    // If the string starts with an 
-    // alphanumeric character or only 
-    // contains alphanumeric characters,
-    // 0 is returned.
-    size_t steps = (size_t) atoi(input);
-    return steps < MAX_STEPS ? steps : MAX_STEPS;
-}
-
-
 char control_map(SDL_Keycode keycode) {
     char result = 0;
     switch (keycode) {
@@ -87,6 +74,18 @@ char control_map(SDL_Keycode keycode) {
         case SDLK_c:
             result = INSERT_COIN;
             break;
+        case SDLK_2:
+            result = P2_START;
+            break;
+        case SDLK_a:
+            result = P2_JOY_LEFT;
+            break;
+        case SDLK_d:
+            result = P2_JOY_RIGHT;
+            break;
+        case SDLK_w:
+            result = P2_FIRE;
+            break;
     }
     return result;
 }
@@ -104,85 +103,123 @@ void handle_input(SDL_Event *event, Machine *machine) {
 }
 
 
+/**
+ * Queues a key change with the host time it happened at.
+ * SDL stamps events in milliseconds of SDL_GetTicks, which
+ * was `ticks` at host time `now`. The stamp is taken when
+ * SDL pumps the event, not when the key moved, so the
+ * placement is only as good as the pump rate and the
+ * millisecond resolution.
+ */
+void queue_input(InputQueue *input, SDL_Event *event, int64_t now, uint32_t ticks) {
+    if ((event->type != SDL_KEYDOWN && event->type != SDL_KEYUP) || event->key.repeat) {
+        return;
+    }
+    char key = control_map(event->key.keysym.sym);
+    if (key == 0) {
+        return;
+    }
+    // an event stamped after `ticks` was read is new,
+    // not 49 days old
+    int32_t age_ms = (int32_t) (ticks - event->common.timestamp);
+    if (age_ms < 0) {
+        age_ms = 0;
+    }
+    input_push(input, now - (int64_t) age_ms * 1000000, key, event->type == SDL_KEYDOWN);
+}
+
+
 void platform_run(Machine *machine) {
     SDL_Event event;
     SDL_Renderer *renderer;
     SDL_Window *window;
     uint8_t *framebuf;
-    int pending = 0;
+    int running = 1;
+    Pacer pacer;
+    InputQueue input;
 
     SDL_Init(SDL_INIT_VIDEO);
     SDL_CreateWindowAndRenderer(COLS, ROWS, 0, &window, &renderer);
-    while (1) {
-        pending = SDL_PollEvent(&event);
-        if (pending && event.type == SDL_QUIT) {
-            break;
+    pacer_init(&pacer, MACHINE_FPS);
+    input_init(&input);
+    while (running) {
+        // read all pending input; pumping first stamps what
+        // has arrived before `ticks` is read (SDL_PollEvent
+        // pumps again, so a few may still come out newer)
+        SDL_PumpEvents();
+        int64_t now = pacer_now_ns();
+        uint32_t ticks = SDL_GetTicks();
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                running = 0;
+            }
+            queue_input(&input, &event, now, ticks);
         }
-        // read input
-        handle_input(&event, machine);
 
-        // update state
-        machine_run(machine, MICRO_SECS);
+        // update state, applying the input as it came;
+        // a CPU fault (HLT, a ROM write) ends the run
+        input_run(&input, machine);
+        if (machine->cpu_state->fault != CPU_FAULT_NONE) {
+            running = 0;
+        }
 
         // get frame buffer
         framebuf = machine_framebuffer(machine);
 
         // render pixels
         render_bitmap_upright(renderer, framebuf);
+        input_presented(&input, pacer_now_ns());
+
+        // wait for the next frame
+        pacer_wait(&pacer);
     }
+    pacer_report(&pacer, stderr);
+    input_report(&input, stderr);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
 
-void platform_step(Machine *machine) {
-    size_t instr_count = 0;
-    char user_in [20];
+typedef struct step_screen_t {
+    Machine *machine;
+    SDL_Renderer *renderer;
+} StepScreen;
+
 
-    size_t instrs_to_advance = 0;
+/**
+ * Redraws the screen when the debugger stops
+ */
+void render_stop(void *arg) {
+    StepScreen *screen = arg;
     SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        handle_input(&event, screen->machine);
+    }
+    render_bitmap_upright(screen->renderer, machine_framebuffer(screen->machine));
+}
+
+
+void platform_step(Machine *machine, Debugger *debugger, const char *socket_path) {
     SDL_Renderer *renderer;
     SDL_Window *window;
 
     SDL_Init(SDL_INIT_VIDEO);
     SDL_CreateWindowAndRenderer(COLS, ROWS, 0, &window, &renderer);
-    while (1) {
-        if (SDL_PollEvent(&event) && event.type == SDL_QUIT) {
-            break;
-        }
-        // update state
-        if (instrs_to_advance == 0) {
-            // show state
-            printf("Emulator state:\n");
-            cpu_print_state(machine->cpu_state);
-            printf("Cycles: %zu\n", machine->cycles);
-            printf("Instructions executed: %zu\n", instr_count);
-
-            // render pixels
-            uint8_t *framebuf = machine_framebuffer(machine);
-            render_bitmap_upright(renderer, framebuf);
-
-            printf(
-                "Press enter to advance one instruction, or " 
-                "enter number of instructions to advance "
-                "and then press enter (press 'q' to quit): "); 
-            fgets(user_in, 20, stdin);
-            if (strncmp(user_in, "q", 1) == 0) {
-                break;
-            }
-            instrs_to_advance = get_num_instrs(user_in);
-            if (instrs_to_advance == 0) {
-                continue;
-            }
-            printf("\n\n");
-        }
 
-        machine_step(machine);
-        instr_count++;
-        instrs_to_advance--;
+    StepScreen screen = { .machine = machine, .renderer = renderer };
+    debugger->on_stop = render_stop;
+    debugger->on_stop_arg = &screen;
+    render_stop(&screen);
 
+    if (socket_path != NULL) {
+        debugger_serve(debugger, socket_path);
+    } else {
+        debugger->interrupt_fd = STDIN_FILENO;
+        debugger_repl(debugger, stdin, stdout);
     }
+
+    debugger->on_stop = NULL;
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disassembler.h"
+#include "profiler.h"
+
+
+#define ADDR_COUNT (1 << 16)
+#define OPCODE_COUNT 256
+
+// deeper call chains are not attributed
+#define MAX_CALL_DEPTH 256
+
+
+typedef struct call_frame_t {
+    uint16_t target;
+
+    // total cycles when the subroutine was entered
+    uint64_t entered_at;
+} CallFrame;
+
+
+typedef struct profile_t {
+    uint64_t op_count[OPCODE_COUNT];
+    uint64_t op_cycles[OPCODE_COUNT];
+
+    // last address each opcode ran at, used
+    // to show an example in the report
+    uint16_t op_example[OPCODE_COUNT];
+
+    uint64_t pc_count[ADDR_COUNT];
+    uint64_t pc_cycles[ADDR_COUNT];
+
+    // per subroutine entry point
+    uint64_t sub_calls[ADDR_COUNT];
+    uint64_t sub_self[ADDR_COUNT];
+    uint64_t sub_total[ADDR_COUNT];
+
+    CallFrame stack[MAX_CALL_DEPTH];
+    int depth;
+
+    // frames dropped because the stack was full
+    int overflow;
+
+    uint64_t instrs;
+    uint64_t cycles;
+} Profile;
+
+
+static Profile profile;
+
+
+void profiler_record_op(uint16_t pc, uint8_t opcode, int cycles) {
+    profile.op_count[opcode]++;
+    profile.op_cycles[opcode] += cycles;
+    profile.op_example[opcode] = pc;
+    profile.pc_count[pc]++;
+    profile.pc_cycles[pc] += cycles;
+    profile.instrs++;
+    profile.cycles += cycles;
+
+    // cycles outside of any tracked call go to
+    // the frame at the bottom (address 0)
+    uint16_t current = profile.depth > 0 ? profile.stack[profile.depth - 1].target : 0;
+    profile.sub_self[current] += cycles;
+}
+
+
+void profiler_enter(uint16_t target) {
+    profile.sub_calls[target]++;
+    if (profile.depth >= MAX_CALL_DEPTH) {
+        profile.overflow++;
+        return;
+    }
+    profile.stack[profile.depth++] = (CallFrame) {
+        .target = target,
+        .entered_at = profile.cycles
+    };
+}
+
+
+void profiler_leave(void) {
+    if (profile.overflow > 0) {
+        profile.overflow--;
+        return;
+    }
+    // the guest may return more often than it calls
+    // (e.g. after manipulating the stack)
+    if (profile.depth == 0) {
+        return;
+    }
+    CallFrame *frame = &profile.stack[--profile.depth];
+    profile.sub_total[frame->target] += profile.cycles - frame->entered_at;
+}
+
+
+void profiler_reset(void) {
+    memset(&profile, 0, sizeof(profile));
+}
+
+
+// sort key for qsort, which has no context argument
+static const uint64_t *sort_key;
+
+int cmp_desc(const void *a, const void *b) {
+    uint64_t ka = sort_key[*(const uint32_t *) a];
+    uint64_t kb = sort_key[*(const uint32_t *) b];
+    return (ka < kb) - (ka > kb);
+}
+
+
+/**
+ * Fills `indices` with the entries of `key` that are non-zero,
+ * sorted in descending order, and returns how many there are
+ */
+int sorted_indices(const uint64_t *key, uint32_t *indices, int n) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (key[i]) {
+            indices[count++] = i;
+        }
+    }
+    sort_key = key;
+    qsort(indices, count, sizeof(*indices), cmp_desc);
+    return count;
+}
+
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+
+void profiler_report(uint8_t *memory, int top) {
+    uint32_t *indices = malloc(ADDR_COUNT * sizeof(*indices));
+    int count;
+
+    printf("\n");
+    printf("Profile: %llu instructions, %llu cycles\n",
+        (unsigned long long) profile.instrs, (unsigned long long) profile.cycles);
+
+    printf("\n-- Opcodes by cycles ----------------------------------------\n");
+    printf("%12s %14s %7s  op  example\n", "count", "cycles", "%");
+    count = sorted_indices(profile.op_cycles, indices, OPCODE_COUNT);
+    for (int i = 0; i < count && i < top; i++) {
+        uint8_t op = indices[i];
+        printf("%12llu %14llu %6.2f%%  %02x  ",
+            (unsigned long long) profile.op_count[op],
+            (unsigned long long) profile.op_cycles[op],
+            percent(profile.op_cycles[op], profile.cycles), op);
+        disassemble8080op(memory, profile.op_example[op]);
+    }
+
+    printf("\n-- Addresses by cycles --------------------------------------\n");
+    printf("%12s %14s %7s  instruction\n", "count", "cycles", "%");
+    count = sorted_indices(profile.pc_cycles, indices, ADDR_COUNT);
+    for (int i = 0; i < count && i < top; i++) {
+        uint16_t pc = indices[i];
+        printf("%12llu %14llu %6.2f%%  ",
+            (unsigned long long) profile.pc_count[pc],
+            (unsigned long long) profile.pc_cycles[pc],
+            percent(profile.pc_cycles[pc], profile.cycles));
+        disassemble8080op(memory, pc);
+    }
+
+    printf("\n-- Subroutines by inclusive cycles -------------------------\n");
+    printf("%12s %14s %7s %14s %7s  entry\n", "calls", "total", "%", "self", "%");
+    count = sorted_indices(profile.sub_total, indices, ADDR_COUNT);
+    for (int i = 0; i < count && i < top; i++) {
+        uint16_t adr = indices[i];
+        printf("%12llu %14llu %6.2f%% %14llu %6.2f%%  ",
+            (unsigned long long) profile.sub_calls[adr],
+            (unsigned long long) profile.sub_total[adr],
+            percent(profile.sub_total[adr], profile.cycles),
+            (unsigned long long) profile.sub_self[adr],
+            percent(profile.sub_self[adr], profile.cycles));
+        disassemble8080op(memory, adr);
+    }
+
+    free(indices);
+}
+
+
+int profiler_save(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        printf("Error: couldn't write profile to %s\n", path);
+        return 1;
+    }
+    fprintf(f, "# pc count cycles\n");
+    for (int pc = 0; pc < ADDR_COUNT; pc++) {
+        if (profile.pc_count[pc]) {
+            fprintf(f, "%04x %llu %llu\n", pc,
+                (unsigned long long) profile.pc_count[pc],
+                (unsigned long long) profile.pc_cycles[pc]);
+        }
+    }
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,349 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "analysis.h"
+#include "aot.h"
+#include "cpu_internal.h"
+#include "disassembler.h"
+#include "recompiler.h"
+
+
+// register operands in opcode order (6 is M)
+static const char *REGS[] = {
+    "state->b", "state->c", "state->d", "state->e",
+    "state->h", "state->l", NULL, "state->a"
+};
+
+// register pairs for LXI, INX, DCX, DAD, STAX, LDAX
+static const char *PAIRS[] = { "bc", "de", "hl" };
+static const char *PAIR_PTRS[] = {
+    "&state->b, &state->c", "&state->d, &state->e", "&state->h, &state->l"
+};
+
+// same for PUSH and POP
+static const char *PAIR_VALUES[] = {
+    "state->b, state->c", "state->d, state->e", "state->h, state->l"
+};
+
+// ALU operations 0x80-0xbf and their immediate forms
+static const char *ALU_OPS[] = {
+    "add_x", "adc_x", "sub_x", "sbb_x", "ana_x", "xra_x", "ora_x", "cmp_x"
+};
+
+// conditions as evaluated by the interpreter
+static const char *CONDS[] = {
+    "!state->cc.z", "state->cc.z", "!state->cc.cy", "state->cc.cy",
+    "!state->cc.p", "state->cc.p", "!state->cc.s", "state->cc.s"
+};
+
+
+/**
+ * Writes the expression that reads register `r`
+ */
+void emit_src(FILE *out, int r) {
+    if (r == 6) {
+        fprintf(out, "get_hl_mem(state)");
+    } else {
+        fprintf(out, "%s", REGS[r]);
+    }
+}
+
+
+/**
+ * Writes the C statements for one instruction. `next` is
+ * the address after it, which control flow needs for the
+ * return address and the not-taken path.
+ */
+void emit_instr(FILE *out, const Instr8080 *instr) {
+    uint8_t op = instr->opcode;
+    uint16_t next = instr->pc + instr->length;
+    uint16_t operand = instr->operand;
+    int dst = (op >> 3) & 7;
+    int src = op & 7;
+    int pair = (op >> 4) & 3;
+
+    // MOV
+    if (op >= 0x40 && op < 0x80) {
+        if (dst == 6) {
+            fprintf(out, "    set_hl_mem(state, %s);\n", REGS[src]);
+        } else if (dst != src) {
+            fprintf(out, "    %s = ", REGS[dst]);
+            emit_src(out, src);
+            fprintf(out, ";\n");
+        }
+        return;
+    }
+
+    // ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP
+    if (op >= 0x80 && op < 0xc0) {
+        fprintf(out, "    %s(state, ", ALU_OPS[dst]);
+        emit_src(out, src);
+        fprintf(out, ");\n");
+        return;
+    }
+
+    // 0x00-0x3f in groups of eight by the low three bits
+    if (op < 0x40) {
+        switch (src) {
+            case 1:
+                if (op & 0x08) {
+                    if (pair == 3) {
+                        fprintf(out, "    state->cc.cy = (tworeg_add(&state->h, &state->l, state->sp) & 0xffff0000) != 0;\n");
+                    } else {
+                        fprintf(out, "    dad_xy(state, %s);\n", PAIR_PTRS[pair]);
+                    }
+                } else if (pair == 3) {
+                    fprintf(out, "    state->sp = 0x%04x;\n", operand);
+                } else {
+                    fprintf(out, "    set_%s_addr(state, 0x%04x);\n", PAIRS[pair], operand);
+                }
+                return;
+            case 2:
+                switch (op) {
+                    case 0x02: fprintf(out, "    set_bc_mem(state, state->a);\n"); break;
+                    case 0x12: fprintf(out, "    set_de_mem(state, state->a);\n"); break;
+                    case 0x0a: fprintf(out, "    state->a = get_bc_mem(state);\n"); break;
+                    case 0x1a: fprintf(out, "    state->a = get_de_mem(state);\n"); break;
+                    case 0x22:
+                        fprintf(out, "    mem_write_byte(state, 0x%04x, state->l);\n", operand);
+                        fprintf(out, "    mem_write_byte(state, 0x%04x, state->h);\n", (uint16_t) (operand + 1));
+                        break;
+                    case 0x2a:
+                        fprintf(out, "    state->l = mem_read_byte(state, 0x%04x);\n", operand);
+                        fprintf(out, "    state->h = mem_read_byte(state, 0x%04x);\n", (uint16_t) (operand + 1));
+                        break;
+                    case 0x32: fprintf(out, "    mem_write_byte(state, 0x%04x, state->a);\n", operand); break;
+                    case 0x3a: fprintf(out, "    state->a = mem_read_byte(state, 0x%04x);\n", operand); break;
+                }
+                return;
+            case 3:
+                if (pair == 3) {
+                    fprintf(out, "    state->sp%s;\n", (op & 0x08) ? "--" : "++");
+                } else {
+                    fprintf(out, "    %s(%s);\n", (op & 0x08) ? "dcx_xy" : "inx_xy", PAIR_PTRS[pair]);
+                }
+                return;
+            case 4:
+            case 5:
+                if (dst == 6) {
+                    // through a copy, so the write is checked
+                    fprintf(out, "    {\n");
+                    fprintf(out, "        uint8_t m = get_hl_mem(state);\n");
+                    fprintf(out, "        %s(state, &m);\n", src == 4 ? "inr_x" : "dcr_x");
+                    fprintf(out, "        set_hl_mem(state, m);\n");
+                    fprintf(out, "    }\n");
+                } else {
+                    fprintf(out, "    %s(state, &%s);\n", src == 4 ? "inr_x" : "dcr_x", REGS[dst]);
+                }
+                return;
+            case 6:
+                if (dst == 6) {
+                    fprintf(out, "    set_hl_mem(state, 0x%02x);\n", operand);
+                } else {
+                    fprintf(out, "    %s = 0x%02x;\n", REGS[dst], operand);
+                }
+                return;
+            case 7:
+                switch (op) {
+                    case 0x07:  // RLC
+                        fprintf(out, "    state->cc.cy = state->a >> 7;\n");
+                        fprintf(out, "    state->a = (state->a << 1) | state->cc.cy;\n");
+                        break;
+                    case 0x0f:  // RRC
+                        fprintf(out, "    state->cc.cy = state->a & 1;\n");
+                        fprintf(out, "    state->a = (state->a >> 1) | (state->cc.cy << 7);\n");
+                        break;
+                    case 0x17:  // RAL
+                        fprintf(out, "    {\n");
+                        fprintf(out, "        uint8_t prev_cy = state->cc.cy;\n");
+                        fprintf(out, "        state->cc.cy = state->a >> 7;\n");
+                        fprintf(out, "        state->a = (state->a << 1) | prev_cy;\n");
+                        fprintf(out, "    }\n");
+                        break;
+                    case 0x1f:  // RAR
+                        fprintf(out, "    {\n");
+                        fprintf(out, "        uint8_t prev_cy = state->cc.cy;\n");
+                        fprintf(out, "        state->cc.cy = state->a & 1;\n");
+                        fprintf(out, "        state->a = (state->a >> 1) | (prev_cy << 7);\n");
+                        fprintf(out, "    }\n");
+                        break;
+                    case 0x27: fprintf(out, "    daa(state);\n"); break;
+                    case 0x2f: fprintf(out, "    state->a = ~state->a;\n"); break;
+                    case 0x37: fprintf(out, "    state->cc.cy = 1;\n"); break;
+                    case 0x3f: fprintf(out, "    state->cc.cy = !state->cc.cy;\n"); break;
+                }
+                return;
+        }
+        // NOP and unused opcodes
+        return;
+    }
+
+    // 0xc0-0xff
+    switch (src) {
+        case 0:
+            fprintf(out, "    state->pc = 0x%04x;\n", next);
+            fprintf(out, "    ret_cond(state, %s);\n", CONDS[dst]);
+            return;
+        case 1:
+            switch (op) {
+                case 0xc9: fprintf(out, "    ret(state);\n"); break;
+                case 0xe9: fprintf(out, "    state->pc = hl_addr(state);\n"); break;
+                case 0xf9: fprintf(out, "    state->sp = hl_addr(state);\n"); break;
+                case 0xf1: fprintf(out, "    pop_psw(state);\n"); break;
+                case 0xd9: break;
+                default:
+                    fprintf(out, "    pop_pair(state, %s);\n", PAIR_PTRS[pair & 3]);
+                    break;
+            }
+            return;
+        case 2:
+            fprintf(out, "    state->pc = %s ? 0x%04x : 0x%04x;\n", CONDS[dst], operand, next);
+            return;
+        case 3:
+            switch (op) {
+                case 0xc3: fprintf(out, "    state->pc = 0x%04x;\n", operand); break;
+                case 0xe3: fprintf(out, "    xthl(state);\n"); break;
+                case 0xeb:
+                    fprintf(out, "    swp_ptrs(&state->h, &state->d);\n");
+                    fprintf(out, "    swp_ptrs(&state->l, &state->e);\n");
+                    break;
+                case 0xf3: fprintf(out, "    state->int_enable = 0;\n"); break;
+                case 0xfb:
+                    fprintf(out, "    state->int_enable = 1;\n");
+                    fprintf(out, "    state->int_delay = 1;\n");
+                    break;
+            }
+            return;
+        case 4:
+            fprintf(out, "    state->pc = 0x%04x;\n", next);
+            fprintf(out, "    if (%s) {\n", CONDS[dst]);
+            fprintf(out, "        call_adr(state, 0x%04x);\n", operand);
+            fprintf(out, "        update_cond_cycles(state);\n");
+            fprintf(out, "    }\n");
+            return;
+        case 5:
+            if (op == 0xcd) {
+                fprintf(out, "    state->pc = 0x%04x;\n", next);
+                fprintf(out, "    call_adr(state, 0x%04x);\n", operand);
+            } else if (op == 0xf5) {
+                fprintf(out, "    push_psw(state);\n");
+            } else if (!(op & 0x08)) {
+                fprintf(out, "    push_pair(state, %s);\n", PAIR_VALUES[pair]);
+            }
+            return;
+        case 6:
+            switch (op) {
+                case 0xc6: fprintf(out, "    add_to_reg(state, &state->a, 0x%02x, 0);\n", operand); break;
+                case 0xce: fprintf(out, "    add_to_reg(state, &state->a, 0x%02x, state->cc.cy);\n", operand); break;
+                case 0xd6: fprintf(out, "    sub_from_reg(state, &state->a, 0x%02x, 0);\n", operand); break;
+                case 0xde: fprintf(out, "    sub_from_reg(state, &state->a, 0x%02x, state->cc.cy);\n", operand); break;
+                default:
+                    fprintf(out, "    %s(state, 0x%02x);\n", ALU_OPS[dst], operand);
+                    break;
+            }
+            return;
+        case 7:
+            fprintf(out, "    state->pc = 0x%04x;\n", next);
+            fprintf(out, "    call_adr(state, 0x%04x);\n", instr->target);
+            return;
+    }
+}
+
+
+/**
+ * Returns 1 if the interpreter has to run the instruction
+ */
+int needs_interpreter(const Instr8080 *instr) {
+    switch (instr->mnemonic) {
+        case MN_IN:
+        case MN_OUT:
+        case MN_HLT:
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Writes the function for one block. Returns 1 if the
+ * block has anything to compile.
+ */
+int emit_block(const uint8_t *memory, const BasicBlock *block, Instr8080 *instrs, FILE *out) {
+    size_t count = disasm_range(memory, block->start, block->end, instrs);
+    if (count > 0 && needs_interpreter(&instrs[count - 1])) {
+        count--;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    unsigned long cycles = 0;
+    for (size_t i = 0; i < count; i++) {
+        cycles += cycles_lookup[instrs[i].opcode];
+    }
+
+    fprintf(out, "\nstatic void block_%04x(State8080 *state) {\n", block->start);
+    fprintf(out, "    state->cycles += %lu;\n", cycles);
+
+    char text[DISASM_TEXT_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        disasm_format(&instrs[i], text, sizeof(text));
+        fprintf(out, "    // %04x  %s\n", instrs[i].pc, text);
+        emit_instr(out, &instrs[i]);
+    }
+
+    // blocks that stop without a branch continue
+    // with the next instruction
+    const Instr8080 *last = &instrs[count - 1];
+    if (last->flow == FLOW_NEXT) {
+        fprintf(out, "    state->pc = 0x%04x;\n", (uint16_t) (last->pc + last->length));
+    }
+    fprintf(out, "}\n");
+    return 1;
+}
+
+
+int recompile_rom(const uint8_t *memory, uint16_t size, FILE *out) {
+    uint16_t entries[] = ANALYSIS_DEFAULT_ENTRIES;
+    RomAnalysis an;
+    if (analysis_run(&an, memory, size, entries, ANALYSIS_DEFAULT_ENTRY_COUNT)) {
+        return -1;
+    }
+
+    uint32_t hash = aot_rom_hash(memory, size);
+    fprintf(out, "// Generated by recomp from a 0x%04x-byte ROM with hash 0x%08x.\n", size, hash);
+    fprintf(out, "// Do not edit.\n\n");
+    fprintf(out, "#include <stdint.h>\n\n");
+    fprintf(out, "#include \"aot.h\"\n");
+    fprintf(out, "#include \"cpu.h\"\n");
+    fprintf(out, "#include \"cpu_internal.h\"\n");
+
+    // one entry per byte is enough for any block
+    Instr8080 *instrs = malloc((size ? size : 1) * sizeof(*instrs));
+    uint8_t *compiled = calloc(an.block_count ? an.block_count : 1, sizeof(*compiled));
+    int count = 0;
+    for (size_t i = 0; i < an.block_count; i++) {
+        compiled[i] = emit_block(memory, &an.blocks[i], instrs, out);
+        count += compiled[i];
+    }
+
+    fprintf(out, "\nstatic const AotBlock BLOCKS[] = {\n");
+    for (size_t i = 0; i < an.block_count; i++) {
+        if (compiled[i]) {
+            fprintf(out, "    { 0x%04x, block_%04x },\n", an.blocks[i].start, an.blocks[i].start);
+        }
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "const AotRom aot_rom = {\n");
+    fprintf(out, "    .hash = 0x%08x,\n", hash);
+    fprintf(out, "    .size = 0x%04x,\n", size);
+    fprintf(out, "    .blocks = BLOCKS,\n");
+    fprintf(out, "    .count = %d\n", count);
+    fprintf(out, "};\n");
+
+    free(compiled);
+    free(instrs);
+    analysis_free(&an);
+    return count;
+}
@@ -0,0 +1,17 @@
+#include <stdint.h>
+#include "shifter.h"
+
+
+uint8_t shifter_in_result(void *arg, uint8_t port) {
+    return shifter_result(arg);
+}
+
+
+void shifter_out_offset(void *arg, uint8_t port, uint8_t value) {
+    shifter_write_offset(arg, value);
+}
+
+
+void shifter_out_data(void *arg, uint8_t port, uint8_t value) {
+    shifter_write_data(arg, value);
+}
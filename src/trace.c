@@ -0,0 +1,346 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+
+#define RECORD_SIZE sizeof(TraceRecord)
+
+// bytes of the changed-byte mask in front of a
+// compressed record
+#define MASK_SIZE ((RECORD_SIZE + 7) / 8)
+
+// 64-bit words covering a record
+#define RECORD_WORDS ((RECORD_SIZE + 7) / 8)
+
+// worst case for a compressed chunk
+#define MAX_CHUNK_BYTES (TRACE_CHUNK_RECORDS * (MASK_SIZE + RECORD_SIZE))
+
+#define MAGIC_SIZE 8
+
+
+typedef struct trace_header_t {
+    char magic[MAGIC_SIZE];
+    uint16_t version;
+    uint16_t flags;
+    uint16_t record_size;
+    uint16_t reserved;
+} TraceHeader;
+
+
+typedef struct chunk_header_t {
+    uint32_t count;
+    uint32_t bytes;
+} ChunkHeader;
+
+
+// tracers still open, closed by the atexit handler
+static Tracer *open_tracers = NULL;
+static pthread_mutex_t open_lock = PTHREAD_MUTEX_INITIALIZER;
+static int exit_handler_set = 0;
+
+
+uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+
+/**
+ * Delta-encodes `count` records into `out` and returns
+ * the number of bytes written. The first record is
+ * encoded against zeros, so chunks decode independently.
+ */
+size_t encode_chunk(const TraceRecord *records, size_t count, uint8_t *out) {
+    // the previous record as words, so the byte stores
+    // below can't alias it
+    uint64_t prev[RECORD_WORDS] = {0};
+    uint8_t *p = out;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t curr[RECORD_WORDS] = {0};
+        memcpy(curr, &records[i], RECORD_SIZE);
+
+        uint8_t *mask = p;
+        uint32_t bits = 0;
+        p += MASK_SIZE;
+        for (size_t w = 0; w < RECORD_WORDS; w++) {
+            uint64_t diff = curr[w] ^ prev[w];
+            prev[w] = curr[w];
+
+            // visit only the changed bytes, lowest first
+            while (diff) {
+                int k = __builtin_ctzll(diff) / 8;
+                bits |= (uint32_t) 1 << (w * 8 + k);
+                *p++ = diff >> (8 * k);
+                diff &= ~((uint64_t) 0xff << (8 * k));
+            }
+        }
+        for (size_t k = 0; k < MASK_SIZE; k++) {
+            mask[k] = bits >> (8 * k);
+        }
+    }
+    return p - out;
+}
+
+
+/**
+ * Reverses encode_chunk. Returns 0 on success, or 1 if
+ * the data is truncated.
+ */
+int decode_chunk(const uint8_t *in, size_t size, TraceRecord *records, size_t count) {
+    uint8_t prev[RECORD_SIZE] = {0};
+    const uint8_t *p = in;
+    const uint8_t *end = in + size;
+    for (size_t i = 0; i < count; i++) {
+        if (p + MASK_SIZE > end) {
+            return 1;
+        }
+        const uint8_t *mask = p;
+        p += MASK_SIZE;
+        for (size_t j = 0; j < RECORD_SIZE; j++) {
+            if (mask[j / 8] & (1 << (j % 8))) {
+                if (p == end) {
+                    return 1;
+                }
+                prev[j] ^= *p++;
+            }
+        }
+        memcpy(&records[i], prev, RECORD_SIZE);
+    }
+    return 0;
+}
+
+
+/**
+ * Writes one chunk to the file
+ */
+void write_chunk(Tracer *tracer, TraceChunk *chunk, uint8_t *buf) {
+    ChunkHeader header = { .count = chunk->count, .bytes = 0 };
+    const void *payload = chunk->records;
+    if (tracer->compress) {
+        header.bytes = encode_chunk(chunk->records, chunk->count, buf);
+        payload = buf;
+    } else {
+        header.bytes = chunk->count * RECORD_SIZE;
+    }
+    fwrite(&header, sizeof(header), 1, tracer->file);
+    fwrite(payload, header.bytes, 1, tracer->file);
+    tracer->bytes += sizeof(header) + header.bytes;
+}
+
+
+/**
+ * Writer thread: drains queued chunks until the
+ * tracer is closed
+ */
+void* writer_main(void *arg) {
+    Tracer *tracer = arg;
+    uint8_t *buf = tracer->compress ? malloc(MAX_CHUNK_BYTES) : NULL;
+
+    pthread_mutex_lock(&tracer->lock);
+    while (1) {
+        while (tracer->queued == 0 && !tracer->done) {
+            pthread_cond_wait(&tracer->cond, &tracer->lock);
+        }
+        if (tracer->queued == 0) {
+            break;
+        }
+        size_t tail = (tracer->head + TRACE_RING_CHUNKS - tracer->queued) % TRACE_RING_CHUNKS;
+        pthread_mutex_unlock(&tracer->lock);
+
+        write_chunk(tracer, &tracer->chunks[tail], buf);
+
+        pthread_mutex_lock(&tracer->lock);
+        tracer->queued--;
+        pthread_cond_broadcast(&tracer->cond);
+    }
+    pthread_mutex_unlock(&tracer->lock);
+
+    free(buf);
+    return NULL;
+}
+
+
+void close_open_tracers(void) {
+    while (open_tracers != NULL) {
+        trace_close(open_tracers);
+    }
+}
+
+
+int trace_open(Tracer *tracer, const char *path, int compress) {
+    tracer->file = fopen(path, "wb");
+    if (tracer->file == NULL) {
+        return 1;
+    }
+    TraceHeader header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .flags = compress ? TRACE_COMPRESSED : 0,
+        .record_size = RECORD_SIZE,
+        .reserved = 0
+    };
+    fwrite(&header, sizeof(header), 1, tracer->file);
+
+    tracer->compress = compress;
+    tracer->chunks = malloc(TRACE_RING_CHUNKS * sizeof(*tracer->chunks));
+    tracer->head = 0;
+    tracer->queued = 0;
+    tracer->next = tracer->chunks[0].records;
+    tracer->end = tracer->next + TRACE_CHUNK_RECORDS;
+    tracer->done = 0;
+    tracer->records = 0;
+    tracer->bytes = sizeof(header);
+    tracer->stalls = 0;
+    tracer->stall_ns = 0;
+    pthread_mutex_init(&tracer->lock, NULL);
+    pthread_cond_init(&tracer->cond, NULL);
+    pthread_create(&tracer->thread, NULL, writer_main, tracer);
+
+    pthread_mutex_lock(&open_lock);
+    tracer->next_open = open_tracers;
+    open_tracers = tracer;
+    if (!exit_handler_set) {
+        atexit(close_open_tracers);
+        exit_handler_set = 1;
+    }
+    pthread_mutex_unlock(&open_lock);
+    return 0;
+}
+
+
+void trace_submit(Tracer *tracer) {
+    pthread_mutex_lock(&tracer->lock);
+    size_t count = tracer->next - tracer->chunks[tracer->head].records;
+    tracer->chunks[tracer->head].count = count;
+    tracer->records += count;
+    tracer->queued++;
+    tracer->head = (tracer->head + 1) % TRACE_RING_CHUNKS;
+    pthread_cond_broadcast(&tracer->cond);
+
+    // the next chunk is free once the writer
+    // has less than a full ring queued
+    if (tracer->queued == TRACE_RING_CHUNKS) {
+        tracer->stalls++;
+        uint64_t start = now_ns();
+        while (tracer->queued == TRACE_RING_CHUNKS) {
+            pthread_cond_wait(&tracer->cond, &tracer->lock);
+        }
+        tracer->stall_ns += now_ns() - start;
+    }
+    pthread_mutex_unlock(&tracer->lock);
+    tracer->next = tracer->chunks[tracer->head].records;
+    tracer->end = tracer->next + TRACE_CHUNK_RECORDS;
+}
+
+
+void trace_close(Tracer *tracer) {
+    pthread_mutex_lock(&open_lock);
+    Tracer **link = &open_tracers;
+    while (*link != NULL && *link != tracer) {
+        link = &(*link)->next_open;
+    }
+    if (*link == NULL) {
+        // already closed
+        pthread_mutex_unlock(&open_lock);
+        return;
+    }
+    *link = tracer->next_open;
+    pthread_mutex_unlock(&open_lock);
+
+    if (tracer->next != tracer->chunks[tracer->head].records) {
+        trace_submit(tracer);
+    }
+    pthread_mutex_lock(&tracer->lock);
+    tracer->done = 1;
+    pthread_cond_broadcast(&tracer->cond);
+    pthread_mutex_unlock(&tracer->lock);
+    pthread_join(tracer->thread, NULL);
+
+    fclose(tracer->file);
+    free(tracer->chunks);
+    pthread_mutex_destroy(&tracer->lock);
+    pthread_cond_destroy(&tracer->cond);
+    tracer->file = NULL;
+    tracer->chunks = NULL;
+
+    fprintf(stderr, "Trace: %lu records, %lu bytes (%.1f per record), %lu stalls (%.1f ms)\n",
+        tracer->records, tracer->bytes,
+        tracer->records ? (double) tracer->bytes / tracer->records : 0.0,
+        tracer->stalls, tracer->stall_ns / 1e6);
+}
+
+
+int trace_reader_open(TraceReader *reader, const char *path) {
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        return 1;
+    }
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, MAGIC_SIZE) != 0 ||
+        header.version != TRACE_VERSION ||
+        header.record_size != RECORD_SIZE) {
+        fclose(reader->file);
+        return 1;
+    }
+    reader->compressed = header.flags & TRACE_COMPRESSED;
+    reader->records = malloc(TRACE_CHUNK_RECORDS * RECORD_SIZE);
+    reader->buf = malloc(MAX_CHUNK_BYTES);
+    reader->count = 0;
+    reader->pos = 0;
+    return 0;
+}
+
+
+/**
+ * Loads the next chunk. Returns 0 at the end of the
+ * trace or if the chunk is damaged.
+ */
+int read_chunk(TraceReader *reader) {
+    ChunkHeader header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 ||
+        header.count > TRACE_CHUNK_RECORDS || header.bytes > MAX_CHUNK_BYTES ||
+        fread(reader->buf, 1, header.bytes, reader->file) != header.bytes) {
+        return 0;
+    }
+    if (reader->compressed) {
+        if (decode_chunk(reader->buf, header.bytes, reader->records, header.count)) {
+            return 0;
+        }
+    } else {
+        if (header.bytes != header.count * RECORD_SIZE) {
+            return 0;
+        }
+        memcpy(reader->records, reader->buf, header.bytes);
+    }
+    reader->count = header.count;
+    reader->pos = 0;
+    return 1;
+}
+
+
+int trace_reader_next(TraceReader *reader, TraceRecord *rec) {
+    while (reader->pos == reader->count) {
+        if (!read_chunk(reader)) {
+            return 0;
+        }
+    }
+    *rec = reader->records[reader->pos++];
+    return 1;
+}
+
+
+void trace_reader_close(TraceReader *reader) {
+    fclose(reader->file);
+    free(reader->records);
+    free(reader->buf);
+    reader->file = NULL;
+    reader->records = NULL;
+    reader->buf = NULL;
+}
@@ -0,0 +1,72 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "machine.h"
+#include "watchdog.h"
+
+
+void watchdog_init(Watchdog *watchdog, int frames, int loop_bytes, WatchdogFn on_hang, void *arg) {
+    *watchdog = (Watchdog) {
+        .frames = frames,
+        .loop_bytes = loop_bytes,
+        .on_hang = on_hang,
+        .arg = arg
+    };
+}
+
+
+/**
+ * Once per frame: progress if an interrupt was delivered,
+ * otherwise widen the loop signature by the current PC
+ */
+void watchdog_vblank(Machine *machine, void *arg) {
+    Watchdog *watchdog = arg;
+    uint16_t pc = machine->cpu_state->pc;
+    if (machine->interrupts_delivered != watchdog->delivered || watchdog->stalled == 0) {
+        watchdog->delivered = machine->interrupts_delivered;
+        watchdog->stalled = 1;
+        watchdog->loop_start = pc;
+        watchdog->loop_end = pc;
+        return;
+    }
+    if (watchdog->hung) {
+        return;
+    }
+
+    watchdog->stalled++;
+    if (pc < watchdog->loop_start) {
+        watchdog->loop_start = pc;
+    }
+    if (pc > watchdog->loop_end) {
+        watchdog->loop_end = pc;
+    }
+    if (watchdog->stalled <= watchdog->frames) {
+        return;
+    }
+    if (watchdog->loop_bytes && watchdog->loop_end - watchdog->loop_start >= watchdog->loop_bytes) {
+        return;
+    }
+
+    watchdog->hung = 1;
+    watchdog->hangs++;
+    if (watchdog->on_hang != NULL) {
+        watchdog->on_hang(machine, watchdog, watchdog->arg);
+    }
+}
+
+
+int watchdog_attach(Watchdog *watchdog, Machine *machine) {
+    watchdog_reset(watchdog, machine);
+    return machine_add_vblank(machine, watchdog_vblank, watchdog);
+}
+
+
+void watchdog_detach(Watchdog *watchdog, Machine *machine) {
+    machine_remove_vblank(machine, watchdog_vblank, watchdog);
+}
+
+
+void watchdog_reset(Watchdog *watchdog, const Machine *machine) {
+    watchdog->delivered = machine->interrupts_delivered;
+    watchdog->stalled = 0;
+    watchdog->hung = 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Benchmark for machine cloning
+ *
+ * Runs a machine for a few frames, then clones it into every
+ * slot of an arena over and over and reports clones per
+ * second and resident memory. As a baseline, the same number
+ * of clones is made the naive way, with one malloc and a full
+ * 64 KB copy each. Finally one frame is run on the original
+ * and on the first and last slots, which must all end up
+ * with the same RAM.
+ *
+ *  clonebench [-n slots] [-r rounds] [invaders folder]
+ *
+ * Without a ROM folder a small program that keeps rewriting
+ * RAM is used instead.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "board.h"
+#include "cpu.h"
+#include "machine.h"
+
+
+// RST 1 and 2 return with interrupts enabled; the main
+// loop increments every byte of RAM after the stack
+static const uint8_t PROGRAM[] = {
+    [0x00] = 0xc3, 0x40, 0x00,      // JMP 0040
+    [0x08] = 0xfb, 0xc9,            // EI; RET
+    [0x10] = 0xfb, 0xc9,            // EI; RET
+    [0x40] = 0x31, 0x00, 0x24,      // LXI SP,2400
+    0xfb,                           // EI
+    0x21, 0x00, 0x24,               // LXI H,2400
+    0x34,                           // INR M
+    0x23,                           // INX H
+    0x7c,                           // MOV A,H
+    0xfe, 0x40,                     // CPI 40
+    0xc2, 0x47, 0x00,               // JNZ 0047
+    0xc3, 0x44, 0x00                // JMP 0044
+};
+
+#define WARMUP_FRAMES 60
+
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Resident memory in bytes, or 0 if unknown
+ */
+size_t resident_bytes(void) {
+    unsigned long size, resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    int n = fscanf(f, "%lu %lu", &size, &resident);
+    fclose(f);
+    return n == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+
+int main(int argc, char **argv) {
+    size_t count = 4096;
+    int rounds = 50;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n': count = strtoul(optarg, NULL, 0); break;
+            case 'r': rounds = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n slots] [-r rounds] [invaders folder]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (count < 1 || rounds < 1) {
+        fprintf(stderr, "Need at least one slot and one round\n");
+        return EXIT_FAILURE;
+    }
+
+    Board board;
+    if (board_open(&board, "invaders")) {
+        return EXIT_FAILURE;
+    }
+    Machine *base = machine_create(&board);
+    if (base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    uint8_t *memory = base->cpu_state->memory;
+    if (optind < argc) {
+        if (board_load_roms(&board, argv[optind], memory)) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        memcpy(memory, PROGRAM, sizeof(PROGRAM));
+    }
+    uint32_t ram_start = board.ram[0].start;
+    uint32_t ram_size = board.ram[0].end - ram_start;
+    machine_run_frames(base, WARMUP_FRAMES);
+
+    size_t before = resident_bytes();
+    MachineArena arena;
+    if (machine_arena_create(&arena, count, base)) {
+        fprintf(stderr, "Can't allocate %zu slots\n", count);
+        return EXIT_FAILURE;
+    }
+    size_t after = resident_bytes();
+
+    double start = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        machine_arena_clone(&arena, base, 0, count);
+    }
+    double arena_secs = now_seconds() - start;
+
+    // baseline: a fresh allocation and the whole address space
+    volatile uint8_t sink = 0;
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            uint8_t *copy = malloc(CPU_MEM_SIZE);
+            memcpy(copy, memory, CPU_MEM_SIZE);
+            sink ^= copy[i & 0xffff];
+            free(copy);
+        }
+    }
+    double naive_secs = now_seconds() - start;
+
+    double clones = (double) count * rounds;
+    printf("Slots:   %zu x %zu bytes reserved, %.1f KB resident each\n",
+        count, sizeof(MachineInstance), (after - before) / 1024.0 / count);
+    printf("Arena:   %.0f clones/s (%.0f ns each, %.2f GB/s of RAM)\n",
+        clones / arena_secs, arena_secs / clones * 1e9,
+        clones * ram_size / arena_secs / 1e9);
+    printf("Naive:   %.0f clones/s (%.0f ns each)\n",
+        clones / naive_secs, naive_secs / clones * 1e9);
+
+    Machine *first = machine_arena_slot(&arena, 0);
+    Machine *last = machine_arena_slot(&arena, count - 1);
+    machine_run_frames(base, 1);
+    machine_run_frames(first, 1);
+    machine_run_frames(last, 1);
+    int ok = memcmp(first->cpu_state->memory + ram_start, memory + ram_start, ram_size) == 0 &&
+        memcmp(last->cpu_state->memory + ram_start, memory + ram_start, ram_size) == 0 &&
+        first->cpu_state->pc == base->cpu_state->pc && last->cpu_state->pc == base->cpu_state->pc;
+    printf("Clones %s the original after one frame\n", ok ? "match" : "DIFFER from");
+
+    machine_arena_destroy(&arena);
+    machine_destroy(base);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
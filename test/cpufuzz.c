@@ -0,0 +1,722 @@
+/*
+ * Differential fuzzing harness for CPU cores
+ *
+ * Every input is turned into a random initial `State8080`
+ * plus a 64K memory image holding an instruction stream at
+ * the initial PC. The input is run for up to STEPS_PER_INPUT
+ * instructions on the reference core (`cpu_emulate_op`) and
+ * on a candidate core, and the first instruction after which
+ * the two disagree is reported with a register/flag/memory
+ * diff.
+ *
+ * Block candidates (`run-block`) run the whole input in one
+ * call with a budget of the cycles the reference took, so
+ * registers stay in locals across instructions and are
+ * only written back at the end, around port handlers and
+ * on a ROM write. Only the final state, memory and port
+ * log are compared, including the fault a ROM write
+ * leaves; half the inputs get a ROM at 0x0000-0x03ff to
+ * trip that path. Each side runs in a child process, so a
+ * crashing candidate is reported rather than fatal.
+ *
+ * Port handlers fold the registers they see into the port
+ * log, and OUT to a port with both low bits set requests
+ * an interrupt, so writebacks around port calls and
+ * interrupts taken mid-run are checked too.
+ *
+ * Input layout:
+ *
+ *  0-6    A B C D E H L
+ *  7      flags (S Z - AC - P - CY, same as PUSH PSW)
+ *  8-9    SP (little endian)
+ *  10-11  PC (little endian)
+ *  12     interrupt bits (enable, pending, delay, type,
+ *         ROM in block mode)
+ *  13-15  seed for the background memory fill
+ *  16-    instruction stream, copied to PC
+ *
+ * Built with -DFUZZ_LIBFUZZER this file only provides
+ * `LLVMFuzzerTestOneInput` (divergences abort). Otherwise it
+ * has its own driver:
+ *
+ *  cpufuzz [-c core] file...              replay inputs
+ *  cpufuzz [-c core] [-j jobs] [-t secs] [-s seed]
+ *                                         throughput mode
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "cpu.h"
+#include "difftest.h"
+#include "disassembler.h"
+
+
+#define MEM_SIZE (1 << 16)
+
+#define HEADER_SIZE 16
+#define MAX_INPUT_SIZE 256
+#define STEPS_PER_INPUT 256
+
+// memory diffs longer than this are truncated
+#define MAX_MEM_DIFFS 16
+
+#define HLT 0x76
+#define NOP 0x00
+
+// ROM given to block mode inputs with bit 5 of byte 12 set
+#define BLOCK_ROM_SIZE 0x0400
+
+// budget for a candidate whose reference run faulted, so it
+// should stop at the same instruction
+#define BLOCK_MAX_BUDGET (1 << 20)
+
+
+typedef int (*CpuCore)(State8080 *state, IO8080 *io);
+typedef int (*CpuBlock)(State8080 *state, IO8080 *io, int budget);
+
+
+/**
+ * cpu_run with a budget of one instruction
+ */
+int cpu_run_one(State8080 *state, IO8080 *io) {
+    return cpu_run(state, io, 1);
+}
+
+
+/**
+ * A core is either stepped one instruction at a time
+ * or, if `block` is set, run over the whole input
+ */
+typedef struct candidate_t {
+    const char *name;
+    CpuCore step;
+    CpuBlock block;
+} Candidate;
+
+
+/**
+ * Cores that can be checked against the reference.
+ * New cores register themselves here.
+ */
+static const Candidate CANDIDATES[] = {
+    { "reference", cpu_emulate_op, NULL },
+    { "run", cpu_run_one, NULL },
+    { "run-block", NULL, cpu_run },
+};
+
+#define CANDIDATE_COUNT (sizeof(CANDIDATES) / sizeof(CANDIDATES[0]))
+
+
+/**
+ * Port accesses during one instruction (all of them in
+ * block mode). `hash` covers every access in order, with
+ * the registers the handler saw.
+ */
+typedef struct port_log_t {
+    uint8_t calls;
+    uint8_t in_port;
+    uint8_t out_port;
+    uint8_t out_value;
+    uint32_t hash;
+} PortLog;
+
+
+/**
+ * One side of the comparison
+ */
+typedef struct run_t {
+    State8080 state;
+    IO8080 io;
+    PortLog ports;
+    int cycles;
+} Run;
+
+
+static uint8_t init_mem[MEM_SIZE];
+static uint8_t ref_mem[MEM_SIZE];
+static uint8_t cand_mem[MEM_SIZE];
+static const Candidate *candidate = &CANDIDATES[0];
+
+
+/**
+ * How one side of a block mode comparison ended, written
+ * by its child process
+ */
+typedef struct outcome_t {
+    State8080 state;
+    PortLog ports;
+    int steps;
+    uint8_t memory[MEM_SIZE];
+} Outcome;
+
+// shared with the children: reference, then candidate
+static Outcome *outcomes;
+
+
+/**
+ * Folds an access and the registers the handler sees
+ * into the log's hash
+ */
+void log_access(Run *run, uint32_t access) {
+    State8080 *s = &run->state;
+    uint32_t regs[] = {
+        access,
+        s->a | (s->b << 8) | (s->c << 16) | ((uint32_t) s->d << 24),
+        s->e | (s->h << 8) | (s->l << 16),
+        s->sp | ((uint32_t) s->pc << 16),
+        s->cc.z | (s->cc.s << 1) | (s->cc.p << 2) | (s->cc.cy << 3) | (s->cc.ac << 4) |
+            (s->int_enable << 5) | (s->int_pending << 6) | (s->int_delay << 7),
+        (uint32_t) s->cycles
+    };
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        run->ports.hash = (run->ports.hash ^ regs[i]) * 16777619;
+    }
+}
+
+
+/**
+ * IN handler on every port: reads a value derived
+ * from the port number
+ */
+uint8_t log_in(void *arg, uint8_t port) {
+    Run *run = arg;
+    run->ports.calls++;
+    run->ports.in_port = port;
+    log_access(run, port);
+    return port ^ 0xa5;
+}
+
+
+/**
+ * OUT handler on every port. Ports with both low bits
+ * set request the interrupt picked by the value.
+ */
+void log_out(void *arg, uint8_t port, uint8_t value) {
+    Run *run = arg;
+    run->ports.calls++;
+    run->ports.out_port = port;
+    run->ports.out_value = value;
+    log_access(run, 0x10000 | (port << 8) | value);
+    if ((port & 3) == 3) {
+        cpu_request_interrupt(&run->state, value & 7);
+    }
+}
+
+
+/**
+ * Builds the initial memory image from the raw fuzzer input
+ */
+void build_image(const uint8_t *data, size_t size) {
+    uint8_t header[HEADER_SIZE] = {0};
+    memcpy(header, data, size < HEADER_SIZE ? size : HEADER_SIZE);
+    uint16_t pc = header[10] | (header[11] << 8);
+
+    // fill the background so loads see varied data
+    uint32_t seed = header[13] | (header[14] << 8) | (header[15] << 16) | 1;
+    for (size_t i = 0; i < MEM_SIZE; i += 4) {
+        uint32_t r = xorshift32(&seed);
+        memcpy(&init_mem[i], &r, 4);
+    }
+    for (size_t i = HEADER_SIZE; i < size; i++) {
+        init_mem[(uint16_t) (pc + i - HEADER_SIZE)] = data[i];
+    }
+
+    // HLT terminates the process in the reference core
+    for (size_t i = 0; i < MEM_SIZE; i++) {
+        if (init_mem[i] == HLT) {
+            init_mem[i] = NOP;
+        }
+    }
+}
+
+
+/**
+ * Resets one side of the comparison to the initial
+ * state described by the input header
+ */
+void init_run(Run *run, uint8_t *memory, const uint8_t *data, size_t size) {
+    uint8_t header[HEADER_SIZE] = {0};
+    memcpy(header, data, size < HEADER_SIZE ? size : HEADER_SIZE);
+
+    uint8_t flags = header[7];
+    run->state = (State8080) {
+        .a = header[0],
+        .b = header[1],
+        .c = header[2],
+        .d = header[3],
+        .e = header[4],
+        .h = header[5],
+        .l = header[6],
+        .sp = header[8] | (header[9] << 8),
+        .pc = header[10] | (header[11] << 8),
+        .memory = memory,
+        .rom_size = candidate->block != NULL && (header[12] & 0x20) ? BLOCK_ROM_SIZE : 0,
+        .cc = (ConditionCodes) {
+            .cy = flags & 1,
+            .p = (flags >> 2) & 1,
+            .ac = (flags >> 4) & 1,
+            .z = (flags >> 6) & 1,
+            .s = (flags >> 7) & 1
+        },
+        .int_enable = header[12] & 1,
+        .int_pending = (header[12] >> 1) & 1,
+        .int_delay = (header[12] >> 2) & 1,
+        .int_type = 8 * ((header[12] >> 3) & 3),
+        .cycles = 0
+    };
+    cpu_io_init(&run->io);
+    for (int port = 0; port < CPU_PORT_COUNT; port++) {
+        cpu_io_on_in(&run->io, port, log_in, run);
+        cpu_io_on_out(&run->io, port, log_out, run);
+    }
+    run->ports = (PortLog) {0};
+    run->cycles = 0;
+    memcpy(memory, init_mem, MEM_SIZE);
+}
+
+
+/**
+ * Returns 1 if registers, flags, port accesses or the
+ * returned cycle count differ
+ */
+int regs_differ(Run *ref, Run *cand) {
+    State8080 *r = &ref->state;
+    State8080 *c = &cand->state;
+    return r->a != c->a || r->b != c->b || r->c != c->c ||
+        r->d != c->d || r->e != c->e || r->h != c->h || r->l != c->l ||
+        r->sp != c->sp || r->pc != c->pc ||
+        r->cc.z != c->cc.z || r->cc.s != c->cc.s || r->cc.p != c->cc.p ||
+        r->cc.cy != c->cc.cy || r->cc.ac != c->cc.ac ||
+        r->int_enable != c->int_enable || r->int_pending != c->int_pending ||
+        r->int_delay != c->int_delay || r->int_type != c->int_type ||
+        r->cycles != c->cycles || ref->cycles != cand->cycles ||
+        r->fault != c->fault || r->fault_adr != c->fault_adr ||
+        memcmp(&ref->ports, &cand->ports, sizeof(PortLog)) != 0;
+}
+
+
+void print_row(const char *name, unsigned long ref, unsigned long cand, int width) {
+    printf("  %-8s %0*lx  %0*lx%s\n", name, width, ref, width, cand,
+        ref != cand ? "  <--" : "");
+}
+
+
+/**
+ * Prints the register, flag and memory differences
+ */
+void print_diff(Run *ref, Run *cand) {
+    State8080 *r = &ref->state;
+    State8080 *c = &cand->state;
+    printf("  %-8s %-4s  %s\n", "", "ref", candidate->name);
+    print_row("A", r->a, c->a, 2);
+    print_row("B", r->b, c->b, 2);
+    print_row("C", r->c, c->c, 2);
+    print_row("D", r->d, c->d, 2);
+    print_row("E", r->e, c->e, 2);
+    print_row("H", r->h, c->h, 2);
+    print_row("L", r->l, c->l, 2);
+    print_row("SP", r->sp, c->sp, 4);
+    print_row("PC", r->pc, c->pc, 4);
+    print_row("Z", r->cc.z, c->cc.z, 1);
+    print_row("S", r->cc.s, c->cc.s, 1);
+    print_row("P", r->cc.p, c->cc.p, 1);
+    print_row("CY", r->cc.cy, c->cc.cy, 1);
+    print_row("AC", r->cc.ac, c->cc.ac, 1);
+    print_row("INTE", r->int_enable, c->int_enable, 1);
+    print_row("INTP", r->int_pending, c->int_pending, 1);
+    print_row("INTD", r->int_delay, c->int_delay, 1);
+    print_row("INTT", r->int_type, c->int_type, 2);
+    print_row("CYCLES", r->cycles, c->cycles, 4);
+    print_row("FAULT", r->fault, c->fault, 1);
+    print_row("FAULT.AT", r->fault_adr, c->fault_adr, 4);
+    print_row("RET", ref->cycles, cand->cycles, 4);
+    print_row("IO.CALLS", ref->ports.calls, cand->ports.calls, 2);
+    print_row("IN.PORT", ref->ports.in_port, cand->ports.in_port, 2);
+    print_row("OUT.PORT", ref->ports.out_port, cand->ports.out_port, 2);
+    print_row("OUT.VAL", ref->ports.out_value, cand->ports.out_value, 2);
+    print_row("IO.HASH", ref->ports.hash, cand->ports.hash, 8);
+
+    int diffs = 0;
+    for (size_t i = 0; i < MEM_SIZE; i++) {
+        if (r->memory[i] == c->memory[i]) {
+            continue;
+        }
+        if (diffs++ < MAX_MEM_DIFFS) {
+            printf("  [%04zx]   %02x    %02x  <--\n", i, r->memory[i], c->memory[i]);
+        }
+    }
+    if (diffs > MAX_MEM_DIFFS) {
+        printf("  ... %d more memory differences\n", diffs - MAX_MEM_DIFFS);
+    }
+}
+
+
+/**
+ * Returns 1 if the next instruction would be a HLT,
+ * including one stored at runtime or at an interrupt vector
+ */
+int next_is_hlt(State8080 *state) {
+    uint16_t pc = state->pc;
+    if (state->int_enable && state->int_pending && state->int_delay == 0) {
+        pc = state->int_type;
+    }
+    return state->memory[pc] == HLT;
+}
+
+
+/**
+ * Runs one instruction on both cores
+ */
+void step_both(Run *ref, Run *cand) {
+    ref->ports = (PortLog) {0};
+    cand->ports = (PortLog) {0};
+    ref->cycles = cpu_emulate_op(&ref->state, &ref->io);
+    cand->cycles = candidate->step(&cand->state, &cand->io);
+}
+
+
+void record_outcome(Run *run, Outcome *outcome) {
+    outcome->state = run->state;
+    outcome->ports = run->ports;
+    memcpy(outcome->memory, run->state.memory, MEM_SIZE);
+}
+
+
+/**
+ * Runs one side of a block mode comparison in a child
+ * process: the reference steps until it has run
+ * STEPS_PER_INPUT instructions, reaches a HLT or faults,
+ * the candidate gets `budget` cycles. Returns 1 if the child
+ * didn't report.
+ */
+int run_side(Run *run, Outcome *outcome, int is_ref, int budget) {
+    outcome->steps = -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int steps = 0;
+        if (is_ref) {
+            while (steps < STEPS_PER_INPUT && !next_is_hlt(&run->state) &&
+                    run->state.fault == CPU_FAULT_NONE) {
+                steps++;
+                cpu_emulate_op(&run->state, &run->io);
+            }
+        } else {
+            candidate->block(&run->state, &run->io, budget);
+        }
+        record_outcome(run, outcome);
+        outcome->steps = steps;
+        _exit(EXIT_SUCCESS);
+    }
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return !WIFEXITED(status);
+}
+
+
+/**
+ * Block mode version of run_input
+ */
+int run_block_input(const uint8_t *data, size_t size) {
+    Run ref, cand;
+    build_image(data, size);
+    init_run(&ref, ref_mem, data, size);
+    init_run(&cand, cand_mem, data, size);
+
+    if (outcomes == NULL) {
+        outcomes = mmap(NULL, 2 * sizeof(Outcome), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (outcomes == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+    Outcome *ref_out = &outcomes[0];
+    Outcome *cand_out = &outcomes[1];
+    if (run_side(&ref, ref_out, 1, 0)) {
+        printf("Reference run crashed\n");
+        return 1;
+    }
+    int ref_fault = ref_out->state.fault != CPU_FAULT_NONE;
+    uint64_t budget = ref_fault ? BLOCK_MAX_BUDGET : ref_out->state.cycles;
+    if (budget == 0) {
+        return 0;
+    }
+    int crashed = run_side(&cand, cand_out, 0, budget);
+
+    ref.state = ref_out->state;
+    ref.state.memory = ref_out->memory;
+    ref.ports = ref_out->ports;
+    cand.state = cand_out->state;
+    cand.state.memory = cand_out->memory;
+    cand.ports = cand_out->ports;
+    if (!crashed && !regs_differ(&ref, &cand) &&
+            memcmp(ref_out->memory, cand_out->memory, MEM_SIZE) == 0) {
+        return 0;
+    }
+
+    printf("Divergence after %d instructions (%s, %s)\n", ref_out->steps,
+        ref_fault ? "reference faulted" : "reference finished",
+        crashed ? "candidate crashed" : cand_out->state.fault ? "candidate faulted" : "candidate finished");
+    print_diff(&ref, &cand);
+    return 1;
+}
+
+
+/**
+ * Runs the input on both cores. Returns 0 if they agree,
+ * otherwise prints the first diverging instruction and
+ * returns 1.
+ */
+int run_input(const uint8_t *data, size_t size) {
+    if (candidate->block != NULL) {
+        return run_block_input(data, size);
+    }
+
+    Run ref, cand;
+    build_image(data, size);
+    init_run(&ref, ref_mem, data, size);
+    init_run(&cand, cand_mem, data, size);
+
+    // registers are cheap to compare after every step,
+    // memory is only compared at the end
+    int step;
+    int diverged = 0;
+    for (step = 0; step < STEPS_PER_INPUT && !next_is_hlt(&ref.state); step++) {
+        step_both(&ref, &cand);
+        if (regs_differ(&ref, &cand)) {
+            diverged = 1;
+            break;
+        }
+    }
+    if (!diverged && memcmp(ref_mem, cand_mem, MEM_SIZE) == 0) {
+        return 0;
+    }
+
+    // replay comparing memory as well, since a bad store
+    // can precede the first register difference
+    int limit = step;
+    diverged = -1;
+    init_run(&ref, ref_mem, data, size);
+    init_run(&cand, cand_mem, data, size);
+    for (step = 0; step <= limit && step < STEPS_PER_INPUT; step++) {
+        step_both(&ref, &cand);
+        if (regs_differ(&ref, &cand) || memcmp(ref_mem, cand_mem, MEM_SIZE) != 0) {
+            diverged = step;
+            break;
+        }
+    }
+    if (diverged < 0) {
+        return 0;
+    }
+
+    // replay once more up to the diverging
+    // instruction to show what it was
+    Run before;
+    init_run(&before, ref_mem, data, size);
+    for (step = 0; step < diverged; step++) {
+        cpu_emulate_op(&before.state, &before.io);
+    }
+    printf("Divergence at instruction %d: ", diverged);
+    disassemble8080op(ref_mem, before.state.pc);
+
+    init_run(&ref, ref_mem, data, size);
+    init_run(&cand, cand_mem, data, size);
+    for (step = 0; step <= diverged; step++) {
+        step_both(&ref, &cand);
+    }
+    print_diff(&ref, &cand);
+    return 1;
+}
+
+
+#ifdef FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    const char *name = getenv("CPUFUZZ_CORE");
+    if (name != NULL) {
+        for (size_t i = 0; i < CANDIDATE_COUNT; i++) {
+            if (strcmp(CANDIDATES[i].name, name) == 0) {
+                candidate = &CANDIDATES[i];
+            }
+        }
+    }
+    if (run_input(data, size)) {
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+/**
+ * Replays an input file. Returns 1 on divergence.
+ */
+int replay_file(const char *path) {
+    uint8_t data[MAX_INPUT_SIZE];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("Error: couldn't open %s\n", path);
+        return 1;
+    }
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    printf("%s: ", path);
+    int res = run_input(data, size);
+    if (!res) {
+        printf("ok\n");
+    }
+    return res;
+}
+
+
+void save_input(const uint8_t *data, size_t size, uint32_t seed, unsigned long n) {
+    char path[64];
+    snprintf(path, sizeof(path), "crash-%08x-%lu.bin", seed, n);
+    FILE *f = fopen(path, "wb");
+    if (f != NULL) {
+        fwrite(data, 1, size, f);
+        fclose(f);
+        printf("Saved input to %s\n", path);
+    }
+}
+
+
+/**
+ * Generates random inputs until `seconds` have passed
+ * (0 = forever). Returns the number of divergences.
+ */
+unsigned long fuzz_worker(uint32_t seed, long seconds) {
+    uint8_t data[MAX_INPUT_SIZE];
+    uint32_t rng = seed | 1;
+    unsigned long execs = 0;
+    unsigned long failures = 0;
+    time_t start = time(NULL);
+    time_t last_report = start;
+
+    while (1) {
+        size_t size = HEADER_SIZE + xorshift32(&rng) % (MAX_INPUT_SIZE - HEADER_SIZE);
+        for (size_t i = 0; i < size; i++) {
+            data[i] = xorshift32(&rng);
+        }
+        if (run_input(data, size)) {
+            save_input(data, size, seed, execs);
+            failures++;
+        }
+        execs++;
+
+        // checking the clock is cheap next to an input,
+        // but there's no need to do it every time
+        if ((execs & 0xff) == 0) {
+            time_t now = time(NULL);
+            if (seconds > 0 && now - start >= seconds) {
+                break;
+            }
+            if (now - last_report >= 60) {
+                printf("[%08x] %lu execs, %.0f/s, %lu divergences\n",
+                    seed, execs, execs / (double) (now - start), failures);
+                fflush(stdout);
+                last_report = now;
+            }
+        }
+    }
+
+    long elapsed = time(NULL) - start;
+    printf("[%08x] done: %lu execs in %lds (%.0f/s), %lu divergences\n",
+        seed, execs, elapsed, execs / (double) (elapsed ? elapsed : 1), failures);
+    return failures;
+}
+
+
+/**
+ * Forks `jobs` workers with consecutive seeds and waits
+ * for all of them. Returns the number of failed workers.
+ */
+int fuzz_parallel(int jobs, uint32_t seed, long seconds) {
+    fflush(stdout);
+    for (int j = 0; j < jobs; j++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(fuzz_worker(seed + j, seconds) ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+        if (pid < 0) {
+            perror("fork");
+            jobs = j;
+            break;
+        }
+    }
+
+    int failed = 0;
+    int status;
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+
+void usage(char *exe) {
+    fprintf(stderr, "Usage: %s [-c core] [-j jobs] [-t seconds] [-s seed] [file...]\n", exe);
+    fprintf(stderr, "Cores:");
+    for (size_t i = 0; i < CANDIDATE_COUNT; i++) {
+        fprintf(stderr, " %s", CANDIDATES[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+    int jobs = 1;
+    long seconds = 10;
+    uint32_t seed = (uint32_t) time(NULL);
+    while ((opt = getopt(argc, argv, "c:j:t:s:")) != -1) {
+        switch (opt) {
+            case 'c':
+                candidate = NULL;
+                for (size_t i = 0; i < CANDIDATE_COUNT; i++) {
+                    if (strcmp(CANDIDATES[i].name, optarg) == 0) {
+                        candidate = &CANDIDATES[i];
+                    }
+                }
+                if (candidate == NULL) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'j': jobs = atoi(optarg); break;
+            case 't': seconds = atol(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind < argc) {
+        int failures = 0;
+        for (int i = optind; i < argc; i++) {
+            failures += replay_file(argv[i]);
+        }
+        return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    printf("Fuzzing core '%s' with %d job(s), seed 0x%08x\n", candidate->name, jobs, seed);
+    if (jobs <= 1) {
+        return fuzz_worker(seed, seconds) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    return fuzz_parallel(jobs, seed, seconds) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
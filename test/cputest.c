@@ -0,0 +1,422 @@
+/*
+ * 8080 instruction-set conformance harness
+ *
+ * Runs the standard CP/M exerciser programs against
+ * `cpu_emulate_op` without a display:
+ *
+ *  TST8080.COM  - Microcosm Associates CPU diagnostic
+ *  8080PRE.COM  - preliminary exerciser (Ian Bartholomew)
+ *  CPUTEST.COM  - SuperSoft Associates CPU test
+ *  8080EXM.COM  - full exerciser, checks a CRC per
+ *                 instruction group
+ *
+ * Each program is loaded at 0x100 into a flat 64K memory
+ * with no ROM-write trap. A minimal BDOS stub at 0x0005
+ * handles console output (functions 2 and 9), and a jump
+ * to 0x0000 (warm boot) ends the program. The captured
+ * console output is then checked for the program's success
+ * banner and for any CRC/error report.
+ *
+ * Before them, a few known-answer checks (values from the
+ * 8080 manual) run single instructions that are easy to get
+ * wrong: the auxiliary carry of each ALU group, DAA, ADC M,
+ * RP and interrupt acceptance. They need no files, so
+ * without a folder only they run.
+ *
+ * Usage: cputest [-v] [-n max_instrs] [folder [program...]]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "cpu.h"
+
+
+#define MEM_SIZE (1 << 16)
+
+#define TPA_START 0x0100
+#define WARM_BOOT 0x0000
+#define BDOS_ENTRY 0x0005
+
+// where programs that use `LHLD 6` put their stack
+#define BDOS_TOP 0xf000
+
+// 8080EXM runs for ~2.4e10 cycles
+#define DEFAULT_MAX_INSTRS 20000000000ULL
+
+#define OUTPUT_CHUNK 4096
+
+
+typedef struct cpm_test_t {
+    // file name inside the ROM folder
+    const char *file;
+
+    // string printed when every check passes
+    const char *pass_marker;
+
+    // strings that indicate a failed check or
+    // CRC mismatch
+    const char *fail_markers[3];
+} CpmTest;
+
+
+static const CpmTest TESTS[] = {
+    { "TST8080.COM", "CPU IS OPERATIONAL", { "CPU HAS FAILED", NULL } },
+    { "8080PRE.COM", "8080 Preliminary tests complete", { "ERROR", NULL } },
+    { "CPUTEST.COM", "CPU TESTS OK", { "FAILED", "ERROR", NULL } },
+    { "8080EXM.COM", "Tests complete", { "ERROR", "crc expected", NULL } },
+};
+
+#define TEST_COUNT (sizeof(TESTS) / sizeof(TESTS[0]))
+
+
+// known-answer checks: HL points at KA_MEM, SP at KA_STACK
+#define KA_MEM 0x2000
+#define KA_STACK 0x3000
+#define KA_RETURN 0x1234
+
+// flags byte as pushed by PUSH PSW: S Z 0 AC 0 P 1 CY
+#define F_CY 0x01
+#define F_P 0x04
+#define F_AC 0x10
+#define F_Z 0x40
+#define F_S 0x80
+#define F_ 0x02
+
+
+typedef struct known_answer_t {
+    const char *name;
+    uint8_t op;
+
+    // A, flags, B and the byte at HL before
+    uint8_t a, f, b, m;
+
+    // and after, with PC and SP
+    uint8_t expect_a, expect_f, expect_m;
+    uint16_t expect_pc, expect_sp;
+} KnownAnswer;
+
+
+#define NEXT (TPA_START + 1)
+
+static const KnownAnswer KNOWN_ANSWERS[] = {
+    { "ADD AC", 0x80, 0x0f, F_, 0x01, 0, 0x10, F_ | F_AC, 0, NEXT, KA_STACK },
+    { "ADC M", 0x8e, 0x01, F_ | F_CY, 0, 0x02, 0x04, F_, 0x02, NEXT, KA_STACK },
+    { "SUB AC", 0x90, 0x10, F_, 0x01, 0, 0x0f, F_ | F_P, 0, NEXT, KA_STACK },
+    { "SUB borrow", 0x90, 0x00, F_, 0x01, 0, 0xff, F_ | F_S | F_P | F_CY, 0, NEXT, KA_STACK },
+    { "CMP AC", 0xb8, 0x02, F_, 0x01, 0, 0x02, F_ | F_AC, 0, NEXT, KA_STACK },
+    { "ANA AC", 0xa0, 0x08, F_ | F_CY, 0x00, 0, 0x00, F_ | F_Z | F_AC | F_P, 0, NEXT, KA_STACK },
+    { "XRA AC", 0xa8, 0x08, F_ | F_AC, 0x00, 0, 0x08, F_, 0, NEXT, KA_STACK },
+    { "INR AC", 0x3c, 0x0f, F_ | F_CY, 0, 0, 0x10, F_ | F_AC | F_CY, 0, NEXT, KA_STACK },
+    { "DCR AC", 0x3d, 0x10, F_, 0, 0, 0x0f, F_ | F_P, 0, NEXT, KA_STACK },
+    { "DCR to 0", 0x3d, 0x01, F_, 0, 0, 0x00, F_ | F_Z | F_AC | F_P, 0, NEXT, KA_STACK },
+    { "INR M", 0x34, 0, F_, 0, 0xff, 0, F_ | F_Z | F_AC | F_P, 0x00, NEXT, KA_STACK },
+    { "DCR M", 0x35, 0, F_ | F_CY, 0, 0x00, 0, F_ | F_S | F_P | F_CY, 0xff, NEXT, KA_STACK },
+    { "DAA", 0x27, 0x9b, F_, 0, 0, 0x01, F_ | F_AC | F_CY, 0, NEXT, KA_STACK },
+    { "DAA AC", 0x27, 0x11, F_ | F_AC, 0, 0, 0x17, F_ | F_P, 0, NEXT, KA_STACK },
+    { "RP taken", 0xf0, 0x55, F_, 0, 0, 0x55, F_, 0, KA_RETURN, KA_STACK + 2 },
+    { "RP not", 0xf0, 0x55, F_ | F_S, 0, 0, 0x55, F_ | F_S, 0, NEXT, KA_STACK },
+};
+
+#define KNOWN_ANSWER_COUNT (sizeof(KNOWN_ANSWERS) / sizeof(KNOWN_ANSWERS[0]))
+
+
+uint8_t flags_byte(const State8080 *state) {
+    return F_ | state->cc.cy | state->cc.p << 2 | state->cc.ac << 4 |
+        state->cc.z << 6 | state->cc.s << 7;
+}
+
+
+/**
+ * Runs one known-answer check. Returns 0 on pass.
+ */
+int run_known_answer(const KnownAnswer *ka, uint8_t *memory) {
+    static IO8080 io;
+    memset(memory, 0, MEM_SIZE);
+    memory[TPA_START] = ka->op;
+    memory[KA_MEM] = ka->m;
+    memory[KA_STACK] = KA_RETURN & 0xff;
+    memory[KA_STACK + 1] = KA_RETURN >> 8;
+
+    State8080 state = {
+        .a = ka->a,
+        .b = ka->b,
+        .h = KA_MEM >> 8,
+        .l = KA_MEM & 0xff,
+        .sp = KA_STACK,
+        .pc = TPA_START,
+        .memory = memory,
+        .cc = {
+            .cy = ka->f & F_CY,
+            .p = (ka->f & F_P) != 0,
+            .ac = (ka->f & F_AC) != 0,
+            .z = (ka->f & F_Z) != 0,
+            .s = (ka->f & F_S) != 0
+        }
+    };
+    cpu_emulate_op(&state, &io);
+
+    int res = state.a != ka->expect_a || flags_byte(&state) != ka->expect_f ||
+        memory[KA_MEM] != ka->expect_m || state.pc != ka->expect_pc ||
+        state.sp != ka->expect_sp;
+    printf("%-12s %s", ka->name, res ? "FAIL" : "PASS");
+    if (res) {
+        printf("  (A %02x F %02x M %02x PC %04x SP %04x, expected %02x %02x %02x %04x %04x)",
+            state.a, flags_byte(&state), memory[KA_MEM], state.pc, state.sp,
+            ka->expect_a, ka->expect_f, ka->expect_m, ka->expect_pc, ka->expect_sp);
+    }
+    printf("\n");
+    return res;
+}
+
+
+/**
+ * An accepted interrupt disables interrupts until EI.
+ * Returns 0 on pass.
+ */
+int run_interrupt_check(uint8_t *memory) {
+    static IO8080 io;
+    memset(memory, 0, MEM_SIZE);
+    State8080 state = {
+        .sp = KA_STACK,
+        .pc = TPA_START,
+        .memory = memory,
+        .int_enable = 1
+    };
+    cpu_request_interrupt(&state, 1);
+    cpu_emulate_op(&state, &io);
+
+    // the NOP at 0x0008 ran
+    int res = state.int_enable != 0 || state.pc != 0x0009 ||
+        memory[KA_STACK - 2] != (TPA_START & 0xff) || memory[KA_STACK - 1] != TPA_START >> 8;
+    printf("%-12s %s\n", "interrupt", res ? "FAIL" : "PASS");
+    return res;
+}
+
+
+/**
+ * Growable buffer holding the console output
+ */
+typedef struct console_t {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int echo;
+} Console;
+
+
+void console_putc(Console *con, char c) {
+    if (con->len + 1 >= con->cap) {
+        con->cap += OUTPUT_CHUNK;
+        con->buf = realloc(con->buf, con->cap);
+    }
+    con->buf[con->len++] = c;
+    con->buf[con->len] = '\0';
+    if (con->echo) {
+        putchar(c);
+        fflush(stdout);
+    }
+}
+
+
+/**
+ * Handles a CALL 5. C holds the BDOS function number.
+ */
+void bdos_call(State8080 *state, Console *con) {
+    switch (state->c) {
+        case 2:  // console output of E
+            console_putc(con, state->e);
+            break;
+        case 9:  // print string at DE up to '$'
+        {
+            uint16_t addr = (state->d << 8) | state->e;
+            while (state->memory[addr] != '$') {
+                console_putc(con, state->memory[addr++]);
+            }
+        }
+            break;
+    }
+}
+
+
+/**
+ * Loads `path` at the start of the TPA and installs the
+ * BDOS stub. Returns the number of bytes read or -1.
+ */
+long load_program(const char *path, uint8_t *memory) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    memset(memory, 0, MEM_SIZE);
+    long size = fread(memory + TPA_START, 1, MEM_SIZE - TPA_START, f);
+    fclose(f);
+
+    // warm boot: never executed, the harness stops at 0x0000
+    memory[WARM_BOOT] = 0x76;
+
+    // BDOS entry returns straight back to the caller
+    // once the harness has handled the call; bytes 6-7
+    // hold the top of usable memory
+    memory[BDOS_ENTRY] = 0xc9;
+    memory[BDOS_ENTRY + 1] = BDOS_TOP & 0xff;
+    memory[BDOS_ENTRY + 2] = BDOS_TOP >> 8;
+    return size;
+}
+
+
+/**
+ * Runs the program until warm boot, HLT or the instruction
+ * limit. Returns 0 on a clean exit.
+ */
+int run_program(State8080 *state, Console *con, unsigned long long max_instrs,
+                unsigned long long *instrs) {
+    // nothing on the ports
+    static IO8080 io;
+    *instrs = 0;
+    while (*instrs < max_instrs) {
+        if (state->pc == WARM_BOOT) {
+            return 0;
+        }
+        if (state->pc == BDOS_ENTRY) {
+            bdos_call(state, con);
+        }
+        if (state->memory[state->pc] == 0x76) {
+            // HLT would stop the CPU for good
+            fprintf(stderr, "HLT at 0x%04x\n", state->pc);
+            return 1;
+        }
+        cpu_emulate_op(state, &io);
+        (*instrs)++;
+    }
+    fprintf(stderr, "instruction limit reached at 0x%04x\n", state->pc);
+    return 1;
+}
+
+
+/**
+ * Checks the console output against the test's markers
+ */
+int check_output(const CpmTest *test, const char *output) {
+    for (int i = 0; test->fail_markers[i] != NULL; i++) {
+        if (strstr(output, test->fail_markers[i]) != NULL) {
+            return 1;
+        }
+    }
+    return strstr(output, test->pass_marker) == NULL;
+}
+
+
+/**
+ * Runs one exerciser program. Returns 0 on pass.
+ * A missing file is reported and counted as a failure.
+ */
+int run_test(const char *folder, const CpmTest *test, uint8_t *memory,
+             unsigned long long max_instrs, int verbose) {
+    size_t path_len = strlen(folder) + strlen(test->file) + 2;
+    char *path = calloc(path_len, sizeof(*path));
+    snprintf(path, path_len, "%s/%s", folder, test->file);
+
+    printf("%-12s ", test->file);
+    fflush(stdout);
+    if (load_program(path, memory) < 0) {
+        printf("MISSING (%s)\n", path);
+        free(path);
+        return 1;
+    }
+    free(path);
+    if (verbose) {
+        printf("\n");
+    }
+
+    State8080 state = (State8080) {
+        .pc = TPA_START,
+        .memory = memory,
+        .rom_size = 0,
+    };
+    Console con = {
+        .buf = calloc(OUTPUT_CHUNK, sizeof(char)),
+        .len = 0,
+        .cap = OUTPUT_CHUNK,
+        .echo = verbose
+    };
+
+    unsigned long long instrs;
+    int res = run_program(&state, &con, max_instrs, &instrs);
+    if (res == 0) {
+        res = check_output(test, con.buf);
+    }
+
+    if (verbose) {
+        printf("\n%-12s ", test->file);
+    }
+    printf("%s  (%llu instructions, %" PRIu64 " cycles)\n",
+        res ? "FAIL" : "PASS", instrs, state.cycles);
+    if (res && !verbose) {
+        printf("%s\n", con.buf);
+    }
+    free(con.buf);
+    return res;
+}
+
+
+const CpmTest* find_test(const char *name) {
+    for (size_t i = 0; i < TEST_COUNT; i++) {
+        if (strcasecmp(TESTS[i].file, name) == 0) {
+            return &TESTS[i];
+        }
+    }
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+    int verbose = 0;
+    unsigned long long max_instrs = DEFAULT_MAX_INSTRS;
+    while ((opt = getopt(argc, argv, "vn:")) != -1) {
+        switch (opt) {
+            case 'v': verbose = 1; break;
+            case 'n': max_instrs = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-v] [-n max_instrs] [folder [program...]]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    uint8_t *memory = malloc(MEM_SIZE);
+    int failures = 0;
+    for (size_t i = 0; i < KNOWN_ANSWER_COUNT; i++) {
+        failures += run_known_answer(&KNOWN_ANSWERS[i], memory);
+    }
+    failures += run_interrupt_check(memory);
+    if (optind >= argc) {
+        free(memory);
+        printf("%d failure(s)\n", failures);
+        return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    char *folder = argv[optind++];
+    if (optind < argc) {
+        // only the programs named on the command line
+        for (int i = optind; i < argc; i++) {
+            const CpmTest *test = find_test(argv[i]);
+            if (test == NULL) {
+                fprintf(stderr, "Unknown test program %s\n", argv[i]);
+                failures++;
+                continue;
+            }
+            failures += run_test(folder, test, memory, max_instrs, verbose);
+        }
+    } else {
+        for (size_t i = 0; i < TEST_COUNT; i++) {
+            failures += run_test(folder, &TESTS[i], memory, max_instrs, verbose);
+        }
+    }
+
+    free(memory);
+    printf("%d failure(s)\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "difftest.h"
+#include "disassembler.h"
+
+
+uint32_t xorshift32(uint32_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+
+void difftest_random_state(State8080 *state, uint8_t *memory,
+        const uint8_t *rom, uint16_t rom_size, uint32_t *rng) {
+    for (size_t i = 0; i < CPU_MEM_SIZE; i += 4) {
+        uint32_t r = xorshift32(rng);
+        memcpy(&memory[i], &r, 4);
+    }
+    memcpy(memory, rom, rom_size);
+
+    uint32_t r = xorshift32(rng);
+    uint32_t f = xorshift32(rng);
+    *state = (State8080) {
+        .a = r,
+        .b = r >> 8,
+        .c = r >> 16,
+        .d = r >> 24,
+        .e = f,
+        .h = f >> 8,
+        .l = f >> 16,
+        .sp = xorshift32(rng),
+        .memory = memory,
+        .cc = (ConditionCodes) {
+            .cy = (f >> 24) & 1,
+            .p = (f >> 25) & 1,
+            .ac = (f >> 26) & 1,
+            .z = (f >> 27) & 1,
+            .s = (f >> 28) & 1
+        },
+        .int_enable = (f >> 29) & 1,
+        .int_delay = (f >> 30) & 1,
+    };
+}
+
+
+int difftest_state_differs(const State8080 *x, const State8080 *y) {
+    return x->a != y->a || x->b != y->b || x->c != y->c || x->d != y->d ||
+        x->e != y->e || x->h != y->h || x->l != y->l ||
+        x->sp != y->sp || x->pc != y->pc ||
+        x->cc.z != y->cc.z || x->cc.s != y->cc.s || x->cc.p != y->cc.p ||
+        x->cc.cy != y->cc.cy || x->cc.ac != y->cc.ac ||
+        x->int_enable != y->int_enable || x->int_delay != y->int_delay ||
+        x->cycles != y->cycles;
+}
+
+
+void difftest_print_state(const char *name, const State8080 *s) {
+    printf("  %-8s A %02x B %02x C %02x D %02x E %02x H %02x L %02x SP %04x PC %04x "
+        "Z%d S%d P%d CY%d AC%d IE%d ID%d cycles %lu\n", name,
+        s->a, s->b, s->c, s->d, s->e, s->h, s->l, s->sp, s->pc,
+        s->cc.z, s->cc.s, s->cc.p, s->cc.cy, s->cc.ac, s->int_enable, s->int_delay,
+        (unsigned long) s->cycles);
+}
+
+
+int difftest_compare(const char *what, const char *name, const uint8_t *rom,
+        uint16_t adr, int length, const State8080 *cand, const State8080 *interp, int report) {
+    int regs = difftest_state_differs(cand, interp);
+    int mem = memcmp(cand->memory, interp->memory, CPU_MEM_SIZE) != 0;
+    if (!regs && !mem) {
+        return 0;
+    }
+    if (report) {
+        printf("%s %04x differs:\n", what, adr);
+        uint16_t pc = adr;
+        for (int i = 0; i < length; i++) {
+            printf("    ");
+            pc += disassemble8080op((uint8_t *) rom, pc);
+        }
+        difftest_print_state(name, cand);
+        difftest_print_state("interp", interp);
+        // the first differing byte
+        for (size_t i = 0; i < CPU_MEM_SIZE && mem; i++) {
+            if (cand->memory[i] != interp->memory[i]) {
+                printf("  [%04zx]   %02x  %02x\n", i, cand->memory[i], interp->memory[i]);
+                mem = 0;
+            }
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,48 @@
+#ifndef DIFFTEST_H
+#define DIFFTEST_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+/*
+ * Shared parts of the differential tests (fusiontest,
+ * recomptest, cpufuzz): a small seeded generator, random
+ * CPU states, and comparing a candidate run of one
+ * instruction sequence against the interpreter running it
+ * one instruction at a time.
+ */
+
+
+// differences printed before a test stops reporting them
+#define DIFFTEST_MAX_REPORTS 8
+
+
+uint32_t xorshift32(uint32_t *x);
+
+/**
+ * Random registers, flags and memory in `memory`, with
+ * the first `rom_size` bytes of `rom` loaded. Leaves PC,
+ * the ROM size and the hooks at 0.
+ */
+void difftest_random_state(State8080 *state, uint8_t *memory,
+    const uint8_t *rom, uint16_t rom_size, uint32_t *rng);
+
+/**
+ * Returns 1 if registers, flags, interrupt state or cycles
+ * differ
+ */
+int difftest_state_differs(const State8080 *x, const State8080 *y);
+
+void difftest_print_state(const char *name, const State8080 *s);
+
+/**
+ * Compares the candidate with the interpreter after both
+ * ran the `length` instructions at `adr` of `rom`: state
+ * and all of memory. Returns 1 on a difference, printed
+ * with the instructions when `report` is set; `what` names
+ * the sequence ("Site", "Block") and `name` the candidate.
+ */
+int difftest_compare(const char *what, const char *name, const uint8_t *rom,
+    uint16_t adr, int length, const State8080 *cand, const State8080 *interp, int report);
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * RL environment tests
+ *
+ * Creates environments (env.h) and checks that a fixed seed
+ * gives the same resets and steps every time, that a
+ * different seed doesn't, and that each instance's
+ * observation sits at its own offset of the one buffer (the
+ * caller's, when given) in the documented layout.
+ *
+ * Without a ROM folder a small stand-in ROM is used: it
+ * waits for 1P start, sets the game mode, scores a point
+ * every frame FIRE is held and redraws the screen from a
+ * frame counter.
+ *
+ * Usage: envtest [invaders folder]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "env.h"
+#include "machine.h"
+
+
+static const uint8_t PROGRAM[] = {
+    [0x00] = 0xc3, 0x40, 0x00,      // JMP 0040
+    [0x08] = 0xfb, 0xc9,            // EI; RET
+    [0x10] = 0xc3, 0x20, 0x00,      // JMP 0020
+    [0x20] = 0xf5,                  // PUSH PSW
+    0xe5,                           // PUSH H
+    0xdb, 0x01,                     // IN 1
+    0xe6, 0x10,                     // ANI 10 (fire)
+    0xca, 0x32, 0x00,               // JZ 0032
+    0x3a, 0xf8, 0x20,               // LDA 20F8 (score)
+    0xc6, 0x01,                     // ADI 1
+    0x27,                           // DAA
+    0x32, 0xf8, 0x20,               // STA 20F8
+    0x21, 0xf0, 0x20,               // LXI H,20F0 (frame counter)
+    0x34,                           // INR M
+    0xe1,                           // POP H
+    0xf1,                           // POP PSW
+    0xfb,                           // EI
+    0xc9,                           // RET
+    [0x40] = 0x31, 0x00, 0x24,      // LXI SP,2400
+    0xfb,                           // EI
+    0xdb, 0x01,                     // IN 1
+    0xe6, 0x04,                     // ANI 04 (1P start)
+    0xca, 0x44, 0x00,               // JZ 0044
+    0x3e, 0x01,                     // MVI A,1
+    0x32, 0xef, 0x20,               // STA 20EF (game mode)
+    0x3e, 0x03,                     // MVI A,3
+    0x32, 0xff, 0x21,               // STA 21FF (ships)
+    0x21, 0x00, 0x24,               // LXI H,2400
+    0x3a, 0xf0, 0x20,               // LDA 20F0
+    0xad,                           // XRA L
+    0x77,                           // MOV M,A
+    0x23,                           // INX H
+    0x7c,                           // MOV A,H
+    0xfe, 0x40,                     // CPI 40
+    0xc2, 0x58, 0x00,               // JNZ 0058
+    0xc3, 0x55, 0x00                // JMP 0055
+};
+
+#define COUNT 4
+#define STEPS 50
+#define SEED 7
+
+// work RAM byte the fault test puts a HLT in
+#define FAULT_ADR 0x2100
+
+
+static uint8_t rom[CPU_MEM_SIZE];
+
+
+static inline uint8_t* instance_ram(Env *env, int index) {
+    return env->instances[index].machine->cpu_state->memory + INV_RAM_START;
+}
+
+
+EnvConfig make_config(EnvObs obs, int downsample, uint64_t seed) {
+    return (EnvConfig) {
+        .count = COUNT,
+        .frameskip = 4,
+        .obs = obs,
+        .downsample = downsample,
+        .noop_max = 30,
+        .seed = seed
+    };
+}
+
+
+int create(Env *env, const EnvConfig *config) {
+    if (env_create(env, config, rom)) {
+        printf("\n  env_create failed");
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Action of instance `index` at step `step`: every
+ * combination, different per instance
+ */
+uint8_t action(int step, int index) {
+    return (step + index * 3) % 8;
+}
+
+
+/**
+ * Returns 1 if the two environments' outputs differ
+ */
+int outputs_differ(Env *x, Env *y) {
+    return memcmp(x->obs, y->obs, COUNT * x->obs_size) != 0 ||
+        memcmp(x->rewards, y->rewards, COUNT * sizeof(*x->rewards)) != 0 ||
+        memcmp(x->dones, y->dones, COUNT) != 0 ||
+        memcmp(x->ships, y->ships, COUNT) != 0;
+}
+
+
+/**
+ * Two environments with the same seed stay identical
+ * through reset and steps
+ */
+int test_same_seed(void) {
+    EnvConfig config = make_config(ENV_OBS_RAM, 1, SEED);
+    Env x, y;
+    if (create(&x, &config)) {
+        return 1;
+    }
+    if (create(&y, &config)) {
+        env_destroy(&x);
+        return 1;
+    }
+
+    int fails = 0;
+    if (outputs_differ(&x, &y)) {
+        printf("\n  differ after create");
+        fails++;
+    }
+    uint8_t actions[COUNT];
+    for (int step = 0; step < STEPS && !fails; step++) {
+        for (int i = 0; i < COUNT; i++) {
+            actions[i] = action(step, i);
+        }
+        env_step(&x, actions, COUNT);
+        env_step(&y, actions, COUNT);
+        if (outputs_differ(&x, &y)) {
+            printf("\n  differ after step %d", step);
+            fails++;
+        }
+    }
+    env_reset(&x, -1);
+    env_reset(&y, -1);
+    if (outputs_differ(&x, &y)) {
+        printf("\n  differ after reset");
+        fails++;
+    }
+    env_destroy(&x);
+    env_destroy(&y);
+    return fails;
+}
+
+
+/**
+ * Another seed gives other idle frames after a reset
+ */
+int test_other_seed(void) {
+    EnvConfig config = make_config(ENV_OBS_RAM, 1, SEED);
+    EnvConfig other = make_config(ENV_OBS_RAM, 1, SEED + 1);
+    Env x, y;
+    if (create(&x, &config)) {
+        return 1;
+    }
+    if (create(&y, &other)) {
+        env_destroy(&x);
+        return 1;
+    }
+    int fails = 0;
+    if (!outputs_differ(&x, &y)) {
+        printf("\n  seeds %d and %d reset the same", SEED, SEED + 1);
+        fails++;
+    }
+    env_destroy(&x);
+    env_destroy(&y);
+    return fails;
+}
+
+
+/**
+ * RAM observations are the instances' work RAM, back to
+ * back in the caller's buffer, which is not overrun
+ */
+int test_ram_layout(void) {
+    EnvConfig config = make_config(ENV_OBS_RAM, 1, SEED);
+    size_t size = env_obs_size(&config);
+    uint8_t *buffer = malloc(COUNT * size + 1);
+    if (buffer == NULL) {
+        printf("\n  out of memory");
+        return 1;
+    }
+    buffer[COUNT * size] = 0xa5;
+    config.obs_buffer = buffer;
+
+    Env env;
+    if (create(&env, &config)) {
+        free(buffer);
+        return 1;
+    }
+    int fails = 0;
+    if (size != INV_RAM_SIZE || env.obs != buffer) {
+        printf("\n  observations not in the caller's buffer");
+        fails++;
+    }
+    uint8_t actions[COUNT] = { ENV_FIRE, ENV_LEFT, ENV_RIGHT, 0 };
+    env_step(&env, actions, COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        if (env_observation(&env, i) != buffer + i * size ||
+            memcmp(buffer + i * size, instance_ram(&env, i), size) != 0) {
+            printf("\n  instance %d: observation isn't its RAM", i);
+            fails++;
+        }
+        if (env.ships[i] != instance_ram(&env, i)[INV_P1_SHIPS - INV_RAM_START]) {
+            printf("\n  instance %d: wrong ships", i);
+            fails++;
+        }
+    }
+    if (buffer[COUNT * size] != 0xa5) {
+        printf("\n  buffer overrun");
+        fails++;
+    }
+    env_destroy(&env);
+    free(buffer);
+    return fails;
+}
+
+
+/**
+ * Pixel at (x, y) of the upright screen
+ */
+int upright_pixel(const uint8_t *framebuf, int x, int y) {
+    int i = FRAME_ROWS - 1 - y;
+    return (framebuf[x * FRAME_ROWS / 8 + i / 8] >> (i % 8)) & 1;
+}
+
+
+/**
+ * Pixel observations are the upright screen max-pooled by
+ * `downsample`, row by row, one byte per pixel
+ */
+int test_pixel_layout(void) {
+    int fails = 0;
+    for (int d = 1; d <= 8 && !fails; d *= 2) {
+        EnvConfig config = make_config(ENV_OBS_PIXELS, d, SEED);
+        Env env;
+        if (create(&env, &config)) {
+            return fails + 1;
+        }
+        int width = FRAME_COLS / d;
+        int height = FRAME_ROWS / d;
+        if (env.obs_size != (size_t) width * height) {
+            printf("\n  downsample %d: %zu bytes per observation", d, env.obs_size);
+            fails++;
+        }
+        for (int i = 0; i < COUNT && !fails; i++) {
+            const uint8_t *framebuf = machine_framebuffer(env.instances[i].machine);
+            const uint8_t *obs = env_observation(&env, i);
+            for (int p = 0; p < width * height && !fails; p++) {
+                int expected = 0;
+                for (int dy = 0; dy < d; dy++) {
+                    for (int dx = 0; dx < d; dx++) {
+                        expected |= upright_pixel(framebuf, (p % width) * d + dx, (p / width) * d + dy);
+                    }
+                }
+                if (obs[p] != expected) {
+                    printf("\n  downsample %d, instance %d: pixel %d is %d, expected %d",
+                        d, i, p, obs[p], expected);
+                    fails++;
+                }
+            }
+        }
+        env_destroy(&env);
+    }
+    return fails;
+}
+
+
+/**
+ * Rewards add up to the score in RAM
+ */
+int test_rewards(void) {
+    EnvConfig config = make_config(ENV_OBS_RAM, 1, SEED);
+    Env env;
+    if (create(&env, &config)) {
+        return 1;
+    }
+    int fails = 0;
+    long total[COUNT] = {0};
+    uint8_t actions[COUNT];
+    for (int step = 0; step < STEPS; step++) {
+        for (int i = 0; i < COUNT; i++) {
+            actions[i] = action(step, i);
+        }
+        env_step(&env, actions, COUNT);
+        for (int i = 0; i < COUNT; i++) {
+            total[i] += env.rewards[i];
+        }
+    }
+    for (int i = 0; i < COUNT; i++) {
+        if (total[i] != env.instances[i].score - env.boot.score) {
+            printf("\n  instance %d: rewards add up to %ld, score is %u",
+                i, total[i], env.instances[i].score);
+            fails++;
+        }
+    }
+    env_destroy(&env);
+    return fails;
+}
+
+
+/**
+ * An instance whose CPU faults is done, counted, and
+ * reset at its next step while the others play on
+ */
+int test_fault(void) {
+    EnvConfig config = make_config(ENV_OBS_RAM, 1, SEED);
+    Env env;
+    if (create(&env, &config)) {
+        return 1;
+    }
+    // a HLT in RAM, run with interrupts off
+    State8080 *state = env.instances[0].machine->cpu_state;
+    state->memory[FAULT_ADR] = 0x76;
+    state->pc = FAULT_ADR;
+    state->int_enable = 0;
+
+    int fails = 0;
+    uint8_t actions[COUNT] = {0};
+    env_step(&env, actions, COUNT);
+    if (!env.dones[0] || env.faults != 1) {
+        printf("\n  fault: done %d, %lu faults", env.dones[0], (unsigned long) env.faults);
+        fails++;
+    }
+    env_step(&env, actions, COUNT);
+    if (state->fault != CPU_FAULT_NONE || env.faults != 1) {
+        printf("\n  not reset after the fault");
+        fails++;
+    }
+    env_destroy(&env);
+    return fails;
+}
+
+
+/**
+ * Invalid configurations are refused
+ */
+int test_invalid(void) {
+    EnvConfig configs[] = {
+        make_config(ENV_OBS_RAM, 1, SEED),
+        make_config(ENV_OBS_RAM, 1, SEED),
+        make_config(ENV_OBS_PIXELS, 3, SEED)
+    };
+    configs[0].count = 0;
+    configs[1].frameskip = 0;
+    int fails = 0;
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        Env env;
+        if (env_create(&env, &configs[i], rom) == 0) {
+            printf("\n  config %zu accepted", i);
+            env_destroy(&env);
+            fails++;
+        }
+    }
+    return fails;
+}
+
+
+typedef struct unit_test_t {
+    const char *name;
+    int (*fn)(void);
+} UnitTest;
+
+
+static const UnitTest TESTS[] = {
+    { "same seed", test_same_seed },
+    { "other seed", test_other_seed },
+    { "ram layout", test_ram_layout },
+    { "pixel layout", test_pixel_layout },
+    { "rewards", test_rewards },
+    { "fault", test_fault },
+    { "invalid", test_invalid }
+};
+
+
+#define TEST_COUNT (sizeof(TESTS) / sizeof(TESTS[0]))
+
+
+/**
+ * Prints the outcome of a test whose name is already
+ * printed; failed checks have printed their own lines
+ */
+int report(int fails) {
+    printf("%s\n", fails ? "\nFAILED" : "ok");
+    return fails != 0;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [invaders folder]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc == 2) {
+        Board board;
+        if (board_open(&board, "invaders") || board_load_roms(&board, argv[1], rom)) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        memcpy(rom, PROGRAM, sizeof(PROGRAM));
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < TEST_COUNT; i++) {
+        printf("%-12s ", TESTS[i].name);
+        failures += report(TESTS[i].fn());
+    }
+    printf("%d failure(s)\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
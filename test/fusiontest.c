@@ -0,0 +1,214 @@
+/*
+ * Fusion differential test
+ *
+ * Builds a synthetic ROM with several copies of every fusible
+ * sequence (random immediates and jump targets), installs
+ * fusion on it, and runs every fused site from random
+ * register, flag and memory states, once through
+ * `cpu_emulate_op` with fusion on and once interpreting the
+ * same instructions one at a time. Registers, flags, memory
+ * and cycles must match.
+ *
+ * Usage: fusiontest [-t trials]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "difftest.h"
+#include "disassembler.h"
+#include "fusion.h"
+
+
+#define ROM_SIZE 0x2000
+#define SITE_START 0x0100
+
+// room between sites, so no two sequences overlap
+#define SITE_STRIDE 0x20
+
+// copies of each sequence in the ROM
+#define COPIES 4
+
+// sequence bytes that are filled in per copy
+#define ANY (-1)
+#define SELF_LO (-2)
+#define SELF_HI (-3)
+
+// first byte of the fill loop (MVI M)
+#define FILL 0x36
+
+#define DEFAULT_TRIALS 256
+
+
+typedef struct sequence_t {
+    int16_t bytes[12];
+    uint8_t length;
+} Sequence;
+
+
+// the sequences `fusion_install` looks for
+static const Sequence SEQUENCES[] = {
+    // fill loop
+    { { 0x36, ANY, 0x23, 0x7c, 0xfe, ANY, 0xc2, SELF_LO, SELF_HI }, 9 },
+    // copy loop
+    { { 0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2, SELF_LO, SELF_HI }, 8 },
+    // read/count
+    { { 0x7e, 0x23, 0x05, 0xc2, ANY, ANY }, 6 },
+};
+
+#define SEQUENCE_COUNT (sizeof(SEQUENCES) / sizeof(SEQUENCES[0]))
+
+
+static uint8_t fused_mem[CPU_MEM_SIZE];
+static uint8_t interp_mem[CPU_MEM_SIZE];
+
+
+/**
+ * Fills the ROM (the same one every time). Returns the
+ * number of sequences placed.
+ */
+int build_rom(uint8_t *rom) {
+    uint32_t rng = 0x8080;
+    memset(rom, 0, ROM_SIZE);
+    uint16_t adr = SITE_START;
+    int count = 0;
+    for (int copy = 0; copy < COPIES; copy++) {
+        for (size_t s = 0; s < SEQUENCE_COUNT; s++) {
+            const Sequence *seq = &SEQUENCES[s];
+            for (int i = 0; i < seq->length; i++) {
+                switch (seq->bytes[i]) {
+                    case ANY: rom[adr + i] = xorshift32(&rng); break;
+                    case SELF_LO: rom[adr + i] = adr & 0xff; break;
+                    case SELF_HI: rom[adr + i] = adr >> 8; break;
+                    default: rom[adr + i] = seq->bytes[i]; break;
+                }
+            }
+            adr += SITE_STRIDE;
+            count++;
+        }
+    }
+    return count;
+}
+
+
+/**
+ * Number of instructions in the fused sequence at `adr`
+ */
+int site_length(const uint8_t *rom, uint16_t adr) {
+    for (size_t s = 0; s < SEQUENCE_COUNT; s++) {
+        if (rom[adr] != SEQUENCES[s].bytes[0]) {
+            continue;
+        }
+        int count = 0;
+        Instr8080 instr;
+        for (int i = 0; i < SEQUENCES[s].length; i += disasm_decode(rom, adr + i, &instr)) {
+            count++;
+        }
+        return count;
+    }
+    return 0;
+}
+
+
+/**
+ * Random registers, flags and RAM, with the ROM loaded.
+ * HL stays out of the ROM, since every sequence that
+ * stores does so through HL.
+ */
+void random_state(State8080 *state, const uint8_t *rom, uint32_t *rng) {
+    difftest_random_state(state, fused_mem, rom, ROM_SIZE, rng);
+    state->rom_size = ROM_SIZE;
+    uint16_t hl = ROM_SIZE + xorshift32(rng) % (CPU_MEM_SIZE - ROM_SIZE);
+    state->h = hl >> 8;
+    state->l = hl & 0xff;
+
+    // small counts, so DCR B reaches zero now and then
+    if (xorshift32(rng) & 1) {
+        state->b &= 1;
+    }
+}
+
+
+/**
+ * Runs the site at `adr` from one random state both ways.
+ * Returns 1 on a difference.
+ */
+int run_trial(const uint8_t *rom, FusionTable *table, uint16_t adr, int length,
+        uint32_t *rng, int report) {
+    static IO8080 io;
+    State8080 fused;
+    random_state(&fused, rom, rng);
+    fused.pc = adr;
+
+    // now and then, end a fill loop: H reaches the CPI operand
+    uint16_t last = (rom[adr + 5] << 8) - 1;
+    if (rom[adr] == FILL && last >= ROM_SIZE && (xorshift32(rng) & 3) == 0) {
+        fused.h = last >> 8;
+        fused.l = last & 0xff;
+    }
+    memcpy(interp_mem, fused_mem, CPU_MEM_SIZE);
+    State8080 interp = fused;
+    interp.memory = interp_mem;
+
+    fused.fused = table;
+    cpu_emulate_op(&fused, &io);
+    for (int i = 0; i < length; i++) {
+        cpu_emulate_op(&interp, &io);
+    }
+
+    return difftest_compare("Site", "fused", rom, adr, length, &fused, &interp, report);
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+    int trials = DEFAULT_TRIALS;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't': trials = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-t trials]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    static uint8_t rom[CPU_MEM_SIZE];
+    int placed = build_rom(rom);
+
+    memcpy(fused_mem, rom, ROM_SIZE);
+    State8080 install_state = { .memory = fused_mem, .rom_size = ROM_SIZE };
+    FusionTable table;
+    int count = fusion_install(&table, &install_state, NULL);
+    if (count < 0) {
+        return EXIT_FAILURE;
+    }
+    int failures = 0;
+    if (count != placed) {
+        printf("%d sequences placed, %d fused\n", placed, count);
+        failures++;
+    }
+
+    uint32_t rng = 0x1234;
+    unsigned long runs = 0;
+    for (uint32_t adr = 0; adr < ROM_SIZE; adr++) {
+        if (!table.sites[adr]) {
+            continue;
+        }
+        int length = site_length(rom, adr);
+        for (int t = 0; t < trials; t++) {
+            runs++;
+            if (run_trial(rom, &table, adr, length, &rng, failures < DIFFTEST_MAX_REPORTS)) {
+                failures++;
+                break;
+            }
+        }
+    }
+
+    printf("%d sites, %lu runs\n", count, runs);
+    printf("%d failure(s)\n", failures);
+    fusion_uninstall(&table, &install_state);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
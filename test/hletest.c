@@ -0,0 +1,275 @@
+/*
+ * HLE tests
+ *
+ * Places the code of every hooked routine (hle.h) in an
+ * invaders ROM and checks that:
+ *
+ *  - in verification mode, calls to each routine from
+ *    random register, flag and memory states reach the hook
+ *    and the native code matches the guest code
+ *  - whole frames run with the hooks installed: a main loop
+ *    that calls ClearScreen, which takes several frames'
+ *    worth of cycles in one step, still finishes its frames
+ *    in about the cycles they take without hooks, and keeps
+ *    getting interrupts (before catch-up interrupts were
+ *    raised one instruction apart, this run never ended)
+ *
+ * Usage: hletest [-t trials]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "cpu.h"
+#include "difftest.h"
+#include "hle.h"
+#include "machine.h"
+
+
+#define CLEAR_SCREEN 0x1a5c
+#define BLOCK_COPY 0x1a32
+
+// where the verification trials call from
+#define CALL_ADR 0x0100
+
+#define CALL 0xcd
+
+// lowest address stores may go to: the top of the
+// stack, as the routines never write below SP
+#define STACK_TOP 0x2400
+
+#define DEFAULT_TRIALS 256
+
+#define FRAMES 10
+
+
+typedef struct routine_code_t {
+    const char *name;
+    uint16_t entry;
+    uint8_t code[16];
+    uint8_t length;
+} RoutineCode;
+
+
+// the code `hle_install` looks for
+static const RoutineCode ROUTINES[] = {
+    {
+        "ClearScreen", CLEAR_SCREEN,
+        { 0x21, 0x00, 0x24, 0x36, 0x00, 0x23, 0x7c, 0xfe, 0x40,
+          0xc2, 0x5f, 0x1a, 0xc9 },
+        13
+    },
+    {
+        "BlockCopy", BLOCK_COPY,
+        { 0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2, 0x32, 0x1a, 0xc9 },
+        9
+    },
+};
+
+#define ROUTINE_COUNT (sizeof(ROUTINES) / sizeof(ROUTINES[0]))
+
+
+// RST 1 and 2 return with interrupts enabled; the main
+// loop clears the screen over and over
+static const uint8_t PROGRAM[] = {
+    [0x00] = 0xc3, 0x40, 0x00,      // JMP 0040
+    [0x08] = 0xfb, 0xc9,            // EI; RET
+    [0x10] = 0xfb, 0xc9,            // EI; RET
+    [0x40] = 0x31, 0x00, 0x24,      // LXI SP,2400
+    0xfb,                           // EI
+    0xcd, 0x5c, 0x1a,               // CALL 1A5C (ClearScreen)
+    0xc3, 0x44, 0x00                // JMP 0044
+};
+
+
+static int trials = DEFAULT_TRIALS;
+
+static uint8_t memory[CPU_MEM_SIZE];
+
+
+int check(const char *what, unsigned long got, unsigned long expected) {
+    if (got == expected) {
+        return 0;
+    }
+    printf("\n  %s: got %lu, expected %lu", what, got, expected);
+    return 1;
+}
+
+
+/**
+ * Loads the program and the routines into `rom`
+ */
+void build_rom(uint8_t *rom, const Board *board) {
+    memset(rom, 0, board->rom_size);
+    memcpy(rom, PROGRAM, sizeof(PROGRAM));
+    for (size_t i = 0; i < ROUTINE_COUNT; i++) {
+        memcpy(&rom[ROUTINES[i].entry], ROUTINES[i].code, ROUTINES[i].length);
+    }
+}
+
+
+/**
+ * Random state about to call `entry`, with the stack
+ * and every store the routine makes (HL onwards) in RAM
+ */
+void random_call(State8080 *state, const uint8_t *rom, const Board *board,
+        uint16_t entry, uint32_t *rng) {
+    difftest_random_state(state, memory, rom, board->rom_size, rng);
+    memory[CALL_ADR] = CALL;
+    memory[CALL_ADR + 1] = entry & 0xff;
+    memory[CALL_ADR + 2] = entry >> 8;
+    state->pc = CALL_ADR;
+    state->rom_size = board->rom_size;
+    state->sp = board->rom_size + 2 + xorshift32(rng) % (STACK_TOP - board->rom_size - 1);
+
+    // BlockCopy stores up to 256 bytes from HL
+    uint16_t hl = STACK_TOP + xorshift32(rng) % (CPU_MEM_SIZE - STACK_TOP - 0x100);
+    state->h = hl >> 8;
+    state->l = hl & 0xff;
+}
+
+
+/**
+ * Verification mode: every call is hooked, and the
+ * native code leaves what the guest code does
+ */
+int test_verify(const Board *board) {
+    static uint8_t rom[CPU_MEM_SIZE];
+    build_rom(rom, board);
+    memcpy(memory, rom, board->rom_size);
+    State8080 install_state = { .memory = memory, .rom_size = board->rom_size };
+    HleTable table;
+    int fails = check("hooked", hle_install(&table, &install_state, 1), ROUTINE_COUNT);
+
+    static IO8080 io;
+    uint32_t rng = 0x1234;
+    for (size_t i = 0; i < ROUTINE_COUNT && !fails; i++) {
+        unsigned long calls = table.calls;
+        for (int t = 0; t < trials && !table.mismatches; t++) {
+            State8080 state;
+            random_call(&state, rom, board, ROUTINES[i].entry, &rng);
+            state.hle = &table;
+            cpu_emulate_op(&state, &io);
+        }
+        if (table.mismatches) {
+            printf("\n  %s: native and guest code differ", ROUTINES[i].name);
+            fails++;
+        }
+        fails += check(ROUTINES[i].name, table.calls - calls, trials);
+    }
+    hle_uninstall(&table, &install_state);
+    return fails;
+}
+
+
+/**
+ * Runs FRAMES frames of the program, with the hooks
+ * installed or not
+ */
+Machine* run_frames(const Board *board, int hle) {
+    Machine *machine = machine_create(board);
+    if (machine == NULL) {
+        printf("\n  out of memory");
+        return NULL;
+    }
+    build_rom(machine->cpu_state->memory, board);
+    HleTable table;
+    if (hle) {
+        hle_install(&table, machine->cpu_state, 0);
+    }
+    machine_run_frames(machine, FRAMES);
+    if (hle) {
+        hle_uninstall(&table, machine->cpu_state);
+    }
+    return machine;
+}
+
+
+/**
+ * Whole frames with ClearScreen hooked: each call runs
+ * past several interrupts in one step, and the machine
+ * catches up instead of running on without them
+ */
+int test_frames(const Board *board) {
+    Machine *plain = run_frames(board, 0);
+    if (plain == NULL) {
+        return 1;
+    }
+    Machine *hooked = run_frames(board, 1);
+    if (hooked == NULL) {
+        machine_destroy(plain);
+        return 1;
+    }
+
+    int fails = 0;
+    fails += check("frames", hooked->frames, plain->frames);
+    fails += check("interrupts", hooked->interrupts, plain->interrupts);
+    if (hooked->interrupts_delivered == 0) {
+        printf("\n  no interrupts delivered");
+        fails++;
+    }
+
+    // at most one ClearScreen past the last interrupt
+    uint64_t clear_cycles = 10 + (10 + 5 + 5 + 7 + 10) * (0x4000 - 0x2400) + 10;
+    if (hooked->cycles < plain->cycles || hooked->cycles > plain->cycles + clear_cycles) {
+        printf("\n  %lu cycles, %lu without hooks",
+            (unsigned long) hooked->cycles, (unsigned long) plain->cycles);
+        fails++;
+    }
+    machine_destroy(plain);
+    machine_destroy(hooked);
+    return fails;
+}
+
+
+typedef struct board_test_t {
+    const char *name;
+    int (*fn)(const Board *board);
+} BoardTest;
+
+
+static const BoardTest TESTS[] = {
+    { "verify", test_verify },
+    { "frames", test_frames }
+};
+
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+
+/**
+ * Prints the outcome of a test whose name is already
+ * printed; failed checks have printed their own lines
+ */
+int report(int fails) {
+    printf("%s\n", fails ? "\nFAILED" : "ok");
+    return fails != 0;
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't': trials = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-t trials]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    Board board;
+    if (board_open(&board, "invaders")) {
+        return EXIT_FAILURE;
+    }
+    int failures = 0;
+    for (size_t i = 0; i < COUNT(TESTS); i++) {
+        printf("%-12s ", TESTS[i].name);
+        failures += report(TESTS[i].fn(&board));
+    }
+    printf("%d failure(s)\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
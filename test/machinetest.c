@@ -0,0 +1,244 @@
+/*
+ * Machine timing tests
+ *
+ * Runs a small program on the invaders board and checks
+ * interrupt delivery: whole frames deliver both interrupts
+ * of each frame, and after a single step that runs past
+ * several interrupts (a native routine or compiled block
+ * can) the overdue interrupts are raised one instruction
+ * apart, so the machine catches up instead of running on
+ * without interrupts. A ROM write or HLT stops the machine
+ * instead of the process.
+ *
+ * Usage: machinetest
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "machine.h"
+
+
+// RST 1 and 2 return with interrupts enabled; the main
+// loop spins
+static const uint8_t PROGRAM[] = {
+    [0x00] = 0xc3, 0x40, 0x00,      // JMP 0040
+    [0x08] = 0xfb, 0xc9,            // EI; RET
+    [0x10] = 0xfb, 0xc9,            // EI; RET
+    [0x40] = 0x31, 0x00, 0x24,      // LXI SP,2400
+    0xfb,                           // EI
+    0xc3, 0x44, 0x00                // JMP 0044
+};
+
+#define FRAMES 10
+
+// interrupts a long step runs past
+#define OVERDUE 16
+
+// longest 8080 instruction
+#define MAX_INSTR_CYCLES 18
+
+// budget of the first slice after the long step: plenty to
+// notice it isn't cut short, without running 2^31 cycles
+#define PROBE_CYCLES 1000000
+
+// main loop address, where the fault tests put their
+// instruction
+#define LOOP 0x44
+
+
+int check(const char *what, unsigned long got, unsigned long expected) {
+    if (got == expected) {
+        return 0;
+    }
+    printf("\n  %s: got %lu, expected %lu", what, got, expected);
+    return 1;
+}
+
+
+Machine* create(const Board *board) {
+    Machine *machine = machine_create(board);
+    if (machine == NULL) {
+        printf("\n  out of memory");
+        return NULL;
+    }
+    memcpy(machine->cpu_state->memory, PROGRAM, sizeof(PROGRAM));
+    return machine;
+}
+
+
+/**
+ * Cycles between interrupts
+ */
+uint64_t interval(const Board *board) {
+    return board->cpu_hz / ((uint64_t) board->fps * board->interrupt_count);
+}
+
+
+/**
+ * Every frame delivers each of its interrupts once
+ */
+int test_frames(const Board *board) {
+    Machine *machine = create(board);
+    if (machine == NULL) {
+        return 1;
+    }
+    machine_run_frames(machine, 1);
+    uint64_t delivered = machine->interrupts_delivered;
+    machine_run_frames(machine, FRAMES);
+
+    int fails = 0;
+    fails += check("frames", machine->frames, FRAMES + 1);
+    fails += check("delivered", machine->interrupts_delivered - delivered,
+        FRAMES * board->interrupt_count);
+    machine_destroy(machine);
+    return fails;
+}
+
+
+/**
+ * A step that runs past OVERDUE interrupts: the next
+ * slices are single instructions until the machine has
+ * caught up, then frames run as usual
+ */
+int test_long_step(const Board *board) {
+    Machine *machine = create(board);
+    if (machine == NULL) {
+        return 1;
+    }
+    machine_run_frames(machine, 1);
+
+    // what a native routine returning after that many
+    // intervals leaves behind
+    machine->cycles += OVERDUE * interval(board);
+    uint64_t interrupts = machine->interrupts;
+
+    int fails = 0;
+    int cycles = machine_run_slice(machine, PROBE_CYCLES);
+    if (cycles > MAX_INSTR_CYCLES) {
+        printf("\n  overdue slice ran %d cycles", cycles);
+        machine_destroy(machine);
+        return 1;
+    }
+    fails += check("interrupts raised", machine->interrupts - interrupts, 1);
+
+    // the overdue frames count, then whole frames follow
+    unsigned long frames = machine->frames;
+    machine_run_frames(machine, OVERDUE / board->interrupt_count + 1);
+    uint64_t delivered = machine->interrupts_delivered;
+    machine_run_frames(machine, FRAMES);
+    fails += check("frames", machine->frames - frames, OVERDUE / board->interrupt_count + 1 + FRAMES);
+    fails += check("delivered", machine->interrupts_delivered - delivered,
+        FRAMES * board->interrupt_count);
+    if (machine->cycles > machine_interrupt_due(machine)) {
+        printf("\n  still behind by %lu cycles",
+            (unsigned long) (machine->cycles - machine_interrupt_due(machine)));
+        fails++;
+    }
+    machine_destroy(machine);
+    return fails;
+}
+
+
+typedef struct fault_case_t {
+    const char *name;
+    uint8_t code[3];
+    CpuFault fault;
+    uint16_t adr;
+} FaultCase;
+
+
+static const FaultCase FAULTS[] = {
+    { "STA 0100", { 0x32, 0x00, 0x01 }, CPU_FAULT_ROM_WRITE, 0x0100 },
+    { "HLT", { 0x76 }, CPU_FAULT_HALT, LOOP }
+};
+
+
+/**
+ * A ROM write or HLT in the main loop: the run returns
+ * the fault and runs nothing after it, the ROM keeps its
+ * byte, and cloning a good machine clears the fault
+ */
+int test_faults(const Board *board) {
+    int fails = 0;
+    for (size_t i = 0; i < sizeof(FAULTS) / sizeof(FAULTS[0]); i++) {
+        const FaultCase *f = &FAULTS[i];
+        Machine *machine = create(board);
+        if (machine == NULL) {
+            return fails + 1;
+        }
+        Machine *good = create(board);
+        if (good == NULL) {
+            machine_destroy(machine);
+            return fails + 1;
+        }
+        State8080 *state = machine->cpu_state;
+        memcpy(&state->memory[LOOP], f->code, sizeof(f->code));
+        uint8_t rom_byte = state->memory[f->adr];
+
+        int fault = machine_run_frames(machine, FRAMES);
+        uint64_t cycles = machine->cycles;
+        int case_fails = 0;
+        case_fails += check("fault", fault, f->fault);
+        case_fails += check("fault address", state->fault_adr, f->adr);
+        case_fails += check("ROM byte", state->memory[f->adr], rom_byte);
+        case_fails += check("run after fault", machine_run_frames(machine, 1), f->fault);
+        case_fails += check("cycles after fault", machine->cycles, cycles);
+
+        // the clone copies RAM, so the ROM gets its code back
+        machine_run_frames(good, 1);
+        machine_clone(machine, good);
+        memcpy(&state->memory[LOOP], &PROGRAM[LOOP], sizeof(f->code));
+        case_fails += check("clone", machine_run_frames(machine, FRAMES), CPU_FAULT_NONE);
+        if (case_fails) {
+            printf("\n  (%s)", f->name);
+        }
+        fails += case_fails;
+        machine_destroy(machine);
+        machine_destroy(good);
+    }
+    return fails;
+}
+
+
+typedef struct board_test_t {
+    const char *name;
+    int (*fn)(const Board *board);
+} BoardTest;
+
+
+static const BoardTest TESTS[] = {
+    { "frames", test_frames },
+    { "long step", test_long_step },
+    { "faults", test_faults }
+};
+
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+
+/**
+ * Prints the outcome of a test whose name is already
+ * printed; failed checks have printed their own lines
+ */
+int report(int fails) {
+    printf("%s\n", fails ? "\nFAILED" : "ok");
+    return fails != 0;
+}
+
+
+int main(void) {
+    Board board;
+    if (board_open(&board, "invaders")) {
+        return EXIT_FAILURE;
+    }
+    int failures = 0;
+    for (size_t i = 0; i < COUNT(TESTS); i++) {
+        printf("%-12s ", TESTS[i].name);
+        failures += report(TESTS[i].fn(&board));
+    }
+    printf("%d failure(s)\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,284 @@
+/*
+ * Recompiler differential test
+ *
+ * Builds a synthetic ROM of short straight-line chunks of
+ * random instructions, each ending in a branch, call,
+ * conditional return, EI, DI, IN or OUT that leads on to the
+ * next chunk, so the analysis reaches every one. The ROM is
+ * compiled with the recompiler and every compiled block is
+ * run from random register, flag and memory states, once
+ * through `cpu_emulate_op` with the blocks installed and
+ * once interpreting the same instructions one at a time.
+ * Registers, flags, memory and cycles must match.
+ *
+ * The compiled code has to be built before it can run, so
+ * this file is built twice:
+ *
+ *  recomptest-gen out.c    (with -DRECOMPTEST_GEN) writes
+ *                          the compiled ROM
+ *  recomptest              links it in and compares
+ *
+ * Usage: recomptest [-t trials]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "analysis.h"
+#include "aot.h"
+#include "cpu.h"
+#include "difftest.h"
+#include "disassembler.h"
+#include "recompiler.h"
+
+
+#define ROM_SIZE 0x2000
+#define CHUNK_START 0x0040
+#define MAX_BODY 8
+
+// room left for the longest chunk and the final jump
+#define CHUNK_ROOM (3 * MAX_BODY + 3 + 3)
+
+#define JMP 0xc3
+
+#define DEFAULT_TRIALS 16
+
+
+void emit_jmp(uint8_t *rom, uint16_t adr, uint16_t target) {
+    rom[adr] = JMP;
+    rom[adr + 1] = target & 0xff;
+    rom[adr + 2] = target >> 8;
+}
+
+
+/**
+ * Returns 1 if the instruction can go in the middle of a
+ * chunk: no control flow, and nothing that ends a block
+ */
+int is_body(const Instr8080 *instr) {
+    switch (instr->mnemonic) {
+        case MN_EI:
+        case MN_DI:
+        case MN_IN:
+        case MN_OUT:
+        case MN_HLT:
+            return 0;
+    }
+    return instr->flow == FLOW_NEXT;
+}
+
+
+/**
+ * Returns 1 if the instruction can end a chunk: anything
+ * that continues at the next instruction or at `next`
+ */
+int is_terminator(const Instr8080 *instr) {
+    switch (instr->mnemonic) {
+        case MN_EI:
+        case MN_DI:
+        case MN_IN:
+        case MN_OUT:
+            return 1;
+    }
+    switch (instr->flow) {
+        case FLOW_JUMP:
+        case FLOW_JUMP_COND:
+        case FLOW_CALL:
+        case FLOW_CALL_COND:
+        case FLOW_RET_COND:
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Fills the ROM (the same one every time)
+ */
+void build_rom(uint8_t *rom) {
+    uint32_t rng = 0x8080;
+    memset(rom, 0, ROM_SIZE);
+    uint16_t entries[] = ANALYSIS_DEFAULT_ENTRIES;
+    for (int i = 0; i < ANALYSIS_DEFAULT_ENTRY_COUNT; i++) {
+        emit_jmp(rom, entries[i], CHUNK_START);
+    }
+
+    uint16_t adr = CHUNK_START;
+    Instr8080 instr;
+    while (adr < ROM_SIZE - CHUNK_ROOM) {
+        int body = 1 + xorshift32(&rng) % MAX_BODY;
+        for (int i = 0; i < body; i++) {
+            do {
+                uint32_t r = xorshift32(&rng);
+                memcpy(&rom[adr], &r, 3);
+                disasm_decode(rom, adr, &instr);
+            } while (!is_body(&instr));
+            adr += instr.length;
+        }
+
+        do {
+            uint32_t r = xorshift32(&rng);
+            memcpy(&rom[adr], &r, 3);
+            disasm_decode(rom, adr, &instr);
+        } while (!is_terminator(&instr));
+
+        // branches go to the next chunk
+        uint16_t next = adr + instr.length;
+        if (instr.length == 3) {
+            rom[adr + 1] = next & 0xff;
+            rom[adr + 2] = next >> 8;
+        }
+        adr = next;
+    }
+    emit_jmp(rom, adr, CHUNK_START);
+}
+
+
+#ifdef RECOMPTEST_GEN
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s out.c\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    uint8_t *memory = calloc(CPU_MEM_SIZE, sizeof(*memory));
+    build_rom(memory);
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: couldn't open %s\n", argv[1]);
+        free(memory);
+        return EXIT_FAILURE;
+    }
+    int count = recompile_rom(memory, ROM_SIZE, out);
+    fclose(out);
+    free(memory);
+    if (count < 0) {
+        fprintf(stderr, "Error: ROM analysis failed\n");
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+#else
+
+static uint8_t compiled_mem[CPU_MEM_SIZE];
+static uint8_t interp_mem[CPU_MEM_SIZE];
+
+
+/**
+ * Number of instructions the compiled block at `block`
+ * runs: like the recompiler, it leaves a final IN, OUT or
+ * HLT to the interpreter
+ */
+int block_length(const uint8_t *rom, const BasicBlock *block) {
+    uint16_t pc = block->start;
+    Instr8080 instr;
+    for (int i = 0; i < block->count; i++) {
+        pc += disasm_decode(rom, pc, &instr);
+    }
+    switch (instr.mnemonic) {
+        case MN_IN:
+        case MN_OUT:
+        case MN_HLT:
+            return block->count - 1;
+    }
+    return block->count;
+}
+
+
+/**
+ * Runs the block from one random state both ways.
+ * Returns 1 on a difference, -1 if the block wrote to
+ * the ROM (which the compiled code can't see).
+ */
+int run_trial(const uint8_t *rom, AotTable *table, const BasicBlock *block,
+        int length, uint32_t *rng, int report) {
+    static IO8080 io;
+    State8080 compiled;
+    difftest_random_state(&compiled, compiled_mem, rom, ROM_SIZE, rng);
+    compiled.pc = block->start;
+    memcpy(interp_mem, compiled_mem, CPU_MEM_SIZE);
+    State8080 interp = compiled;
+    interp.memory = interp_mem;
+
+    compiled.aot = table;
+    cpu_emulate_op(&compiled, &io);
+    for (int i = 0; i < length; i++) {
+        cpu_emulate_op(&interp, &io);
+    }
+
+    if (memcmp(compiled_mem, rom, ROM_SIZE) != 0 || memcmp(interp_mem, rom, ROM_SIZE) != 0) {
+        return -1;
+    }
+    return difftest_compare("Block", "compiled", rom, block->start, length, &compiled, &interp, report);
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+    int trials = DEFAULT_TRIALS;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't': trials = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-t trials]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    static uint8_t rom[CPU_MEM_SIZE];
+    build_rom(rom);
+    uint16_t entries[] = ANALYSIS_DEFAULT_ENTRIES;
+    RomAnalysis an;
+    if (analysis_run(&an, rom, ROM_SIZE, entries, ANALYSIS_DEFAULT_ENTRY_COUNT)) {
+        fprintf(stderr, "Error: ROM analysis failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // installed once, with the ROM loaded; the trials
+    // then drop the ROM size so stores anywhere succeed
+    // (trials that store to the ROM are skipped)
+    memcpy(compiled_mem, rom, ROM_SIZE);
+    State8080 install_state = { .memory = compiled_mem, .rom_size = ROM_SIZE };
+    AotTable table;
+    if (aot_install(&table, &install_state, &aot_rom) < 0) {
+        fprintf(stderr, "Error: compiled ROM doesn't match\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t rng = 0x1234;
+    int failures = 0;
+    unsigned long runs = 0, skipped = 0;
+    for (size_t i = 0; i < aot_rom.count; i++) {
+        const BasicBlock *block = analysis_block_at(&an, aot_rom.blocks[i].adr);
+        if (block == NULL) {
+            printf("Block %04x: not found by the analysis\n", aot_rom.blocks[i].adr);
+            failures++;
+            continue;
+        }
+        int length = block_length(rom, block);
+        for (int t = 0; t < trials; t++) {
+            int res = run_trial(rom, &table, block, length, &rng, failures < DIFFTEST_MAX_REPORTS);
+            if (res < 0) {
+                skipped++;
+                continue;
+            }
+            runs++;
+            if (res > 0) {
+                failures++;
+                break;
+            }
+        }
+    }
+
+    printf("%zu blocks, %lu runs (%lu skipped for ROM writes)\n", aot_rom.count, runs, skipped);
+    printf("%d failure(s)\n", failures);
+    aot_uninstall(&table, &install_state);
+    analysis_free(&an);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
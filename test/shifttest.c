@@ -0,0 +1,346 @@
+/*
+ * Shift register tests
+ *
+ * Checks the Shifter (shifter.h) on its own against a
+ * bit-by-bit model of the hardware, then wired into the
+ * invaders board and driven by 8080 code through IN/OUT on
+ * both CPU cores: `cpu_emulate_op` (machine_step) and
+ * `cpu_run` (machine_run_to). The board tests also check that
+ * the offset register and the player 2 inputs, which share
+ * port number 2, don't disturb each other.
+ *
+ * Usage: shifttest
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "machine.h"
+#include "shifter.h"
+
+
+// where the test programs are loaded and store their results
+#define PROGRAM_START 0x0000
+#define RESULTS 0x2100
+
+// 8080 opcodes the programs are made of
+#define MVI_A 0x3e
+#define OUT 0xd3
+#define IN 0xdb
+#define STA 0x32
+#define HLT 0x76
+
+#define PORT_P2 2
+#define PORT_SHIFT_OFFSET 2
+#define PORT_SHIFT_RESULT 3
+#define PORT_SHIFT_DATA 4
+
+// port 2 bits of P2_FIRE, P2_JOY_LEFT and P2_JOY_RIGHT
+#define P2_BITS 0x70
+
+// enough for the longest program
+#define MAX_STEPS 256
+
+
+/**
+ * Result bit i is bit 8 - offset + i of the value
+ */
+uint8_t model_result(uint16_t value, int offset) {
+    uint8_t result = 0;
+    for (int i = 0; i < 8; i++) {
+        result |= ((value >> (8 - offset + i)) & 1) << i;
+    }
+    return result;
+}
+
+
+int check(const char *what, unsigned got, unsigned expected) {
+    if (got == expected) {
+        return 0;
+    }
+    printf("\n  %s: got 0x%02x, expected 0x%02x", what, got, expected);
+    return 1;
+}
+
+
+/**
+ * The sequence from the hardware description
+ */
+int test_data(void) {
+    Shifter shifter = {0};
+    int fails = 0;
+    shifter_write_data(&shifter, 0xaa);
+    fails += check("after $aa", shifter.value, 0xaa00);
+    shifter_write_data(&shifter, 0xff);
+    fails += check("after $ff", shifter.value, 0xffaa);
+    shifter_write_data(&shifter, 0x12);
+    fails += check("after $12", shifter.value, 0x12ff);
+    return fails;
+}
+
+
+/**
+ * Every value at every offset, against the model
+ */
+int test_result(void) {
+    int fails = 0;
+    for (uint32_t value = 0; value < 0x10000 && fails < 8; value++) {
+        for (int offset = 0; offset < 8; offset++) {
+            Shifter shifter = { .value = value, .offset = offset };
+            if (shifter_result(&shifter) != model_result(value, offset)) {
+                printf("\n  value 0x%04x offset %d: got 0x%02x, expected 0x%02x",
+                    value, offset, shifter_result(&shifter), model_result(value, offset));
+                fails++;
+            }
+        }
+    }
+    return fails;
+}
+
+
+/**
+ * Only bits 0-2 of an offset write count, and they leave
+ * the value alone
+ */
+int test_offset(void) {
+    int fails = 0;
+    for (int data = 0; data < 0x100; data++) {
+        Shifter shifter = { .value = 0x1234 };
+        shifter_write_offset(&shifter, data);
+        fails += check("offset", shifter.offset, data & 0x7);
+        fails += check("value", shifter.value, 0x1234);
+    }
+    return fails;
+}
+
+
+/**
+ * The port handlers do what the inline operations do
+ */
+int test_handlers(void) {
+    Shifter shifter = {0};
+    int fails = 0;
+    shifter_out_data(&shifter, PORT_SHIFT_DATA, 0xc3);
+    shifter_out_data(&shifter, PORT_SHIFT_DATA, 0x5a);
+    shifter_out_offset(&shifter, PORT_SHIFT_OFFSET, 0xfd);
+    fails += check("value", shifter.value, 0x5ac3);
+    fails += check("offset", shifter.offset, 5);
+    fails += check("result", shifter_in_result(&shifter, PORT_SHIFT_RESULT), model_result(0x5ac3, 5));
+    return fails;
+}
+
+
+typedef struct program_t {
+    uint8_t code[128];
+    int size;
+} Program;
+
+
+void emit2(Program *program, uint8_t op, uint8_t arg) {
+    program->code[program->size++] = op;
+    program->code[program->size++] = arg;
+}
+
+
+void emit_store(Program *program, uint16_t address) {
+    program->code[program->size++] = STA;
+    program->code[program->size++] = address & 0xff;
+    program->code[program->size++] = address >> 8;
+}
+
+
+/**
+ * Runs `program` on a fresh invaders machine, on the
+ * interpreter if `fast` is set. `setup` (if any) is called
+ * before it starts. Returns the machine, which the caller
+ * destroys, or NULL.
+ */
+Machine* run_program(const Board *board, const Program *program, int fast,
+        void (*setup)(Machine *machine)) {
+    Machine *machine = machine_create(board);
+    if (machine == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return NULL;
+    }
+    uint8_t *memory = machine->cpu_state->memory;
+    memcpy(memory + PROGRAM_START, program->code, program->size);
+    memory[PROGRAM_START + program->size] = HLT;
+    if (setup != NULL) {
+        setup(machine);
+    }
+
+    // all the programs run well within the first interrupt
+    uint16_t end = PROGRAM_START + program->size;
+    for (int i = 0; i < MAX_STEPS && machine->cpu_state->pc != end; i++) {
+        if (fast) {
+            machine_run_to(machine, machine->cycles + 1);
+        } else {
+            machine_step(machine);
+        }
+    }
+    if (machine->cpu_state->pc != end) {
+        printf("\n  program didn't finish (pc 0x%04x)", machine->cpu_state->pc);
+        machine_destroy(machine);
+        return NULL;
+    }
+    return machine;
+}
+
+
+/**
+ * Shifts bytes in through the data port, then reads the
+ * result at each offset through the result port
+ */
+int test_board_ports(const Board *board, int fast) {
+    Program program = {0};
+    emit2(&program, MVI_A, 0xaa);
+    emit2(&program, OUT, PORT_SHIFT_DATA);
+    emit2(&program, MVI_A, 0x3c);
+    emit2(&program, OUT, PORT_SHIFT_DATA);
+    for (int offset = 0; offset < 8; offset++) {
+        // garbage in the high bits must be ignored
+        emit2(&program, MVI_A, offset | 0xf8);
+        emit2(&program, OUT, PORT_SHIFT_OFFSET);
+        emit2(&program, IN, PORT_SHIFT_RESULT);
+        emit_store(&program, RESULTS + offset);
+    }
+
+    Machine *machine = run_program(board, &program, fast, NULL);
+    if (machine == NULL) {
+        return 1;
+    }
+    int fails = 0;
+    for (int offset = 0; offset < 8; offset++) {
+        char what[32];
+        snprintf(what, sizeof(what), "offset %d", offset);
+        fails += check(what, machine->cpu_state->memory[RESULTS + offset],
+            model_result(0x3caa, offset));
+    }
+    machine_destroy(machine);
+    return fails;
+}
+
+
+void press_p2(Machine *machine) {
+    machine_keydown(machine, P2_FIRE);
+    machine_keydown(machine, P2_JOY_LEFT);
+    machine_keydown(machine, P2_JOY_RIGHT);
+}
+
+
+/**
+ * Player 2 inputs held down while the offset is set: the
+ * result only depends on the offset written, and IN 2 only
+ * returns the inputs
+ */
+int test_board_p2(const Board *board, int fast) {
+    Program program = {0};
+    emit2(&program, MVI_A, 0x81);
+    emit2(&program, OUT, PORT_SHIFT_DATA);
+    emit2(&program, MVI_A, 0x42);
+    emit2(&program, OUT, PORT_SHIFT_DATA);
+    emit2(&program, MVI_A, 3);
+    emit2(&program, OUT, PORT_SHIFT_OFFSET);
+    emit2(&program, IN, PORT_SHIFT_RESULT);
+    emit_store(&program, RESULTS);
+    emit2(&program, IN, PORT_P2);
+    emit_store(&program, RESULTS + 1);
+
+    int fails = 0;
+    for (int pressed = 0; pressed < 2; pressed++) {
+        Machine *machine = run_program(board, &program, fast, pressed ? press_p2 : NULL);
+        if (machine == NULL) {
+            return fails + 1;
+        }
+        uint8_t p2 = pressed ? P2_BITS : 0;
+        fails += check("result", machine->cpu_state->memory[RESULTS], model_result(0x4281, 3));
+        fails += check("IN 2", machine->cpu_state->memory[RESULTS + 1], p2);
+        fails += check("offset", machine->shifter.offset, 3);
+        machine_destroy(machine);
+    }
+    return fails;
+}
+
+
+int test_board_ports_step(const Board *board) {
+    return test_board_ports(board, 0);
+}
+
+
+int test_board_ports_run(const Board *board) {
+    return test_board_ports(board, 1);
+}
+
+
+int test_board_p2_step(const Board *board) {
+    return test_board_p2(board, 0);
+}
+
+
+int test_board_p2_run(const Board *board) {
+    return test_board_p2(board, 1);
+}
+
+
+typedef struct unit_test_t {
+    const char *name;
+    int (*fn)(void);
+} UnitTest;
+
+
+typedef struct board_test_t {
+    const char *name;
+    int (*fn)(const Board *board);
+} BoardTest;
+
+
+static const UnitTest UNIT_TESTS[] = {
+    { "data", test_data },
+    { "result", test_result },
+    { "offset", test_offset },
+    { "handlers", test_handlers }
+};
+
+
+static const BoardTest BOARD_TESTS[] = {
+    { "ports/step", test_board_ports_step },
+    { "ports/run", test_board_ports_run },
+    { "p2/step", test_board_p2_step },
+    { "p2/run", test_board_p2_run }
+};
+
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+
+/**
+ * Prints the outcome of a test whose name is already
+ * printed; failed checks have printed their own lines
+ */
+int report(int fails) {
+    printf("%s\n", fails ? "\nFAILED" : "ok");
+    return fails != 0;
+}
+
+
+int main(void) {
+    int failures = 0;
+    for (size_t i = 0; i < COUNT(UNIT_TESTS); i++) {
+        printf("%-12s ", UNIT_TESTS[i].name);
+        failures += report(UNIT_TESTS[i].fn());
+    }
+
+    Board board;
+    if (board_open(&board, "invaders")) {
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < COUNT(BOARD_TESTS); i++) {
+        printf("%-12s ", BOARD_TESTS[i].name);
+        failures += report(BOARD_TESTS[i].fn(&board));
+    }
+
+    printf("%d failure(s)\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/*
+ * Compares two frame hash logs written with `intel8080 -c`.
+ *
+ * Usage: framecmp expected actual
+ *
+ * Prints the first frame whose hash differs and exits with
+ * 1, or exits with 0 if both runs produced the same frames.
+ */
+
+
+/**
+ * Reads the next entry. Returns 1 on success, 0 at the end.
+ */
+int next_entry(FILE *f, unsigned long *frame, uint64_t *hash) {
+    return fscanf(f, "%lu %" SCNx64, frame, hash) == 2;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s expected actual\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    FILE *a = fopen(argv[1], "r");
+    FILE *b = fopen(argv[2], "r");
+    if (a == NULL || b == NULL) {
+        fprintf(stderr, "Error: couldn't open %s\n", a == NULL ? argv[1] : argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned long frame_a, frame_b;
+    uint64_t hash_a, hash_b;
+    unsigned long frames = 0;
+    int status = 0;
+    while (1) {
+        int more_a = next_entry(a, &frame_a, &hash_a);
+        int more_b = next_entry(b, &frame_b, &hash_b);
+        if (!more_a && !more_b) {
+            printf("%lu frames match\n", frames);
+            break;
+        }
+        if (!more_a || !more_b) {
+            printf("%s ends after %lu frames\n", more_a ? argv[2] : argv[1], frames);
+            status = 1;
+            break;
+        }
+        if (hash_a != hash_b) {
+            printf("First divergent frame: %lu (%016" PRIx64 " vs %016" PRIx64 ")\n",
+                frame_a, hash_a, hash_b);
+            status = 1;
+            break;
+        }
+        frames++;
+    }
+
+    fclose(a);
+    fclose(b);
+    return status;
+}
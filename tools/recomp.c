@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "board.h"
+#include "cpu.h"
+#include "recompiler.h"
+
+
+/*
+ * Compiles a board's ROM (Space Invaders by default) to C
+ * ahead of time.
+ *
+ * Usage: recomp folder out.c [board]
+ *
+ * See aot.h for how the output is used.
+ */
+int main(int argc, char **argv) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s folder out.c [board]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Board board;
+    if (board_open(&board, argc == 4 ? argv[3] : "invaders")) {
+        return EXIT_FAILURE;
+    }
+    uint8_t *memory = calloc(CPU_MEM_SIZE, sizeof(*memory));
+    if (board_load_roms(&board, argv[1], memory)) {
+        free(memory);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: couldn't open %s\n", argv[2]);
+        free(memory);
+        return EXIT_FAILURE;
+    }
+    int count = recompile_rom(memory, board.rom_size, out);
+    fclose(out);
+    free(memory);
+
+    if (count < 0) {
+        fprintf(stderr, "Error: ROM analysis failed\n");
+        return EXIT_FAILURE;
+    }
+    printf("Compiled %d blocks to %s\n", count, argv[2]);
+    return 0;
+}
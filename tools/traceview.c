@@ -0,0 +1,107 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "disassembler.h"
+#include "trace.h"
+
+
+/*
+ * Prints a trace written with `intel8080 -t`.
+ *
+ * Usage: traceview [-r start-end] [-n max] trace
+ *
+ * -r only prints instructions with start <= PC <= end (hex)
+ * -n stops after `max` printed instructions
+ *
+ * The cycle column counts from the start of the trace,
+ * including filtered out instructions.
+ */
+
+
+void print_header(void) {
+    printf("%12s  %-4s  %-8s  %-18s %-2s %-2s %-2s %-2s %-2s %-2s %-2s %-4s %-5s %s %s\n",
+        "cycle", "pc", "bytes", "instruction",
+        "A", "B", "C", "D", "E", "H", "L", "SP", "SZAPC", "I", "cyc");
+}
+
+
+void print_record(const TraceRecord *rec, unsigned long long cycle, uint8_t *scratch) {
+    // decode from the bytes stored with the record
+    scratch[rec->pc] = rec->opcode;
+    scratch[(uint16_t) (rec->pc + 1)] = rec->operand[0];
+    scratch[(uint16_t) (rec->pc + 2)] = rec->operand[1];
+
+    Instr8080 instr;
+    char text[DISASM_TEXT_SIZE];
+    disasm_decode(scratch, rec->pc, &instr);
+    disasm_format(&instr, text, sizeof(text));
+
+    char bytes[9];
+    int n = 0;
+    for (int i = 0; i < 3; i++) {
+        n += snprintf(bytes + n, sizeof(bytes) - n, i < instr.length ? "%02x" : "  ",
+            i == 0 ? rec->opcode : rec->operand[i - 1]);
+    }
+
+    printf("%12llu  %04x  %-8s  %-18s %02x %02x %02x %02x %02x %02x %02x %04x %d%d%d%d%d %d %u\n",
+        cycle, rec->pc, bytes, text,
+        rec->a, rec->b, rec->c, rec->d, rec->e, rec->h, rec->l, rec->sp,
+        rec->cc.s, rec->cc.z, rec->cc.ac, rec->cc.p, rec->cc.cy,
+        rec->int_enable, rec->cycles);
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+    unsigned int start = 0;
+    unsigned int end = 0xffff;
+    unsigned long max = 0;
+    while ((opt = getopt(argc, argv, "r:n:")) != -1) {
+        switch (opt) {
+            case 'r':
+                if (sscanf(optarg, "%x-%x", &start, &end) != 2) {
+                    fprintf(stderr, "Error: expected a range like 1a5c-1a70\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n': max = strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-r start-end] [-n max] trace\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-r start-end] [-n max] trace\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    TraceReader reader;
+    if (trace_reader_open(&reader, argv[optind])) {
+        fprintf(stderr, "Error: %s is not a trace\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t *scratch = calloc(CPU_MEM_SIZE, sizeof(*scratch));
+    unsigned long long cycle = 0;
+    unsigned long printed = 0;
+    TraceRecord rec;
+
+    print_header();
+    while (trace_reader_next(&reader, &rec)) {
+        if (rec.pc >= start && rec.pc <= end) {
+            print_record(&rec, cycle, scratch);
+            printed++;
+            if (printed == max) {
+                break;
+            }
+        }
+        cycle += rec.cycles;
+    }
+
+    free(scratch);
+    trace_reader_close(&reader);
+    return 0;
+}